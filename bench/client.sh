@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# Startup time and peak RSS of way-displays and way-displays-client for a trivial request.
+#
+# usage: bench/client.sh [iterations] [request arguments]
+#
+# Requires GNU time. The server need not be running: --peek reads the snapshot only.
+
+ITERATIONS="${1:-200}"
+[ "${#}" -gt 0 ] && shift
+[ "${#}" -eq 0 ] && set -- --peek
+
+TIME="${TIME:-/usr/bin/time}"
+if ! "${TIME}" -f "%M" true > /dev/null 2>&1; then
+	echo "GNU time required at ${TIME}" >&2
+	exit 1
+fi
+
+export WAYLAND_DISPLAY="${WAYLAND_DISPLAY:-bench}"
+
+for BIN in ./way-displays ./way-displays-client; do
+	if [ ! -x "${BIN}" ]; then
+		echo "${BIN} not built" >&2
+		exit 1
+	fi
+
+	# libraries loaded
+	LIBS="$(ldd "${BIN}" | grep -c "=>")"
+
+	START="$(date +%s%N)"
+	i=0
+	while [ "${i}" -lt "${ITERATIONS}" ]; do
+		"${BIN}" "${@}" > /dev/null 2>&1
+		i=$((i + 1))
+	done
+	END="$(date +%s%N)"
+
+	# max resident KiB of one run
+	RSS="$("${TIME}" -f "%M" "${BIN}" "${@}" 2>&1 > /dev/null | tail -n 1)"
+
+	printf "%-24s %4d libs %8d us/run %8d KiB max RSS\n" "${BIN}" "${LIBS}" "$(((END - START) / ITERATIONS / 1000))" "${RSS}"
+done
@@ -0,0 +1,102 @@
+// Repeated YAML GET requests against a running server, reporting requests/s and response size.
+//
+// usage: bench/get [seconds]
+//
+// Sequential: connect, request, read the response stream until the server closes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REQUEST "OP: GET\n"
+
+// as socket_path
+void get_socket_path(struct sockaddr_un *addr) {
+	size_t sun_path_size = sizeof(addr->sun_path);
+
+	char name[sun_path_size - 4];
+	if (getenv("XDG_VTNR")) {
+		snprintf(name, sizeof(name), "/way-displays.%s.sock", getenv("XDG_VTNR"));
+	} else {
+		snprintf(name, sizeof(name), "/way-displays.sock");
+	}
+
+	if (!getenv("XDG_RUNTIME_DIR") || strlen(name) + strlen(getenv("XDG_RUNTIME_DIR")) > sun_path_size) {
+		snprintf(addr->sun_path, sun_path_size, "/tmp%s", name);
+	} else {
+		snprintf(addr->sun_path, sun_path_size, "%s%s", getenv("XDG_RUNTIME_DIR"), name);
+	}
+}
+
+// bytes of the response stream, -1 on failure
+long get(const struct sockaddr_un *addr) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	if (connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == -1) {
+		perror("connect");
+		close(fd);
+		return -1;
+	}
+
+	if (write(fd, REQUEST, strlen(REQUEST)) != (ssize_t)strlen(REQUEST)) {
+		perror("write");
+		close(fd);
+		return -1;
+	}
+
+	char buf[65536];
+	long total = 0;
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		total += n;
+	}
+
+	close(fd);
+
+	return n == 0 ? total : -1;
+}
+
+double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 5;
+	if (seconds <= 0) {
+		fprintf(stderr, "usage: %s [seconds]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX, };
+	get_socket_path(&addr);
+
+	long requests = 0;
+	long bytes = 0;
+
+	double start = now();
+	double elapsed = 0;
+	while (elapsed < seconds) {
+		long n = get(&addr);
+		if (n < 0) {
+			fprintf(stderr, "GET failed after %ld requests at %s\n", requests, addr.sun_path);
+			return EXIT_FAILURE;
+		}
+		bytes += n;
+		requests++;
+		elapsed = now() - start;
+	}
+
+	printf("%ld GET in %.2fs: %.0f GET/s %ld bytes/response\n", requests, elapsed, (double)requests / elapsed, bytes / requests);
+
+	return EXIT_SUCCESS;
+}
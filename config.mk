@@ -11,7 +11,8 @@ CPPFLAGS += $(INCS) -D_GNU_SOURCE -DVERSION=\"$(VERSION)\" -DROOT_ETC=\"$(ROOT_E
 OFLAGS = -O3
 WFLAGS = -pedantic -Wall -Wextra -Werror -Wno-unused-parameter
 DFLAGS = -g
-COMPFLAGS = $(WFLAGS) $(OFLAGS) $(DFLAGS)
+SFLAGS = -ffunction-sections -fdata-sections
+COMPFLAGS = $(WFLAGS) $(OFLAGS) $(DFLAGS) $(SFLAGS)
 
 CFLAGS += $(COMPFLAGS) -std=gnu17 -Wold-style-definition -Wstrict-prototypes
 CXXFLAGS += $(COMPFLAGS) -std=gnu++17
@@ -27,6 +28,11 @@ CFLAGS += $(foreach p,$(PKGS),$(shell pkg-config --cflags $(p)))
 CXXFLAGS += $(foreach p,$(PKGS),$(shell pkg-config --cflags $(p)))
 LDLIBS += $(foreach p,$(PKGS),$(shell pkg-config --libs $(p)))
 
+# way-displays-client: unreferenced server sections are discarded
+PKGS_CLIENT += yaml-cpp
+LDFLAGS_CLIENT += $(LDFLAGS) -Wl,--gc-sections
+LDLIBS_CLIENT += $(foreach p,$(PKGS_CLIENT),$(shell pkg-config --libs $(p)))
+
 CC = gcc
 CXX = g++
 
@@ -23,7 +23,7 @@ void execute(enum IpcRequestOperation op, char *request) {
 
 	for (;;) {
 		char *response = NULL;
-		if (!(response = socket_read(fd))) { // yup, that's a memory leak
+		if (!(response = socket_read(fd, NULL))) { // yup, that's a memory leak
 			exit(1);
 		}
 		log_debug("========%s response================\n%s\n----------------------------------------", ipc_request_op_name(op), response);
@@ -1,8 +1,14 @@
 #ifndef CFG_H
 #define CFG_H
 
+#include <regex.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
 #include "log.h"
 
 struct UserScale {
@@ -37,7 +43,60 @@ struct UserMode {
 	int32_t width;
 	int32_t height;
 	int32_t refresh_hz;
-	bool warned_no_mode;
+};
+
+enum MatchKind {
+	// exact, then case insensitive substring, of name or description
+	MATCH_TEXT = 1,
+	// '!' prefixed POSIX extended
+	MATCH_REGEX,
+	// '!' prefixed that does not compile, matches exactly only
+	MATCH_REGEX_INVALID,
+};
+
+// a compiled name_desc
+struct Matcher {
+	enum MatchKind kind;
+	// as configured
+	const char *name_desc;
+	// MATCH_TEXT, lowercased for substring matching
+	char *name_desc_lower;
+	// MATCH_REGEX, allocated as most are text
+	regex_t *regex;
+	// position in the configured list
+	size_t index;
+	// configured list value: name_desc, UserScale or UserMode
+	void *val;
+};
+
+struct Matchers {
+	struct Matcher *matchers;
+	size_t len;
+};
+
+// matchers for the name_desc lists, in configured order
+struct CfgCompiled {
+	struct Matchers order;
+	struct Matchers user_scales;
+	struct Matchers user_modes;
+	struct Matchers adaptive_sync_off;
+	struct Matchers max_preferred_refresh;
+	struct Matchers disabled;
+};
+
+enum CfgElement {
+	ARRANGE = 1,
+	ALIGN,
+	ORDER,
+	AUTO_SCALE,
+	SCALE,
+	MODE,
+	VRR_OFF,
+	LAPTOP_DISPLAY_PREFIX,
+	MAX_PREFERRED_REFRESH,
+	LOG_THRESHOLD,
+	DISABLED,
+	ARRANGE_ALIGN,
 };
 
 struct Cfg {
@@ -45,7 +104,20 @@ struct Cfg {
 	char *file_path;
 	char *file_name;
 
-	bool written;
+	// FNV-1a of the file content last read or written, 0 when none
+	uint64_t file_hash;
+
+	// INCLUDE as written, read from the main file only
+	struct SList *includes;
+
+	// CFG fragment, freed by anything that changes cfg once marshalled
+	char *marshalled;
+
+	// rebuilt by cfg_compile whenever a name_desc list changes
+	struct CfgCompiled *compiled;
+
+	// list references shared with clones, indexed by CfgElement, NULL when not shared
+	unsigned int *shared[ARRANGE_ALIGN];
 
 	char *laptop_display_prefix;
 	struct SList *order_name_desc;
@@ -60,34 +132,108 @@ struct Cfg {
 	enum LogThreshold log_threshold;
 };
 
-enum CfgElement {
-	ARRANGE = 1,
-	ALIGN,
-	ORDER,
-	AUTO_SCALE,
-	SCALE,
-	MODE,
-	VRR_OFF,
-	LAPTOP_DISPLAY_PREFIX,
-	MAX_PREFERRED_REFRESH,
-	LOG_THRESHOLD,
-	DISABLED,
-	ARRANGE_ALIGN,
+// a configuration file, parsed alone and cached until it changes
+struct CfgLayer {
+	char *file_path;
+	char *dir_path;
+	char *file_name;
+
+	// cache key
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+
+	// coarse realtime of the last read, a write during the same tick does not change mtime
+	struct timespec read_at;
+
+	// FNV-1a of the content last parsed
+	uint64_t hash;
+
+	// without defaults, NULL when unreadable or invalid
+	struct Cfg *cfg;
+
+	// inotify watch descriptor for dir_path, -1 when none
+	int wd;
+};
+
+// INCLUDEs in order followed by the main file
+extern struct SList *cfg_layers;
+
+// parsed layers from a previous run, mapped read only during cfg_init
+struct CfgCache {
+	const char *buf;
+	size_t len;
+
+	// a layer was parsed from YAML since the cache was written
+	bool stale;
 };
+extern struct CfgCache cfg_cache;
 
 void cfg_init(const char *cfg_path);
 
 bool cfg_equal(struct Cfg *a, struct Cfg *b);
 
+// replace any compiled form
+void cfg_compile(struct Cfg *cfg);
+
+// compiled form, compiling when absent
+const struct CfgCompiled *cfg_compiled(struct Cfg *cfg);
+
+// bit 1 << CfgElement set for each element that differs
+unsigned int cfg_changed(struct Cfg *a, struct Cfg *b);
+
+// lists are shared with from until changed
+struct Cfg *clone_cfg(struct Cfg *from);
+
+// lists are shared with to until changed
 struct Cfg *cfg_merge(struct Cfg *to, struct Cfg *from, bool del);
 
-void cfg_file_reload(void);
+// the list of a list element, NULL for other elements
+struct SList **cfg_list(struct Cfg *cfg, enum CfgElement element);
+
+// copy a list shared with clones, before changing it
+void cfg_unshare(struct Cfg *cfg, enum CfgElement element);
+
+// replace cfg when a file changed, recompiling and marshalling only the changed elements, returning cfg_changed
+unsigned int cfg_file_reload(void);
+
+// reparse layers whose file changed, returning true when any did or the INCLUDEs changed
+bool cfg_layers_refresh(const char *file_path);
+
+// defaults with each layer merged in order, NULL when a layer is unreadable or invalid
+struct Cfg *cfg_layers_merge(void);
+
+// as cfg_layers_merge with candidate in place of the main file, its INCLUDE ignored
+struct Cfg *cfg_layers_merge_candidate(struct Cfg *candidate);
+
+void cfg_layer_free(void *layer);
+
+// entire file, null terminated, NULL on failure
+char *cfg_file_read(const char *path, size_t *len);
+
+// replace path with a complete temporary file, path is unchanged on failure
+// st is that of the new file when set, sync before and after the rename
+bool file_write_atomic(const char *path, const char *buf, size_t len, bool sync, struct stat *st);
+
+uint64_t cfg_hash(const char *buf, size_t len);
+
+// allocated, hidden next to the main file
+char *cfg_cache_path(const char *file_path);
+
+// map cfg_cache_path, absent or unreadable is a miss
+void cfg_cache_map(const char *file_path);
+
+void cfg_cache_unmap(void);
+
+// replace cfg_cache_path with all layers
+void cfg_cache_write(const char *file_path);
 
-void cfg_file_write(void);
+// atomically replace cfg_write's file, unless it already has the same content
+bool cfg_file_write(struct Cfg *cfg_write);
 
 struct Cfg *cfg_default(void);
 
-struct UserMode *cfg_user_mode_init(const char *name_desc, const bool max, const int32_t width, const int32_t height, const int32_t refresh_hz, const bool warned_no_mode);
+struct UserMode *cfg_user_mode_init(const char *name_desc, const bool max, const int32_t width, const int32_t height, const int32_t refresh_hz);
 
 struct UserMode *cfg_user_mode_default(void);
 
@@ -1,9 +1,14 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <stdbool.h>
+
 #include "ipc.h"
 
 int client(struct IpcRequest *ipc_request);
 
+// print the published snapshot without contacting the server
+int client_snapshot(bool json);
+
 #endif // CLIENT_H
 
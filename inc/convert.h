@@ -4,6 +4,8 @@
 #include "cfg.h"
 #include "ipc.h"
 #include "log.h"
+#include "stats.h"
+#include "trace.h"
 
 enum CfgElement cfg_element_val(const char *name);
 const char *cfg_element_name(enum CfgElement cfg_element);
@@ -21,8 +23,31 @@ enum IpcRequestOperation ipc_request_op_val(const char *name);
 const char *ipc_request_op_name(enum IpcRequestOperation ipc_request_op);
 const char *ipc_request_op_friendly(enum IpcRequestOperation ipc_request_op);
 
+enum IpcEncoding ipc_encoding_val(const char *name);
+const char *ipc_encoding_name(enum IpcEncoding ipc_encoding);
+
 enum LogThreshold log_threshold_val(const char *name);
 const char *log_threshold_name(enum LogThreshold log_threshold);
 
+enum TraceEventType trace_event_type_val(const char *name);
+const char *trace_event_type_name(enum TraceEventType trace_event_type);
+
+enum TraceFormat trace_format_val(const char *name);
+const char *trace_format_name(enum TraceFormat trace_format);
+
+enum StatsCounter stats_counter_val(const char *name);
+const char *stats_counter_name(enum StatsCounter stats_counter);
+const char *stats_counter_friendly(enum StatsCounter stats_counter);
+
+enum StatsGauge stats_gauge_val(const char *name);
+const char *stats_gauge_name(enum StatsGauge stats_gauge);
+const char *stats_gauge_friendly(enum StatsGauge stats_gauge);
+
+enum StatsFormat stats_format_val(const char *name);
+const char *stats_format_name(enum StatsFormat stats_format);
+
+// allocated ASCII lowercase copy of str
+char *strdup_lower(const char *str);
+
 #endif // CONVERT_H
 
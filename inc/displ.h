@@ -1,6 +1,7 @@
 #ifndef DISPL_H
 #define DISPL_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 enum ConfigState {
@@ -24,6 +25,11 @@ struct Displ {
 	uint32_t output_manager_version;
 
 	enum ConfigState config_state;
+
+	// the outstanding configuration is a rollback
+	bool rolling_back;
+	// rollbacks attempted since the last succeeded or settled
+	uint32_t rollbacks;
 };
 
 void displ_init(void);
@@ -7,21 +7,53 @@
 extern int fd_signal;
 extern int fd_socket_server;
 extern int fd_cfg_dir;
+extern int fd_cfg_timer;
+extern int fd_ipc_timer;
 
 extern nfds_t npfds;
-extern struct pollfd pfds[5];
+extern struct pollfd pfds[9];
 
 extern struct pollfd *pfd_signal;
 extern struct pollfd *pfd_ipc;
 extern struct pollfd *pfd_wayland;
 extern struct pollfd *pfd_lid;
 extern struct pollfd *pfd_cfg_dir;
+extern struct pollfd *pfd_cfg_timer;
+extern struct pollfd *pfd_ipc_timer;
+extern struct pollfd *pfd_log_out;
+extern struct pollfd *pfd_log_err;
 
 void init_pfds(void);
 
 void destroy_pfds(void);
 
-bool cfg_file_modified(char *file_name);
+// quiet period after a cfg_layers change before reloading, coalescing an editor's write and rename
+#define CFG_DEBOUNCE_MS 100
+
+// retry interval for a directory that has been deleted or moved away
+#define CFG_REWATCH_MS 1000
+
+// watch the directories of any new or unwatched cfg_layers, true when any watch was added
+bool fd_cfg_dir_watch(void);
+
+// any cfg_layers directory is not watched
+bool fd_cfg_dir_unwatched(void);
+
+// (re)start the one shot cfg timer
+void fd_cfg_timer_arm(long ms);
+
+// consume the cfg timer expiry
+bool fd_cfg_timer_expired(void);
+
+// (re)start the one shot timeout of the IPC response, 0 to stop
+void fd_ipc_timer_arm(long ms);
+
+// consume the IPC timer expiry
+bool fd_ipc_timer_expired(void);
+
+// drain the cfg directory events, true when a cfg_layers file was written, moved in or created,
+// or a watched directory was deleted or moved away
+bool cfg_file_modified(void);
 
 #endif // FDS_H
 
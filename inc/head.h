@@ -6,6 +6,7 @@
 #include <wayland-client-protocol.h>
 #include <wayland-util.h>
 
+#include "cfg.h"
 #include "mode.h"
 #include "wlr-output-management-unstable-v1.h"
 
@@ -40,6 +41,9 @@ struct Head {
 	char *make;
 	char *model;
 	char *serial_number;
+	// for substring matching
+	char *name_lower;
+	char *description_lower;
 
 	struct HeadState current;
 	struct HeadState desired;
@@ -47,32 +51,49 @@ struct Head {
 	struct SList *modes_failed;
 	bool adaptive_sync_failed;
 
+	// state when last settled, restored on unexplained failure
+	struct HeadState last_good;
+	bool has_last_good;
+
+	// desired state rolled back, not applied again until desired changes
+	struct HeadState failed;
+	bool has_failed;
+
 	struct {
 		int32_t width;
 		int32_t height;
 	} scaled;
 
 	bool warned_no_preferred;
+	bool warned_no_user_mode;
 	bool warned_no_mode;
-};
 
-bool head_matches_name_desc_exact(const void *head, const void *name_desc);
+	// STATE fragment, rebuilt when stale or the marshalled states differ
+	struct {
+		char *yaml;
+		bool stale;
+		struct HeadState current;
+		struct HeadState desired;
+	} marshalled;
+};
 
-bool head_matches_name_desc_regex(const void *head, const void *name_desc);
+bool head_matches_exact(const void *head, const void *matcher);
 
-bool head_matches_name_desc_fuzzy(const void *h, const void *name_desc);
+bool head_matches_regex(const void *head, const void *matcher);
 
-bool head_matches_name_desc_partial(const void *head, const void *name_desc);
+bool head_matches_fuzzy(const void *head, const void *matcher);
 
-bool head_matches_name_desc(const void *head, const void *name_desc);
+bool head_matches(const void *head, const void *matcher);
 
-bool head_name_desc_matches_head(const void *name_desc, const void *head);
+// first in configured order
+const struct Matcher *head_match(const struct Matchers *matchers, const struct Head *head);
 
 wl_fixed_t head_auto_scale(struct Head *head);
 
 void head_scaled_dimensions(struct Head *head);
 
-struct Mode *head_find_mode(struct Head *head);
+// per cfg, notices and warned state only when warn
+struct Mode *head_find_mode(struct Cfg *cfg, struct Head *head, bool warn);
 
 bool head_current_not_desired(const void *head);
 
@@ -80,6 +101,14 @@ bool head_current_mode_not_desired(const void *head);
 
 bool head_current_adaptive_sync_not_desired(const void *head);
 
+bool head_state_equal(const struct HeadState *a, const struct HeadState *b);
+
+// desired is the state that was rolled back
+bool head_desired_failed(const void *head);
+
+// current not desired, excluding a desired state that was rolled back
+bool head_current_not_desired_retry(const void *head);
+
 void head_release_mode(struct Head *head, struct Mode *mode);
 
 void head_free(void *head);
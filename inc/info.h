@@ -6,6 +6,7 @@
 
 #include "cfg.h"
 #include "head.h"
+#include "ipc.h"
 #include "list.h"
 #include "log.h"
 #include "mode.h"
@@ -19,6 +20,8 @@ enum InfoEvent {
 
 void print_cfg(enum LogThreshold t, struct Cfg *cfg, bool del);
 
+void print_ipc_operations(enum LogThreshold t, struct SList *ops);
+
 void print_head(enum LogThreshold t, enum InfoEvent event, struct Head *head);
 
 void print_heads(enum LogThreshold t, enum InfoEvent event, struct SList *heads);
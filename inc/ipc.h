@@ -2,6 +2,11 @@
 #define IPC_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
 
 #define IPC_RC_SUCCESS 0
 #define IPC_RC_WARN 1
@@ -10,42 +15,128 @@
 #define IPC_RC_BAD_RESPONSE 12
 #define IPC_RC_REQUEST_IN_PROGRESS 13
 
+// responses of at least this many bytes are passed to the client as a memfd
+#define IPC_MEMFD_THRESHOLD_DEFAULT 65536
+
+// SETTLE without a TIMEOUT_MS
+#define IPC_SETTLE_TIMEOUT_MS_DEFAULT 5000
+
 enum IpcRequestOperation {
 	GET = 1,
 	CFG_SET,
 	CFG_DEL,
 	CFG_WRITE,
+	BATCH,
+	TRACE,
+	STATS,
+	EVALUATE,
+	SETTLE,
+};
+
+// response encoding, requests are YAML or TLV
+enum IpcEncoding {
+	IPC_ENCODING_YAML = 1,
+	IPC_ENCODING_TLV,
+	IPC_ENCODING_JSON,
+	IPC_ENCODING_DEFAULT = IPC_ENCODING_YAML,
+};
+
+// one of a BATCH: CFG_SET, CFG_DEL or CFG_WRITE
+struct IpcOperation {
+	enum IpcRequestOperation op;
+	struct Cfg *cfg;
 };
 
 struct IpcRequest {
 	enum IpcRequestOperation op;
 	struct Cfg *cfg;
+	// BATCH, applied in order
+	struct SList *ops;
+	enum IpcEncoding encoding;
+	// pass responses of at least this many bytes as a memfd, 0 to always write
+	size_t memfd_threshold;
+	// SETTLE, 0 for IPC_SETTLE_TIMEOUT_MS_DEFAULT
+	long timeout_ms;
 	int socket_client;
 	bool bad;
 	bool raw;
+	// client TRACE output
+	enum TraceFormat trace_format;
+	// client STATS output
+	enum StatsFormat stats_format;
+};
+
+// EVALUATE desired state of a head, owned rather than referring to heads or modes
+struct IpcEvaluation {
+	char *name;
+	bool enabled;
+	// desired mode, 0 when none
+	int32_t width;
+	int32_t height;
+	int32_t refresh_mhz;
+	double scale;
+	int32_t x;
+	int32_t y;
+	bool adaptive_sync;
 };
 
 struct IpcResponse {
 	bool done;
 	int rc;
+	// server messages overwritten before this response
+	unsigned long messages_dropped;
+	enum IpcEncoding encoding;
+	size_t memfd_threshold;
 	int socket_client;
 	bool messages;
 	bool state;
+	// server: the trace ring
+	bool trace;
+	// client: received trace, oldest first
+	struct TraceEvent *trace_events;
+	size_t trace_len;
+	// server: stats
+	bool stats;
+	// client: received stats
+	struct Stats *stats_values;
+	// server: EVALUATE IpcEvaluation, see layout_evaluate
+	struct SList *evaluation;
+	// server: SETTLE, done when settled or after timeout_ms
+	bool settle;
+	long timeout_ms;
 };
 
 void ipc_send_request(struct IpcRequest *request);
 
 void ipc_send_response(struct IpcResponse *response);
 
-char *ipc_receive_raw_client(int socket_client);
+// a response passed as a memfd is returned as fd following any bytes read, -1 when none
+char *ipc_receive_raw_client(int socket_client, size_t *len, int *fd);
+
+// read only mapping of a passed memfd, NUL terminated, len excludes the terminator
+char *ipc_map_memfd(int fd, size_t *len);
+
+void ipc_unmap_memfd(char *buf, size_t len);
 
 struct IpcRequest *ipc_receive_request_server(int socket_server);
 
 struct IpcResponse *ipc_receive_response_client(int socket_client);
 
+// the next response is TLV or a memfd, not consumed; servers that predate TLV answer in YAML
+bool ipc_peek_tlv_client(int socket_client);
+
+struct IpcOperation *ipc_operation_init(enum IpcRequestOperation op, struct Cfg *cfg);
+
 void ipc_request_free(struct IpcRequest *request);
 
+void ipc_operation_free(void *data);
+
+// raise rc to WARN or ERROR for a message of threshold
+void ipc_response_rc_message(struct IpcResponse *response, enum LogThreshold threshold);
+
 void ipc_response_free(struct IpcResponse *response);
 
+void ipc_evaluation_free(void *evaluation);
+
 #endif // IPC_H
 
@@ -0,0 +1,47 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sockets.h"
+
+// streaming, compact JSON writer
+// key is used within an object and must be null within an array or at the root
+struct JsonWriter {
+	// written directly when set, otherwise buffered
+	struct SocketBuf *out;
+	char *buf;
+	size_t len;
+	size_t size;
+	unsigned int depth;
+	// no value has been written to the current container
+	bool first;
+};
+
+void json_object_begin(struct JsonWriter *w, const char *key);
+
+void json_object_end(struct JsonWriter *w);
+
+void json_array_begin(struct JsonWriter *w, const char *key);
+
+void json_array_end(struct JsonWriter *w);
+
+void json_put_int(struct JsonWriter *w, const char *key, int64_t val);
+
+void json_put_bool(struct JsonWriter *w, const char *key, bool val);
+
+// null str is written as null
+void json_put_str(struct JsonWriter *w, const char *key, const char *str);
+
+// same precision as the YAML emitter, non-finite is written as null
+void json_put_float(struct JsonWriter *w, const char *key, float val);
+
+void json_put_double(struct JsonWriter *w, const char *key, double val);
+
+// newline terminated document which the caller owns, null when written to out
+char *json_end(struct JsonWriter *w);
+
+#endif // JSON_H
+
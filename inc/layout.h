@@ -1,7 +1,30 @@
 #ifndef LAYOUT_H
 #define LAYOUT_H
 
+#include "cfg.h"
+#include "list.h"
+
+// desired state is calculated from these alone
+struct LayoutState {
+	struct Cfg *cfg;
+	struct SList *heads;
+	// dry run: no notices, warned state or counters
+	bool evaluate;
+};
+
+// calculate desired state of each of heads, without applying
+void desire(const struct LayoutState *state);
+
+// IpcEvaluation of each of the active heads for cfg instead of the active, logging the changes
+struct SList *layout_evaluate(struct Cfg *cfg);
+
+// unexplained failures are rolled back at most this many times in a row
+#define ROLLBACK_ATTEMPTS_MAX 3
+
 void layout(void);
 
+// no configuration outstanding and the current state of all heads is desired
+bool layout_settled(void);
+
 #endif // LAYOUT_H
 
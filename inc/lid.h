@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 
+#include "cfg.h"
+
 struct Lid {
 	bool closed;
 
@@ -15,7 +17,8 @@ void lid_init(void);
 
 void lid_update(void);
 
-bool lid_is_closed(char *name);
+// laptop display per cfg
+bool lid_is_closed(struct Cfg *cfg, char *name);
 
 void lid_destroy(void);
 
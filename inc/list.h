@@ -44,6 +44,9 @@ void *slist_at(struct SList *head, unsigned long index);
 // clone the list, setting val pointers
 struct SList *slist_shallow_clone(struct SList *head);
 
+// clone the list, null clone_val sets val pointers
+struct SList *slist_clone(struct SList *head, void *(*clone_val)(const void *val));
+
 // sort into a new list
 struct SList *slist_sort(struct SList *head, bool (*before)(const void *a, const void *b));
 
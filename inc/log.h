@@ -2,6 +2,9 @@
 #define LOG_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 enum LogThreshold {
 	DEBUG = 1,
@@ -11,16 +14,78 @@ enum LogThreshold {
 	LOG_THRESHOLD_DEFAULT = INFO,
 };
 
+#define LOG_CAP_LINES_MAX 1024
+
 struct LogCapLine {
 	char *line;
+	// allocated size of line, reused once cleared
+	size_t size;
 	enum LogThreshold threshold;
 };
-extern struct SList *log_cap_lines;
+
+// captured lines in a ring of fixed capacity, oldest dropped when full
+struct LogCap {
+	struct LogCapLine lines[LOG_CAP_LINES_MAX];
+	size_t start;
+	size_t len;
+	// since cleared
+	unsigned long dropped;
+	enum LogThreshold dropped_threshold;
+};
+extern struct LogCap log_cap;
+
+// nth oldest captured line, NULL when n >= log_cap.len
+const struct LogCapLine *log_cap_line(size_t n);
+
+#define LOG_SINK_SIZE (256 * 1024)
+
+// when full, lines below this are dropped, others wait for the fd to accept
+#define LOG_SINK_BLOCK_THRESHOLD WARNING
+
+// output buffered for an fd, written by the event loop when it is writable
+struct LogSink {
+	int fd;
+	// O_NONBLOCK open of fd when a pipe or terminal, -1 when writes do not block or fd is a socket
+	int fd_nonblock;
+	bool socket;
+	// line buffered, appending to buf
+	FILE *stream;
+	char *buf;
+	size_t start;
+	size_t len;
+	// line being appended
+	enum LogThreshold threshold;
+	// since started
+	unsigned long lines;
+	unsigned long bytes_written;
+	unsigned long dropped;
+	unsigned long blocked;
+	size_t high_water;
+	// not yet reported
+	unsigned long dropped_unreported;
+	// write failed, output is discarded
+	bool failed;
+};
+extern struct LogSink log_sink_out;
+extern struct LogSink log_sink_err;
 
 void log_set_threshold(enum LogThreshold threshold, bool cli);
 
+// CLOCK_MONOTONIC
+int64_t monotonic_ns(void);
+
+// prefix lines with the wall clock to the millisecond
 void log_set_times(bool times);
 
+// times are annotated with the elapsed since the event started, until stopped
+// an event in progress is not restarted
+void log_event_start(void);
+
+void log_event_stop(void);
+
+// a line at threshold would be printed, or captured when capture
+bool log_enabled(enum LogThreshold threshold, bool capture);
+
 void log_(enum LogThreshold threshold, const char *__restrict __format, ...);
 
 void log_debug(const char *__restrict __format, ...);
@@ -51,5 +116,24 @@ void log_capture_clear(void);
 
 void log_capture_playback(void);
 
+// buffer stdout and stderr until log_sink_stop
+void log_sink_start(void);
+
+// write what each fd will accept without blocking
+void log_sink_drain(void);
+
+// write everything, blocking
+void log_sink_flush(void);
+
+// flush and return to writing directly
+void log_sink_stop(void);
+
+// arguments are evaluated only when the line would be printed or captured
+// _nocap only when printed, whether or not capturing
+#define log_debug(...) do { if (log_enabled(DEBUG, true)) log_debug(__VA_ARGS__); } while (0)
+#define log_debug_nocap(...) do { if (log_enabled(DEBUG, false)) log_debug_nocap(__VA_ARGS__); } while (0)
+#define log_info(...) do { if (log_enabled(INFO, true)) log_info(__VA_ARGS__); } while (0)
+#define log_error_nocap(...) do { if (log_enabled(ERROR, false)) log_error_nocap(__VA_ARGS__); } while (0)
+
 #endif // LOG_H
 
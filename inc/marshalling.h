@@ -3,12 +3,15 @@
 
 #ifdef __cplusplus
 extern "C" { //}
-#else
+#endif
+
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "cfg.h"
 #include "ipc.h"
-#endif
+#include "sockets.h"
 
 char *marshal_ipc_request(struct IpcRequest *request);
 
@@ -16,12 +19,43 @@ struct IpcRequest *unmarshal_ipc_request(char *yaml);
 
 char *marshal_ipc_response(struct IpcResponse *response);
 
+// write to buf as the response is marshalled, flushing when full
+bool marshal_ipc_response_stream(struct IpcResponse *response, struct SocketBuf *buf);
+
 struct IpcResponse *unmarshal_ipc_response(char *yaml);
 
 char *marshal_cfg(struct Cfg *cfg);
 
 bool unmarshal_cfg_from_file(struct Cfg *cfg);
 
+// file content, as read by cfg_file_reload
+bool unmarshal_cfg_from_yaml(struct Cfg *cfg, const char *yaml);
+
+// JSON encoding of the same schema
+char *marshal_ipc_response_json(struct IpcResponse *response);
+
+bool marshal_ipc_response_json_stream(struct IpcResponse *response, struct SocketBuf *buf);
+
+// TLV encoding of the same schema, see tlv.h
+char *marshal_ipc_request_tlv(struct IpcRequest *request, size_t *len);
+
+struct IpcRequest *unmarshal_ipc_request_tlv(const char *buf, size_t len);
+
+char *marshal_ipc_response_tlv(struct IpcResponse *response, size_t *len);
+
+bool marshal_ipc_response_tlv_stream(struct IpcResponse *response, struct SocketBuf *buf);
+
+struct IpcResponse *unmarshal_ipc_response_tlv(const char *buf, size_t len);
+
+// parsed cfg of each layer, keyed by path and content hash, for this VERSION only
+char *marshal_cfg_cache_tlv(struct SList *cfg_layers, size_t *len);
+
+// the layer at path with hash, NULL when absent or written by another VERSION
+struct Cfg *unmarshal_cfg_cache_tlv(const char *buf, size_t len, const char *path, uint64_t hash);
+
+// warn and return false when a '!' prefixed pattern does not compile
+bool validate_regex(const char *pattern, enum CfgElement element);
+
 #if __cplusplus
 } // extern "C"
 #endif
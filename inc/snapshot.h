@@ -0,0 +1,81 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// fixed layout state, published by the server to a shared file in XDG_RUNTIME_DIR
+// readers map it once and copy it out without syscalls
+//
+// seqlock: seq is odd while the server is writing
+// a reader copies when even and retries if seq has changed since
+//
+// this header and snapshot_read.c depend only on libc and may be copied into clients
+#define SNAPSHOT_MAGIC 0x50534457 // "WDSP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HEADS_MAX 16
+#define SNAPSHOT_NAME_LEN 64
+#define SNAPSHOT_DESCRIPTION_LEN 256
+
+struct SnapshotHead {
+	char name[SNAPSHOT_NAME_LEN];
+	char description[SNAPSHOT_DESCRIPTION_LEN];
+	// current mode, 0 when none
+	int32_t width;
+	int32_t height;
+	int32_t refresh_mhz;
+	// layout coords and scaled size
+	int32_t x;
+	int32_t y;
+	int32_t scaled_width;
+	int32_t scaled_height;
+	// wl_output_transform
+	int32_t transform;
+	double scale;
+	uint8_t enabled;
+	uint8_t adaptive_sync;
+	uint8_t pad[6];
+};
+
+struct Snapshot {
+	uint32_t magic;
+	uint32_t version;
+	// sizeof(struct Snapshot)
+	uint32_t size;
+	uint32_t seq;
+
+	// server, 0 after it has exited
+	int32_t pid;
+	uint8_t lid_present;
+	uint8_t lid_closed;
+	uint8_t pad[2];
+	// at most SNAPSHOT_HEADS_MAX, in server order
+	uint32_t heads_len;
+	// all heads, more than heads_len when truncated
+	uint32_t heads_total;
+	struct SnapshotHead heads[SNAPSHOT_HEADS_MAX];
+};
+
+// $XDG_RUNTIME_DIR/way-displays.$XDG_VTNR.snapshot, /tmp when XDG_RUNTIME_DIR is not set
+void snapshot_path(char *path, size_t len);
+
+// map the published snapshot read only, NULL when not present, not owned or not compatible
+const struct Snapshot *snapshot_open(void);
+
+// consistent copy, false when the server has been writing for too long
+bool snapshot_read(const struct Snapshot *shared, struct Snapshot *snapshot);
+
+void snapshot_close(const struct Snapshot *shared);
+
+// server: create and map
+void snapshot_init(void);
+
+// server: write heads and lid when changed
+void snapshot_publish(void);
+
+// server: mark as exited and unmap
+void snapshot_destroy(void);
+
+#endif // SNAPSHOT_H
+
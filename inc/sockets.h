@@ -1,9 +1,34 @@
 #ifndef SOCKETS_H
 #define SOCKETS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/un.h>
 
+#define SOCKET_BUF_SIZE 4096
+
+// sent in place of a response that has been passed as a memfd, carrying the fd via SCM_RIGHTS
+#define SOCKET_MEMFD_MARKER "\0WDM"
+#define SOCKET_MEMFD_MARKER_LEN 4
+
+// fixed size output, written to the socket as it fills
+//
+// when memfd_threshold is set output is instead spilled to a memfd as it fills
+// on flush, totals of at least memfd_threshold are sealed and passed to the peer
+// smaller are copied from the memfd to the socket
+struct SocketBuf {
+	int socket;
+	bool failed;
+	size_t len;
+	size_t written;
+	size_t memfd_threshold;
+	// valid once spilled
+	int memfd;
+	size_t spilled;
+	char data[SOCKET_BUF_SIZE];
+};
+
 void socket_path(struct sockaddr_un *addr);
 
 int create_socket_server(void);
@@ -12,9 +37,29 @@ int create_socket_client(void);
 
 int socket_accept(int socket_server);
 
-char *socket_read(int socket_client);
+// NUL terminated, len excludes the terminator and may be null
+char *socket_read(int socket_client, size_t *len);
+
+// as socket_read, also receiving a passed fd, -1 when none
+// a passed fd arrives with the last bytes read
+char *socket_read_fd(int socket_client, size_t *len, int *fd);
+
+// read exactly n bytes
+bool socket_read_n(int socket_client, char *buf, size_t n);
+
+// read exactly n bytes that carry a passed fd, returning the fd or -1
+int socket_read_n_fd(int socket_client, char *buf, size_t n);
+
+// write all of data with fd passed alongside
+bool socket_write_fd(int socket_client, const char *data, size_t len, int fd);
 
 ssize_t socket_write(int socket_client, char *data, size_t len);
 
+// nothing is written once failed
+void socket_buf_write(struct SocketBuf *buf, const char *data, size_t len);
+
+// write remaining, false if anything failed
+bool socket_buf_flush(struct SocketBuf *buf);
+
 #endif // SOCKETS_H
 
@@ -0,0 +1,115 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "displ.h"
+
+// bucket i counts values <= 2^i, the last everything greater
+#define STATS_BUCKETS 24
+
+// greater than any IpcRequestOperation
+#define STATS_IPC_OPS 16
+
+// monotonic, incremented from any path
+enum StatsCounter {
+	// server loop iterations
+	STATS_LOOPS = 1,
+	// layout passes that calculated desired state
+	STATS_LAYOUTS,
+	// layout passes waiting on an outstanding or cancelled configuration
+	STATS_LAYOUTS_SKIPPED,
+	// per head
+	STATS_DESIRES,
+	STATS_HOTPLUGS,
+	STATS_APPLIED,
+	STATS_MODESETS,
+	STATS_SUCCEEDED,
+	STATS_FAILED,
+	STATS_CANCELLED,
+	STATS_MODES_FAILED,
+	// name or description regex matches attempted
+	STATS_REGEX_EVALS,
+	// IPC responses written
+	STATS_BYTES_MARSHALLED,
+	STATS_LOG_CAPTURED,
+	// last good configurations applied after a failure
+	STATS_ROLLBACKS,
+	// not a counter
+	STATS_COUNTERS_END,
+};
+
+// sampled when requested
+enum StatsGauge {
+	STATS_HEADS = 1,
+	STATS_HEADS_ENABLED,
+	STATS_TRACE_EVENTS,
+	// bytes not yet written to stdout and stderr
+	STATS_LOG_PENDING,
+	// not a gauge
+	STATS_GAUGES_END,
+};
+
+// client output
+enum StatsFormat {
+	STATS_FORMAT_TEXT = 1,
+	STATS_FORMAT_PROMETHEUS,
+};
+
+struct StatsHistogram {
+	unsigned long buckets[STATS_BUCKETS];
+	unsigned long count;
+	uint64_t sum;
+	uint64_t max;
+};
+
+// since the server started
+struct Stats {
+	// hotplug until the first desire
+	struct StatsHistogram desire_us;
+	// apply until succeeded, failed or cancelled
+	struct StatsHistogram apply_us;
+	// hotplug until no further changes are needed
+	struct StatsHistogram settle_us;
+	// configurations applied, per settled hotplug
+	struct StatsHistogram applies;
+	unsigned long counters[STATS_COUNTERS_END];
+	long gauges[STATS_GAUGES_END];
+	// by IpcRequestOperation
+	unsigned long ipc_requests[STATS_IPC_OPS];
+};
+extern struct Stats stats;
+
+void stats_inc(enum StatsCounter counter);
+
+void stats_add(enum StatsCounter counter, unsigned long n);
+
+// sample all gauges
+void stats_sample(void);
+
+void stats_histogram_add(struct StatsHistogram *histogram, uint64_t value);
+
+// server: a head arrived or departed, starting a transition unless one is in progress
+void stats_hotplug(void);
+
+// server: desired state has been calculated
+void stats_desire(void);
+
+// server: a configuration has been applied
+void stats_apply(bool modeset);
+
+// server: SUCCEEDED, FAILED or CANCELLED
+void stats_result(enum ConfigState config_state);
+
+// server: no changes are needed, ending any transition
+void stats_settled(void);
+
+void stats_print(FILE *stream, const struct Stats *s);
+
+// prometheus text exposition, for a node exporter textfile collector
+void stats_print_prometheus(FILE *stream, const struct Stats *s);
+
+#endif // STATS_H
+
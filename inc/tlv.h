@@ -0,0 +1,213 @@
+#ifndef TLV_H
+#define TLV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// compact tag-length-value encoding:
+//   message: TLV_MAGIC, version, kind tag, records, end record
+//   record:  tag byte, varint value length, value
+//   value:   zigzag varint for int and bool, raw bytes for string,
+//            little endian IEEE 754 for float and double, records for a container
+//   end:     zero tag, zero length
+// top level records are complete once written, allowing them to be streamed
+#define TLV_MAGIC "\0WD"
+#define TLV_MAGIC_LEN 3
+#define TLV_VERSION 1
+#define TLV_HEADER_LEN (TLV_MAGIC_LEN + 2)
+
+// IPC schema, tags are part of the wire format: append only
+enum TlvTag {
+	TAG_REQUEST = 1,
+	TAG_RESPONSE,
+
+	// request, response
+	TAG_OP,
+	TAG_CFG,
+	TAG_DONE,
+	TAG_RC,
+	TAG_MESSAGE,
+
+	// MESSAGE
+	TAG_THRESHOLD,
+	TAG_LINE,
+
+	// CFG
+	TAG_ARRANGE,
+	TAG_ALIGN,
+	TAG_ORDER,
+	TAG_AUTO_SCALE,
+	TAG_SCALE,
+	TAG_MODE,
+	TAG_VRR_OFF,
+	TAG_LAPTOP_DISPLAY_PREFIX,
+	TAG_MAX_PREFERRED_REFRESH,
+	TAG_DISABLED,
+	TAG_LOG_THRESHOLD,
+
+	// SCALE, MODE
+	TAG_NAME_DESC,
+	TAG_SCALE_VAL,
+	TAG_MAX,
+	TAG_WIDTH,
+	TAG_HEIGHT,
+	TAG_HZ,
+
+	// response STATE
+	TAG_LID,
+	TAG_CLOSED,
+	TAG_DEVICE_PATH,
+	TAG_HEAD,
+
+	// HEAD
+	TAG_NAME,
+	TAG_DESCRIPTION,
+	TAG_MAKE,
+	TAG_MODEL,
+	TAG_SERIAL_NUMBER,
+	TAG_WIDTH_MM,
+	TAG_HEIGHT_MM,
+	TAG_TRANSFORM,
+	TAG_CURRENT,
+	TAG_DESIRED,
+
+	// CURRENT, DESIRED
+	TAG_ENABLED,
+	TAG_X,
+	TAG_Y,
+
+	// MODE
+	TAG_REFRESH_MHZ,
+	TAG_PREFERRED,
+
+	// request
+	TAG_ENCODING,
+	TAG_OPERATION,
+	TAG_MEMFD_THRESHOLD,
+
+	// response
+	TAG_MESSAGES_DROPPED,
+	TAG_TRACE,
+
+	// TRACE
+	TAG_NS,
+	TAG_SERIAL,
+	TAG_EVENT,
+	TAG_VRR,
+	TAG_HEADS,
+
+	// response
+	TAG_STATS,
+
+	// STATS
+	TAG_COUNTER,
+	TAG_GAUGE,
+	TAG_IPC_REQUESTS,
+	TAG_DESIRE_US,
+	TAG_APPLY_US,
+	TAG_SETTLE_US,
+	TAG_APPLIES,
+
+	// histogram
+	TAG_COUNT,
+	TAG_SUM,
+	TAG_BUCKET,
+
+	// COUNTER, GAUGE by NAME, IPC_REQUESTS by OP
+	TAG_VALUE,
+
+	// CFG
+	TAG_INCLUDE,
+
+	// configuration cache, see cfg_cache_path
+	TAG_CFG_CACHE,
+	TAG_VERSION,
+	TAG_LAYER,
+
+	// LAYER
+	TAG_PATH,
+	TAG_HASH,
+
+	// response, per head: NAME, ENABLED, MODE, SCALE_VAL, X, Y, VRR
+	TAG_EVALUATION,
+
+	// request
+	TAG_TIMEOUT_MS,
+};
+
+struct TlvWriter {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+struct TlvReader {
+	const char *pos;
+	const char *end;
+	// shared by nested readers, set on any malformed record or value
+	bool *bad;
+};
+
+struct TlvVal {
+	uint8_t tag;
+	const char *val;
+	size_t len;
+};
+
+// true when buf starts with the magic of any version
+bool tlv_is_message(const char *buf, size_t len);
+
+// write the header
+void tlv_message_begin(struct TlvWriter *w, uint8_t kind);
+
+// write the end record
+void tlv_message_end(struct TlvWriter *w);
+
+// length of the first complete message in buf, 0 when incomplete or invalid
+size_t tlv_message_len(const char *buf, size_t len);
+
+// bytes that must follow the partial message in buf before it can progress, 0 when complete
+// false when invalid
+bool tlv_message_need(const char *buf, size_t len, size_t *need);
+
+// validate a complete message, returning its kind and a reader of its records; 0 on failure
+uint8_t tlv_message_read(const char *buf, size_t len, bool *bad, struct TlvReader *r);
+
+void tlv_put_int(struct TlvWriter *w, uint8_t tag, int64_t val);
+
+void tlv_put_bool(struct TlvWriter *w, uint8_t tag, bool val);
+
+// null str is not written
+void tlv_put_str(struct TlvWriter *w, uint8_t tag, const char *str);
+
+void tlv_put_float(struct TlvWriter *w, uint8_t tag, float val);
+
+void tlv_put_double(struct TlvWriter *w, uint8_t tag, double val);
+
+// open a container record, returning the offset to pass to tlv_end
+size_t tlv_begin(struct TlvWriter *w, uint8_t tag);
+
+void tlv_end(struct TlvWriter *w, size_t begin);
+
+void tlv_writer_free(struct TlvWriter *w);
+
+// next record, false at the end or when malformed
+bool tlv_next(struct TlvReader *r, struct TlvVal *v);
+
+int64_t tlv_int(struct TlvReader *r, const struct TlvVal *v);
+
+bool tlv_bool(struct TlvReader *r, const struct TlvVal *v);
+
+// allocated copy
+char *tlv_str(struct TlvReader *r, const struct TlvVal *v);
+
+float tlv_float(struct TlvReader *r, const struct TlvVal *v);
+
+double tlv_double(struct TlvReader *r, const struct TlvVal *v);
+
+// reader of a container's records
+struct TlvReader tlv_nested(struct TlvReader *r, const struct TlvVal *v);
+
+#endif // TLV_H
+
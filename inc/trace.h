@@ -0,0 +1,95 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// always on record of output management, in a ring of fixed capacity, oldest overwritten when full
+#define TRACE_EVENTS_MAX 2048
+#define TRACE_HEAD_LEN 16
+
+enum TraceEventType {
+	TRACE_HEAD_ARRIVED = 1,
+	TRACE_HEAD_DEPARTED,
+	// output manager done
+	TRACE_DONE,
+	// head desired differs from current
+	TRACE_DELTA,
+	// configuration applied
+	TRACE_APPLY,
+	TRACE_SUCCEEDED,
+	TRACE_FAILED,
+	TRACE_CANCELLED,
+	// last good configuration applied after a failure
+	TRACE_ROLLBACK,
+};
+
+// DELTA elements that differ
+enum TraceDelta {
+	TRACE_DELTA_ENABLED = 1 << 0,
+	TRACE_DELTA_MODE = 1 << 1,
+	TRACE_DELTA_SCALE = 1 << 2,
+	TRACE_DELTA_POSITION = 1 << 3,
+	TRACE_DELTA_VRR = 1 << 4,
+};
+
+enum TraceFormat {
+	TRACE_FORMAT_TEXT = 1,
+	TRACE_FORMAT_CHROME,
+};
+
+struct TraceEvent {
+	// monotonic
+	int64_t ns;
+	// output manager serial when recorded
+	uint32_t serial;
+	uint16_t type;
+	// DELTA: TraceDelta
+	uint16_t delta;
+	// truncated
+	char head[TRACE_HEAD_LEN];
+	union {
+		// DELTA
+		struct {
+			int32_t width;
+			int32_t height;
+			int32_t refresh_mhz;
+			// wl_fixed_t
+			int32_t scale;
+			int32_t x;
+			int32_t y;
+			uint8_t enabled;
+			uint8_t adaptive_sync;
+		} desired;
+		// APPLY
+		uint32_t heads;
+	};
+};
+
+struct Trace {
+	struct TraceEvent events[TRACE_EVENTS_MAX];
+	size_t start;
+	size_t len;
+	// overwritten
+	unsigned long dropped;
+};
+extern struct Trace trace;
+
+// record now, returning the event to fill in any detail
+struct TraceEvent *trace_event(enum TraceEventType type, uint32_t serial, const char *head);
+
+// nth oldest event, NULL when n >= trace.len
+const struct TraceEvent *trace_event_n(size_t n);
+
+void trace_clear(void);
+
+// one line per event
+void trace_print_text(FILE *stream, const struct TraceEvent *events, size_t len);
+
+// chrome://tracing and Perfetto, APPLY spans until its outcome
+void trace_print_chrome(FILE *stream, const struct TraceEvent *events, size_t len);
+
+#endif // TRACE_H
+
@@ -1,10 +1,16 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
+#include <regex.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "cfg.h"
@@ -16,6 +22,10 @@
 #include "log.h"
 #include "marshalling.h"
 
+struct SList *cfg_layers = NULL;
+
+struct CfgCache cfg_cache = { 0 };
+
 bool cfg_equal_user_mode_name(const void *value, const void *data) {
 	if (!value || !data) {
 		return false;
@@ -149,17 +159,297 @@ void warn_short_name_desc(const char *name_desc, const char *element) {
 	}
 }
 
+void matcher_init(struct Matcher *matcher, const char *name_desc, size_t index, void *val) {
+	matcher->name_desc = name_desc;
+	matcher->index = index;
+	matcher->val = val;
+
+	if (name_desc[0] == '!') {
+		matcher->regex = calloc(1, sizeof(regex_t));
+		if (regcomp(matcher->regex, name_desc + 1, REG_EXTENDED) == 0) {
+			matcher->kind = MATCH_REGEX;
+		} else {
+			log_debug("Could not compile regex '%s'\n", name_desc + 1);
+			matcher->kind = MATCH_REGEX_INVALID;
+			free(matcher->regex);
+			matcher->regex = NULL;
+		}
+	} else {
+		matcher->kind = MATCH_TEXT;
+		matcher->name_desc_lower = strdup_lower(name_desc);
+	}
+}
+
+// vals are name_desc strings unless name_desc_of is set
+void matchers_init(struct Matchers *matchers, struct SList *vals, const char *(*name_desc_of)(const void *val)) {
+	matchers->len = 0;
+	matchers->matchers = NULL;
+
+	size_t len = slist_length(vals);
+	if (!len) {
+		return;
+	}
+
+	matchers->matchers = calloc(len, sizeof(struct Matcher));
+
+	for (struct SList *i = vals; i; i = i->nex) {
+		const char *name_desc = name_desc_of ? name_desc_of(i->val) : (const char*)i->val;
+		if (name_desc) {
+			matcher_init(&matchers->matchers[matchers->len], name_desc, matchers->len, i->val);
+			matchers->len++;
+		}
+	}
+}
+
+void matchers_free(struct Matchers *matchers) {
+	for (size_t i = 0; i < matchers->len; i++) {
+		struct Matcher *matcher = &matchers->matchers[i];
+		if (matcher->regex) {
+			regfree(matcher->regex);
+			free(matcher->regex);
+		}
+		free(matcher->name_desc_lower);
+	}
+	free(matchers->matchers);
+
+	matchers->matchers = NULL;
+	matchers->len = 0;
+}
+
+const char *user_scale_name_desc(const void *val) {
+	return ((const struct UserScale*)val)->name_desc;
+}
+
+const char *user_mode_name_desc(const void *val) {
+	return ((const struct UserMode*)val)->name_desc;
+}
+
+void cfg_compiled_free(struct CfgCompiled *compiled) {
+	if (!compiled)
+		return;
+
+	matchers_free(&compiled->order);
+	matchers_free(&compiled->user_scales);
+	matchers_free(&compiled->user_modes);
+	matchers_free(&compiled->adaptive_sync_off);
+	matchers_free(&compiled->max_preferred_refresh);
+	matchers_free(&compiled->disabled);
+
+	free(compiled);
+}
+
+void cfg_compile(struct Cfg *cfg) {
+	if (!cfg)
+		return;
+
+	cfg_compiled_free(cfg->compiled);
+
+	struct CfgCompiled *compiled = calloc(1, sizeof(struct CfgCompiled));
+
+	matchers_init(&compiled->order, cfg->order_name_desc, NULL);
+	matchers_init(&compiled->user_scales, cfg->user_scales, user_scale_name_desc);
+	matchers_init(&compiled->user_modes, cfg->user_modes, user_mode_name_desc);
+	matchers_init(&compiled->adaptive_sync_off, cfg->adaptive_sync_off_name_desc, NULL);
+	matchers_init(&compiled->max_preferred_refresh, cfg->max_preferred_refresh_name_desc, NULL);
+	matchers_init(&compiled->disabled, cfg->disabled_name_desc, NULL);
+
+	cfg->compiled = compiled;
+}
+
+// the matchers of a list element, NULL for other elements
+struct Matchers *cfg_compiled_matchers(struct CfgCompiled *compiled, enum CfgElement element) {
+	switch (element) {
+		case ORDER:
+			return &compiled->order;
+		case SCALE:
+			return &compiled->user_scales;
+		case MODE:
+			return &compiled->user_modes;
+		case VRR_OFF:
+			return &compiled->adaptive_sync_off;
+		case MAX_PREFERRED_REFRESH:
+			return &compiled->max_preferred_refresh;
+		case DISABLED:
+			return &compiled->disabled;
+		default:
+			return NULL;
+	}
+}
+
+const struct CfgCompiled *cfg_compiled(struct Cfg *cfg) {
+	if (!cfg->compiled) {
+		cfg_compile(cfg);
+	}
+	return cfg->compiled;
+}
+
+void *clone_name_desc(const void *val) {
+	return strdup((const char*)val);
+}
+
+void *clone_user_scale(const void *val) {
+	const struct UserScale *from = val;
+
+	return cfg_user_scale_init(from->name_desc, from->scale);
+}
+
+void *clone_user_mode(const void *val) {
+	const struct UserMode *from = val;
+
+	return cfg_user_mode_init(from->name_desc, from->max, from->width, from->height, from->refresh_hz);
+}
+
+struct SList **cfg_list(struct Cfg *cfg, enum CfgElement element) {
+	switch (element) {
+		case ORDER:
+			return &cfg->order_name_desc;
+		case SCALE:
+			return &cfg->user_scales;
+		case MODE:
+			return &cfg->user_modes;
+		case VRR_OFF:
+			return &cfg->adaptive_sync_off_name_desc;
+		case MAX_PREFERRED_REFRESH:
+			return &cfg->max_preferred_refresh_name_desc;
+		case DISABLED:
+			return &cfg->disabled_name_desc;
+		default:
+			return NULL;
+	}
+}
+
+void (*cfg_list_free_val(enum CfgElement element))(void *val) {
+	switch (element) {
+		case SCALE:
+			return cfg_user_scale_free;
+		case MODE:
+			return cfg_user_mode_free;
+		default:
+			return free;
+	}
+}
+
+void cfg_list_free(struct Cfg *cfg, enum CfgElement element) {
+	struct SList **list = cfg_list(cfg, element);
+	if (!list) {
+		return;
+	}
+
+	unsigned int *shared = cfg->shared[element];
+	cfg->shared[element] = NULL;
+
+	// the last reference frees
+	if (shared && --(*shared) > 0) {
+		*list = NULL;
+		return;
+	}
+	free(shared);
+
+	slist_free_vals(list, cfg_list_free_val(element));
+}
+
+void cfg_share(struct Cfg *to, struct Cfg *from, enum CfgElement element) {
+	struct SList **list = cfg_list(from, element);
+	if (!list || !*list) {
+		return;
+	}
+
+	cfg_list_free(to, element);
+
+	if (!from->shared[element]) {
+		from->shared[element] = calloc(1, sizeof(unsigned int));
+		*from->shared[element] = 1;
+	}
+	(*from->shared[element])++;
+	to->shared[element] = from->shared[element];
+	*cfg_list(to, element) = *list;
+
+	cfg_compiled_free(to->compiled);
+	to->compiled = NULL;
+}
+
+// evaluates each val once, copying a shared list only when one is removed
+void cfg_list_remove_invalid(struct Cfg *cfg, enum CfgElement element, bool (*invalid)(const void *val, const void *data)) {
+	struct SList **list = cfg_list(cfg, element);
+	struct SList **i = list;
+
+	while (*i) {
+		if (!invalid((*i)->val, NULL)) {
+			i = &(*i)->nex;
+			continue;
+		}
+
+		// same position in the copy
+		if (cfg->shared[element]) {
+			unsigned long n = 0;
+			for (struct SList *j = *list; j != *i; j = j->nex) {
+				n++;
+			}
+			cfg_unshare(cfg, element);
+			for (i = list; n; n--) {
+				i = &(*i)->nex;
+			}
+		}
+
+		struct SList *removed = *i;
+		*i = removed->nex;
+		cfg_list_free_val(element)(removed->val);
+		free(removed);
+
+		free(cfg->marshalled);
+		cfg->marshalled = NULL;
+	}
+}
+
+void cfg_unshare(struct Cfg *cfg, enum CfgElement element) {
+	if (!cfg || !cfg->shared[element]) {
+		return;
+	}
+
+	unsigned int *shared = cfg->shared[element];
+	cfg->shared[element] = NULL;
+
+	// others have been freed
+	if (*shared == 1) {
+		free(shared);
+		return;
+	}
+	(*shared)--;
+
+	struct SList **list = cfg_list(cfg, element);
+	switch (element) {
+		case SCALE:
+			*list = slist_clone(*list, clone_user_scale);
+			break;
+		case MODE:
+			*list = slist_clone(*list, clone_user_mode);
+			break;
+		default:
+			*list = slist_clone(*list, clone_name_desc);
+			break;
+	}
+
+	// matchers refer to the shared
+	cfg_compiled_free(cfg->compiled);
+	cfg->compiled = NULL;
+
+	// about to be changed
+	free(cfg->marshalled);
+	cfg->marshalled = NULL;
+}
+
 struct Cfg *clone_cfg(struct Cfg *from) {
 	if (!from) {
 		return NULL;
 	}
 
-	struct SList *i;
 	struct Cfg *to = (struct Cfg*)calloc(1, sizeof(struct Cfg));
 
 	to->dir_path = from->dir_path ? strdup(from->dir_path) : NULL;
 	to->file_path = from->file_path ? strdup(from->file_path) : NULL;
 	to->file_name = from->file_name ? strdup(from->file_name) : NULL;
+	to->file_hash = from->file_hash;
+	to->includes = slist_clone(from->includes, clone_name_desc);
 
 	// ARRANGE
 	if (from->arrange) {
@@ -171,56 +461,19 @@ struct Cfg *clone_cfg(struct Cfg *from) {
 		to->align = from->align;
 	}
 
-	// ORDER
-	for (i = from->order_name_desc; i; i = i->nex) {
-		slist_append(&to->order_name_desc, strdup((char*)i->val));
-	}
-
 	// AUTO_SCALE
 	if (from->auto_scale) {
 		to->auto_scale = from->auto_scale;
 	}
 
-	// SCALE
-	for (i = from->user_scales; i; i = i->nex) {
-		struct UserScale *from_scale = (struct UserScale*)i->val;
-		struct UserScale *to_scale = (struct UserScale*)calloc(1, sizeof(struct UserScale));
-		to_scale->name_desc = strdup(from_scale->name_desc);
-		to_scale->scale = from_scale->scale;
-		slist_append(&to->user_scales, to_scale);
-	}
-
-	// MODE
-	for (i = from->user_modes; i; i = i->nex) {
-		struct UserMode *from_user_mode = (struct UserMode*)i->val;
-		struct UserMode *to_user_mode = (struct UserMode*)calloc(1, sizeof(struct UserMode));
-		to_user_mode->name_desc = strdup(from_user_mode->name_desc);
-		to_user_mode->max = from_user_mode->max;
-		to_user_mode->width = from_user_mode->width;
-		to_user_mode->height = from_user_mode->height;
-		to_user_mode->refresh_hz = from_user_mode->refresh_hz;
-		to_user_mode->warned_no_mode = from_user_mode->warned_no_mode;
-		slist_append(&to->user_modes, to_user_mode);
-	}
-
-	// VRR_OFF
-	for (i = from->adaptive_sync_off_name_desc; i; i = i->nex) {
-		slist_append(&to->adaptive_sync_off_name_desc, strdup((char*)i->val));
-	}
-
 	// LAPTOP_DISPLAY_PREFIX
 	if (from->laptop_display_prefix) {
 		to->laptop_display_prefix = strdup(from->laptop_display_prefix);
 	}
 
-	// MAX_PREFERRED_REFRESH
-	for (i = from->max_preferred_refresh_name_desc; i; i = i->nex) {
-		slist_append(&to->max_preferred_refresh_name_desc, strdup((char*)i->val));
-	}
-
-	// DISABLED
-	for (i = from->disabled_name_desc; i; i = i->nex) {
-		slist_append(&to->disabled_name_desc, strdup((char*)i->val));
+	// ORDER, SCALE, MODE, VRR_OFF, MAX_PREFERRED_REFRESH, DISABLED
+	for (enum CfgElement element = ARRANGE; element < ARRANGE_ALIGN; element++) {
+		cfg_share(to, from, element);
 	}
 
 	// LOG_THRESHOLD
@@ -231,69 +484,75 @@ struct Cfg *clone_cfg(struct Cfg *from) {
 	return to;
 }
 
-bool cfg_equal(struct Cfg *a, struct Cfg *b) {
-	if (!a || !b) {
-		return false;
-	}
+unsigned int cfg_changed(struct Cfg *a, struct Cfg *b) {
+	unsigned int changed = 0;
 
 	// ARRANGE
 	if (a->arrange != b->arrange) {
-		return false;
+		changed |= 1 << ARRANGE;
 	}
 
 	// ALIGN
 	if (a->align != b->align) {
-		return false;
+		changed |= 1 << ALIGN;
 	}
 
-	// ORDER
-	if (!slist_equal(a->order_name_desc, b->order_name_desc, slist_equal_strcmp)) {
-		return false;
+	// ORDER, lists shared by a merge are equal without comparing
+	if (a->order_name_desc != b->order_name_desc && !slist_equal(a->order_name_desc, b->order_name_desc, slist_equal_strcmp)) {
+		changed |= 1 << ORDER;
 	}
 
 	// AUTO_SCALE
 	if (a->auto_scale != b->auto_scale) {
-		return false;
+		changed |= 1 << AUTO_SCALE;
 	}
 
 	// SCALE
-	if (!slist_equal(a->user_scales, b->user_scales, cfg_equal_user_scale)) {
-		return false;
+	if (a->user_scales != b->user_scales && !slist_equal(a->user_scales, b->user_scales, cfg_equal_user_scale)) {
+		changed |= 1 << SCALE;
 	}
 
 	// MODE
-	if (!slist_equal(a->user_modes, b->user_modes, cfg_equal_user_mode)) {
-		return false;
+	if (a->user_modes != b->user_modes && !slist_equal(a->user_modes, b->user_modes, cfg_equal_user_mode)) {
+		changed |= 1 << MODE;
 	}
 
 	// VRR_OFF
-	if (!slist_equal(a->adaptive_sync_off_name_desc, b->adaptive_sync_off_name_desc, slist_equal_strcmp)) {
-		return false;
+	if (a->adaptive_sync_off_name_desc != b->adaptive_sync_off_name_desc && !slist_equal(a->adaptive_sync_off_name_desc, b->adaptive_sync_off_name_desc, slist_equal_strcmp)) {
+		changed |= 1 << VRR_OFF;
 	}
 
 	// LAPTOP_DISPLAY_PREFIX
 	char *al = a->laptop_display_prefix;
 	char *bl = b->laptop_display_prefix;
 	if ((al && !bl) || (!al && bl) || (al && bl && strcmp(al, bl) != 0)) {
-		return false;
+		changed |= 1 << LAPTOP_DISPLAY_PREFIX;
 	}
 
 	// MAX_PREFERRED_REFRESH
-	if (!slist_equal(a->max_preferred_refresh_name_desc, b->max_preferred_refresh_name_desc, slist_equal_strcmp)) {
-		return false;
+	if (a->max_preferred_refresh_name_desc != b->max_preferred_refresh_name_desc && !slist_equal(a->max_preferred_refresh_name_desc, b->max_preferred_refresh_name_desc, slist_equal_strcmp)) {
+		changed |= 1 << MAX_PREFERRED_REFRESH;
 	}
 
 	// DISABLED
-	if (!slist_equal(a->disabled_name_desc, b->disabled_name_desc, slist_equal_strcmp)) {
-		return false;
+	if (a->disabled_name_desc != b->disabled_name_desc && !slist_equal(a->disabled_name_desc, b->disabled_name_desc, slist_equal_strcmp)) {
+		changed |= 1 << DISABLED;
 	}
 
 	// LOG_THRESHOLD
 	if (a->log_threshold != b->log_threshold) {
+		changed |= 1 << LOG_THRESHOLD;
+	}
+
+	return changed;
+}
+
+bool cfg_equal(struct Cfg *a, struct Cfg *b) {
+	if (!a || !b) {
 		return false;
 	}
 
-	return true;
+	return cfg_changed(a, b) == 0;
 }
 
 struct Cfg *cfg_default(void) {
@@ -307,10 +566,10 @@ struct Cfg *cfg_default(void) {
 }
 
 struct UserMode *cfg_user_mode_default(void) {
-	return cfg_user_mode_init(NULL, false, -1, -1, -1, false);
+	return cfg_user_mode_init(NULL, false, -1, -1, -1);
 }
 
-struct UserMode *cfg_user_mode_init(const char *name_desc, const bool max, const int32_t width, const int32_t height, const int32_t refresh_hz, const bool warned_no_mode) {
+struct UserMode *cfg_user_mode_init(const char *name_desc, const bool max, const int32_t width, const int32_t height, const int32_t refresh_hz) {
 	struct UserMode *um = (struct UserMode*)calloc(1, sizeof(struct UserMode));
 
 	if (name_desc) {
@@ -320,7 +579,6 @@ struct UserMode *cfg_user_mode_init(const char *name_desc, const bool max, const
 	um->width = width;
 	um->height = height;
 	um->refresh_hz = refresh_hz;
-	um->warned_no_mode = warned_no_mode;
 
 	return um;
 }
@@ -392,9 +650,16 @@ void validate_fix(struct Cfg *cfg) {
 			break;
 	}
 
-	slist_remove_all_free(&cfg->user_scales, invalid_user_scale, NULL, cfg_user_scale_free);
+	unsigned long len = slist_length(cfg->user_scales) + slist_length(cfg->user_modes);
+
+	cfg_list_remove_invalid(cfg, SCALE, invalid_user_scale);
 
-	slist_remove_all_free(&cfg->user_modes, invalid_user_mode, NULL, cfg_user_mode_free);
+	cfg_list_remove_invalid(cfg, MODE, invalid_user_mode);
+
+	// matchers refer to those removed, compiled when next used
+	if (cfg->compiled && len != slist_length(cfg->user_scales) + slist_length(cfg->user_modes)) {
+		cfg_compile(cfg);
+	}
 }
 
 void validate_warn(struct Cfg *cfg) {
@@ -457,12 +722,7 @@ struct Cfg *merge_set(struct Cfg *to, struct Cfg *from) {
 	}
 
 	// ORDER, replace
-	if (from->order_name_desc) {
-		slist_free_vals(&merged->order_name_desc, NULL);
-		for (i = from->order_name_desc; i; i = i->nex) {
-			slist_append(&merged->order_name_desc, strdup((char*)i->val));
-		}
-	}
+	cfg_share(merged, from, ORDER);
 
 	// AUTO_SCALE
 	if (from->auto_scale) {
@@ -472,44 +732,63 @@ struct Cfg *merge_set(struct Cfg *to, struct Cfg *from) {
 	// SCALE
 	struct UserScale *set_user_scale = NULL;
 	struct UserScale *merged_user_scale = NULL;
-	for (i = from->user_scales; i; i = i->nex) {
-		set_user_scale = (struct UserScale*)i->val;
-		if (!(merged_user_scale = (struct UserScale*)slist_find_equal_val(merged->user_scales, cfg_equal_user_scale_name, set_user_scale))) {
-			merged_user_scale = (struct UserScale*)calloc(1, sizeof(struct UserScale));
-			merged_user_scale->name_desc = strdup(set_user_scale->name_desc);
-			slist_append(&merged->user_scales, merged_user_scale);
+	if (!merged->user_scales) {
+		cfg_share(merged, from, SCALE);
+	} else if (from->user_scales) {
+		cfg_unshare(merged, SCALE);
+		for (i = from->user_scales; i; i = i->nex) {
+			set_user_scale = (struct UserScale*)i->val;
+			if (!(merged_user_scale = (struct UserScale*)slist_find_equal_val(merged->user_scales, cfg_equal_user_scale_name, set_user_scale))) {
+				merged_user_scale = (struct UserScale*)calloc(1, sizeof(struct UserScale));
+				merged_user_scale->name_desc = strdup(set_user_scale->name_desc);
+				slist_append(&merged->user_scales, merged_user_scale);
+			}
+			merged_user_scale->scale = set_user_scale->scale;
 		}
-		merged_user_scale->scale = set_user_scale->scale;
 	}
 
 	// MODE
 	struct UserMode *set_user_mode = NULL;
 	struct UserMode *merged_user_mode = NULL;
-	for (i = from->user_modes; i; i = i->nex) {
-		set_user_mode = (struct UserMode*)i->val;
-		if (!(merged_user_mode = (struct UserMode*)slist_find_equal_val(merged->user_modes, cfg_equal_user_mode_name, set_user_mode))) {
-			merged_user_mode = cfg_user_mode_default();
-			merged_user_mode->name_desc = strdup(set_user_mode->name_desc);
-			slist_append(&merged->user_modes, merged_user_mode);
+	if (!merged->user_modes) {
+		cfg_share(merged, from, MODE);
+	} else if (from->user_modes) {
+		cfg_unshare(merged, MODE);
+		for (i = from->user_modes; i; i = i->nex) {
+			set_user_mode = (struct UserMode*)i->val;
+			if (!(merged_user_mode = (struct UserMode*)slist_find_equal_val(merged->user_modes, cfg_equal_user_mode_name, set_user_mode))) {
+				merged_user_mode = cfg_user_mode_default();
+				merged_user_mode->name_desc = strdup(set_user_mode->name_desc);
+				slist_append(&merged->user_modes, merged_user_mode);
+			}
+			merged_user_mode->max = set_user_mode->max;
+			merged_user_mode->width = set_user_mode->width;
+			merged_user_mode->height = set_user_mode->height;
+			merged_user_mode->refresh_hz = set_user_mode->refresh_hz;
 		}
-		merged_user_mode->max = set_user_mode->max;
-		merged_user_mode->width = set_user_mode->width;
-		merged_user_mode->height = set_user_mode->height;
-		merged_user_mode->refresh_hz = set_user_mode->refresh_hz;
-		merged_user_mode->warned_no_mode = set_user_mode->warned_no_mode;
 	}
 
 	// VRR_OFF
-	for (i = from->adaptive_sync_off_name_desc; i; i = i->nex) {
-		if (!slist_find_equal(merged->adaptive_sync_off_name_desc, slist_equal_strcmp, i->val)) {
-			slist_append(&merged->adaptive_sync_off_name_desc, strdup((char*)i->val));
+	if (!merged->adaptive_sync_off_name_desc) {
+		cfg_share(merged, from, VRR_OFF);
+	} else {
+		for (i = from->adaptive_sync_off_name_desc; i; i = i->nex) {
+			if (!slist_find_equal(merged->adaptive_sync_off_name_desc, slist_equal_strcmp, i->val)) {
+				cfg_unshare(merged, VRR_OFF);
+				slist_append(&merged->adaptive_sync_off_name_desc, strdup((char*)i->val));
+			}
 		}
 	}
 
 	// DISABLED
-	for (i = from->disabled_name_desc; i; i = i->nex) {
-		if (!slist_find_equal(merged->disabled_name_desc, slist_equal_strcmp, i->val)) {
-			slist_append(&merged->disabled_name_desc, strdup((char*)i->val));
+	if (!merged->disabled_name_desc) {
+		cfg_share(merged, from, DISABLED);
+	} else {
+		for (i = from->disabled_name_desc; i; i = i->nex) {
+			if (!slist_find_equal(merged->disabled_name_desc, slist_equal_strcmp, i->val)) {
+				cfg_unshare(merged, DISABLED);
+				slist_append(&merged->disabled_name_desc, strdup((char*)i->val));
+			}
 		}
 	}
 
@@ -527,22 +806,34 @@ struct Cfg *merge_del(struct Cfg *to, struct Cfg *from) {
 
 	// SCALE
 	for (i = from->user_scales; i; i = i->nex) {
-		slist_remove_all_free(&merged->user_scales, cfg_equal_user_scale_name, i->val, cfg_user_scale_free);
+		if (slist_find_equal(merged->user_scales, cfg_equal_user_scale_name, i->val)) {
+			cfg_unshare(merged, SCALE);
+			slist_remove_all_free(&merged->user_scales, cfg_equal_user_scale_name, i->val, cfg_user_scale_free);
+		}
 	}
 
 	// MODE
 	for (i = from->user_modes; i; i = i->nex) {
-		slist_remove_all_free(&merged->user_modes, cfg_equal_user_mode_name, i->val, cfg_user_mode_free);
+		if (slist_find_equal(merged->user_modes, cfg_equal_user_mode_name, i->val)) {
+			cfg_unshare(merged, MODE);
+			slist_remove_all_free(&merged->user_modes, cfg_equal_user_mode_name, i->val, cfg_user_mode_free);
+		}
 	}
 
 	// VRR_OFF
 	for (i = from->adaptive_sync_off_name_desc; i; i = i->nex) {
-		slist_remove_all_free(&merged->adaptive_sync_off_name_desc, slist_equal_strcmp, i->val, NULL);
+		if (slist_find_equal(merged->adaptive_sync_off_name_desc, slist_equal_strcmp, i->val)) {
+			cfg_unshare(merged, VRR_OFF);
+			slist_remove_all_free(&merged->adaptive_sync_off_name_desc, slist_equal_strcmp, i->val, NULL);
+		}
 	}
 
 	// DISABLED
 	for (i = from->disabled_name_desc; i; i = i->nex) {
-		slist_remove_all_free(&merged->disabled_name_desc, slist_equal_strcmp, i->val, NULL);
+		if (slist_find_equal(merged->disabled_name_desc, slist_equal_strcmp, i->val)) {
+			cfg_unshare(merged, DISABLED);
+			slist_remove_all_free(&merged->disabled_name_desc, slist_equal_strcmp, i->val, NULL);
+		}
 	}
 
 	return merged;
@@ -574,6 +865,258 @@ struct Cfg *cfg_merge(struct Cfg *to, struct Cfg *from, bool del) {
 	return merged;
 }
 
+struct Cfg *merge_layer(struct Cfg *to, struct Cfg *from) {
+	struct Cfg *merged = merge_set(to, from);
+
+	struct SList *i;
+
+	// LAPTOP_DISPLAY_PREFIX
+	if (from->laptop_display_prefix) {
+		free(merged->laptop_display_prefix);
+		merged->laptop_display_prefix = strdup(from->laptop_display_prefix);
+	}
+
+	// MAX_PREFERRED_REFRESH
+	if (!merged->max_preferred_refresh_name_desc) {
+		cfg_share(merged, from, MAX_PREFERRED_REFRESH);
+	} else {
+		for (i = from->max_preferred_refresh_name_desc; i; i = i->nex) {
+			if (!slist_find_equal(merged->max_preferred_refresh_name_desc, slist_equal_strcmp, i->val)) {
+				cfg_unshare(merged, MAX_PREFERRED_REFRESH);
+				slist_append(&merged->max_preferred_refresh_name_desc, strdup((char*)i->val));
+			}
+		}
+	}
+
+	// LOG_THRESHOLD
+	if (from->log_threshold) {
+		merged->log_threshold = from->log_threshold;
+	}
+
+	return merged;
+}
+
+struct CfgLayer *cfg_layer_init(const char *file_path) {
+	struct CfgLayer *layer = (struct CfgLayer*)calloc(1, sizeof(struct CfgLayer));
+
+	char path[PATH_MAX];
+
+	layer->file_path = strdup(file_path);
+
+	snprintf(path, PATH_MAX, "%s", file_path);
+	layer->dir_path = strdup(dirname(path));
+
+	snprintf(path, PATH_MAX, "%s", file_path);
+	layer->file_name = strdup(basename(path));
+
+	layer->wd = -1;
+
+	return layer;
+}
+
+bool cfg_layer_equal_path(const void *value, const void *data) {
+	return strcmp(((struct CfgLayer*)value)->file_path, (const char*)data) == 0;
+}
+
+// returns true when the parsed result may differ
+bool cfg_layer_refresh(struct CfgLayer *layer) {
+	struct stat st;
+
+	if (stat(layer->file_path, &st) != 0) {
+		log_error_errno("\nUnable to read %s", layer->file_path);
+		bool changed = layer->cfg || layer->hash;
+		cfg_free(layer->cfg);
+		layer->cfg = NULL;
+		layer->hash = 0;
+		layer->ino = 0;
+		return changed;
+	}
+
+	// same file, not written since it was read
+	if (layer->hash &&
+			st.st_dev == layer->dev &&
+			st.st_ino == layer->ino &&
+			st.st_mtim.tv_sec == layer->mtime.tv_sec &&
+			st.st_mtim.tv_nsec == layer->mtime.tv_nsec &&
+			(st.st_mtim.tv_sec < layer->read_at.tv_sec ||
+			 (st.st_mtim.tv_sec == layer->read_at.tv_sec && st.st_mtim.tv_nsec < layer->read_at.tv_nsec))) {
+		return false;
+	}
+
+	layer->dev = st.st_dev;
+	layer->ino = st.st_ino;
+	layer->mtime = st.st_mtim;
+	clock_gettime(CLOCK_REALTIME_COARSE, &layer->read_at);
+
+	size_t len = 0;
+	char *yaml = cfg_file_read(layer->file_path, &len);
+	if (!yaml) {
+		log_error_errno("\nUnable to read %s", layer->file_path);
+		cfg_free(layer->cfg);
+		layer->cfg = NULL;
+		layer->hash = 0;
+		return true;
+	}
+
+	// metadata change or identical content rewritten
+	uint64_t hash = cfg_hash(yaml, len);
+	if (hash == layer->hash) {
+		log_debug("\nConfiguration file content unchanged: %s", layer->file_path);
+		free(yaml);
+		return false;
+	}
+	layer->hash = hash;
+
+	cfg_free(layer->cfg);
+
+	// parsed and validated by a previous run
+	if (cfg_cache.buf) {
+		layer->cfg = unmarshal_cfg_cache_tlv(cfg_cache.buf, cfg_cache.len, layer->file_path, hash);
+		if (layer->cfg) {
+			log_debug("\nUsing cached configuration for %s", layer->file_path);
+			layer->cfg->file_path = strdup(layer->file_path);
+			free(yaml);
+			return true;
+		}
+	}
+
+	layer->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+	layer->cfg->file_path = strdup(layer->file_path);
+
+	if (unmarshal_cfg_from_yaml(layer->cfg, yaml)) {
+		cfg_cache.stale = true;
+	} else {
+		cfg_free(layer->cfg);
+		layer->cfg = NULL;
+	}
+
+	free(yaml);
+
+	return true;
+}
+
+bool cfg_layers_refresh(const char *file_path) {
+	if (!file_path)
+		return false;
+
+	struct SList *layers = NULL;
+	struct CfgLayer *layer;
+	bool changed = false;
+
+	// main first, for its INCLUDEs
+	struct CfgLayer *main = slist_find_equal_val(cfg_layers, cfg_layer_equal_path, file_path);
+	if (!main) {
+		main = cfg_layer_init(file_path);
+	}
+	changed |= cfg_layer_refresh(main);
+
+	for (struct SList *i = main->cfg ? main->cfg->includes : NULL; i; i = i->nex) {
+		char path[PATH_MAX];
+		const char *include = (const char*)i->val;
+		if (include[0] == '/') {
+			snprintf(path, PATH_MAX, "%s", include);
+		} else {
+			snprintf(path, PATH_MAX, "%s/%s", main->dir_path, include);
+		}
+
+		if (strcmp(path, main->file_path) == 0 || slist_find_equal(layers, cfg_layer_equal_path, path)) {
+			continue;
+		}
+
+		if (!(layer = slist_find_equal_val(cfg_layers, cfg_layer_equal_path, path))) {
+			layer = cfg_layer_init(path);
+		}
+		if (cfg_layer_refresh(layer)) {
+			changed = true;
+			if (layer->cfg && layer->cfg->includes) {
+				log_warn("\nIgnoring INCLUDE in %s, it is read from the main configuration file only", layer->file_path);
+			}
+		}
+		slist_append(&layers, layer);
+	}
+	slist_append(&layers, main);
+
+	// INCLUDE added, removed or reordered
+	changed |= !slist_equal(layers, cfg_layers, NULL);
+
+	for (struct SList *i = cfg_layers; i; i = i->nex) {
+		if (!slist_find_equal(layers, NULL, i->val)) {
+			cfg_layer_free(i->val);
+		}
+	}
+	slist_free(&cfg_layers);
+	cfg_layers = layers;
+
+	if (cfg_cache.stale) {
+		cfg_cache_write(file_path);
+	}
+
+	return changed;
+}
+
+// the last layer, NULL when none
+struct CfgLayer *cfg_layer_main(void) {
+	struct SList *i = cfg_layers;
+	while (i && i->nex) {
+		i = i->nex;
+	}
+	return i ? i->val : NULL;
+}
+
+// defaults with the layers before until merged in order, NULL when a layer is unreadable or invalid
+struct Cfg *merge_layers(struct SList *until) {
+	struct Cfg *merged = cfg_default();
+
+	for (struct SList *i = cfg_layers; i && i != until; i = i->nex) {
+		struct CfgLayer *layer = (struct CfgLayer*)i->val;
+		if (!layer->cfg) {
+			cfg_free(merged);
+			return NULL;
+		}
+
+		struct Cfg *next = merge_layer(merged, layer->cfg);
+		cfg_free(merged);
+		merged = next;
+	}
+
+	return merged;
+}
+
+struct Cfg *cfg_layers_merge_candidate(struct Cfg *candidate) {
+	struct SList *main = NULL;
+	for (struct SList *i = cfg_layers; i; i = i->nex) {
+		main = i;
+	}
+
+	struct Cfg *below = merge_layers(main);
+	if (!below) {
+		return NULL;
+	}
+
+	struct Cfg *merged = merge_layer(below, candidate);
+	cfg_free(below);
+
+	validate_fix(merged);
+
+	return merged;
+}
+
+struct Cfg *cfg_layers_merge(void) {
+	struct Cfg *merged = merge_layers(NULL);
+	if (!merged) {
+		return NULL;
+	}
+
+	// main's, for writing
+	struct CfgLayer *layer = cfg_layer_main();
+	if (layer) {
+		merged->includes = slist_clone(layer->cfg->includes, clone_name_desc);
+		merged->file_hash = layer->hash;
+	}
+
+	return merged;
+}
+
 void cfg_init(const char *cfg_path) {
 	bool found = false;
 
@@ -596,14 +1139,22 @@ void cfg_init(const char *cfg_path) {
 
 	if (found) {
 		log_info("\nFound configuration file: %s", cfg->file_path);
-		if (!unmarshal_cfg_from_file(cfg)) {
-			log_info("\nUsing default configuration:");
-			struct Cfg *def = cfg_default();
-			def->dir_path = cfg->dir_path ? strdup(cfg->dir_path) : NULL;
-			def->file_path = cfg->file_path ? strdup(cfg->file_path) : NULL;
-			def->file_name = cfg->file_name ? strdup(cfg->file_name) : NULL;
+		cfg_cache_map(cfg->file_path);
+		cfg_layers_refresh(cfg->file_path);
+		cfg_cache_unmap();
+		for (struct SList *i = cfg_layers; i && i->nex; i = i->nex) {
+			log_info("\nIncluding configuration file: %s", ((struct CfgLayer*)i->val)->file_path);
+		}
+
+		struct Cfg *merged = cfg_layers_merge();
+		if (merged) {
+			merged->dir_path = strdup(cfg->dir_path);
+			merged->file_path = strdup(cfg->file_path);
+			merged->file_name = strdup(cfg->file_name);
 			cfg_free(cfg);
-			cfg = def;
+			cfg = merged;
+		} else {
+			log_info("\nUsing default configuration:");
 		}
 	} else {
 		log_info("\nNo configuration file found, using defaults:");
@@ -614,60 +1165,437 @@ void cfg_init(const char *cfg_path) {
 	validate_warn(cfg);
 }
 
-void cfg_file_reload(void) {
+void print_changed(unsigned int changed) {
+	char buf[256] = { 0 };
+	size_t len = 0;
+
+	for (enum CfgElement element = ARRANGE; element <= DISABLED; element++) {
+		if (changed & (1 << element)) {
+			len += snprintf(buf + len, sizeof(buf) - len, "%s%s", len ? ", " : "", cfg_element_name(element));
+		}
+	}
+
+	log_info("\nChanged: %s", buf);
+}
+
+// take the lists, matchers and CFG fragment of from for the elements not changed, before from is freed
+void cfg_reuse(struct Cfg *to, struct Cfg *from, unsigned int changed) {
+	enum CfgElement element;
+
+	for (element = ARRANGE; element < ARRANGE_ALIGN; element++) {
+		if (!(changed & (1 << element)) && cfg_list(to, element)) {
+			cfg_share(to, from, element);
+		}
+	}
+
+	// unchanged matchers refer to the now shared vals, compile only the changed
+	if (from->compiled) {
+		cfg_compiled_free(to->compiled);
+		to->compiled = calloc(1, sizeof(struct CfgCompiled));
+
+		for (element = ARRANGE; element < ARRANGE_ALIGN; element++) {
+			struct Matchers *matchers = cfg_compiled_matchers(to->compiled, element);
+			if (!matchers)
+				continue;
+
+			if (changed & (1 << element)) {
+				matchers_init(matchers, *cfg_list(to, element), element == SCALE ? user_scale_name_desc : element == MODE ? user_mode_name_desc : NULL);
+			} else {
+				struct Matchers *reused = cfg_compiled_matchers(from->compiled, element);
+				*matchers = *reused;
+				reused->matchers = NULL;
+				reused->len = 0;
+			}
+		}
+	}
+
+	// the fragment contains INCLUDE
+	if (!changed && slist_equal(to->includes, from->includes, slist_equal_strcmp)) {
+		to->marshalled = from->marshalled;
+		from->marshalled = NULL;
+	}
+}
+
+unsigned int cfg_file_reload(void) {
 	if (!cfg->file_path)
-		return;
+		return 0;
 
-	struct Cfg *reloaded = cfg_default();
-	reloaded->dir_path = cfg->dir_path ? strdup(cfg->dir_path) : NULL;
-	reloaded->file_path = cfg->file_path ? strdup(cfg->file_path) : NULL;
-	reloaded->file_name = cfg->file_name ? strdup(cfg->file_name) : NULL;
+	if (!cfg_layers_refresh(cfg->file_path)) {
+		return 0;
+	}
+
+	unsigned int changed = 0;
 
 	log_info("\nReloading configuration file: %s", cfg->file_path);
-	if (unmarshal_cfg_from_file(reloaded)) {
-		cfg_free(cfg);
-		cfg = reloaded;
-		log_set_threshold(cfg->log_threshold, false);
-		validate_fix(cfg);
-		log_info("\nNew configuration:");
-		print_cfg(INFO, cfg, false);
-		validate_warn(cfg);
+	struct Cfg *reloaded = cfg_layers_merge();
+	if (reloaded) {
+		reloaded->dir_path = cfg->dir_path ? strdup(cfg->dir_path) : NULL;
+		reloaded->file_path = cfg->file_path ? strdup(cfg->file_path) : NULL;
+		reloaded->file_name = cfg->file_name ? strdup(cfg->file_name) : NULL;
+
+		validate_fix(reloaded);
+
+		changed = cfg_changed(cfg, reloaded);
+		cfg_reuse(reloaded, cfg, changed);
+		if (changed) {
+			cfg_free(cfg);
+			cfg = reloaded;
+			log_set_threshold(cfg->log_threshold, false);
+			print_changed(changed);
+			log_info("\nNew configuration:");
+			print_cfg(INFO, cfg, false);
+			validate_warn(cfg);
+		} else {
+			// comments, whitespace, defaults made explicit or moved between layers; INCLUDE and the hash may differ
+			cfg_free(cfg);
+			cfg = reloaded;
+			log_info("\nNo changes to make.");
+		}
 	} else {
 		log_info("\nConfiguration unchanged:");
 		print_cfg(INFO, cfg, false);
-		cfg_free(reloaded);
 	}
+
+	return changed;
 }
 
-void cfg_file_write(void) {
-	if (!cfg->file_path) {
-		log_error("\nMissing file path");
-		return;
+char *cfg_file_read(const char *path, size_t *len) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return NULL;
 	}
 
-	char *yaml = marshal_cfg(cfg);
-	if (!yaml) {
-		return;
+	char *buf = NULL;
+	size_t size = 0;
+	size_t n = 0;
+
+	for (;;) {
+		if (n + 1 >= size) {
+			size = size ? size * 2 : 4096;
+			buf = realloc(buf, size);
+		}
+		size_t got = fread(buf + n, 1, size - n - 1, f);
+		n += got;
+		if (got == 0) {
+			break;
+		}
 	}
 
-	FILE *f = fopen(cfg->file_path, "w");
-	if (!f) {
-		log_error_errno("\nUnable to write to %s", cfg->file_path);
+	bool error = ferror(f);
+	fclose(f);
+
+	if (error) {
+		free(buf);
+		return NULL;
+	}
+
+	buf[n] = '\0';
+	if (len) {
+		*len = n;
+	}
+
+	return buf;
+}
+
+uint64_t cfg_hash(const char *buf, size_t len) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)buf[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+char *cfg_cache_path(const char *file_path) {
+	char path[PATH_MAX];
+	char dir[PATH_MAX];
+	char name[PATH_MAX];
+
+	snprintf(dir, PATH_MAX, "%s", file_path);
+	snprintf(name, PATH_MAX, "%s", file_path);
+	snprintf(path, PATH_MAX, "%s/.%s.cache", dirname(dir), basename(name));
+
+	return strdup(path);
+}
+
+void cfg_cache_map(const char *file_path) {
+	cfg_cache_unmap();
+
+	char *path = cfg_cache_path(file_path);
+	struct stat st;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		log_debug("\nNo configuration cache %s", path);
+		free(path);
 		return;
 	}
 
-	fprintf(f, "%s\n", yaml);
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf != MAP_FAILED) {
+			cfg_cache.buf = buf;
+			cfg_cache.len = st.st_size;
+		}
+	}
 
-	fclose(f);
+	close(fd);
+	free(path);
+}
+
+void cfg_cache_unmap(void) {
+	if (cfg_cache.buf) {
+		munmap((void*)cfg_cache.buf, cfg_cache.len);
+	}
+	cfg_cache.buf = NULL;
+	cfg_cache.len = 0;
+}
+
+bool file_write_atomic(const char *path, const char *buf, size_t len, bool sync, struct stat *st) {
+	char tmp[PATH_MAX];
+	snprintf(tmp, PATH_MAX, "%s.XXXXXX", path);
+
+	int fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd == -1) {
+		return false;
+	}
+
+	// mkostemp creates 0600
+	struct stat existing;
+	fchmod(fd, stat(path, &existing) == 0 ? existing.st_mode & 07777 : 0644);
+
+	bool ok = true;
+	for (size_t n = 0; ok && n < len;) {
+		ssize_t written = write(fd, buf + n, len - n);
+		if (written > 0) {
+			n += written;
+		} else if (written == -1 && errno != EINTR) {
+			ok = false;
+		}
+	}
+
+	ok = ok && (!sync || fsync(fd) == 0) && (!st || fstat(fd, st) == 0);
+
+	int err = errno;
+	close(fd);
+
+	if (!ok || rename(tmp, path) != 0) {
+		err = ok ? errno : err;
+		unlink(tmp);
+		errno = err;
+		return false;
+	}
+
+	// the rename itself
+	if (sync) {
+		char dir[PATH_MAX];
+		snprintf(dir, PATH_MAX, "%s", path);
+		int dir_fd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dir_fd != -1) {
+			fsync(dir_fd);
+			close(dir_fd);
+		}
+	}
+
+	return true;
+}
+
+void cfg_cache_write(const char *file_path) {
+	cfg_cache.stale = false;
+
+	size_t len = 0;
+	char *buf = marshal_cfg_cache_tlv(cfg_layers, &len);
+	char *path = cfg_cache_path(file_path);
+
+	// an unwritable directory such as ROOT_ETC is expected: parse every time
+	if (!file_write_atomic(path, buf, len, false, NULL)) {
+		log_debug("\nUnable to write configuration cache %s: %s", path, strerror(errno));
+	}
+
+	free(path);
+	free(buf);
+}
+
+// entries of cfg_write's list not in below's, warning of those of below that cfg_write removed
+void layer_own_list(struct Cfg *own, struct Cfg *below, struct Cfg *cfg_write, enum CfgElement element,
+		bool (*equal_name)(const void *val, const void *data),
+		bool (*equal)(const void *val, const void *data),
+		void *(*clone)(const void *val),
+		const char *(*name_desc_of)(const void *val)) {
+
+	cfg_list_free(own, element);
+
+	struct SList **list = cfg_list(own, element);
+	for (struct SList *i = *cfg_list(cfg_write, element); i; i = i->nex) {
+		if (!slist_find_equal(*cfg_list(below, element), equal, i->val)) {
+			slist_append(list, clone(i->val));
+		}
+	}
+
+	for (struct SList *i = *cfg_list(below, element); i; i = i->nex) {
+		if (!slist_find_equal(*cfg_list(cfg_write, element), equal_name, i->val)) {
+			log_warn("\n%s %s is included from another file, it cannot be removed from %s",
+					cfg_element_name(element), name_desc_of ? name_desc_of(i->val) : (const char*)i->val, cfg_write->file_name);
+		}
+	}
+}
+
+// main's own settings and those of cfg_write that differ from the layers, such that merging the layers results in cfg_write
+struct Cfg *layer_own_cfg(struct SList *main, struct Cfg *cfg_write) {
+	struct CfgLayer *layer = (struct CfgLayer*)main->val;
+	struct Cfg *layers = cfg_layers_merge();
+	struct Cfg *below = merge_layers(main);
+
+	// unreadable or invalid, replaced entirely
+	if (!layer->cfg || !layers || !below) {
+		cfg_free(layers);
+		cfg_free(below);
+		return clone_cfg(cfg_write);
+	}
+
+	struct Cfg *own = clone_cfg(layer->cfg);
+	unsigned int changed = cfg_changed(layers, cfg_write);
+
+	if (changed & (1 << ARRANGE)) {
+		own->arrange = cfg_write->arrange;
+	}
+	if (changed & (1 << ALIGN)) {
+		own->align = cfg_write->align;
+	}
+	if (changed & (1 << AUTO_SCALE)) {
+		own->auto_scale = cfg_write->auto_scale;
+	}
+	if (changed & (1 << LOG_THRESHOLD)) {
+		own->log_threshold = cfg_write->log_threshold;
+	}
+	if (changed & (1 << LAPTOP_DISPLAY_PREFIX)) {
+		free(own->laptop_display_prefix);
+		own->laptop_display_prefix = cfg_write->laptop_display_prefix ? strdup(cfg_write->laptop_display_prefix) : NULL;
+	}
+
+	// replaced
+	if (changed & (1 << ORDER)) {
+		cfg_list_free(own, ORDER);
+		if (!slist_equal(below->order_name_desc, cfg_write->order_name_desc, slist_equal_strcmp)) {
+			cfg_share(own, cfg_write, ORDER);
+		}
+	}
+
+	// replaced by NAME_DESC
+	if (changed & (1 << SCALE)) {
+		layer_own_list(own, below, cfg_write, SCALE, cfg_equal_user_scale_name, cfg_equal_user_scale, clone_user_scale, user_scale_name_desc);
+	}
+	if (changed & (1 << MODE)) {
+		layer_own_list(own, below, cfg_write, MODE, cfg_equal_user_mode_name, cfg_equal_user_mode, clone_user_mode, user_mode_name_desc);
+	}
+
+	// added
+	if (changed & (1 << VRR_OFF)) {
+		layer_own_list(own, below, cfg_write, VRR_OFF, slist_equal_strcmp, slist_equal_strcmp, clone_name_desc, NULL);
+	}
+	if (changed & (1 << MAX_PREFERRED_REFRESH)) {
+		layer_own_list(own, below, cfg_write, MAX_PREFERRED_REFRESH, slist_equal_strcmp, slist_equal_strcmp, clone_name_desc, NULL);
+	}
+	if (changed & (1 << DISABLED)) {
+		layer_own_list(own, below, cfg_write, DISABLED, slist_equal_strcmp, slist_equal_strcmp, clone_name_desc, NULL);
+	}
+
+	free(own->dir_path);
+	free(own->file_path);
+	free(own->file_name);
+	own->dir_path = cfg_write->dir_path ? strdup(cfg_write->dir_path) : NULL;
+	own->file_path = strdup(cfg_write->file_path);
+	own->file_name = cfg_write->file_name ? strdup(cfg_write->file_name) : NULL;
+
+	cfg_free(layers);
+	cfg_free(below);
+
+	return own;
+}
+
+bool cfg_file_write(struct Cfg *cfg_write) {
+	if (!cfg_write || !cfg_write->file_path) {
+		log_error("\nMissing file path");
+		return false;
+	}
+
+	// included settings are left to their files
+	struct SList *main = slist_find_equal(cfg_layers, cfg_layer_equal_path, cfg_write->file_path);
+	struct Cfg *cfg_own = main ? layer_own_cfg(main, cfg_write) : clone_cfg(cfg_write);
+
+	char *yaml = marshal_cfg(cfg_own);
+	if (!yaml) {
+		cfg_free(cfg_own);
+		return false;
+	}
+
+	struct CfgLayer *layer = main ? (struct CfgLayer*)main->val : NULL;
+
+	size_t len = strlen(yaml);
+	yaml = realloc(yaml, len + 2);
+	yaml[len++] = '\n';
+	yaml[len] = '\0';
+
+	uint64_t hash = cfg_hash(yaml, len);
+
+	// repeated writes of the same configuration
+	size_t current_len = 0;
+	char *current = cfg_file_read(cfg_write->file_path, &current_len);
+	bool unchanged = current && current_len == len && memcmp(current, yaml, len) == 0;
+	free(current);
+	if (unchanged) {
+		log_info("\nConfiguration file unchanged: %s", cfg_write->file_path);
+		cfg_free(cfg_own);
+		free(yaml);
+		return true;
+	}
+
+	// the previous content or all of the new, never a truncated file
+	struct stat st;
+	if (!file_write_atomic(cfg_write->file_path, yaml, len, true, &st)) {
+		log_error_errno("\nUnable to write to %s", cfg_write->file_path);
+		cfg_free(cfg_own);
+		free(yaml);
+		return false;
+	}
 
 	free(yaml);
 
-	cfg->written = true;
+	log_info("\nWrote configuration file: %s", cfg_write->file_path);
+
+	cfg->file_hash = hash;
+	free(cfg->marshalled);
+	cfg->marshalled = NULL;
+
+	// what was written is current, so that the reload it triggers is a no-op without reparsing
+	if (layer) {
+		layer->dev = st.st_dev;
+		layer->ino = st.st_ino;
+		layer->mtime = st.st_mtim;
+		clock_gettime(CLOCK_REALTIME_COARSE, &layer->read_at);
+		layer->hash = hash;
+
+		cfg_free(layer->cfg);
+		layer->cfg = cfg_own;
+
+		cfg_cache_write(layer->file_path);
+	} else {
+		cfg_free(cfg_own);
+		cfg_layers_refresh(cfg_write->file_path);
+	}
+
+	return true;
 }
 
 void cfg_destroy(void) {
 	cfg_free(cfg);
 	cfg = NULL;
+
+	slist_free_vals(&cfg_layers, cfg_layer_free);
+
+	cfg_cache_unmap();
 }
 
 void cfg_free(struct Cfg *cfg) {
@@ -678,18 +1606,15 @@ void cfg_free(struct Cfg *cfg) {
 	free(cfg->file_path);
 	free(cfg->file_name);
 	free(cfg->laptop_display_prefix);
+	free(cfg->marshalled);
 
-	slist_free_vals(&cfg->order_name_desc, NULL);
-
-	slist_free_vals(&cfg->user_scales, cfg_user_scale_free);
-
-	slist_free_vals(&cfg->user_modes, cfg_user_mode_free);
+	slist_free_vals(&cfg->includes, NULL);
 
-	slist_free_vals(&cfg->adaptive_sync_off_name_desc, NULL);
+	cfg_compiled_free(cfg->compiled);
 
-	slist_free_vals(&cfg->max_preferred_refresh_name_desc, NULL);
-
-	slist_free_vals(&cfg->disabled_name_desc, NULL);
+	for (enum CfgElement element = ARRANGE; element < ARRANGE_ALIGN; element++) {
+		cfg_list_free(cfg, element);
+	}
 
 	free(cfg);
 }
@@ -716,3 +1641,18 @@ void cfg_user_mode_free(void *data) {
 	free(user_mode);
 }
 
+void cfg_layer_free(void *data) {
+	struct CfgLayer *layer = (struct CfgLayer*)data;
+
+	if (!layer)
+		return;
+
+	free(layer->file_path);
+	free(layer->dir_path);
+	free(layer->file_name);
+
+	cfg_free(layer->cfg);
+
+	free(layer);
+}
+
@@ -1,4 +1,5 @@
 #include <getopt.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,10 +8,12 @@
 #include <unistd.h>
 
 #include "cfg.h"
+#include "client.h"
 #include "convert.h"
 #include "ipc.h"
 #include "list.h"
 #include "log.h"
+#include "marshalling.h"
 #include "process.h"
 
 #include "cli.h"
@@ -23,11 +26,17 @@ void usage(FILE *stream) {
 		"  -L, --l[og-threshold] <debug|info|warning|error>\n"
 		"  -c, --c[onfig]        <path>\n"
 		"  -y, --y[aml]          YAML client output\n"
+		"  -j, --j[son]          JSON client output\n"
 		"COMMANDS\n"
 		"  -h, --h[elp]    show this message\n"
 		"  -v, --v[ersion] display version information\n"
 		"  -g, --g[et]     show the active settings\n"
+		"  -p, --p[eek]    show the display state without the server\n"
 		"  -w, --w[rite]   write active to cfg.yaml\n"
+		"  -t, --t[race]   [text|chrome]\n"
+		"     dump recent output management events\n"
+		"  -m, --m[etrics] [text|prometheus]\n"
+		"     show counters, gauges and hotplug latency\n"
 		"  -s, --s[et]     add or change\n"
 		"     ARRANGE_ALIGN <row|column> <top|middle|bottom|left|right>\n"
 		"     ORDER <name> ...\n"
@@ -40,6 +49,14 @@ void usage(FILE *stream) {
 		"     SCALE <name>\n"
 		"     MODE <name>\n"
 		"     DISABLED <name>\n"
+		"  -b, --b[atch]   <path|->\n"
+		"     one command per line: set ..., delete ... or write\n"
+		"     quoted as by sh, without expansion\n"
+		"  -e, --e[valuate] <path|->\n"
+		"     show the layout setting a cfg.yaml would result in, without applying\n"
+		"  -a, --a[wait]   [<seconds>]\n"
+		"     wait until the layout has settled, default 5 seconds\n"
+		"  Multiple set, delete, write and batch are applied together.\n"
 		;
 	fprintf(stream, "%s", mesg);
 }
@@ -177,6 +194,105 @@ struct IpcRequest *parse_write(int argc, char **argv) {
 	return request;
 }
 
+struct IpcRequest *parse_trace(int argc, char **argv) {
+	enum TraceFormat trace_format = TRACE_FORMAT_TEXT;
+
+	if (optind + 1 == argc) {
+		trace_format = trace_format_val(argv[optind]);
+		if (!trace_format) {
+			log_error("invalid --trace %s", argv[optind]);
+			wd_exit(EXIT_FAILURE);
+			return NULL;
+		}
+	} else if (optind != argc) {
+		log_error("--trace takes at most one argument");
+		wd_exit(EXIT_FAILURE);
+		return NULL;
+	}
+
+	struct IpcRequest *request = calloc(1, sizeof(struct IpcRequest));
+	request->op = TRACE;
+	request->trace_format = trace_format;
+
+	return request;
+}
+
+struct IpcRequest *parse_metrics(int argc, char **argv) {
+	enum StatsFormat stats_format = STATS_FORMAT_TEXT;
+
+	if (optind + 1 == argc) {
+		stats_format = stats_format_val(argv[optind]);
+		if (!stats_format) {
+			log_error("invalid --metrics %s", argv[optind]);
+			wd_exit(EXIT_FAILURE);
+			return NULL;
+		}
+	} else if (optind != argc) {
+		log_error("--metrics takes at most one argument");
+		wd_exit(EXIT_FAILURE);
+		return NULL;
+	}
+
+	struct IpcRequest *request = calloc(1, sizeof(struct IpcRequest));
+	request->op = STATS;
+	request->stats_format = stats_format;
+
+	return request;
+}
+
+struct IpcRequest *parse_await(int argc, char **argv) {
+	long timeout_ms = 0;
+
+	if (optind + 1 == argc) {
+		char *end = NULL;
+		double seconds = strtod(argv[optind], &end);
+		if (*end != '\0' || seconds <= 0 || seconds > LONG_MAX / 1000) {
+			log_error("invalid --await %s", argv[optind]);
+			wd_exit(EXIT_FAILURE);
+			return NULL;
+		}
+		timeout_ms = (long)(seconds * 1000 + 0.5);
+	} else if (optind != argc) {
+		log_error("--await takes at most one argument");
+		wd_exit(EXIT_FAILURE);
+		return NULL;
+	}
+
+	struct IpcRequest *request = calloc(1, sizeof(struct IpcRequest));
+	request->op = SETTLE;
+	request->timeout_ms = timeout_ms;
+
+	return request;
+}
+
+// a cfg.yaml, as a candidate
+struct IpcRequest *parse_evaluate(const char *path) {
+	char *yaml = cfg_file_read(strcmp(path, "-") == 0 ? "/dev/stdin" : path, NULL);
+	if (!yaml) {
+		log_error_errno("unable to read --evaluate %s", path);
+		wd_exit(EXIT_FAILURE);
+		return NULL;
+	}
+
+	struct Cfg *cfg = calloc(1, sizeof(struct Cfg));
+	cfg->file_path = strdup(path);
+
+	bool parsed = unmarshal_cfg_from_yaml(cfg, yaml);
+	free(yaml);
+
+	if (!parsed) {
+		cfg_free(cfg);
+		wd_exit(EXIT_FAILURE);
+		return NULL;
+	}
+
+	struct IpcRequest *request = calloc(1, sizeof(struct IpcRequest));
+	request->op = EVALUATE;
+	request->cfg = cfg;
+
+	return request;
+}
+
 struct IpcRequest *parse_set(int argc, char **argv) {
 	enum CfgElement element = cfg_element_val(optarg);
 	switch (element) {
@@ -249,6 +365,242 @@ struct IpcRequest *parse_del(int argc, char **argv) {
 	return request;
 }
 
+// index of the next option, or argc
+int command_end(int argc, char **argv) {
+	for (int i = optind; i < argc; i++) {
+		char *end = NULL;
+		if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			// negative numbers are arguments
+			strtod(argv[i], &end);
+			if (*end != '\0') {
+				return i;
+			}
+		}
+	}
+	return argc;
+}
+
+// set, delete and write are combined into a BATCH
+void append_request(struct IpcRequest **ipc_request, struct IpcRequest *request) {
+	if (!request) {
+		return;
+	}
+
+	if (!*ipc_request) {
+		*ipc_request = request;
+		return;
+	}
+
+	if ((*ipc_request)->op == GET || request->op == GET) {
+		log_error("--get cannot be combined with other commands");
+		ipc_request_free(request);
+		wd_exit(EXIT_FAILURE);
+		return;
+	}
+
+	if ((*ipc_request)->op == TRACE || request->op == TRACE) {
+		log_error("--trace cannot be combined with other commands");
+		ipc_request_free(request);
+		wd_exit(EXIT_FAILURE);
+		return;
+	}
+
+	if ((*ipc_request)->op == STATS || request->op == STATS) {
+		log_error("--metrics cannot be combined with other commands");
+		ipc_request_free(request);
+		wd_exit(EXIT_FAILURE);
+		return;
+	}
+
+	if ((*ipc_request)->op == EVALUATE || request->op == EVALUATE) {
+		log_error("--evaluate cannot be combined with other commands");
+		ipc_request_free(request);
+		wd_exit(EXIT_FAILURE);
+		return;
+	}
+
+	if ((*ipc_request)->op == SETTLE || request->op == SETTLE) {
+		log_error("--await cannot be combined with other commands");
+		ipc_request_free(request);
+		wd_exit(EXIT_FAILURE);
+		return;
+	}
+
+	if ((*ipc_request)->op != BATCH) {
+		struct IpcRequest *batch = calloc(1, sizeof(struct IpcRequest));
+		batch->op = BATCH;
+		slist_append(&batch->ops, ipc_operation_init((*ipc_request)->op, (*ipc_request)->cfg));
+		(*ipc_request)->cfg = NULL;
+		ipc_request_free(*ipc_request);
+		*ipc_request = batch;
+	}
+
+	if (request->op == BATCH) {
+		for (struct SList *i = request->ops; i; i = i->nex) {
+			slist_append(&(*ipc_request)->ops, i->val);
+		}
+		slist_free(&request->ops);
+	} else {
+		slist_append(&(*ipc_request)->ops, ipc_operation_init(request->op, request->cfg));
+		request->cfg = NULL;
+	}
+
+	ipc_request_free(request);
+}
+
+void batch_words_free(char **argv) {
+	for (char **i = argv; i && *i; i++) {
+		free(*i);
+	}
+	free(argv);
+}
+
+// whitespace separated words, quoted and escaped as by sh but without any expansion
+// NULL terminated, NULL when a quote or escape is unterminated
+char **batch_words(const char *line, int *argc) {
+	size_t len = strlen(line);
+	char **argv = calloc(len / 2 + 2, sizeof(char*));
+	char *word = malloc(len + 1);
+
+	*argc = 0;
+
+	const char *c = line;
+	for (;;) {
+		c += strspn(c, " \t");
+		if (!*c) {
+			break;
+		}
+
+		size_t n = 0;
+		while (*c && *c != ' ' && *c != '\t') {
+			if (*c == '\'') {
+				const char *close = strchr(c + 1, '\'');
+				if (!close) {
+					goto unterminated;
+				}
+				memcpy(word + n, c + 1, close - c - 1);
+				n += close - c - 1;
+				c = close + 1;
+			} else if (*c == '"') {
+				for (c++; *c != '"'; c++) {
+					if (!*c) {
+						goto unterminated;
+					}
+					if (*c == '\\' && (c[1] == '"' || c[1] == '\\')) {
+						c++;
+					}
+					word[n++] = *c;
+				}
+				c++;
+			} else if (*c == '\\') {
+				if (!c[1]) {
+					goto unterminated;
+				}
+				word[n++] = c[1];
+				c += 2;
+			} else {
+				word[n++] = *c++;
+			}
+		}
+
+		word[n] = '\0';
+		argv[(*argc)++] = strdup(word);
+	}
+
+	free(word);
+	return argv;
+
+unterminated:
+	free(word);
+	batch_words_free(argv);
+	return NULL;
+}
+
+// each line is a command as per the command line, without the leading dashes
+struct IpcRequest *parse_batch(const char *path) {
+	FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	if (!f) {
+		log_error_errno("unable to read batch %s", path);
+		wd_exit(EXIT_FAILURE);
+		return NULL;
+	}
+
+	// parse_set etc. read the current command from these
+	int optind_prev = optind;
+	char *optarg_prev = optarg;
+
+	struct IpcRequest *batch = NULL;
+	bool ok = true;
+
+	char *line = NULL;
+	size_t n = 0;
+	int line_number = 0;
+	while (ok && getline(&line, &n, f) != -1) {
+		line_number++;
+
+		line[strcspn(line, "\n")] = '\0';
+
+		const char *c = line + strspn(line, " \t");
+		if (!*c || *c == '#') {
+			continue;
+		}
+
+		int argc = 0;
+		char **argv = batch_words(c, &argc);
+		if (!argv) {
+			log_error("%s:%d invalid command: %s", path, line_number, c);
+			ok = false;
+			break;
+		}
+
+		const char *command = argc ? argv[0] : "";
+		struct IpcRequest *request = NULL;
+
+		optind = 1;
+		optarg = argc > 1 ? argv[1] : NULL;
+		if (strcasecmp(command, "set") == 0 && optarg) {
+			optind = 2;
+			request = parse_set(argc, argv);
+		} else if (strcasecmp(command, "delete") == 0 && optarg) {
+			optind = 2;
+			request = parse_del(argc, argv);
+		} else if (strcasecmp(command, "write") == 0) {
+			request = parse_write(argc, argv);
+		} else {
+			log_error("%s:%d invalid command: %s", path, line_number, command);
+		}
+
+		batch_words_free(argv);
+
+		if (request) {
+			append_request(&batch, request);
+		} else {
+			ok = false;
+		}
+	}
+
+	free(line);
+	if (f != stdin) {
+		fclose(f);
+	}
+
+	optind = optind_prev;
+	optarg = optarg_prev;
+
+	if (ok && !batch) {
+		log_error("empty batch %s", path);
+		ok = false;
+	}
+
+	if (!ok) {
+		ipc_request_free(batch);
+		wd_exit(EXIT_FAILURE);
+		return NULL;
+	}
+
+	return batch;
+}
+
 bool parse_log_threshold(char *optarg) {
 	enum LogThreshold threshold = log_threshold_val(optarg);
 
@@ -264,22 +616,31 @@ bool parse_log_threshold(char *optarg) {
 
 void parse_args(int argc, char **argv, struct IpcRequest **ipc_request, char **cfg_path) {
 	static struct option long_options[] = {
+		{ "await",         no_argument,       0, 'a' },
+		{ "batch",         required_argument, 0, 'b' },
 		{ "config",        required_argument, 0, 'c' },
 		{ "delete",        required_argument, 0, 'd' },
+		{ "evaluate",      required_argument, 0, 'e' },
 		{ "get",           no_argument,       0, 'g' },
 		{ "help",          no_argument,       0, 'h' },
+		{ "json",          no_argument,       0, 'j' },
 		{ "log-threshold", required_argument, 0, 'L' },
+		{ "metrics",       no_argument,       0, 'm' },
+		{ "peek",          no_argument,       0, 'p' },
 		{ "set",           required_argument, 0, 's' },
+		{ "trace",         no_argument,       0, 't' },
 		{ "version",       no_argument,       0, 'v' },
 		{ "write",         no_argument,       0, 'w' },
 		{ "yaml",          no_argument,       0, 'y' },
 		{ 0,               0,                 0,  0  }
 	};
-	static char *short_options = "c:d:ghL:s:vwy";
+	static char *short_options = "ab:c:d:e:ghjL:mps:tvwy";
 
 	bool raw = false;
+	bool peek = false;
+	enum IpcEncoding encoding = 0;
 
-	int c;
+	int c, end;
 	while (1) {
 		int long_index = 0;
 		c = getopt_long(argc, argv, short_options, long_options, &long_index);
@@ -305,18 +666,55 @@ void parse_args(int argc, char **argv, struct IpcRequest **ipc_request, char **c
 				break;
 			case 'y':
 				raw = true;
+				encoding = IPC_ENCODING_YAML;
+				break;
+			case 'j':
+				raw = true;
+				encoding = IPC_ENCODING_JSON;
 				break;
 			case 'g':
-				*ipc_request = parse_get(argc, argv);
+				end = command_end(argc, argv);
+				append_request(ipc_request, parse_get(end, argv));
+				optind = end;
 				break;
 			case 's':
-				*ipc_request = parse_set(argc, argv);
+				end = command_end(argc, argv);
+				append_request(ipc_request, parse_set(end, argv));
+				optind = end;
 				break;
 			case 'd':
-				*ipc_request = parse_del(argc, argv);
+				end = command_end(argc, argv);
+				append_request(ipc_request, parse_del(end, argv));
+				optind = end;
 				break;
 			case 'w':
-				*ipc_request = parse_write(argc, argv);
+				end = command_end(argc, argv);
+				append_request(ipc_request, parse_write(end, argv));
+				optind = end;
+				break;
+			case 't':
+				end = command_end(argc, argv);
+				append_request(ipc_request, parse_trace(end, argv));
+				optind = end;
+				break;
+			case 'm':
+				end = command_end(argc, argv);
+				append_request(ipc_request, parse_metrics(end, argv));
+				optind = end;
+				break;
+			case 'a':
+				end = command_end(argc, argv);
+				append_request(ipc_request, parse_await(end, argv));
+				optind = end;
+				break;
+			case 'b':
+				append_request(ipc_request, parse_batch(optarg));
+				break;
+			case 'e':
+				append_request(ipc_request, parse_evaluate(optarg));
+				break;
+			case 'p':
+				peek = true;
 				break;
 			case '?':
 			default:
@@ -326,8 +724,19 @@ void parse_args(int argc, char **argv, struct IpcRequest **ipc_request, char **c
 		}
 	}
 
+	if (peek) {
+		if (*ipc_request) {
+			log_error("--peek cannot be combined with other commands");
+			wd_exit(EXIT_FAILURE);
+			return;
+		}
+		wd_exit(client_snapshot(encoding == IPC_ENCODING_JSON));
+		return;
+	}
+
 	if (*ipc_request) {
 		(*ipc_request)->raw = raw;
+		(*ipc_request)->encoding = encoding;
 	}
 }
 
@@ -1,4 +1,6 @@
+#include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -8,30 +10,50 @@
 #include "convert.h"
 #include "info.h"
 #include "ipc.h"
+#include "json.h"
 #include "log.h"
+#include "mode.h"
 #include "process.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
 
 int handle_raw(int socket_client) {
 	int rc = EXIT_SUCCESS;
 
-	char *yaml = ipc_receive_raw_client(socket_client);
-	while (yaml) {
-		fprintf(stdout, "%s", yaml);
-		free(yaml);
-		yaml = ipc_receive_raw_client(socket_client);
+	size_t len = 0;
+	int fd = -1;
+
+	char *raw = ipc_receive_raw_client(socket_client, &len, &fd);
+	while (raw) {
+		fwrite(raw, 1, len, stdout);
+		free(raw);
+
+		// printed straight from the mapping
+		if (fd != -1) {
+			char *mapped = ipc_map_memfd(fd, &len);
+			if (!mapped) {
+				rc = IPC_RC_BAD_RESPONSE;
+				break;
+			}
+			fwrite(mapped, 1, len, stdout);
+			ipc_unmap_memfd(mapped, len);
+		}
+
+		raw = ipc_receive_raw_client(socket_client, &len, &fd);
 	}
 
 	return rc;
 }
 
-int handle_human(int socket_client) {
+int handle_human(struct IpcRequest *ipc_request) {
 	int rc = EXIT_SUCCESS;
 
 	struct IpcResponse *response;
 	bool done = false;
 
 	while (!done) {
-		response = ipc_receive_response_client(socket_client);
+		response = ipc_receive_response_client(ipc_request->socket_client);
 		if (response) {
 			rc = response->rc;
 			done = response->done;
@@ -42,6 +64,29 @@ int handle_human(int socket_client) {
 	}
 
 	if (response) {
+		switch (ipc_request->trace_format) {
+			case TRACE_FORMAT_TEXT:
+				trace_print_text(stdout, response->trace_events, response->trace_len);
+				break;
+			case TRACE_FORMAT_CHROME:
+				trace_print_chrome(stdout, response->trace_events, response->trace_len);
+				break;
+			default:
+				break;
+		}
+
+		if (response->stats_values) {
+			switch (ipc_request->stats_format) {
+				case STATS_FORMAT_PROMETHEUS:
+					stats_print_prometheus(stdout, response->stats_values);
+					break;
+				case STATS_FORMAT_TEXT:
+				default:
+					stats_print(stdout, response->stats_values);
+					break;
+			}
+		}
+
 		ipc_response_free(response);
 	}
 
@@ -55,6 +100,18 @@ int client(struct IpcRequest *ipc_request) {
 
 	if (ipc_request->raw) {
 		log_set_threshold(ERROR, true);
+	} else if (!ipc_request->encoding) {
+		// only DONE, RC, MESSAGES, TRACE and STATS are read back, YAML when the server predates TLV
+		ipc_request->encoding = IPC_ENCODING_TLV;
+	}
+
+	// stdout is the document
+	if (!ipc_request->raw && (ipc_request->trace_format == TRACE_FORMAT_CHROME || ipc_request->stats_format == STATS_FORMAT_PROMETHEUS)) {
+		log_set_threshold(WARNING, false);
+	}
+
+	if (!ipc_request->memfd_threshold) {
+		ipc_request->memfd_threshold = IPC_MEMFD_THRESHOLD_DEFAULT;
 	}
 
 	log_set_times(false);
@@ -69,9 +126,18 @@ int client(struct IpcRequest *ipc_request) {
 
 	log_info("\nClient sending request: %s", ipc_request_op_friendly(ipc_request->op));
 	print_cfg(INFO, ipc_request->cfg, ipc_request->op == CFG_DEL);
+	print_ipc_operations(INFO, ipc_request->ops);
 
 	ipc_send_request(ipc_request);
 
+	// the BAD_REQUEST answering TLV is discarded unread
+	if (ipc_request->socket_client != -1 && ipc_request->encoding == IPC_ENCODING_TLV && !ipc_peek_tlv_client(ipc_request->socket_client)) {
+		log_debug("\nServer does not accept TLV, sending YAML");
+		close(ipc_request->socket_client);
+		ipc_request->encoding = IPC_ENCODING_YAML;
+		ipc_send_request(ipc_request);
+	}
+
 	if (ipc_request->socket_client == -1) {
 		rc = EXIT_FAILURE;
 		goto end;
@@ -80,7 +146,7 @@ int client(struct IpcRequest *ipc_request) {
 	if (ipc_request->raw) {
 		rc = handle_raw(ipc_request->socket_client);
 	} else {
-		rc = handle_human(ipc_request->socket_client);
+		rc = handle_human(ipc_request);
 	}
 
 	close(ipc_request->socket_client);
@@ -91,3 +157,101 @@ end:
 	return rc;
 }
 
+void print_snapshot_json(struct Snapshot *snapshot) {
+	struct JsonWriter w = { 0 };
+
+	json_object_begin(&w, NULL);
+	json_put_int(&w, "PID", snapshot->pid);
+
+	if (snapshot->lid_present) {
+		json_object_begin(&w, "LID");
+		json_put_bool(&w, "CLOSED", snapshot->lid_closed);
+		json_object_end(&w);
+	}
+
+	json_array_begin(&w, "HEADS");
+	for (uint32_t i = 0; i < snapshot->heads_len; i++) {
+		struct SnapshotHead *head = &snapshot->heads[i];
+		json_object_begin(&w, NULL);
+		json_put_str(&w, "NAME", head->name);
+		json_put_str(&w, "DESCRIPTION", head->description);
+		json_put_bool(&w, "ENABLED", head->enabled);
+		json_put_int(&w, "WIDTH", head->width);
+		json_put_int(&w, "HEIGHT", head->height);
+		json_put_int(&w, "REFRESH_MHZ", head->refresh_mhz);
+		json_put_double(&w, "SCALE", head->scale);
+		json_put_int(&w, "X", head->x);
+		json_put_int(&w, "Y", head->y);
+		json_put_int(&w, "SCALED_WIDTH", head->scaled_width);
+		json_put_int(&w, "SCALED_HEIGHT", head->scaled_height);
+		json_put_int(&w, "TRANSFORM", head->transform);
+		json_put_bool(&w, "VRR", head->adaptive_sync);
+		json_object_end(&w);
+	}
+	json_array_end(&w);
+	json_put_int(&w, "HEADS_TOTAL", snapshot->heads_total);
+
+	json_object_end(&w);
+
+	char *json = json_end(&w);
+	fprintf(stdout, "%s", json);
+	free(json);
+}
+
+void print_snapshot_human(struct Snapshot *snapshot) {
+	if (snapshot->lid_present) {
+		fprintf(stdout, "Lid: %s\n", snapshot->lid_closed ? "closed" : "open");
+	}
+
+	for (uint32_t i = 0; i < snapshot->heads_len; i++) {
+		struct SnapshotHead *head = &snapshot->heads[i];
+		fprintf(stdout, "%s '%s'\n", head->name, head->description);
+		if (head->enabled) {
+			fprintf(stdout, "  %dx%d@%dHz scale %g position %d,%d size %dx%d transform %d VRR %s\n",
+					head->width, head->height, mhz_to_hz(head->refresh_mhz),
+					head->scale,
+					head->x, head->y,
+					head->scaled_width, head->scaled_height,
+					head->transform,
+					head->adaptive_sync ? "on" : "off");
+		} else {
+			fprintf(stdout, "  disabled\n");
+		}
+	}
+
+	if (snapshot->heads_total > snapshot->heads_len) {
+		fprintf(stdout, "%u more not shown\n", snapshot->heads_total - snapshot->heads_len);
+	}
+}
+
+int client_snapshot(bool json) {
+	const struct Snapshot *shared = snapshot_open();
+	if (!shared) {
+		log_error("way-displays snapshot not available, check $XDG_VTNR");
+		return EXIT_FAILURE;
+	}
+
+	struct Snapshot snapshot;
+	bool consistent = snapshot_read(shared, &snapshot);
+
+	snapshot_close(shared);
+
+	if (!consistent) {
+		log_error("way-displays snapshot is being written");
+		return EXIT_FAILURE;
+	}
+
+	// exited or crashed
+	if (!snapshot.pid || kill(snapshot.pid, 0) == -1) {
+		log_error("way-displays not running, check $XDG_VTNR");
+		return EXIT_FAILURE;
+	}
+
+	if (json) {
+		print_snapshot_json(&snapshot);
+	} else {
+		print_snapshot_human(&snapshot);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,4 +1,6 @@
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
@@ -7,6 +9,8 @@
 #include "cfg.h"
 #include "ipc.h"
 #include "log.h"
+#include "stats.h"
+#include "trace.h"
 
 struct NameVal {
 	unsigned int val;
@@ -56,11 +60,75 @@ static struct NameVal auto_scales[] = {
 };
 
 static struct NameVal ipc_request_ops[] = {
-	{ .val = GET,       .name = "GET",       .friendly = "get",    },
-	{ .val = CFG_SET,   .name = "CFG_SET",   .friendly = "set",    },
-	{ .val = CFG_DEL,   .name = "CFG_DEL",   .friendly = "delete", },
-	{ .val = CFG_WRITE, .name = "CFG_WRITE", .friendly = "write",  },
-	{ .val = 0,         .name = NULL,        .friendly = NULL,     },
+	{ .val = GET,       .name = "GET",       .friendly = "get",      },
+	{ .val = CFG_SET,   .name = "CFG_SET",   .friendly = "set",      },
+	{ .val = CFG_DEL,   .name = "CFG_DEL",   .friendly = "delete",   },
+	{ .val = CFG_WRITE, .name = "CFG_WRITE", .friendly = "write",    },
+	{ .val = BATCH,     .name = "BATCH",     .friendly = "batch",    },
+	{ .val = TRACE,     .name = "TRACE",     .friendly = "trace",    },
+	{ .val = STATS,     .name = "STATS",     .friendly = "stats",    },
+	{ .val = EVALUATE,  .name = "EVALUATE",  .friendly = "evaluate", },
+	{ .val = SETTLE,    .name = "SETTLE",    .friendly = "settle",   },
+	{ .val = 0,         .name = NULL,        .friendly = NULL,       },
+};
+
+static struct NameVal ipc_encodings[] = {
+	{ .val = IPC_ENCODING_YAML, .name = "YAML", },
+	{ .val = IPC_ENCODING_TLV,  .name = "TLV",  },
+	{ .val = IPC_ENCODING_JSON, .name = "JSON", },
+	{ .val = 0,                 .name = NULL,   },
+};
+
+static struct NameVal trace_event_types[] = {
+	{ .val = TRACE_HEAD_ARRIVED,  .name = "HEAD_ARRIVED",  },
+	{ .val = TRACE_HEAD_DEPARTED, .name = "HEAD_DEPARTED", },
+	{ .val = TRACE_DONE,          .name = "DONE",          },
+	{ .val = TRACE_DELTA,         .name = "DELTA",         },
+	{ .val = TRACE_APPLY,         .name = "APPLY",         },
+	{ .val = TRACE_SUCCEEDED,     .name = "SUCCEEDED",     },
+	{ .val = TRACE_FAILED,        .name = "FAILED",        },
+	{ .val = TRACE_CANCELLED,     .name = "CANCELLED",     },
+	{ .val = TRACE_ROLLBACK,      .name = "ROLLBACK",      },
+	{ .val = 0,                   .name = NULL,            },
+};
+
+static struct NameVal trace_formats[] = {
+	{ .val = TRACE_FORMAT_TEXT,   .name = "TEXT",   },
+	{ .val = TRACE_FORMAT_CHROME, .name = "CHROME", },
+	{ .val = 0,                   .name = NULL,     },
+};
+
+static struct NameVal stats_counters[] = {
+	{ .val = STATS_LOOPS,            .name = "LOOPS",            .friendly = "loops",            },
+	{ .val = STATS_LAYOUTS,          .name = "LAYOUTS",          .friendly = "layouts",          },
+	{ .val = STATS_LAYOUTS_SKIPPED,  .name = "LAYOUTS_SKIPPED",  .friendly = "layouts_skipped",  },
+	{ .val = STATS_DESIRES,          .name = "DESIRES",          .friendly = "desires",          },
+	{ .val = STATS_HOTPLUGS,         .name = "HOTPLUGS",         .friendly = "hotplugs",         },
+	{ .val = STATS_APPLIED,          .name = "APPLIED",          .friendly = "applied",          },
+	{ .val = STATS_MODESETS,         .name = "MODESETS",         .friendly = "modesets",         },
+	{ .val = STATS_SUCCEEDED,        .name = "SUCCEEDED",        .friendly = "succeeded",        },
+	{ .val = STATS_FAILED,           .name = "FAILED",           .friendly = "failed",           },
+	{ .val = STATS_CANCELLED,        .name = "CANCELLED",        .friendly = "cancelled",        },
+	{ .val = STATS_MODES_FAILED,     .name = "MODES_FAILED",     .friendly = "modes_failed",     },
+	{ .val = STATS_REGEX_EVALS,      .name = "REGEX_EVALS",      .friendly = "regex_evals",      },
+	{ .val = STATS_BYTES_MARSHALLED, .name = "BYTES_MARSHALLED", .friendly = "bytes_marshalled", },
+	{ .val = STATS_LOG_CAPTURED,     .name = "LOG_CAPTURED",     .friendly = "log_captured",     },
+	{ .val = STATS_ROLLBACKS,        .name = "ROLLBACKS",        .friendly = "rollbacks",        },
+	{ .val = 0,                      .name = NULL,               .friendly = NULL,               },
+};
+
+static struct NameVal stats_gauges[] = {
+	{ .val = STATS_HEADS,         .name = "HEADS",         .friendly = "heads",         },
+	{ .val = STATS_HEADS_ENABLED, .name = "HEADS_ENABLED", .friendly = "heads_enabled", },
+	{ .val = STATS_TRACE_EVENTS,  .name = "TRACE_EVENTS",  .friendly = "trace_events",  },
+	{ .val = STATS_LOG_PENDING,   .name = "LOG_PENDING",   .friendly = "log_pending",   },
+	{ .val = 0,                   .name = NULL,            .friendly = NULL,            },
+};
+
+static struct NameVal stats_formats[] = {
+	{ .val = STATS_FORMAT_TEXT,       .name = "TEXT",       },
+	{ .val = STATS_FORMAT_PROMETHEUS, .name = "PROMETHEUS", },
+	{ .val = 0,                       .name = NULL,         },
 };
 
 static struct NameVal log_thresholds[] = {
@@ -167,6 +235,14 @@ const char *ipc_request_op_friendly(enum IpcRequestOperation ipc_request_op) {
 	return friendly(ipc_request_ops, ipc_request_op);
 }
 
+enum IpcEncoding ipc_encoding_val(const char *name) {
+	return val(ipc_encodings, name);
+}
+
+const char *ipc_encoding_name(enum IpcEncoding ipc_encoding) {
+	return name(ipc_encodings, ipc_encoding);
+}
+
 enum LogThreshold log_threshold_val(const char *name) {
 	return val(log_thresholds, name);
 }
@@ -175,3 +251,63 @@ const char *log_threshold_name(enum LogThreshold log_threshold) {
 	return friendly(log_thresholds, log_threshold);
 }
 
+enum TraceEventType trace_event_type_val(const char *name) {
+	return val(trace_event_types, name);
+}
+
+const char *trace_event_type_name(enum TraceEventType trace_event_type) {
+	return name(trace_event_types, trace_event_type);
+}
+
+enum TraceFormat trace_format_val(const char *name) {
+	return val(trace_formats, name);
+}
+
+const char *trace_format_name(enum TraceFormat trace_format) {
+	return name(trace_formats, trace_format);
+}
+
+enum StatsCounter stats_counter_val(const char *name) {
+	return val(stats_counters, name);
+}
+
+const char *stats_counter_name(enum StatsCounter stats_counter) {
+	return name(stats_counters, stats_counter);
+}
+
+const char *stats_counter_friendly(enum StatsCounter stats_counter) {
+	return friendly(stats_counters, stats_counter);
+}
+
+enum StatsGauge stats_gauge_val(const char *name) {
+	return val(stats_gauges, name);
+}
+
+const char *stats_gauge_name(enum StatsGauge stats_gauge) {
+	return name(stats_gauges, stats_gauge);
+}
+
+const char *stats_gauge_friendly(enum StatsGauge stats_gauge) {
+	return friendly(stats_gauges, stats_gauge);
+}
+
+enum StatsFormat stats_format_val(const char *name) {
+	return val(stats_formats, name);
+}
+
+const char *stats_format_name(enum StatsFormat stats_format) {
+	return name(stats_formats, stats_format);
+}
+
+char *strdup_lower(const char *str) {
+	if (!str) {
+		return NULL;
+	}
+
+	char *lower = strdup(str);
+	for (char *c = lower; *c; c++) {
+		*c = (char)tolower((unsigned char)*c);
+	}
+
+	return lower;
+}
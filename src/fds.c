@@ -1,10 +1,13 @@
+#include <errno.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/inotify.h>
 #include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <wayland-client-core.h>
 
@@ -13,16 +16,22 @@
 #include "cfg.h"
 #include "displ.h"
 #include "lid.h"
+#include "list.h"
 #include "log.h"
 #include "global.h"
 #include "process.h"
 #include "sockets.h"
 
-#define PFDS_SIZE 5
+#define PFDS_SIZE 9
+
+// a layer written, moved in or created, or its directory deleted or moved away
+#define CFG_DIR_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF)
 
 int fd_signal = -1;
 int fd_socket_server = -1;
 int fd_cfg_dir = -1;
+int fd_cfg_timer = -1;
+int fd_ipc_timer = -1;
 bool fds_created = false;
 
 nfds_t npfds = 0;
@@ -33,6 +42,10 @@ struct pollfd *pfd_ipc = NULL;
 struct pollfd *pfd_wayland = NULL;
 struct pollfd *pfd_lid = NULL;
 struct pollfd *pfd_cfg_dir = NULL;
+struct pollfd *pfd_cfg_timer = NULL;
+struct pollfd *pfd_ipc_timer = NULL;
+struct pollfd *pfd_log_out = NULL;
+struct pollfd *pfd_log_err = NULL;
 
 int create_fd_signal(void) {
 	sigset_t mask;
@@ -50,19 +63,107 @@ int create_fd_cfg_dir(void) {
 		return -1;
 
 	fd_cfg_dir = inotify_init1(IN_NONBLOCK);
-	if (inotify_add_watch(fd_cfg_dir, cfg->dir_path, IN_CLOSE_WRITE) == -1) {
+	if (inotify_add_watch(fd_cfg_dir, cfg->dir_path, CFG_DIR_EVENTS) == -1) {
 		log_error_errno("\nunable to create config file watch for %s, exiting", cfg->dir_path);
 		wd_exit_message(EXIT_FAILURE);
 		return -1;
 	}
 
+	fd_cfg_dir_watch();
+
 	return fd_cfg_dir;
 }
 
+int create_fd_cfg_timer(void) {
+	if (fd_cfg_dir == -1)
+		return -1;
+
+	return timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+int create_fd_ipc_timer(void) {
+	if (fd_socket_server == -1)
+		return -1;
+
+	return timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+bool fd_cfg_dir_watch(void) {
+	bool watched = false;
+
+	if (fd_cfg_dir == -1)
+		return false;
+
+	// the same watch is returned for a directory already watched
+	for (struct SList *i = cfg_layers; i; i = i->nex) {
+		struct CfgLayer *layer = (struct CfgLayer*)i->val;
+		if (layer->wd == -1) {
+			layer->wd = inotify_add_watch(fd_cfg_dir, layer->dir_path, CFG_DIR_EVENTS);
+			if (layer->wd != -1) {
+				watched = true;
+			} else if (errno == ENOENT) {
+				// directory being replaced
+				log_debug("\nUnable to watch %s for changes to %s, retrying", layer->dir_path, layer->file_name);
+			} else {
+				log_warn_errno("\nUnable to watch %s for changes to %s", layer->dir_path, layer->file_name);
+			}
+		}
+	}
+
+	return watched;
+}
+
+bool fd_cfg_dir_unwatched(void) {
+	for (struct SList *i = cfg_layers; i; i = i->nex) {
+		if (((struct CfgLayer*)i->val)->wd == -1) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void fd_cfg_timer_arm(long ms) {
+	if (fd_cfg_timer == -1)
+		return;
+
+	struct itimerspec its = {
+		.it_value = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000, },
+	};
+	timerfd_settime(fd_cfg_timer, 0, &its, NULL);
+}
+
+bool fd_cfg_timer_expired(void) {
+	uint64_t expirations = 0;
+
+	return fd_cfg_timer != -1 &&
+		read(fd_cfg_timer, &expirations, sizeof(expirations)) == sizeof(expirations) &&
+		expirations;
+}
+
+void fd_ipc_timer_arm(long ms) {
+	if (fd_ipc_timer == -1)
+		return;
+
+	struct itimerspec its = {
+		.it_value = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000, },
+	};
+	timerfd_settime(fd_ipc_timer, 0, &its, NULL);
+}
+
+bool fd_ipc_timer_expired(void) {
+	uint64_t expirations = 0;
+
+	return fd_ipc_timer != -1 &&
+		read(fd_ipc_timer, &expirations, sizeof(expirations)) == sizeof(expirations) &&
+		expirations;
+}
+
 void create_fds(void) {
 	fd_signal = create_fd_signal();
 	fd_socket_server = create_socket_server();
 	fd_cfg_dir = create_fd_cfg_dir();
+	fd_cfg_timer = create_fd_cfg_timer();
+	fd_ipc_timer = create_fd_ipc_timer();
 
 	fds_created = true;
 }
@@ -79,6 +180,14 @@ void init_pfds(void) {
 		npfds++;
 	if (fd_cfg_dir != -1)
 		npfds++;
+	if (fd_cfg_timer != -1)
+		npfds++;
+	if (fd_ipc_timer != -1)
+		npfds++;
+	if (log_sink_out.len)
+		npfds++;
+	if (log_sink_err.len)
+		npfds++;
 
 	int i = 0;
 
@@ -107,6 +216,31 @@ void init_pfds(void) {
 		pfd_cfg_dir->fd = fd_cfg_dir;
 		pfd_cfg_dir->events = POLLIN;
 	}
+
+	if (fd_cfg_timer != -1) {
+		pfd_cfg_timer = &pfds[i++];
+		pfd_cfg_timer->fd = fd_cfg_timer;
+		pfd_cfg_timer->events = POLLIN;
+	}
+
+	if (fd_ipc_timer != -1) {
+		pfd_ipc_timer = &pfds[i++];
+		pfd_ipc_timer->fd = fd_ipc_timer;
+		pfd_ipc_timer->events = POLLIN;
+	}
+
+	// buffered log output waiting for the fd
+	if (log_sink_out.len) {
+		pfd_log_out = &pfds[i++];
+		pfd_log_out->fd = log_sink_out.fd;
+		pfd_log_out->events = POLLOUT;
+	}
+
+	if (log_sink_err.len) {
+		pfd_log_err = &pfds[i++];
+		pfd_log_err->fd = log_sink_err.fd;
+		pfd_log_err->events = POLLOUT;
+	}
 }
 
 void destroy_pfds(void) {
@@ -117,6 +251,10 @@ void destroy_pfds(void) {
 	pfd_lid = NULL;
 	pfd_ipc = NULL;
 	pfd_cfg_dir = NULL;
+	pfd_cfg_timer = NULL;
+	pfd_ipc_timer = NULL;
+	pfd_log_out = NULL;
+	pfd_log_err = NULL;
 
 	for (size_t i = 0; i < PFDS_SIZE; i++) {
 		pfds[i].fd = 0;
@@ -125,25 +263,60 @@ void destroy_pfds(void) {
 	}
 }
 
-// see man 7 inotify
-bool cfg_file_modified(char *file_name) {
-	if (!file_name) {
-		return false;
+// the watch of a directory deleted or moved away, to be added again by path, true when any layer used it
+bool cfg_dir_unwatch(int wd) {
+	bool unwatched = false;
+
+	for (struct SList *i = cfg_layers; i; i = i->nex) {
+		struct CfgLayer *layer = (struct CfgLayer*)i->val;
+		if (layer->wd == wd) {
+			layer->wd = -1;
+			unwatched = true;
+		}
 	}
 
+	return unwatched;
+}
+
+// see man 7 inotify
+bool cfg_file_modified(void) {
 	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
 	const struct inotify_event *event;
 	ssize_t len;
+	bool modified = false;
 
+	// all pending, a burst is one modification
 	while ((len = read(fd_cfg_dir, buf, sizeof(buf))) > 0) {
 		for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
 			event = (const struct inotify_event *) ptr;
-			if (event->mask & IN_CLOSE_WRITE && event->len && strcmp(file_name, event->name) == 0) {
-				return true;
+
+			// events were dropped
+			if (event->mask & IN_Q_OVERFLOW) {
+				modified = true;
+				continue;
+			}
+
+			// the watch follows a moved directory, which is no longer the path
+			if (event->mask & IN_MOVE_SELF) {
+				inotify_rm_watch(fd_cfg_dir, event->wd);
+			}
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				modified |= cfg_dir_unwatch(event->wd);
+				continue;
+			}
+
+			if (!(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)) || !event->len) {
+				continue;
+			}
+			for (struct SList *i = cfg_layers; i; i = i->nex) {
+				struct CfgLayer *layer = (struct CfgLayer*)i->val;
+				if (event->wd == layer->wd && strcmp(layer->file_name, event->name) == 0) {
+					modified = true;
+				}
 			}
 		}
 	}
 
-	return false;
+	return modified;
 }
 
@@ -1,5 +1,6 @@
 #include <regex.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,25 +14,17 @@
 #include "list.h"
 #include "log.h"
 #include "mode.h"
+#include "stats.h"
 
 struct SList *heads = NULL;
 struct SList *heads_arrived = NULL;
 struct SList *heads_departed = NULL;
 
-bool head_is_max_preferred_refresh(struct Head *head) {
+bool head_is_max_preferred_refresh(struct Cfg *cfg, struct Head *head) {
 	if (!head)
 		return false;
 
-	for (struct SList *i = cfg->max_preferred_refresh_name_desc; i; i = i->nex) {
-		if (head_matches_name_desc(head, i->val)) {
-			return true;
-		}
-	}
-	return false;
-}
-
-bool head_matches_user_mode(const void *user_mode, const void *head) {
-	return user_mode && head && head_matches_name_desc((struct Head*)head, ((struct UserMode*)user_mode)->name_desc);
+	return head_match(&cfg_compiled(cfg)->max_preferred_refresh, head) != NULL;
 }
 
 struct Mode *max_mode(struct Head *head) {
@@ -71,73 +64,71 @@ struct Mode *max_mode(struct Head *head) {
 	return max;
 }
 
-bool head_matches_name_desc_regex(const void *h, const void *n) {
+bool head_matches_exact(const void *h, const void *m) {
 	const struct Head *head = h;
-	const char *name_desc = n;
+	const struct Matcher *matcher = m;
 
-	if (name_desc[0] != '!')
+	if (!matcher || !head)
 		return false;
 
-	const char *regex_pattern = name_desc + 1;
+	return (head->name && strcmp(head->name, matcher->name_desc) == 0) ||
+		(head->description && strcmp(head->description, matcher->name_desc) == 0);
+}
 
-	regex_t regex;
-	int result;
-	char error_msg[100];
+bool head_matches_regex(const void *h, const void *m) {
+	const struct Head *head = h;
+	const struct Matcher *matcher = m;
 
-	result = regcomp(&regex, regex_pattern, REG_EXTENDED);
-	if (result) {
-		log_debug("Could not compile regex '%s'\n", regex_pattern);
+	if (!matcher || !head || matcher->kind != MATCH_REGEX)
 		return false;
-	}
 
-	result = REG_NOMATCH;
+	stats_inc(STATS_REGEX_EVALS);
+
+	int result = REG_NOMATCH;
 	if (head->name) {
-		result = regexec(&regex, head->name, 0, NULL, 0);
+		result = regexec(matcher->regex, head->name, 0, NULL, 0);
 	}
 	if (result && head->description) {
-		result = regexec(&regex, head->description, 0, NULL, 0);
+		result = regexec(matcher->regex, head->description, 0, NULL, 0);
 	}
 	if (result && result != REG_NOMATCH) {
-		regerror(result, &regex, error_msg, sizeof(error_msg));
+		char error_msg[100];
+		regerror(result, matcher->regex, error_msg, sizeof(error_msg));
 		log_debug("Regex match failed: %s\n", error_msg);
 	}
-	regfree(&regex);
 
 	return !result;
 }
 
-bool head_matches_name_desc_fuzzy(const void *h, const void *n) {
+bool head_matches_fuzzy(const void *h, const void *m) {
 	const struct Head *head = h;
-	const char *name_desc = n;
+	const struct Matcher *matcher = m;
 
-	if (!name_desc || !head || name_desc[0] == '!')
+	if (!matcher || !head || matcher->kind != MATCH_TEXT)
 		return false;
 
 	return (
-			(head->name && strcasestr(head->name, name_desc)) ||
-			(head->description && strcasestr(head->description, name_desc))
+			(head->name_lower && strstr(head->name_lower, matcher->name_desc_lower)) ||
+			(head->description_lower && strstr(head->description_lower, matcher->name_desc_lower))
 		   );
 }
 
-bool head_matches_name_desc(const void *h, const void *n) {
-	return head_matches_name_desc_exact(h, n) ||
-		head_matches_name_desc_regex(h, n) ||
-		head_matches_name_desc_fuzzy(h, n);
+bool head_matches(const void *h, const void *m) {
+	return head_matches_exact(h, m) ||
+		head_matches_regex(h, m) ||
+		head_matches_fuzzy(h, m);
 }
 
-bool head_name_desc_matches_head(const void *n, const void *h) {
-	return head_matches_name_desc(h, n);
-}
-
-bool head_matches_name_desc_exact(const void *h, const void *n) {
-	const struct Head *head = h;
-	const char *name_desc = n;
-
-	if (!name_desc || !head)
-		return false;
+const struct Matcher *head_match(const struct Matchers *matchers, const struct Head *head) {
+	if (!matchers || !head)
+		return NULL;
 
-	return (head->name && strcmp(head->name, name_desc) == 0) ||
-		(head->description && strcmp(head->description, name_desc) == 0);
+	for (size_t i = 0; i < matchers->len; i++) {
+		if (head_matches(head, &matchers->matchers[i])) {
+			return &matchers->matchers[i];
+		}
+	}
+	return NULL;
 }
 
 wl_fixed_t head_auto_scale(struct Head *head) {
@@ -175,7 +166,7 @@ void head_scaled_dimensions(struct Head *head) {
 	head->scaled.width = (int32_t)((double)head->scaled.width * 256 / head->desired.scale + 0.5);
 }
 
-struct Mode *head_find_mode(struct Head *head) {
+struct Mode *head_find_mode(struct Cfg *cfg, struct Head *head, bool warn) {
 	if (!head)
 		return NULL;
 
@@ -188,11 +179,12 @@ struct Mode *head_find_mode(struct Head *head) {
 	struct Mode *mode = NULL;
 
 	// maybe a user mode
-	struct UserMode *um = slist_find_equal_val(cfg->user_modes, head_matches_user_mode, head);
-	if (um) {
+	const struct Matcher *matcher = head_match(&cfg_compiled(cfg)->user_modes, head);
+	if (matcher) {
+		struct UserMode *um = matcher->val;
 		mode = mode_user_mode(head->modes, head->modes_failed, um);
-		if (!mode && !um->warned_no_mode) {
-			um->warned_no_mode = true;
+		if (!mode && warn && !head->warned_no_user_mode) {
+			head->warned_no_user_mode = true;
 			info_user_mode_string(um, buf, sizeof(buf));
 			log_warn("\n%s: No available mode for %s, falling back to preferred", head->name, buf);
 		}
@@ -200,12 +192,12 @@ struct Mode *head_find_mode(struct Head *head) {
 
 	// always preferred
 	if (!mode) {
-		if (head_is_max_preferred_refresh(head)) {
+		if (head_is_max_preferred_refresh(cfg, head)) {
 			mode = mode_max_preferred(head->modes, head->modes_failed);
 		} else {
 			mode = mode_preferred(head->modes, head->modes_failed);
 		}
-		if (!mode && !head->warned_no_preferred) {
+		if (!mode && warn && !head->warned_no_preferred) {
 			head->warned_no_preferred = true;
 			log_info("\n%s: No preferred mode, falling back to maximum available", head->name);
 		}
@@ -243,6 +235,28 @@ bool head_current_adaptive_sync_not_desired(const void *data) {
 	return (head && head->desired.adaptive_sync != head->current.adaptive_sync);
 }
 
+bool head_state_equal(const struct HeadState *a, const struct HeadState *b) {
+	if (!a || !b)
+		return false;
+
+	return a->mode == b->mode &&
+		a->scale == b->scale &&
+		a->enabled == b->enabled &&
+		a->x == b->x &&
+		a->y == b->y &&
+		a->adaptive_sync == b->adaptive_sync;
+}
+
+bool head_desired_failed(const void *data) {
+	const struct Head *head = data;
+
+	return (head && head->has_failed && head_state_equal(&head->desired, &head->failed));
+}
+
+bool head_current_not_desired_retry(const void *data) {
+	return head_current_not_desired(data) && !head_desired_failed(data);
+}
+
 void head_free(void *data) {
 	struct Head *head = data;
 
@@ -253,11 +267,15 @@ void head_free(void *data) {
 	slist_free_vals(&head->modes, mode_free);
 
 	free(head->name);
+	free(head->name_lower);
 	free(head->description);
+	free(head->description_lower);
 	free(head->make);
 	free(head->model);
 	free(head->serial_number);
 
+	free(head->marshalled.yaml);
+
 	free(head);
 }
 
@@ -271,6 +289,12 @@ void head_release_mode(struct Head *head, struct Mode *mode) {
 	if (head->current.mode == mode) {
 		head->current.mode = NULL;
 	}
+	if (head->last_good.mode == mode) {
+		head->last_good.mode = NULL;
+	}
+	if (head->failed.mode == mode) {
+		head->failed.mode = NULL;
+	}
 
 	slist_remove_all(&head->modes, NULL, mode);
 }
@@ -6,7 +6,9 @@
 
 #include "cfg.h"
 #include "convert.h"
+#include "global.h"
 #include "head.h"
+#include "ipc.h"
 #include "lid.h"
 #include "list.h"
 #include "log.h"
@@ -68,6 +70,9 @@ void print_user_mode(enum LogThreshold t, struct UserMode *user_mode, bool del)
 void print_mode(enum LogThreshold t, struct Mode *mode) {
 	static char buf[2048];
 
+	if (!log_enabled(t, true))
+		return;
+
 	if (mode) {
 		mode_string(mode, buf, sizeof(buf));
 		log_(t, "    mode:     %s", buf);
@@ -120,7 +125,7 @@ void print_modes_res_refresh(enum LogThreshold t, struct Head *head) {
 }
 
 void print_cfg(enum LogThreshold t, struct Cfg *cfg, bool del) {
-	if (!cfg)
+	if (!cfg || !log_enabled(t, true))
 		return;
 
 	struct UserScale *user_scale;
@@ -201,7 +206,7 @@ void print_head_current(enum LogThreshold t, struct Head *head) {
 		log_(t, "    (disabled)");
 	}
 
-	if (lid_is_closed(head->name)) {
+	if (lid_is_closed(cfg, head->name)) {
 		log_(t, "    (lid closed)");
 	}
 }
@@ -241,8 +246,19 @@ void print_head_desired(enum LogThreshold t, struct Head *head) {
 	}
 }
 
+void print_ipc_operations(enum LogThreshold t, struct SList *ops) {
+	if (!log_enabled(t, true))
+		return;
+
+	for (struct SList *i = ops; i; i = i->nex) {
+		struct IpcOperation *operation = (struct IpcOperation*)i->val;
+		log_(t, "  %s:", ipc_request_op_friendly(operation->op));
+		print_cfg(t, operation->cfg, operation->op == CFG_DEL);
+	}
+}
+
 void print_head(enum LogThreshold t, enum InfoEvent event, struct Head *head) {
-	if (!head)
+	if (!head || !log_enabled(t, true))
 		return;
 
 	switch (event) {
@@ -297,6 +313,9 @@ void print_head(enum LogThreshold t, enum InfoEvent event, struct Head *head) {
 }
 
 void print_heads(enum LogThreshold t, enum InfoEvent event, struct SList *heads) {
+	if (!log_enabled(t, true))
+		return;
+
 	for (struct SList *i = heads; i; i = i->nex) {
 		print_head(t, event, i->val);
 	}
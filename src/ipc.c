@@ -1,88 +1,210 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "ipc.h"
 
 #include "cfg.h"
+#include "convert.h"
+#include "list.h"
 #include "log.h"
 #include "marshalling.h"
 #include "sockets.h"
+#include "stats.h"
+#include "tlv.h"
 
 void ipc_send_request(struct IpcRequest *request) {
+	char *buf = NULL;
+	size_t len = 0;
+
+	if (request->encoding == IPC_ENCODING_TLV) {
+		buf = marshal_ipc_request_tlv(request, &len);
+		if (buf) {
+			log_debug_nocap("========sending server request==========\n%s %zu bytes TLV\n----------------------------------------", ipc_request_op_name(request->op), len);
+		}
+	} else {
+		buf = marshal_ipc_request(request);
+		if (buf) {
+			len = strlen(buf);
+			log_debug_nocap("========sending server request==========\n%s\n----------------------------------------", buf);
+		}
+	}
 
-	char *yaml = marshal_ipc_request(request);
-	if (!yaml) {
+	if (!buf) {
 		goto end;
 	}
 
-	log_debug_nocap("========sending server request==========\n%s\n----------------------------------------", yaml);
-
 	if ((request->socket_client = create_socket_client()) == -1) {
 		goto end;
 	}
 
-	if (socket_write(request->socket_client, yaml, strlen(yaml)) == -1) {
+	if (socket_write(request->socket_client, buf, len) == -1) {
 		request->socket_client = -1;
 		goto end;
 	}
 
 end:
-	if (yaml) {
-		free(yaml);
+	if (buf) {
+		free(buf);
 	}
 }
 
 void ipc_send_response(struct IpcResponse *response) {
-	char *yaml = marshal_ipc_response(response);
+	struct SocketBuf buf = { .socket = response->socket_client, .memfd_threshold = response->memfd_threshold, };
+	bool marshalled = false;
+
+	switch (response->encoding) {
+		case IPC_ENCODING_TLV:
+			marshalled = marshal_ipc_response_tlv_stream(response, &buf);
+			break;
+		case IPC_ENCODING_JSON:
+			marshalled = marshal_ipc_response_json_stream(response, &buf);
+			break;
+		case IPC_ENCODING_YAML:
+		default:
+			marshalled = marshal_ipc_response_stream(response, &buf);
+			break;
+	}
 
-	if (!yaml) {
+	// a partial document is not completed; closing the connection aborts it
+	if (!marshalled) {
+		buf.failed = true;
+	}
+
+	if (!socket_buf_flush(&buf)) {
 		response->done = true;
-		return;
 	}
 
-	log_debug_nocap("========sending client response==========\n%s----------------------------------------", yaml);
+	stats_add(STATS_BYTES_MARSHALLED, buf.written);
 
-	if (socket_write(response->socket_client, yaml, strlen(yaml)) == -1) {
-		response->done = true;
+	log_debug_nocap("========sent client response=============\n%zu bytes %s\n----------------------------------------", buf.written, ipc_encoding_name(response->encoding ? response->encoding : IPC_ENCODING_DEFAULT));
+}
+
+char *ipc_receive_raw_client(int socket_client, size_t *len, int *fd) {
+	char *buf = NULL;
+	size_t n = 0;
+
+	if (!(buf = socket_read_fd(socket_client, &n, fd))) {
+		close(socket_client);
+		return NULL;
 	}
 
-	free(yaml);
+	// the marker that carried the fd is the last read
+	if (fd && *fd != -1) {
+		if (n < SOCKET_MEMFD_MARKER_LEN || memcmp(buf + n - SOCKET_MEMFD_MARKER_LEN, SOCKET_MEMFD_MARKER, SOCKET_MEMFD_MARKER_LEN) != 0) {
+			log_error("\nInvalid memfd marker");
+			close(*fd);
+			*fd = -1;
+		} else {
+			n -= SOCKET_MEMFD_MARKER_LEN;
+			buf[n] = '\0';
+		}
+	}
+
+	if (len) {
+		*len = n;
+	}
+
+	return buf;
 }
 
-char *ipc_receive_raw_client(int socket_client) {
-	char *yaml = NULL;
+char *ipc_map_memfd(int fd, size_t *len) {
+	char *buf = NULL;
+
+	// the server can no longer change it
+	int seals = fcntl(fd, F_GET_SEALS);
+	if (seals == -1 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) != (F_SEAL_SHRINK | F_SEAL_WRITE)) {
+		log_error("\nmemfd not sealed");
+		goto end;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size < 1) {
+		log_error("\nmemfd empty");
+		goto end;
+	}
 
-	if (!(yaml = socket_read(socket_client))) {
+	void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapped == MAP_FAILED) {
+		log_error_errno("\nmemfd mmap failed");
+		goto end;
+	}
+
+	*len = st.st_size - 1;
+	buf = mapped;
+
+	if (buf[*len] != '\0') {
+		log_error("\nmemfd not terminated");
+		munmap(mapped, st.st_size);
+		buf = NULL;
+	}
+
+end:
+	close(fd);
+	return buf;
+}
+
+void ipc_unmap_memfd(char *buf, size_t len) {
+	if (buf) {
+		munmap(buf, len + 1);
+	}
+}
+
+// a response passed as a memfd, mapped
+char *ipc_receive_memfd_client(int socket_client, size_t *len) {
+	char marker[SOCKET_MEMFD_MARKER_LEN];
+
+	int fd = socket_read_n_fd(socket_client, marker, sizeof(marker));
+	if (fd == -1) {
 		close(socket_client);
 		return NULL;
 	}
 
-	return yaml;
+	char *buf = ipc_map_memfd(fd, len);
+	if (!buf) {
+		close(socket_client);
+	}
+
+	return buf;
 }
 
 struct IpcRequest *ipc_receive_request_server(int socket_server) {
 	struct IpcRequest *request = NULL;
 	int socket_client = -1;
-	char *yaml = NULL;
+	char *buf = NULL;
+	size_t len = 0;
 
 	if ((socket_client = socket_accept(socket_server)) == -1) {
 		return NULL;
 	}
 
-	if (!(yaml = ipc_receive_raw_client(socket_client))) {
+	if (!(buf = ipc_receive_raw_client(socket_client, &len, NULL))) {
 		return NULL;
 	}
 
-	log_debug_nocap("========received client request=========\n%s\n----------------------------------------", yaml);
+	enum IpcEncoding encoding = tlv_is_message(buf, len) ? IPC_ENCODING_TLV : IPC_ENCODING_YAML;
+
+	if (encoding == IPC_ENCODING_TLV) {
+		log_debug_nocap("========received client request=========\n%zu bytes TLV\n----------------------------------------", len);
 
-	request = unmarshal_ipc_request(yaml);
-	free(yaml);
+		request = unmarshal_ipc_request_tlv(buf, len);
+	} else {
+		log_debug_nocap("========received client request=========\n%s\n----------------------------------------", buf);
+
+		request = unmarshal_ipc_request(buf);
+	}
+	free(buf);
 
 	if (!request) {
 		request = (struct IpcRequest*)calloc(1, sizeof(struct IpcRequest));
 		request->bad = true;
+		request->encoding = encoding;
 		request->socket_client = socket_client;
 		return request;
 	}
@@ -92,22 +214,171 @@ struct IpcRequest *ipc_receive_request_server(int socket_server) {
 	return request;
 }
 
+// offset past the root RC line that ends a YAML response, 0 until received
+// lines from scanned onwards are examined, scanned is advanced past complete lines
+size_t yaml_response_end(const char *buf, size_t len, size_t *scanned) {
+	const char *eol;
+
+	while (*scanned < len && (eol = memchr(buf + *scanned, '\n', len - *scanned))) {
+		size_t bol = *scanned;
+		*scanned = eol - buf + 1;
+
+		if (*scanned - bol > 4 && memcmp(buf + bol, "RC: ", 4) == 0) {
+			return *scanned;
+		}
+	}
+
+	return 0;
+}
+
+// one complete YAML response, as it may be streamed in many writes
+// the next response is left unread
+char *ipc_receive_yaml_client(int socket_client, size_t *len) {
+	size_t size = SOCKET_BUF_SIZE + 1;
+	char *buf = malloc(size);
+	size_t scanned = 0;
+	size_t end = 0;
+
+	*len = 0;
+
+	while (!end) {
+		if (*len + SOCKET_BUF_SIZE + 1 > size) {
+			size *= 2;
+			buf = realloc(buf, size);
+		}
+
+		// peek, consuming only up to the end of this response
+		ssize_t r = recv(socket_client, buf + *len, SOCKET_BUF_SIZE, MSG_PEEK);
+		if (r == -1 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			if (r == -1 && errno == EAGAIN) {
+				log_error("\nSocket read timeout");
+			} else if (r == -1) {
+				log_error_errno("\nSocket recv failed");
+			} else if (*len) {
+				log_error("\nYAML response truncated after %zu bytes", *len);
+			}
+			free(buf);
+			close(socket_client);
+			return NULL;
+		}
+
+		end = yaml_response_end(buf, *len + r, &scanned);
+
+		size_t n = end ? end - *len : (size_t)r;
+		if (!socket_read_n(socket_client, buf + *len, n)) {
+			free(buf);
+			close(socket_client);
+			return NULL;
+		}
+		*len += n;
+	}
+
+	buf[*len] = '\0';
+
+	return buf;
+}
+
+// one complete message, as a response may arrive in many writes
+char *ipc_receive_tlv_client(int socket_client, size_t *len) {
+	size_t size = 1024;
+	char *buf = malloc(size);
+	size_t need = 0;
+	bool valid;
+
+	*len = 0;
+
+	while ((valid = tlv_message_need(buf, *len, &need)) && need) {
+		if (*len + need > size) {
+			while (*len + need > size) {
+				size *= 2;
+			}
+			buf = realloc(buf, size);
+		}
+
+		if (!socket_read_n(socket_client, buf + *len, need)) {
+			free(buf);
+			close(socket_client);
+			return NULL;
+		}
+
+		*len += need;
+	}
+
+	if (!valid) {
+		log_error("\nInvalid TLV response");
+		free(buf);
+		close(socket_client);
+		return NULL;
+	}
+
+	return buf;
+}
+
 struct IpcResponse *ipc_receive_response_client(int socket_client) {
 	struct IpcResponse *response = NULL;
-	char *yaml = NULL;
+	char *buf = NULL;
+	size_t len = 0;
+
+	char peek[SOCKET_MEMFD_MARKER_LEN];
+	bool peeked = recv(socket_client, peek, sizeof(peek), MSG_PEEK | MSG_WAITALL) == sizeof(peek);
+	bool memfd = peeked && memcmp(peek, SOCKET_MEMFD_MARKER, SOCKET_MEMFD_MARKER_LEN) == 0;
+	bool tlv = false;
+
+	if (memfd) {
+		buf = ipc_receive_memfd_client(socket_client, &len);
+		tlv = buf && tlv_is_message(buf, len);
+	} else if (peeked && memcmp(peek, TLV_MAGIC, TLV_MAGIC_LEN) == 0) {
+		tlv = true;
+		buf = ipc_receive_tlv_client(socket_client, &len);
+	} else {
+		buf = ipc_receive_yaml_client(socket_client, &len);
+	}
 
-	if (!(yaml = ipc_receive_raw_client(socket_client))) {
+	if (!buf) {
 		return NULL;
 	}
 
-	log_debug_nocap("========received server response========\n%s\n----------------------------------------", yaml);
+	if (tlv) {
+		log_debug_nocap("========received server response========\n%zu bytes TLV%s\n----------------------------------------", len, memfd ? " memfd" : "");
+
+		response = unmarshal_ipc_response_tlv(buf, len);
+	} else {
+		log_debug_nocap("========received server response========\n%s\n----------------------------------------", buf);
 
-	response = unmarshal_ipc_response(yaml);
-	free(yaml);
+		response = unmarshal_ipc_response(buf);
+	}
+
+	if (memfd) {
+		ipc_unmap_memfd(buf, len);
+	} else {
+		free(buf);
+	}
 
 	return response;
 }
 
+bool ipc_peek_tlv_client(int socket_client) {
+	char peek[SOCKET_MEMFD_MARKER_LEN];
+	if (recv(socket_client, peek, sizeof(peek), MSG_PEEK | MSG_WAITALL) != sizeof(peek)) {
+		return false;
+	}
+
+	return memcmp(peek, TLV_MAGIC, TLV_MAGIC_LEN) == 0 ||
+		memcmp(peek, SOCKET_MEMFD_MARKER, SOCKET_MEMFD_MARKER_LEN) == 0;
+}
+
+struct IpcOperation *ipc_operation_init(enum IpcRequestOperation op, struct Cfg *cfg) {
+	struct IpcOperation *operation = (struct IpcOperation*)calloc(1, sizeof(struct IpcOperation));
+
+	operation->op = op;
+	operation->cfg = cfg;
+
+	return operation;
+}
+
 void ipc_request_free(struct IpcRequest *request) {
 	if (!request) {
 		return;
@@ -115,14 +386,54 @@ void ipc_request_free(struct IpcRequest *request) {
 
 	cfg_free(request->cfg);
 
+	slist_free_vals(&request->ops, ipc_operation_free);
+
 	free(request);
 }
 
+void ipc_operation_free(void *data) {
+	struct IpcOperation *operation = (struct IpcOperation*)data;
+
+	if (!operation) {
+		return;
+	}
+
+	cfg_free(operation->cfg);
+
+	free(operation);
+}
+
+void ipc_response_rc_message(struct IpcResponse *response, enum LogThreshold threshold) {
+	if (threshold == WARNING && response->rc < IPC_RC_WARN) {
+		response->rc = IPC_RC_WARN;
+	}
+	if (threshold == ERROR && response->rc < IPC_RC_ERROR) {
+		response->rc = IPC_RC_ERROR;
+	}
+}
+
 void ipc_response_free(struct IpcResponse *response) {
 	if (!response) {
 		return;
 	}
 
+	free(response->trace_events);
+	free(response->stats_values);
+
+	slist_free_vals(&response->evaluation, ipc_evaluation_free);
+
 	free(response);
 }
 
+void ipc_evaluation_free(void *data) {
+	struct IpcEvaluation *evaluation = (struct IpcEvaluation*)data;
+
+	if (!evaluation) {
+		return;
+	}
+
+	free(evaluation->name);
+
+	free(evaluation);
+}
+
@@ -0,0 +1,180 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+#include "sockets.h"
+
+void json_reserve(struct JsonWriter *w, size_t n) {
+	if (w->len + n + 1 <= w->size) {
+		return;
+	}
+
+	size_t size = w->size ? w->size : 1024;
+	while (size < w->len + n + 1) {
+		size *= 2;
+	}
+
+	w->buf = realloc(w->buf, size);
+	w->size = size;
+}
+
+void json_raw(struct JsonWriter *w, const char *raw, size_t len) {
+	if (w->out) {
+		socket_buf_write(w->out, raw, len);
+		return;
+	}
+
+	json_reserve(w, len);
+	memcpy(w->buf + w->len, raw, len);
+	w->len += len;
+	w->buf[w->len] = '\0';
+}
+
+void json_string(struct JsonWriter *w, const char *str) {
+	static const char hex[] = "0123456789abcdef";
+
+	json_raw(w, "\"", 1);
+
+	const char *run = str;
+	for (const char *c = str; *c; c++) {
+		char esc[7] = { '\\', *c, };
+		size_t esc_len = 2;
+
+		switch (*c) {
+			case '"':
+			case '\\':
+				break;
+			case '\n':
+				esc[1] = 'n';
+				break;
+			case '\t':
+				esc[1] = 't';
+				break;
+			default:
+				if ((unsigned char)*c >= 0x20) {
+					continue;
+				}
+				memcpy(esc + 1, "u00", 3);
+				esc[4] = hex[(*c >> 4) & 0xf];
+				esc[5] = hex[*c & 0xf];
+				esc_len = 6;
+				break;
+		}
+
+		json_raw(w, run, c - run);
+		json_raw(w, esc, esc_len);
+		run = c + 1;
+	}
+
+	json_raw(w, run, strlen(run));
+	json_raw(w, "\"", 1);
+}
+
+// separator and key for the next value
+void json_key(struct JsonWriter *w, const char *key) {
+	if (w->depth && !w->first) {
+		json_raw(w, ",", 1);
+	}
+	w->first = false;
+
+	if (key) {
+		json_string(w, key);
+		json_raw(w, ":", 1);
+	}
+}
+
+void json_number(struct JsonWriter *w, const char *key, double val, int precision) {
+	json_key(w, key);
+
+	if (!isfinite(val)) {
+		json_raw(w, "null", 4);
+		return;
+	}
+
+	char num[32];
+	int len = snprintf(num, sizeof(num), "%.*g", precision, val);
+	json_raw(w, num, len);
+}
+
+void json_object_begin(struct JsonWriter *w, const char *key) {
+	json_key(w, key);
+	json_raw(w, "{", 1);
+	w->depth++;
+	w->first = true;
+}
+
+void json_object_end(struct JsonWriter *w) {
+	json_raw(w, "}", 1);
+	w->depth--;
+	w->first = false;
+}
+
+void json_array_begin(struct JsonWriter *w, const char *key) {
+	json_key(w, key);
+	json_raw(w, "[", 1);
+	w->depth++;
+	w->first = true;
+}
+
+void json_array_end(struct JsonWriter *w) {
+	json_raw(w, "]", 1);
+	w->depth--;
+	w->first = false;
+}
+
+void json_put_int(struct JsonWriter *w, const char *key, int64_t val) {
+	json_key(w, key);
+
+	char num[24];
+	int len = snprintf(num, sizeof(num), "%" PRId64, val);
+	json_raw(w, num, len);
+}
+
+void json_put_bool(struct JsonWriter *w, const char *key, bool val) {
+	json_key(w, key);
+
+	if (val) {
+		json_raw(w, "true", 4);
+	} else {
+		json_raw(w, "false", 5);
+	}
+}
+
+void json_put_str(struct JsonWriter *w, const char *key, const char *str) {
+	json_key(w, key);
+
+	if (str) {
+		json_string(w, str);
+	} else {
+		json_raw(w, "null", 4);
+	}
+}
+
+void json_put_float(struct JsonWriter *w, const char *key, float val) {
+	json_number(w, key, val, 9);
+}
+
+void json_put_double(struct JsonWriter *w, const char *key, double val) {
+	json_number(w, key, val, 17);
+}
+
+char *json_end(struct JsonWriter *w) {
+	json_raw(w, "\n", 1);
+
+	char *buf = w->buf;
+
+	w->buf = NULL;
+	w->len = 0;
+	w->size = 0;
+	w->depth = 0;
+	w->first = false;
+
+	return buf;
+}
+
@@ -11,15 +11,18 @@
 #include "global.h"
 #include "head.h"
 #include "info.h"
+#include "ipc.h"
 #include "lid.h"
 #include "list.h"
 #include "listeners.h"
 #include "log.h"
 #include "mode.h"
 #include "process.h"
+#include "stats.h"
+#include "trace.h"
 #include "wlr-output-management-unstable-v1.h"
 
-void position_heads(struct SList *heads) {
+void position_heads(struct Cfg *cfg, struct SList *heads) {
 	struct Head *head;
 	int32_t tallest = 0, widest = 0, x = 0, y = 0;
 
@@ -88,36 +91,30 @@ void position_heads(struct SList *heads) {
 	}
 }
 
-struct SList *order_heads(struct SList *order_name_desc, struct SList *heads) {
+struct SList *order_heads(const struct Matchers *order, struct SList *heads) {
 	if (!heads)
 		return NULL;
 
-	unsigned long n_order = slist_length(order_name_desc);
-	unsigned long i;
+	size_t n_order = order ? order->len : 0;
+	size_t i;
 	struct SList *sorting = slist_shallow_clone(heads);
 
 	// array of order to list of heads matched
 	struct SList **order_heads = calloc(n_order, sizeof(struct SList*));
 
 	// exact match
-	i = 0;
-	for (struct SList *o = order_name_desc; o; o = o->nex) {
-		slist_move(&order_heads[i], &sorting, head_matches_name_desc_exact, o->val);
-		i++;
+	for (i = 0; i < n_order; i++) {
+		slist_move(&order_heads[i], &sorting, head_matches_exact, &order->matchers[i]);
 	}
 
 	// regex
-	i = 0;
-	for (struct SList *o = order_name_desc; o; o = o->nex) {
-		slist_move(&order_heads[i], &sorting, head_matches_name_desc_regex, o->val);
-		i++;
+	for (i = 0; i < n_order; i++) {
+		slist_move(&order_heads[i], &sorting, head_matches_regex, &order->matchers[i]);
 	}
 
 	// fuzzy
-	i = 0;
-	for (struct SList *o = order_name_desc; o; o = o->nex) {
-		slist_move(&order_heads[i], &sorting, head_matches_name_desc_fuzzy, o->val);
-		i++;
+	for (i = 0; i < n_order; i++) {
+		slist_move(&order_heads[i], &sorting, head_matches_fuzzy, &order->matchers[i]);
 	}
 
 	// marshal the ordered
@@ -141,19 +138,19 @@ struct SList *order_heads(struct SList *order_name_desc, struct SList *heads) {
 	return sorted;
 }
 
-void desire_enabled(struct Head *head) {
+void desire_enabled(const struct LayoutState *state, struct Head *head) {
 
 	// lid closed
-	head->desired.enabled = !lid_is_closed(head->name);
+	head->desired.enabled = !lid_is_closed(state->cfg, head->name);
 
 	// ignore lid closed when there is only the laptop display, for smoother sleeping
-	head->desired.enabled |= slist_length(heads) == 1;
+	head->desired.enabled |= slist_length(state->heads) == 1;
 
 	// explicitly disabled
-	head->desired.enabled &= slist_find_equal(cfg->disabled_name_desc, head_name_desc_matches_head, head) == NULL;
+	head->desired.enabled &= head_match(&cfg_compiled(state->cfg)->disabled, head) == NULL;
 }
 
-void desire_mode(struct Head *head) {
+void desire_mode(const struct LayoutState *state, struct Head *head) {
 	head->desired.mode = NULL;
 
 	if (!head->desired.enabled) {
@@ -161,13 +158,13 @@ void desire_mode(struct Head *head) {
 	}
 
 	// attempt to find a mode
-	struct Mode *mode = head_find_mode(head);
+	struct Mode *mode = head_find_mode(state->cfg, head, !state->evaluate);
 
 	if (mode) {
 		head->desired.mode = mode;
 	} else {
 
-		if (!head->warned_no_mode) {
+		if (!state->evaluate && !head->warned_no_mode) {
 			log_warn("\nNo mode for %s, disabling.", head->name);
 			print_head(WARNING, NONE, head);
 			head->warned_no_mode = true;
@@ -177,7 +174,7 @@ void desire_mode(struct Head *head) {
 	}
 }
 
-void desire_scale(struct Head *head) {
+void desire_scale(const struct LayoutState *state, struct Head *head) {
 	head->desired.scale = 0;
 
 	if (!head->desired.enabled) {
@@ -185,24 +182,21 @@ void desire_scale(struct Head *head) {
 	}
 
 	// user scale first
-	struct UserScale *user_scale;
-	for (struct SList *i = cfg->user_scales; i; i = i->nex) {
-		user_scale = (struct UserScale*)i->val;
-		if (head_matches_name_desc(head, user_scale->name_desc)) {
-			head->desired.scale = wl_fixed_from_double(user_scale->scale);
-			return;
-		}
+	const struct Matcher *matcher = head_match(&cfg_compiled(state->cfg)->user_scales, head);
+	if (matcher) {
+		head->desired.scale = wl_fixed_from_double(((struct UserScale*)matcher->val)->scale);
+		return;
 	}
 
 	// auto or 1
-	if (cfg->auto_scale == ON) {
+	if (state->cfg->auto_scale == ON) {
 		head->desired.scale = head_auto_scale(head);
 	} else {
 		head->desired.scale = wl_fixed_from_int(1);
 	}
 }
 
-void desire_adaptive_sync(struct Head *head) {
+void desire_adaptive_sync(const struct LayoutState *state, struct Head *head) {
 	head->desired.adaptive_sync = ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_DISABLED;
 
 	if (!head->desired.enabled) {
@@ -213,33 +207,122 @@ void desire_adaptive_sync(struct Head *head) {
 		return;
 	}
 
-	if (!slist_find_equal(cfg->adaptive_sync_off_name_desc, head_name_desc_matches_head, head)) {
+	if (!head_match(&cfg_compiled(state->cfg)->adaptive_sync_off, head)) {
 		head->desired.adaptive_sync = ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED;
 	}
 }
 
-void desire(void) {
+void desire(const struct LayoutState *state) {
 
-	for (struct SList *i = heads; i; i = i->nex) {
+	for (struct SList *i = state->heads; i; i = i->nex) {
 		struct Head *head = (struct Head*)i->val;
 
 		memcpy(&head->desired, &head->current, sizeof(struct HeadState));
+		if (!state->evaluate) {
+			stats_inc(STATS_DESIRES);
+		}
 
-		desire_enabled(head);
-		desire_mode(head);
-		desire_scale(head);
-		desire_adaptive_sync(head);
+		desire_enabled(state, head);
+		desire_mode(state, head);
+		desire_scale(state, head);
+		desire_adaptive_sync(state, head);
 
 		head_scaled_dimensions(head);
 	}
 
-	struct SList *heads_ordered = order_heads(cfg->order_name_desc, heads);
+	struct SList *heads_ordered = order_heads(&cfg_compiled(state->cfg)->order, state->heads);
 
-	position_heads(heads_ordered);
+	position_heads(state->cfg, heads_ordered);
 
 	slist_free(&heads_ordered);
 }
 
+struct IpcEvaluation *evaluation_of(const struct Head *head) {
+	struct IpcEvaluation *evaluation = (struct IpcEvaluation*)calloc(1, sizeof(struct IpcEvaluation));
+
+	evaluation->name = head->name ? strdup(head->name) : NULL;
+	evaluation->enabled = head->desired.enabled;
+	if (head->desired.mode) {
+		evaluation->width = head->desired.mode->width;
+		evaluation->height = head->desired.mode->height;
+		evaluation->refresh_mhz = head->desired.mode->refresh_mhz;
+	}
+	evaluation->scale = wl_fixed_to_double(head->desired.scale);
+	evaluation->x = head->desired.x;
+	evaluation->y = head->desired.y;
+	evaluation->adaptive_sync = head->desired.adaptive_sync == ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED;
+
+	return evaluation;
+}
+
+struct SList *layout_evaluate(struct Cfg *cfg) {
+	struct LayoutState state = { .cfg = cfg, .evaluate = true, };
+
+	for (struct SList *i = heads; i; i = i->nex) {
+		struct Head *head = (struct Head*)malloc(sizeof(struct Head));
+		memcpy(head, i->val, sizeof(struct Head));
+
+		// not marshalled
+		head->marshalled.yaml = NULL;
+
+		slist_append(&state.heads, head);
+	}
+
+	// matched by the shared predicates, which always count
+	unsigned long regex_evals = stats.counters[STATS_REGEX_EVALS];
+
+	desire(&state);
+
+	stats.counters[STATS_REGEX_EVALS] = regex_evals;
+
+	if (slist_find(state.heads, head_current_not_desired)) {
+		print_heads(INFO, DELTA, state.heads);
+	} else {
+		log_info("\nNo changes to make.");
+	}
+
+	// the copies refer to heads and modes that may not outlive the response
+	struct SList *evaluation = NULL;
+	for (struct SList *i = state.heads; i; i = i->nex) {
+		slist_append(&evaluation, evaluation_of(i->val));
+	}
+
+	slist_free_vals(&state.heads, NULL);
+
+	return evaluation;
+}
+
+void trace_delta(struct Head *head) {
+	struct TraceEvent *event = trace_event(TRACE_DELTA, displ->serial, head->name);
+
+	if (head->desired.enabled != head->current.enabled) {
+		event->delta |= TRACE_DELTA_ENABLED;
+	}
+	if (head->desired.mode != head->current.mode) {
+		event->delta |= TRACE_DELTA_MODE;
+	}
+	if (head->desired.scale != head->current.scale) {
+		event->delta |= TRACE_DELTA_SCALE;
+	}
+	if (head->desired.x != head->current.x || head->desired.y != head->current.y) {
+		event->delta |= TRACE_DELTA_POSITION;
+	}
+	if (head->desired.adaptive_sync != head->current.adaptive_sync) {
+		event->delta |= TRACE_DELTA_VRR;
+	}
+
+	if (head->desired.mode) {
+		event->desired.width = head->desired.mode->width;
+		event->desired.height = head->desired.mode->height;
+		event->desired.refresh_mhz = head->desired.mode->refresh_mhz;
+	}
+	event->desired.scale = head->desired.scale;
+	event->desired.x = head->desired.x;
+	event->desired.y = head->desired.y;
+	event->desired.enabled = head->desired.enabled;
+	event->desired.adaptive_sync = head->desired.adaptive_sync == ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED;
+}
+
 void apply(void) {
 	struct SList *heads_changing = NULL;
 	head_changing_mode = NULL;
@@ -247,18 +330,26 @@ void apply(void) {
 
 	// determine whether changes are needed before initiating output configuration
 	struct SList *i = heads;
-	while ((i = slist_find(i, head_current_not_desired))) {
-		slist_append(&heads_changing, i->val);
+	// rolled back changes are not retried until their desired state changes
+	while ((i = slist_find(i, head_current_not_desired_retry))) {
+		struct Head *head = i->val;
+		head->has_failed = false;
+		slist_append(&heads_changing, head);
 		i = i->nex;
 	}
 	if (!heads_changing)
 		return;
 
+	uint32_t changing = 0;
+	for (i = heads_changing; i; i = i->nex, changing++) {
+		trace_delta(i->val);
+	}
+
 	// passed into our configuration listener
 	struct zwlr_output_configuration_v1 *zwlr_config = zwlr_output_manager_v1_create_configuration(displ->output_manager, displ->serial);
 	zwlr_output_configuration_v1_add_listener(zwlr_config, output_configuration_listener(), displ);
 
-	if ((head_changing_mode = slist_find_val(heads, head_current_mode_not_desired))) {
+	if ((head_changing_mode = slist_find_val(heads_changing, head_current_mode_not_desired))) {
 
 		print_head(INFO, DELTA, head_changing_mode);
 
@@ -266,7 +357,7 @@ void apply(void) {
 		head_changing_mode->zwlr_config_head = zwlr_output_configuration_v1_enable_head(zwlr_config, head_changing_mode->zwlr_head);
 		zwlr_output_configuration_head_v1_set_mode(head_changing_mode->zwlr_config_head, head_changing_mode->desired.mode->zwlr_mode);
 
-	} else if ((head_changing_adaptive_sync = slist_find_val(heads, head_current_adaptive_sync_not_desired))) {
+	} else if ((head_changing_adaptive_sync = slist_find_val(heads_changing, head_current_adaptive_sync_not_desired))) {
 
 		print_head(INFO, DELTA, head_changing_adaptive_sync);
 
@@ -294,12 +385,95 @@ void apply(void) {
 
 	zwlr_output_configuration_v1_apply(zwlr_config);
 
+	trace_event(TRACE_APPLY, displ->serial, NULL)->heads = changing;
+	stats_apply(head_changing_mode != NULL);
+
 	displ->config_state = OUTSTANDING;
 
 	slist_free(&heads_changing);
 }
 
+// apply the last good state of all heads in one configuration, false when not possible
+// heads that have not settled e.g. just arrived keep their current state
+bool rollback(void) {
+	if (displ->rollbacks >= ROLLBACK_ATTEMPTS_MAX) {
+		log_error("\nRollback failed %u times, giving up", displ->rollbacks);
+		return false;
+	}
+
+	uint32_t restoring = slist_length(heads);
+	if (!restoring) {
+		log_error("\nNo good configuration to roll back to");
+		return false;
+	}
+
+	head_changing_mode = NULL;
+	head_changing_adaptive_sync = NULL;
+
+	struct zwlr_output_configuration_v1 *zwlr_config = zwlr_output_manager_v1_create_configuration(displ->output_manager, displ->serial);
+	zwlr_output_configuration_v1_add_listener(zwlr_config, output_configuration_listener(), displ);
+
+	bool modeset = false;
+	for (struct SList *i = heads; i; i = i->nex) {
+		struct Head *head = i->val;
+		const struct HeadState *good = head->has_last_good ? &head->last_good : &head->current;
+
+		// not retried until desired changes
+		if (!displ->rolling_back) {
+			head->failed = head->desired;
+			head->has_failed = true;
+		}
+
+		if (good->enabled) {
+			head->zwlr_config_head = zwlr_output_configuration_v1_enable_head(zwlr_config, head->zwlr_head);
+			if (good->mode) {
+				modeset |= good->mode != head->current.mode;
+				zwlr_output_configuration_head_v1_set_mode(head->zwlr_config_head, good->mode->zwlr_mode);
+			}
+			zwlr_output_configuration_head_v1_set_scale(head->zwlr_config_head, good->scale);
+			zwlr_output_configuration_head_v1_set_position(head->zwlr_config_head, good->x, good->y);
+			if (good->adaptive_sync != head->current.adaptive_sync) {
+				zwlr_output_configuration_head_v1_set_adaptive_sync(head->zwlr_config_head, good->adaptive_sync);
+			}
+		} else {
+			zwlr_output_configuration_v1_disable_head(zwlr_config, head->zwlr_head);
+		}
+	}
+
+	zwlr_output_configuration_v1_apply(zwlr_config);
+
+	displ->rollbacks++;
+	displ->rolling_back = true;
+	displ->config_state = OUTSTANDING;
+
+	log_warn("\nRolling back to the last good configuration, attempt %u of %u", displ->rollbacks, ROLLBACK_ATTEMPTS_MAX);
+
+	trace_event(TRACE_ROLLBACK, displ->serial, NULL)->heads = restoring;
+	stats_apply(modeset);
+	stats_inc(STATS_ROLLBACKS);
+
+	return true;
+}
+
+// record the settled state of all heads
+void settle_last_good(void) {
+	for (struct SList *i = heads; i; i = i->nex) {
+		struct Head *head = i->val;
+		head->last_good = head->current;
+		head->has_last_good = true;
+	}
+	displ->rollbacks = 0;
+}
+
 void handle_success(void) {
+	displ->rollbacks = 0;
+
+	if (displ->rolling_back) {
+		displ->rolling_back = false;
+		log_warn("\nRolled back to the last good configuration");
+		return;
+	}
+
 	if (head_changing_mode) {
 
 		// succesful mode change is not always reported
@@ -332,6 +506,7 @@ void handle_failure(void) {
 		log_error("  %s:", head_changing_mode->name);
 		print_mode(ERROR, head_changing_mode->desired.mode);
 		slist_append(&head_changing_mode->modes_failed, head_changing_mode->desired.mode);
+		stats_inc(STATS_MODES_FAILED);
 
 		// current mode may be misreported
 		head_changing_mode->current.mode = NULL;
@@ -347,15 +522,26 @@ void handle_failure(void) {
 		head_changing_adaptive_sync = NULL;
 
 	} else {
-		log_error("\nChanges failed");
+		log_error(displ->rolling_back ? "\nRollback failed" : "\nChanges failed");
 
-		// any other failures are fatal
-		wd_exit_message(EXIT_FAILURE);
+		// restore the last good state, fatal when that is not possible
+		if (!rollback()) {
+			wd_exit_message(EXIT_FAILURE);
+		}
 	}
 }
 
 void layout(void) {
 
+	// hotplug, until applied
+	if (heads_arrived || heads_departed) {
+		log_event_start();
+	}
+
+	for (struct SList *i = heads_arrived; i; i = i->nex) {
+		trace_event(TRACE_HEAD_ARRIVED, displ->serial, ((struct Head*)i->val)->name);
+	}
+
 	print_heads(INFO, ARRIVED, heads_arrived);
 	slist_free(&heads_arrived);
 
@@ -370,16 +556,29 @@ void layout(void) {
 
 		case OUTSTANDING:
 			// wait
+			stats_inc(STATS_LAYOUTS_SKIPPED);
 			return;
 
 		case FAILED:
-			handle_failure();
 			displ->config_state = IDLE;
+			handle_failure();
+			if (displ->config_state == OUTSTANDING) {
+				// rolling back
+				return;
+			}
 			break;
 
 		case CANCELLED:
 			log_warn("\nChanges cancelled, retrying");
+			if (displ->rolling_back) {
+				// rollback not applied, retry the failed changes as usual
+				for (struct SList *i = heads; i; i = i->nex) {
+					((struct Head*)i->val)->has_failed = false;
+				}
+				displ->rolling_back = false;
+			}
 			displ->config_state = IDLE;
+			stats_inc(STATS_LAYOUTS_SKIPPED);
 			return;
 
 		case IDLE:
@@ -387,7 +586,22 @@ void layout(void) {
 			break;
 	}
 
-	desire();
+	stats_inc(STATS_LAYOUTS);
+
+	struct LayoutState state = { .cfg = cfg, .heads = heads, };
+	desire(&state);
+	stats_desire();
+
 	apply();
+
+	if (displ->config_state == IDLE) {
+		settle_last_good();
+		log_event_stop();
+		stats_settled();
+	}
+}
+
+bool layout_settled(void) {
+	return displ->config_state == IDLE && !slist_find(heads, head_current_not_desired_retry);
 }
 
@@ -202,7 +202,7 @@ void lid_init(void) {
 	lid->libinput_monitor = libinput_monitor;
 }
 
-bool lid_is_closed(char *name) {
+bool lid_is_closed(struct Cfg *cfg, char *name) {
 	if (!name)
 		return false;
 
@@ -147,11 +147,18 @@ unsigned long slist_remove_all_free(struct SList **head, bool (*predicate)(const
 }
 
 struct SList *slist_shallow_clone(struct SList *head) {
-	struct SList *c, *i;
+	return slist_clone(head, NULL);
+}
 
-	c = NULL;
-	for (i = head; i; i = i->nex) {
-		slist_append(&c, i->val);
+struct SList *slist_clone(struct SList *head, void *(*clone_val)(const void *val)) {
+	struct SList *c = NULL;
+	struct SList **tail = &c;
+
+	// append at the tail rather than walking the clone
+	for (struct SList *i = head; i; i = i->nex) {
+		*tail = calloc(1, sizeof(struct SList));
+		(*tail)->val = clone_val ? clone_val(i->val) : i->val;
+		tail = &(*tail)->nex;
 	}
 
 	return c;
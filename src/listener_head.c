@@ -5,9 +5,14 @@
 
 #include "listeners.h"
 
+#include "convert.h"
+#include "displ.h"
+#include "global.h"
 #include "head.h"
 #include "list.h"
 #include "mode.h"
+#include "stats.h"
+#include "trace.h"
 #include "wlr-output-management-unstable-v1.h"
 
 // Head data
@@ -17,7 +22,10 @@ static void name(void *data,
 		const char *name) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->name = strdup(name);
+	head->name_lower = strdup_lower(name);
 }
 
 static void description(void *data,
@@ -25,7 +33,10 @@ static void description(void *data,
 		const char *description) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->description = strdup(description);
+	head->description_lower = strdup_lower(description);
 }
 
 static void physical_size(void *data,
@@ -34,6 +45,8 @@ static void physical_size(void *data,
 		int32_t height) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->width_mm = width;
 	head->height_mm = height;
 }
@@ -43,6 +56,8 @@ static void mode(void *data,
 		struct zwlr_output_mode_v1 *zwlr_output_mode_v1) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	struct Mode *mode = calloc(1, sizeof(struct Mode));
 	mode->head = head;
 	mode->zwlr_mode = zwlr_output_mode_v1;
@@ -57,6 +72,8 @@ static void enabled(void *data,
 		int32_t enabled) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->current.enabled = enabled;
 }
 
@@ -65,6 +82,8 @@ static void current_mode(void *data,
 		struct zwlr_output_mode_v1 *zwlr_output_mode_v1) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	struct Mode *mode = NULL;
 	for (struct SList *i = head->modes; i; i = i->nex) {
 		mode = i->val;
@@ -81,6 +100,8 @@ static void position(void *data,
 		int32_t y) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->current.x = x;
 	head->current.y = y;
 }
@@ -90,6 +111,8 @@ static void transform(void *data,
 		int32_t transform) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->transform = transform;
 }
 
@@ -98,6 +121,8 @@ static void scale(void *data,
 		wl_fixed_t scale) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->current.scale = scale;
 }
 
@@ -106,6 +131,8 @@ static void make(void *data,
 		const char *make) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->make = strdup(make);
 }
 
@@ -114,6 +141,8 @@ static void model(void *data,
 		const char *model) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->model = strdup(model);
 }
 
@@ -122,6 +151,8 @@ static void serial_number(void *data,
 		const char *serial_number) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->serial_number = strdup(serial_number);
 }
 
@@ -130,6 +161,8 @@ static void adaptive_sync(void *data,
 		uint32_t state) {
 	struct Head *head = data;
 
+	head->marshalled.stale = true;
+
 	head->current.adaptive_sync = state;
 }
 
@@ -137,6 +170,9 @@ static void finished(void *data,
 		struct zwlr_output_head_v1 *zwlr_output_head_v1) {
 	struct Head *head = data;
 
+	trace_event(TRACE_HEAD_DEPARTED, displ ? displ->serial : 0, head->name);
+	stats_hotplug();
+
 	// dummy Head, just for printing
 	struct Head *head_departed = calloc(1, sizeof(struct Head));
 	head_departed->name = strdup(head->name);
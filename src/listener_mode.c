@@ -15,6 +15,10 @@ static void size(void *data,
 		int32_t height) {
 	struct Mode *mode = data;
 
+	if (mode->head) {
+		mode->head->marshalled.stale = true;
+	}
+
 	mode->width = width;
 	mode->height = height;
 }
@@ -24,6 +28,10 @@ static void refresh(void *data,
 		int32_t refresh) {
 	struct Mode *mode = data;
 
+	if (mode->head) {
+		mode->head->marshalled.stale = true;
+	}
+
 	mode->refresh_mhz = refresh;
 }
 
@@ -35,6 +43,7 @@ static void preferred(void *data,
 
 	if (mode->head) {
 		mode->head->preferred_mode = mode;
+		mode->head->marshalled.stale = true;
 	}
 }
 
@@ -42,6 +51,10 @@ static void finished(void *data,
 		struct zwlr_output_mode_v1 *zwlr_output_mode_v1) {
 	struct Mode *mode = data;
 
+	if (mode->head) {
+		mode->head->marshalled.stale = true;
+	}
+
 	head_release_mode(mode->head, mode);
 	mode_free(mode);
 
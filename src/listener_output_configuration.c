@@ -5,13 +5,19 @@
 #include "displ.h"
 #include "list.h"
 #include "head.h"
+#include "stats.h"
+#include "trace.h"
 #include "wlr-output-management-unstable-v1.h"
 
 // Displ data
 
 void cleanup(struct Displ *displ,
 		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1,
-		enum ConfigState config_state) {
+		enum ConfigState config_state,
+		enum TraceEventType trace_event_type) {
+
+	trace_event(trace_event_type, displ->serial, NULL);
+	stats_result(config_state);
 
 	for (struct SList *i = heads; i; i = i->nex) {
 		struct Head *head = i->val;
@@ -28,17 +34,17 @@ void cleanup(struct Displ *displ,
 
 static void succeeded(void *data,
 		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1) {
-	cleanup(data, zwlr_output_configuration_v1, SUCCEEDED);
+	cleanup(data, zwlr_output_configuration_v1, SUCCEEDED, TRACE_SUCCEEDED);
 }
 
 static void failed(void *data,
 		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1) {
-	cleanup(data, zwlr_output_configuration_v1, FAILED);
+	cleanup(data, zwlr_output_configuration_v1, FAILED, TRACE_FAILED);
 }
 
 static void cancelled(void *data,
 		struct zwlr_output_configuration_v1 *zwlr_output_configuration_v1) {
-	cleanup(data, zwlr_output_configuration_v1, CANCELLED);
+	cleanup(data, zwlr_output_configuration_v1, CANCELLED, TRACE_CANCELLED);
 }
 
 static const struct zwlr_output_configuration_v1_listener listener = {
@@ -6,6 +6,8 @@
 #include "displ.h"
 #include "head.h"
 #include "list.h"
+#include "stats.h"
+#include "trace.h"
 #include "wlr-output-management-unstable-v1.h"
 
 // Displ data
@@ -22,6 +24,8 @@ static void head(void *data,
 	slist_append(&heads, head);
 	slist_append(&heads_arrived, head);
 
+	stats_hotplug();
+
 	if (displ->output_manager_version == ZWLR_OUTPUT_MANAGER_V1_VERSION_MIN) {
 		zwlr_output_head_v1_add_listener(zwlr_output_head_v1, head_listener_min(), head);
 	} else {
@@ -35,6 +39,8 @@ static void done(void *data,
 	struct Displ *displ = data;
 
 	displ->serial = serial;
+
+	trace_event(TRACE_DONE, serial, NULL);
 }
 
 static void finished(void *data,
@@ -1,14 +1,27 @@
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "log.h"
 
-#include "list.h"
+#include "stats.h"
+
+// the functions, rather than the short circuiting macros
+#undef log_debug
+#undef log_debug_nocap
+#undef log_info
+#undef log_error_nocap
 
 #define LS 16384
 
@@ -27,7 +40,10 @@ struct LogActive active = {
 	.suppressing = false,
 };
 
-struct SList *log_cap_lines = NULL;
+struct LogCap log_cap = { 0 };
+
+struct LogSink log_sink_out = { .fd = STDOUT_FILENO, };
+struct LogSink log_sink_err = { .fd = STDERR_FILENO, };
 
 char threshold_char[] = {
 	'?',
@@ -45,28 +61,275 @@ char *threshold_prefix[] = {
 	"ERROR: ",
 };
 
-void print_time(enum LogThreshold threshold, FILE *__restrict __stream) {
-	static char buf[16];
-	static time_t t;
+// wall clock of monotonic, formatted once per second
+struct LogTime {
+	int64_t offset_ns;
+	time_t sec;
+	char hms[16];
+	// monotonic, 0 when no event
+	int64_t event_ns;
+};
+struct LogTime log_time = { 0 };
 
-	t = time(NULL);
+int64_t monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void print_time(enum LogThreshold threshold, FILE *__restrict __stream) {
+	int64_t now_ns = monotonic_ns();
+	int64_t wall_ns = now_ns + log_time.offset_ns;
+
+	// realign with the wall clock as each second passes
+	if (!log_time.hms[0] || wall_ns / 1000000000 != log_time.sec) {
+		struct timespec wall;
+		clock_gettime(CLOCK_REALTIME, &wall);
+		log_time.offset_ns = (int64_t)wall.tv_sec * 1000000000 + wall.tv_nsec - now_ns;
+		wall_ns = now_ns + log_time.offset_ns;
+
+		log_time.sec = wall_ns / 1000000000;
+		strftime(log_time.hms, sizeof(log_time.hms), "%H:%M:%S", localtime(&log_time.sec));
+	}
 
-	strftime(buf, sizeof(buf), "%H:%M:%S", localtime(&t));
+	int ms = (int)(wall_ns % 1000000000 / 1000000);
 
-	fprintf(__stream, "%c [%s] ", threshold_char[threshold], buf);
+	if (log_time.event_ns) {
+		int64_t us = (now_ns - log_time.event_ns) / 1000;
+		fprintf(__stream, "%c [%s.%03d +%lld.%03dms] ", threshold_char[threshold], log_time.hms, ms, (long long)(us / 1000), (int)(us % 1000));
+	} else {
+		fprintf(__stream, "%c [%s.%03d] ", threshold_char[threshold], log_time.hms, ms);
+	}
 }
 
 void capture_line(enum LogThreshold threshold, char *l) {
-	struct LogCapLine *cap_line = calloc(1, sizeof(struct LogCapLine));
-	cap_line->line = strdup(l);
+	struct LogCapLine *cap_line;
+
+	stats_inc(STATS_LOG_CAPTURED);
+
+	if (log_cap.len < LOG_CAP_LINES_MAX) {
+		cap_line = &log_cap.lines[(log_cap.start + log_cap.len++) % LOG_CAP_LINES_MAX];
+	} else {
+		// overwrite the oldest
+		cap_line = &log_cap.lines[log_cap.start];
+		log_cap.start = (log_cap.start + 1) % LOG_CAP_LINES_MAX;
+		log_cap.dropped++;
+		if (cap_line->threshold > log_cap.dropped_threshold) {
+			log_cap.dropped_threshold = cap_line->threshold;
+		}
+	}
+
+	size_t n = strlen(l) + 1;
+	if (n > cap_line->size) {
+		free(cap_line->line);
+		cap_line->line = malloc(n);
+		cap_line->size = n;
+	}
+
+	memcpy(cap_line->line, l, n);
 	cap_line->threshold = threshold;
-	slist_append(&log_cap_lines, cap_line);
+}
+
+const struct LogCapLine *log_cap_line(size_t n) {
+	if (n >= log_cap.len) {
+		return NULL;
+	}
+
+	return &log_cap.lines[(log_cap.start + n) % LOG_CAP_LINES_MAX];
+}
+
+// a new open file description, as O_NONBLOCK set on a dup of a terminal would also apply to the shell
+// sockets are sent MSG_DONTWAIT; regular files do not block
+void sink_open_nonblock(struct LogSink *sink) {
+	struct stat st;
+
+	sink->fd_nonblock = -1;
+	sink->socket = false;
+
+	if (fstat(sink->fd, &st) == -1) {
+		return;
+	}
+
+	if (S_ISSOCK(st.st_mode)) {
+		sink->socket = true;
+	} else if (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode)) {
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", sink->fd);
+		sink->fd_nonblock = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	}
+}
+
+// write from the start of the buffer, false when nothing was written
+bool sink_write(struct LogSink *sink, bool block) {
+	if (!sink->len) {
+		return false;
+	}
+
+	ssize_t written;
+	if (block) {
+		written = write(sink->fd, sink->buf + sink->start, sink->len);
+	} else if (sink->socket) {
+		written = send(sink->fd, sink->buf + sink->start, sink->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} else if (sink->fd_nonblock != -1) {
+		written = write(sink->fd_nonblock, sink->buf + sink->start, sink->len);
+	} else {
+		// best effort without /proc: a writable terminal may still block
+		struct pollfd pfd = { .fd = sink->fd, .events = POLLOUT, };
+		if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLOUT)) {
+			return false;
+		}
+		written = write(sink->fd, sink->buf + sink->start, sink->len < PIPE_BUF ? sink->len : PIPE_BUF);
+	}
+
+	if (written < 0 && errno == EINTR) {
+		return true;
+	}
+	if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return false;
+	}
+
+	// nowhere left to write, discard
+	if (written <= 0) {
+		sink->failed = true;
+		sink->start = 0;
+		sink->len = 0;
+		return false;
+	}
+
+	sink->start += written;
+	sink->len -= written;
+	sink->bytes_written += written;
+	if (!sink->len) {
+		sink->start = 0;
+	}
+
+	return true;
+}
+
+void sink_append(struct LogSink *sink, const char *buf, size_t size) {
+	if (sink->failed) {
+		sink->dropped++;
+		return;
+	}
+
+	// full
+	if (sink->len + size > LOG_SINK_SIZE) {
+		if (sink->threshold < LOG_SINK_BLOCK_THRESHOLD) {
+			sink->dropped++;
+			sink->dropped_unreported++;
+			return;
+		}
+
+		sink->blocked++;
+		while (sink_write(sink, true));
+
+		if (sink->failed || sink->len + size > LOG_SINK_SIZE) {
+			sink->dropped++;
+			return;
+		}
+	}
+
+	// make room at the end
+	if (sink->start + sink->len + size > LOG_SINK_SIZE) {
+		memmove(sink->buf, sink->buf + sink->start, sink->len);
+		sink->start = 0;
+	}
+
+	memcpy(sink->buf + sink->start + sink->len, buf, size);
+	sink->len += size;
+	sink->lines++;
+
+	if (sink->len > sink->high_water) {
+		sink->high_water = sink->len;
+	}
+}
+
+ssize_t sink_cookie_write(void *cookie, const char *buf, size_t size) {
+	sink_append(cookie, buf, size);
+
+	// dropped is not an error for the stream
+	return size;
+}
+
+void sink_start(struct LogSink *sink) {
+	if (sink->stream) {
+		return;
+	}
+
+	sink_open_nonblock(sink);
+
+	sink->buf = malloc(LOG_SINK_SIZE);
+	sink->stream = fopencookie(sink, "w", (cookie_io_functions_t) { .write = sink_cookie_write, });
+	if (!sink->buf || !sink->stream) {
+		free(sink->buf);
+		sink->buf = NULL;
+		sink->stream = NULL;
+		if (sink->fd_nonblock != -1) {
+			close(sink->fd_nonblock);
+		}
+		return;
+	}
+
+	// one append per line
+	setvbuf(sink->stream, NULL, _IOLBF, LS + 128);
+}
+
+void sink_drain(struct LogSink *sink) {
+	if (!sink->stream) {
+		return;
+	}
+
+	while (sink_write(sink, false));
+
+	// report once there is room
+	if (!sink->len && sink->dropped_unreported && !sink->failed) {
+		char dropped[64];
+		int n = snprintf(dropped, sizeof(dropped), "WARNING: %lu log messages dropped\n", sink->dropped_unreported);
+		sink->dropped_unreported = 0;
+		sink_append(sink, dropped, n);
+		while (sink_write(sink, false));
+	}
+}
+
+void sink_flush(struct LogSink *sink) {
+	if (!sink->stream) {
+		return;
+	}
+
+	fflush(sink->stream);
+
+	while (sink_write(sink, true));
+}
+
+void sink_stop(struct LogSink *sink) {
+	sink_flush(sink);
+
+	if (sink->stream) {
+		fclose(sink->stream);
+		sink->stream = NULL;
+
+		if (sink->fd_nonblock != -1) {
+			close(sink->fd_nonblock);
+			sink->fd_nonblock = -1;
+		}
+	}
+
+	free(sink->buf);
+	sink->buf = NULL;
+	sink->start = 0;
+	sink->len = 0;
 }
 
 void print_raw(enum LogThreshold threshold, bool prefix, const char *l) {
 	static FILE *stream;
 
-	stream = threshold == ERROR ? stderr : stdout;
+	struct LogSink *sink = threshold == ERROR ? &log_sink_err : &log_sink_out;
+	if (sink->stream) {
+		sink->threshold = threshold;
+		stream = sink->stream;
+	} else {
+		stream = threshold == ERROR ? stderr : stdout;
+	}
 
 	if (threshold >= active.threshold && !active.suppressing) {
 		if (active.times) {
@@ -108,6 +371,10 @@ void print_line(enum LogThreshold threshold, bool prefix, int eno, const char *_
 void print_log(enum LogThreshold threshold, int eno, const char *__restrict __format, va_list __args) {
 	static const char *format;
 
+	if (!log_enabled(threshold, true)) {
+		return;
+	}
+
 	format = __format;
 	while (*format == '\n') {
 		print_line(threshold, false, 0, NULL, __args);
@@ -131,6 +398,20 @@ void log_set_times(bool times) {
 	active.times = times;
 }
 
+void log_event_start(void) {
+	if (!log_time.event_ns) {
+		log_time.event_ns = monotonic_ns();
+	}
+}
+
+void log_event_stop(void) {
+	log_time.event_ns = 0;
+}
+
+bool log_enabled(enum LogThreshold threshold, bool capture) {
+	return (capture && active.capturing) || (threshold >= active.threshold && !active.suppressing);
+}
+
 void log_(enum LogThreshold threshold, const char *__restrict __format, ...) {
 	va_list args;
 	va_start(args, __format);
@@ -146,6 +427,10 @@ void log_debug(const char *__restrict __format, ...) {
 }
 
 void log_debug_nocap(const char *__restrict __format, ...) {
+	if (!log_enabled(DEBUG, false)) {
+		return;
+	}
+
 	bool was_capturing = active.capturing;
 	active.capturing = false;
 
@@ -186,6 +471,10 @@ void log_error(const char *__restrict __format, ...) {
 }
 
 void log_error_nocap(const char *__restrict __format, ...) {
+	if (!log_enabled(ERROR, false)) {
+		return;
+	}
+
 	bool was_capturing = active.capturing;
 	active.capturing = false;
 
@@ -204,20 +493,6 @@ void log_error_errno(const char *__restrict __format, ...) {
 	va_end(args);
 }
 
-void free_log_cap_line(void *data) {
-	struct LogCapLine *cap_line = data;
-
-	if (!cap_line) {
-		return;
-	}
-
-	if (cap_line->line) {
-		free(cap_line->line);
-	}
-
-	free(cap_line);
-}
-
 void log_suppress_start(void) {
 	active.suppressing = true;
 }
@@ -235,17 +510,24 @@ void log_capture_stop(void) {
 }
 
 void log_capture_clear(void) {
-	slist_free_vals(&log_cap_lines, free_log_cap_line);
+	log_cap.start = 0;
+	log_cap.len = 0;
+	log_cap.dropped = 0;
+	log_cap.dropped_threshold = 0;
 }
 
 void log_capture_playback(void) {
 	bool was_capturing = active.capturing;
 	active.capturing = false;
 
-	for (struct SList *i = log_cap_lines; i; i = i->nex) {
-		struct LogCapLine *cap_line = i->val;
-		if (!cap_line)
-			continue;
+	if (log_cap.dropped) {
+		char dropped[64];
+		snprintf(dropped, sizeof(dropped), "%lu earlier messages dropped", log_cap.dropped);
+		print_raw(WARNING, true, dropped);
+	}
+
+	for (size_t i = 0; i < log_cap.len; i++) {
+		const struct LogCapLine *cap_line = log_cap_line(i);
 
 		print_raw(cap_line->threshold, true, cap_line->line);
 	}
@@ -253,3 +535,26 @@ void log_capture_playback(void) {
 	active.capturing = was_capturing;
 }
 
+void log_sink_start(void) {
+	fflush(stdout);
+	fflush(stderr);
+
+	sink_start(&log_sink_out);
+	sink_start(&log_sink_err);
+}
+
+void log_sink_drain(void) {
+	sink_drain(&log_sink_out);
+	sink_drain(&log_sink_err);
+}
+
+void log_sink_flush(void) {
+	sink_flush(&log_sink_out);
+	sink_flush(&log_sink_err);
+}
+
+void log_sink_stop(void) {
+	sink_stop(&log_sink_out);
+	sink_stop(&log_sink_err);
+}
+
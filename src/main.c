@@ -21,10 +21,21 @@ main(int argc, char **argv) {
 
 	parse_args(argc, argv, &ipc_request, &cfg_path);
 
+#ifdef WD_CLIENT_ONLY
+	free(cfg_path);
+
+	if (!ipc_request) {
+		log_error("way-displays-client sends requests only, start the server with way-displays");
+		return EXIT_FAILURE;
+	}
+
+	return client(ipc_request);
+#else
 	if (ipc_request) {
 		return client(ipc_request);
 	} else {
 		return server(cfg_path);
 	}
+#endif
 }
 
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +30,9 @@ extern "C" {
 #include "list.h"
 #include "log.h"
 #include "mode.h"
+#include "sockets.h"
+#include "stats.h"
+#include "trace.h"
 }
 
 // If this is a regex pattern, attempt to compile it before including it in configuration.
@@ -116,6 +120,14 @@ char *yaml_with_newline(const YAML::Emitter &e) {
 
 YAML::Emitter& operator << (YAML::Emitter& e, struct Cfg& cfg) {
 
+	if (cfg.includes) {
+		e << YAML::Key << "INCLUDE" << YAML::BeginSeq;					// INCLUDE
+		for (struct SList *i = cfg.includes; i; i = i->nex) {
+			e << (char*)i->val;
+		}
+		e << YAML::EndSeq;												// INCLUDE
+	}
+
 	if (cfg.arrange) {
 		e << YAML::Key << "ARRANGE" << YAML::Value << arrange_name(cfg.arrange);
 	}
@@ -263,11 +275,127 @@ YAML::Emitter& operator << (YAML::Emitter& e, struct Head& head) {
 	return e;
 }
 
+YAML::Emitter& operator << (YAML::Emitter& e, const struct IpcEvaluation& evaluation) {
+
+	if (evaluation.name)
+		e << YAML::Key << "NAME" << YAML::Value << evaluation.name;
+	e << YAML::Key << "ENABLED" << YAML::Value << evaluation.enabled;
+	if (evaluation.width) {
+		e << YAML::Key << "MODE" << YAML::BeginMap;		// MODE
+		e << YAML::Key << "WIDTH" << YAML::Value << evaluation.width;
+		e << YAML::Key << "HEIGHT" << YAML::Value << evaluation.height;
+		e << YAML::Key << "REFRESH_MHZ" << YAML::Value << evaluation.refresh_mhz;
+		e << YAML::EndMap;								// MODE
+	}
+	e << YAML::Key << "SCALE" << YAML::Value << evaluation.scale;
+	e << YAML::Key << "X" << YAML::Value << evaluation.x;
+	e << YAML::Key << "Y" << YAML::Value << evaluation.y;
+	e << YAML::Key << "VRR" << YAML::Value << evaluation.adaptive_sync;
+
+	return e;
+}
+
+YAML::Emitter& operator << (YAML::Emitter& e, const struct TraceEvent& event) {
+
+	e << YAML::Key << "NS" << YAML::Value << event.ns;
+	e << YAML::Key << "EVENT" << YAML::Value << trace_event_type_name((enum TraceEventType)event.type);
+	e << YAML::Key << "SERIAL" << YAML::Value << event.serial;
+	if (event.head[0])
+		e << YAML::Key << "HEAD" << YAML::Value << event.head;
+
+	switch (event.type) {
+		case TRACE_DELTA:
+			e << YAML::Key << "DESIRED" << YAML::BeginMap;		// DESIRED, differing only
+			if (event.delta & TRACE_DELTA_ENABLED)
+				e << YAML::Key << "ENABLED" << YAML::Value << (bool)event.desired.enabled;
+			if (event.delta & TRACE_DELTA_MODE) {
+				e << YAML::Key << "MODE" << YAML::BeginMap;		// MODE
+				e << YAML::Key << "WIDTH" << YAML::Value << event.desired.width;
+				e << YAML::Key << "HEIGHT" << YAML::Value << event.desired.height;
+				e << YAML::Key << "REFRESH_MHZ" << YAML::Value << event.desired.refresh_mhz;
+				e << YAML::EndMap;									// MODE
+			}
+			if (event.delta & TRACE_DELTA_SCALE)
+				e << YAML::Key << "SCALE" << YAML::Value << wl_fixed_to_double(event.desired.scale);
+			if (event.delta & TRACE_DELTA_POSITION) {
+				e << YAML::Key << "X" << YAML::Value << event.desired.x;
+				e << YAML::Key << "Y" << YAML::Value << event.desired.y;
+			}
+			if (event.delta & TRACE_DELTA_VRR)
+				e << YAML::Key << "VRR" << YAML::Value << (bool)event.desired.adaptive_sync;
+			e << YAML::EndMap;									// DESIRED
+			break;
+		case TRACE_APPLY:
+		case TRACE_ROLLBACK:
+			e << YAML::Key << "HEADS" << YAML::Value << event.heads;
+			break;
+		default:
+			break;
+	}
+
+	return e;
+}
+
+YAML::Emitter& operator << (YAML::Emitter& e, const struct StatsHistogram& histogram) {
+
+	e << YAML::Key << "COUNT" << YAML::Value << histogram.count;
+	e << YAML::Key << "SUM" << YAML::Value << histogram.sum;
+	e << YAML::Key << "MAX" << YAML::Value << histogram.max;
+	e << YAML::Key << "BUCKETS" << YAML::Flow << YAML::BeginSeq;	// BUCKETS
+	for (size_t i = 0; i < STATS_BUCKETS; i++) {
+		e << histogram.buckets[i];
+	}
+	e << YAML::EndSeq;												// BUCKETS
+
+	return e;
+}
+
+YAML::Emitter& operator << (YAML::Emitter& e, const struct Stats& s) {
+
+	e << YAML::Key << "COUNTERS" << YAML::BeginMap;				// COUNTERS
+	for (int c = 1; c < STATS_COUNTERS_END; c++) {
+		e << YAML::Key << stats_counter_name((enum StatsCounter)c) << YAML::Value << s.counters[c];
+	}
+	e << YAML::EndMap;												// COUNTERS
+
+	e << YAML::Key << "GAUGES" << YAML::BeginMap;					// GAUGES
+	for (int g = 1; g < STATS_GAUGES_END; g++) {
+		e << YAML::Key << stats_gauge_name((enum StatsGauge)g) << YAML::Value << s.gauges[g];
+	}
+	e << YAML::EndMap;												// GAUGES
+
+	e << YAML::Key << "IPC_REQUESTS" << YAML::BeginMap;				// IPC_REQUESTS
+	for (int op = 1; op < STATS_IPC_OPS; op++) {
+		const char *name = ipc_request_op_name((enum IpcRequestOperation)op);
+		if (name) {
+			e << YAML::Key << name << YAML::Value << s.ipc_requests[op];
+		}
+	}
+	e << YAML::EndMap;												// IPC_REQUESTS
+	e << YAML::Key << "DESIRE_US" << YAML::BeginMap << s.desire_us << YAML::EndMap;
+	e << YAML::Key << "APPLY_US" << YAML::BeginMap << s.apply_us << YAML::EndMap;
+	e << YAML::Key << "SETTLE_US" << YAML::BeginMap << s.settle_us << YAML::EndMap;
+	e << YAML::Key << "APPLIES" << YAML::BeginMap << s.applies << YAML::EndMap;
+
+	return e;
+}
+
 void cfg_parse_node(struct Cfg *cfg, const YAML::Node &node) {
 	if (!cfg || !node || !node.IsMap()) {
 		throw std::runtime_error("empty CFG");
 	}
 
+	if (node["INCLUDE"]) {
+		const auto &includes = node["INCLUDE"];
+		for (const auto &include : includes) {
+			const std::string &include_str = include.as<std::string>();
+			const char *include_cstr = include_str.c_str();
+			if (!slist_find_equal(cfg->includes, slist_equal_strcmp, include_cstr)) {
+				slist_append(&cfg->includes, strdup(include_cstr));
+			}
+		}
+	}
+
 	if (node["LOG_THRESHOLD"]) {
 		const std::string &threshold_str = node["LOG_THRESHOLD"].as<std::string>();
 		cfg->log_threshold = log_threshold_val(threshold_str.c_str());
@@ -425,6 +553,28 @@ void cfg_parse_node(struct Cfg *cfg, const YAML::Node &node) {
 	}
 }
 
+// append to ops, throws on an invalid or missing OP
+void parse_operation(const YAML::Node &node, struct SList **ops) {
+	if (!node.IsMap() || !node["OP"]) {
+		throw std::runtime_error("missing OPS OP");
+	}
+
+	const std::string &op_str = node["OP"].as<std::string>();
+	enum IpcRequestOperation op = ipc_request_op_val(op_str.c_str());
+	if (op != CFG_SET && op != CFG_DEL && op != CFG_WRITE) {
+		throw std::runtime_error("invalid OPS OP '" + op_str + "'");
+	}
+
+	struct IpcOperation *operation = ipc_operation_init(op, NULL);
+	slist_append(ops, operation);
+
+	const YAML::Node node_cfg = node["CFG"];
+	if (node_cfg && node_cfg.IsMap()) {
+		operation->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+		cfg_parse_node(operation->cfg, node_cfg);
+	}
+}
+
 char *marshal_ipc_request(struct IpcRequest *request) {
 	if (!request) {
 		return NULL;
@@ -446,12 +596,42 @@ char *marshal_ipc_request(struct IpcRequest *request) {
 			return NULL;
 		}
 
+		// TLV requests are for TLV responses
+		if (request->encoding && request->encoding != IPC_ENCODING_YAML && request->encoding != IPC_ENCODING_TLV) {
+			e << YAML::Key << "ENCODING" << YAML::Value << ipc_encoding_name(request->encoding);
+		}
+
+		if (request->memfd_threshold) {
+			e << YAML::Key << "MEMFD_THRESHOLD" << YAML::Value << request->memfd_threshold;
+		}
+
+		if (request->timeout_ms) {
+			e << YAML::Key << "TIMEOUT_MS" << YAML::Value << request->timeout_ms;
+		}
+
 		if (request->cfg) {
 			e << YAML::Key << "CFG" << YAML::BeginMap;	// CFG
 			e << *request->cfg;
 			e << YAML::EndMap;							// CFG
 		}
 
+		if (request->ops) {
+			e << YAML::Key << "OPS" << YAML::BeginSeq;	// OPS
+			for (struct SList *i = request->ops; i; i = i->nex) {
+				struct IpcOperation *operation = (struct IpcOperation*)i->val;
+
+				e << YAML::BeginMap;					// operation
+				e << YAML::Key << "OP" << YAML::Value << ipc_request_op_name(operation->op);
+				if (operation->cfg) {
+					e << YAML::Key << "CFG" << YAML::BeginMap;	// CFG
+					e << *operation->cfg;
+					e << YAML::EndMap;					// CFG
+				}
+				e << YAML::EndMap;						// operation
+			}
+			e << YAML::EndSeq;							// OPS
+		}
+
 		e << YAML::EndMap;							// root
 
 		if (!e.good()) {
@@ -491,12 +671,44 @@ struct IpcRequest *unmarshal_ipc_request(char *yaml) {
 			throw std::runtime_error("missing OP");
 		}
 
+		const YAML::Node node_encoding = node["ENCODING"];
+		if (node_encoding) {
+			const std::string &encoding_str = node_encoding.as<std::string>();
+			request->encoding = ipc_encoding_val(encoding_str.c_str());
+			if (!request->encoding || request->encoding == IPC_ENCODING_TLV) {
+				throw std::runtime_error("invalid ENCODING '" + encoding_str + "'");
+			}
+		}
+
+		const YAML::Node node_memfd_threshold = node["MEMFD_THRESHOLD"];
+		if (node_memfd_threshold) {
+			request->memfd_threshold = node_memfd_threshold.as<size_t>();
+		}
+
+		const YAML::Node node_timeout_ms = node["TIMEOUT_MS"];
+		if (node_timeout_ms) {
+			request->timeout_ms = node_timeout_ms.as<long>();
+			if (request->timeout_ms < 0) {
+				throw std::runtime_error("invalid TIMEOUT_MS '" + node_timeout_ms.as<std::string>() + "'");
+			}
+		}
+
 		const YAML::Node node_cfg = node["CFG"];
 		if (node_cfg && node_cfg.IsMap()) {
 			request->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
 			cfg_parse_node(request->cfg, node_cfg);
 		}
 
+		const YAML::Node node_ops = node["OPS"];
+		if (request->op == BATCH) {
+			if (!node_ops || !node_ops.IsSequence() || node_ops.size() == 0) {
+				throw std::runtime_error("missing OPS");
+			}
+			for (const auto &node_operation : node_ops) {
+				parse_operation(node_operation, &request->ops);
+			}
+		}
+
 		return request;
 
 	} catch (const std::exception &e) {
@@ -507,76 +719,217 @@ struct IpcRequest *unmarshal_ipc_request(char *yaml) {
 	}
 }
 
-char *marshal_ipc_response(struct IpcResponse *response) {
-	char *yaml = NULL;
+// emitted document with each line indented, for inclusion in a larger document
+void append_indented(std::string &out, const YAML::Emitter &e, const size_t indent) {
+	bool bol = true;
+	for (const char *c = e.c_str(); *c; c++) {
+		if (bol && *c != '\n') {
+			out.append(indent, ' ');
+		}
+		out.push_back(*c);
+		bol = *c == '\n';
+	}
+	out.push_back('\n');
+}
 
-	try {
-		YAML::Emitter e;
+// head fragment is current for the marshalled fields of a state
+bool head_state_marshalled_equal(const struct HeadState &a, const struct HeadState &b) {
+	return a.mode == b.mode &&
+		a.scale == b.scale &&
+		a.enabled == b.enabled &&
+		a.x == b.x &&
+		a.y == b.y;
+}
 
-		e << YAML::TrueFalseBool;
-		e << YAML::UpperCase;
+// CFG, cached until cfg is replaced
+const char *marshal_cfg_fragment(struct Cfg *cfg) {
+	if (cfg->marshalled) {
+		return cfg->marshalled;
+	}
 
-		e << YAML::BeginMap;								// root
+	YAML::Emitter e;
 
-		e << YAML::Key << "DONE" << YAML::Value << response->done;
+	e << YAML::TrueFalseBool;
+	e << YAML::UpperCase;
 
-		if (response->state) {
-			if (cfg) {
-				e << YAML::Key << "CFG" << YAML::BeginMap;		// CFG
-				e << *cfg;
-				e << YAML::EndMap;								// CFG
-			}
+	e << YAML::BeginMap;							// root
+	e << YAML::Key << "CFG" << YAML::BeginMap;		// CFG
+	e << *cfg;
+	e << YAML::EndMap;								// CFG
+	e << YAML::EndMap;								// root
 
-			if (lid || heads) {
-				e << YAML::Key << "STATE" << YAML::BeginMap;	// STATE
+	if (!e.good()) {
+		throw std::runtime_error(e.GetLastError());
+	}
 
-				if (lid) {
-					e << YAML::Key << "LID" << YAML::BeginMap;		// LID
-					e << YAML::Key << "CLOSED" << YAML::Value << lid->closed;
-					e << YAML::Key << "DEVICE_PATH" << YAML::Value << lid->device_path;
-					e << YAML::EndMap;								// LID
-				}
+	std::string fragment;
+	append_indented(fragment, e, 0);
+	cfg->marshalled = strdup(fragment.c_str());
 
-				if (heads) {
-					e << YAML::Key << "HEADS" << YAML::BeginSeq;	// HEADS
-					for (struct SList *i = heads; i; i = i->nex) {
-						e << YAML::BeginMap << *(Head*)(i->val) << YAML::EndMap;
-					}
-					e << YAML::EndSeq;								// HEADS
-				}
+	return cfg->marshalled;
+}
 
-				e << YAML::EndMap;								// STATE
-			}
+// HEADS item, cached until a listener touches the head or its marshalled states change
+const char *marshal_head_fragment(struct Head *head) {
+	if (head->marshalled.yaml &&
+			!head->marshalled.stale &&
+			head_state_marshalled_equal(head->marshalled.current, head->current) &&
+			head_state_marshalled_equal(head->marshalled.desired, head->desired)) {
+		return head->marshalled.yaml;
+	}
+
+	YAML::Emitter e;
+
+	e << YAML::TrueFalseBool;
+	e << YAML::UpperCase;
+
+	e << YAML::BeginSeq;							// HEADS
+	e << YAML::BeginMap << *head << YAML::EndMap;
+	e << YAML::EndSeq;								// HEADS
+
+	if (!e.good()) {
+		throw std::runtime_error(e.GetLastError());
+	}
+
+	std::string fragment;
+	append_indented(fragment, e, 4);
+
+	free(head->marshalled.yaml);
+	head->marshalled.yaml = strdup(fragment.c_str());
+	head->marshalled.stale = false;
+	head->marshalled.current = head->current;
+	head->marshalled.desired = head->desired;
+
+	return head->marshalled.yaml;
+}
+
+// response destinations
+void out_append(std::string &out, const char *data) {
+	out.append(data);
+}
+
+void out_append(struct SocketBuf &out, const char *data) {
+	socket_buf_write(&out, data, strlen(data));
+}
+
+// fragments are appended to out as they are available
+template <typename Out>
+void marshal_ipc_response_out(struct IpcResponse *response, Out &out) {
+	std::string fragment;
+
+	YAML::Emitter e_done;
+
+	e_done << YAML::TrueFalseBool;
+	e_done << YAML::UpperCase;
+
+	e_done << YAML::BeginMap;								// root
+	e_done << YAML::Key << "DONE" << YAML::Value << response->done;
+	e_done << YAML::EndMap;									// root
+
+	append_indented(fragment, e_done, 0);
+	out_append(out, fragment.c_str());
+
+	if (response->state) {
+		if (cfg) {
+			out_append(out, marshal_cfg_fragment(cfg));
 		}
 
-		if (response->messages) {
-			e << YAML::Key << "MESSAGES" << YAML::BeginMap;		// MESSAGES
-			for (struct SList *i = log_cap_lines; i; i = i->nex) {
-				struct LogCapLine *cap_line = (struct LogCapLine*)i->val;
-				if (cap_line && cap_line->line) {
-					e << YAML::Key << log_threshold_name(cap_line->threshold);
-					e << YAML::Value << cap_line->line;
-					if (cap_line->threshold == WARNING && response->rc < IPC_RC_WARN) {
-						response->rc = IPC_RC_WARN;
-					}
-					if (cap_line->threshold == ERROR && response->rc < IPC_RC_ERROR) {
-						response->rc = IPC_RC_ERROR;
-					}
+		if (lid || heads) {
+			out_append(out, "STATE:\n");					// STATE
+
+			if (lid) {
+				YAML::Emitter e_lid;
+
+				e_lid << YAML::TrueFalseBool;
+				e_lid << YAML::UpperCase;
+
+				e_lid << YAML::BeginMap;
+				e_lid << YAML::Key << "LID" << YAML::BeginMap;	// LID
+				e_lid << YAML::Key << "CLOSED" << YAML::Value << lid->closed;
+				e_lid << YAML::Key << "DEVICE_PATH" << YAML::Value << lid->device_path;
+				e_lid << YAML::EndMap;							// LID
+				e_lid << YAML::EndMap;
+
+				fragment.clear();
+				append_indented(fragment, e_lid, 2);
+				out_append(out, fragment.c_str());
+			}
+
+			if (heads) {
+				out_append(out, "  HEADS:\n");				// HEADS
+				for (struct SList *i = heads; i; i = i->nex) {
+					out_append(out, marshal_head_fragment((struct Head*)i->val));
 				}
 			}
-			e << YAML::EndMap;									// MESSAGES
 		}
+	}
 
-		e << YAML::Key << "RC" << YAML::Value << response->rc;
+	YAML::Emitter e;
 
-		e << YAML::EndMap;									// root
+	e << YAML::TrueFalseBool;
+	e << YAML::UpperCase;
 
-		if (!e.good()) {
-			log_error("marshalling ipc response: %s", e.GetLastError().c_str());
-			return NULL;
+	e << YAML::BeginMap;								// root
+
+	if (response->trace) {
+		// oldest first
+		e << YAML::Key << "TRACE" << YAML::BeginSeq;		// TRACE
+		for (size_t i = 0; i < trace.len; i++) {
+			e << YAML::BeginMap << *trace_event_n(i) << YAML::EndMap;
+		}
+		e << YAML::EndSeq;									// TRACE
+	}
+
+	if (response->stats) {
+		e << YAML::Key << "STATS" << YAML::BeginMap << stats << YAML::EndMap;
+	}
+
+	if (response->evaluation) {
+		e << YAML::Key << "EVALUATION" << YAML::BeginSeq;	// EVALUATION
+		for (struct SList *i = response->evaluation; i; i = i->nex) {
+			e << YAML::BeginMap << *(struct IpcEvaluation*)i->val << YAML::EndMap;
+		}
+		e << YAML::EndSeq;									// EVALUATION
+	}
+
+	if (response->messages) {
+		// oldest first
+		if (log_cap.dropped) {
+			e << YAML::Key << "MESSAGES_DROPPED" << YAML::Value << log_cap.dropped;
+			ipc_response_rc_message(response, log_cap.dropped_threshold);
+		}
+		e << YAML::Key << "MESSAGES" << YAML::BeginMap;		// MESSAGES
+		for (size_t i = 0; i < log_cap.len; i++) {
+			const struct LogCapLine *cap_line = log_cap_line(i);
+			e << YAML::Key << log_threshold_name(cap_line->threshold);
+			e << YAML::Value << cap_line->line;
+			ipc_response_rc_message(response, cap_line->threshold);
 		}
+		e << YAML::EndMap;									// MESSAGES
+	}
+
+	e << YAML::Key << "RC" << YAML::Value << response->rc;
 
-		yaml = yaml_with_newline(e);
+	e << YAML::EndMap;									// root
+
+	if (!e.good()) {
+		throw std::runtime_error(e.GetLastError());
+	}
+
+	fragment.clear();
+	append_indented(fragment, e, 0);
+	out_append(out, fragment.c_str());
+}
+
+char *marshal_ipc_response(struct IpcResponse *response) {
+	char *yaml = NULL;
+
+	try {
+		std::string out;
+
+		marshal_ipc_response_out(response, out);
+
+		yaml = strdup(out.c_str());
 
 	} catch (const std::exception &e) {
 		log_error("marshalling ipc response: %s\n%s", e.what());
@@ -589,6 +942,23 @@ char *marshal_ipc_response(struct IpcResponse *response) {
 	return yaml;
 }
 
+bool marshal_ipc_response_stream(struct IpcResponse *response, struct SocketBuf *buf) {
+	bool rc = true;
+
+	try {
+		marshal_ipc_response_out(response, *buf);
+	} catch (const std::exception &e) {
+		log_error("marshalling ipc response: %s", e.what());
+		rc = false;
+	}
+
+	if (response->messages) {
+		log_capture_clear();
+	}
+
+	return rc;
+}
+
 struct IpcResponse *unmarshal_ipc_response(char *yaml) {
 	if (!yaml) {
 		return NULL;
@@ -621,6 +991,11 @@ struct IpcResponse *unmarshal_ipc_response(char *yaml) {
 				response->rc = i->second.as<int>();
 			}
 
+			if (i->first.as<std::string>() == "MESSAGES_DROPPED") {
+				response->messages_dropped = i->second.as<unsigned long>();
+				log_warn("%lu earlier messages dropped", response->messages_dropped);
+			}
+
 			if (i->first.as<std::string>() == "MESSAGES" && i->second.IsMap()) {
 				for (YAML::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
 					enum LogThreshold threshold = log_threshold_val(j->first.as<std::string>().c_str());
@@ -674,8 +1049,25 @@ bool unmarshal_cfg_from_file(struct Cfg *cfg) {
 		return false;
 	}
 
+	size_t len = 0;
+	char *yaml = cfg_file_read(cfg->file_path, &len);
+	if (!yaml) {
+		log_error("\nparsing file %s %s", cfg->file_path, strerror(errno));
+		return false;
+	}
+
+	cfg->file_hash = cfg_hash(yaml, len);
+
+	bool parsed = unmarshal_cfg_from_yaml(cfg, yaml);
+
+	free(yaml);
+
+	return parsed;
+}
+
+bool unmarshal_cfg_from_yaml(struct Cfg *cfg, const char *yaml) {
 	try {
-		YAML::Node node = YAML::LoadFile(cfg->file_path);
+		YAML::Node node = YAML::Load(yaml);
 		cfg_parse_node(cfg, node);
 	} catch (const std::exception &e) {
 		log_error("\nparsing file %s %s", cfg->file_path, e.what());
@@ -0,0 +1,351 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <wayland-util.h>
+
+#include "marshalling.h"
+
+#include "cfg.h"
+#include "convert.h"
+#include "global.h"
+#include "head.h"
+#include "ipc.h"
+#include "json.h"
+#include "lid.h"
+#include "list.h"
+#include "log.h"
+#include "mode.h"
+#include "stats.h"
+#include "trace.h"
+
+// keys and order as per the YAML emitters
+
+void json_put_strs(struct JsonWriter *w, const char *key, struct SList *strs) {
+	if (!strs) {
+		return;
+	}
+
+	json_array_begin(w, key);
+	for (struct SList *i = strs; i; i = i->nex) {
+		json_put_str(w, NULL, (char*)i->val);
+	}
+	json_array_end(w);
+}
+
+void json_put_cfg(struct JsonWriter *w, struct Cfg *cfg) {
+	json_object_begin(w, "CFG");
+
+	if (cfg->arrange) {
+		json_put_str(w, "ARRANGE", arrange_name(cfg->arrange));
+	}
+
+	if (cfg->align) {
+		json_put_str(w, "ALIGN", align_name(cfg->align));
+	}
+
+	json_put_strs(w, "ORDER", cfg->order_name_desc);
+
+	if (cfg->auto_scale) {
+		json_put_bool(w, "AUTO_SCALE", cfg->auto_scale == ON);
+	}
+
+	if (cfg->user_scales) {
+		json_array_begin(w, "SCALE");
+		for (struct SList *i = cfg->user_scales; i; i = i->nex) {
+			struct UserScale *user_scale = (struct UserScale*)i->val;
+			json_object_begin(w, NULL);
+			json_put_str(w, "NAME_DESC", user_scale->name_desc);
+			json_put_float(w, "SCALE", user_scale->scale);
+			json_object_end(w);
+		}
+		json_array_end(w);
+	}
+
+	if (cfg->user_modes) {
+		json_array_begin(w, "MODE");
+		for (struct SList *i = cfg->user_modes; i; i = i->nex) {
+			struct UserMode *user_mode = (struct UserMode*)i->val;
+			json_object_begin(w, NULL);
+			json_put_str(w, "NAME_DESC", user_mode->name_desc);
+			if (user_mode->max) {
+				json_put_bool(w, "MAX", true);
+			} else {
+				json_put_int(w, "WIDTH", user_mode->width);
+				json_put_int(w, "HEIGHT", user_mode->height);
+				if (user_mode->refresh_hz != -1) {
+					json_put_int(w, "HZ", user_mode->refresh_hz);
+				}
+			}
+			json_object_end(w);
+		}
+		json_array_end(w);
+	}
+
+	json_put_strs(w, "VRR_OFF", cfg->adaptive_sync_off_name_desc);
+
+	if (cfg->laptop_display_prefix) {
+		json_put_str(w, "LAPTOP_DISPLAY_PREFIX", cfg->laptop_display_prefix);
+	}
+
+	json_put_strs(w, "MAX_PREFERRED_REFRESH", cfg->max_preferred_refresh_name_desc);
+
+	json_put_strs(w, "DISABLED", cfg->disabled_name_desc);
+
+	if (cfg->log_threshold) {
+		json_put_str(w, "LOG_THRESHOLD", log_threshold_name(cfg->log_threshold));
+	}
+
+	json_object_end(w);
+}
+
+void json_put_head_state(struct JsonWriter *w, const char *key, struct HeadState *head_state) {
+	json_object_begin(w, key);
+	json_put_double(w, "SCALE", wl_fixed_to_double(head_state->scale));
+	json_put_bool(w, "ENABLED", head_state->enabled);
+	json_put_int(w, "X", head_state->x);
+	json_put_int(w, "Y", head_state->y);
+	json_object_end(w);
+}
+
+void json_put_head(struct JsonWriter *w, struct Head *head) {
+	json_object_begin(w, NULL);
+
+	if (head->name)
+		json_put_str(w, "NAME", head->name);
+	if (head->description)
+		json_put_str(w, "DESCRIPTION", head->description);
+	if (head->make)
+		json_put_str(w, "MAKE", head->make);
+	if (head->model)
+		json_put_str(w, "MODEL", head->model);
+	if (head->serial_number)
+		json_put_str(w, "SERIAL_NUMBER", head->serial_number);
+	json_put_int(w, "WIDTH_MM", head->width_mm);
+	json_put_int(w, "HEIGHT_MM", head->height_mm);
+	json_put_int(w, "TRANSFORM", head->transform);
+
+	json_put_head_state(w, "CURRENT", &head->current);
+	json_put_head_state(w, "DESIRED", &head->desired);
+
+	if (head->modes) {
+		json_array_begin(w, "MODES");
+		for (struct SList *i = head->modes; i; i = i->nex) {
+			struct Mode *mode = (struct Mode*)i->val;
+			json_object_begin(w, NULL);
+			json_put_int(w, "WIDTH", mode->width);
+			json_put_int(w, "HEIGHT", mode->height);
+			json_put_int(w, "REFRESH_MHZ", mode->refresh_mhz);
+			json_put_bool(w, "PREFERRED", mode->preferred);
+			json_put_bool(w, "CURRENT", head->current.mode == mode);
+			json_object_end(w);
+		}
+		json_array_end(w);
+	}
+
+	json_object_end(w);
+}
+
+void json_put_trace_event(struct JsonWriter *w, const struct TraceEvent *event) {
+	json_object_begin(w, NULL);
+
+	json_put_int(w, "NS", event->ns);
+	json_put_str(w, "EVENT", trace_event_type_name(event->type));
+	json_put_int(w, "SERIAL", event->serial);
+	if (event->head[0]) {
+		json_put_str(w, "HEAD", event->head);
+	}
+
+	switch (event->type) {
+		case TRACE_DELTA:
+			// differing only
+			json_object_begin(w, "DESIRED");
+			if (event->delta & TRACE_DELTA_ENABLED) {
+				json_put_bool(w, "ENABLED", event->desired.enabled);
+			}
+			if (event->delta & TRACE_DELTA_MODE) {
+				json_object_begin(w, "MODE");
+				json_put_int(w, "WIDTH", event->desired.width);
+				json_put_int(w, "HEIGHT", event->desired.height);
+				json_put_int(w, "REFRESH_MHZ", event->desired.refresh_mhz);
+				json_object_end(w);
+			}
+			if (event->delta & TRACE_DELTA_SCALE) {
+				json_put_double(w, "SCALE", wl_fixed_to_double(event->desired.scale));
+			}
+			if (event->delta & TRACE_DELTA_POSITION) {
+				json_put_int(w, "X", event->desired.x);
+				json_put_int(w, "Y", event->desired.y);
+			}
+			if (event->delta & TRACE_DELTA_VRR) {
+				json_put_bool(w, "VRR", event->desired.adaptive_sync);
+			}
+			json_object_end(w);
+			break;
+		case TRACE_APPLY:
+		case TRACE_ROLLBACK:
+			json_put_int(w, "HEADS", event->heads);
+			break;
+		default:
+			break;
+	}
+
+	json_object_end(w);
+}
+
+void json_put_evaluation(struct JsonWriter *w, struct IpcEvaluation *evaluation) {
+	json_object_begin(w, NULL);
+
+	if (evaluation->name)
+		json_put_str(w, "NAME", evaluation->name);
+	json_put_bool(w, "ENABLED", evaluation->enabled);
+	if (evaluation->width) {
+		json_object_begin(w, "MODE");
+		json_put_int(w, "WIDTH", evaluation->width);
+		json_put_int(w, "HEIGHT", evaluation->height);
+		json_put_int(w, "REFRESH_MHZ", evaluation->refresh_mhz);
+		json_object_end(w);
+	}
+	json_put_double(w, "SCALE", evaluation->scale);
+	json_put_int(w, "X", evaluation->x);
+	json_put_int(w, "Y", evaluation->y);
+	json_put_bool(w, "VRR", evaluation->adaptive_sync);
+
+	json_object_end(w);
+}
+
+void json_put_histogram(struct JsonWriter *w, const char *key, const struct StatsHistogram *histogram) {
+	json_object_begin(w, key);
+	json_put_int(w, "COUNT", histogram->count);
+	json_put_int(w, "SUM", histogram->sum);
+	json_put_int(w, "MAX", histogram->max);
+	json_array_begin(w, "BUCKETS");
+	for (size_t i = 0; i < STATS_BUCKETS; i++) {
+		json_put_int(w, NULL, histogram->buckets[i]);
+	}
+	json_array_end(w);
+	json_object_end(w);
+}
+
+void json_put_stats(struct JsonWriter *w, const struct Stats *s) {
+	json_object_begin(w, "STATS");
+
+	json_object_begin(w, "COUNTERS");
+	for (enum StatsCounter c = 1; c < STATS_COUNTERS_END; c++) {
+		json_put_int(w, stats_counter_name(c), s->counters[c]);
+	}
+	json_object_end(w);
+
+	json_object_begin(w, "GAUGES");
+	for (enum StatsGauge g = 1; g < STATS_GAUGES_END; g++) {
+		json_put_int(w, stats_gauge_name(g), s->gauges[g]);
+	}
+	json_object_end(w);
+
+	json_object_begin(w, "IPC_REQUESTS");
+	for (unsigned int op = 1; op < STATS_IPC_OPS; op++) {
+		if (ipc_request_op_name(op)) {
+			json_put_int(w, ipc_request_op_name(op), s->ipc_requests[op]);
+		}
+	}
+	json_object_end(w);
+
+	json_put_histogram(w, "DESIRE_US", &s->desire_us);
+	json_put_histogram(w, "APPLY_US", &s->apply_us);
+	json_put_histogram(w, "SETTLE_US", &s->settle_us);
+	json_put_histogram(w, "APPLIES", &s->applies);
+	json_object_end(w);
+}
+
+void json_put_response(struct JsonWriter *w, struct IpcResponse *response) {
+	json_object_begin(w, NULL);
+
+	json_put_bool(w, "DONE", response->done);
+
+	if (response->state) {
+		if (cfg) {
+			json_put_cfg(w, cfg);
+		}
+
+		if (lid || heads) {
+			json_object_begin(w, "STATE");
+
+			if (lid) {
+				json_object_begin(w, "LID");
+				json_put_bool(w, "CLOSED", lid->closed);
+				json_put_str(w, "DEVICE_PATH", lid->device_path);
+				json_object_end(w);
+			}
+
+			if (heads) {
+				json_array_begin(w, "HEADS");
+				for (struct SList *i = heads; i; i = i->nex) {
+					json_put_head(w, (struct Head*)i->val);
+				}
+				json_array_end(w);
+			}
+
+			json_object_end(w);
+		}
+	}
+
+	// oldest first
+	if (response->trace) {
+		json_array_begin(w, "TRACE");
+		for (size_t i = 0; i < trace.len; i++) {
+			json_put_trace_event(w, trace_event_n(i));
+		}
+		json_array_end(w);
+	}
+
+	if (response->stats) {
+		json_put_stats(w, &stats);
+	}
+
+	if (response->evaluation) {
+		json_array_begin(w, "EVALUATION");
+		for (struct SList *i = response->evaluation; i; i = i->nex) {
+			json_put_evaluation(w, (struct IpcEvaluation*)i->val);
+		}
+		json_array_end(w);
+	}
+
+	// a sequence of single entry maps, as per the schema
+	if (response->messages) {
+		if (log_cap.dropped) {
+			json_put_int(w, "MESSAGES_DROPPED", log_cap.dropped);
+			ipc_response_rc_message(response, log_cap.dropped_threshold);
+		}
+		json_array_begin(w, "MESSAGES");
+		for (size_t i = 0; i < log_cap.len; i++) {
+			const struct LogCapLine *cap_line = log_cap_line(i);
+			json_object_begin(w, NULL);
+			json_put_str(w, log_threshold_name(cap_line->threshold), cap_line->line);
+			json_object_end(w);
+			ipc_response_rc_message(response, cap_line->threshold);
+		}
+		json_array_end(w);
+		log_capture_clear();
+	}
+
+	json_put_int(w, "RC", response->rc);
+
+	json_object_end(w);
+}
+
+char *marshal_ipc_response_json(struct IpcResponse *response) {
+	struct JsonWriter w = { 0 };
+
+	json_put_response(&w, response);
+
+	return json_end(&w);
+}
+
+bool marshal_ipc_response_json_stream(struct IpcResponse *response, struct SocketBuf *buf) {
+	struct JsonWriter w = { .out = buf, };
+
+	json_put_response(&w, response);
+
+	json_end(&w);
+
+	return !buf->failed;
+}
+
@@ -0,0 +1,1036 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+
+#include "marshalling.h"
+
+#include "cfg.h"
+#include "convert.h"
+#include "global.h"
+#include "head.h"
+#include "ipc.h"
+#include "lid.h"
+#include "list.h"
+#include "log.h"
+#include "mode.h"
+#include "sockets.h"
+#include "stats.h"
+#include "tlv.h"
+#include "trace.h"
+
+void tlv_put_strs(struct TlvWriter *w, uint8_t tag, struct SList *strs) {
+	for (struct SList *i = strs; i; i = i->nex) {
+		tlv_put_str(w, tag, (char*)i->val);
+	}
+}
+
+void tlv_put_cfg(struct TlvWriter *w, struct Cfg *cfg) {
+	size_t begin = tlv_begin(w, TAG_CFG);
+
+	if (cfg->arrange) {
+		tlv_put_int(w, TAG_ARRANGE, cfg->arrange);
+	}
+
+	if (cfg->align) {
+		tlv_put_int(w, TAG_ALIGN, cfg->align);
+	}
+
+	tlv_put_strs(w, TAG_ORDER, cfg->order_name_desc);
+
+	if (cfg->auto_scale) {
+		tlv_put_bool(w, TAG_AUTO_SCALE, cfg->auto_scale == ON);
+	}
+
+	for (struct SList *i = cfg->user_scales; i; i = i->nex) {
+		struct UserScale *user_scale = (struct UserScale*)i->val;
+		size_t scale = tlv_begin(w, TAG_SCALE);
+		tlv_put_str(w, TAG_NAME_DESC, user_scale->name_desc);
+		tlv_put_float(w, TAG_SCALE_VAL, user_scale->scale);
+		tlv_end(w, scale);
+	}
+
+	for (struct SList *i = cfg->user_modes; i; i = i->nex) {
+		struct UserMode *user_mode = (struct UserMode*)i->val;
+		size_t mode = tlv_begin(w, TAG_MODE);
+		tlv_put_str(w, TAG_NAME_DESC, user_mode->name_desc);
+		if (user_mode->max) {
+			tlv_put_bool(w, TAG_MAX, true);
+		} else {
+			tlv_put_int(w, TAG_WIDTH, user_mode->width);
+			tlv_put_int(w, TAG_HEIGHT, user_mode->height);
+			if (user_mode->refresh_hz != -1) {
+				tlv_put_int(w, TAG_HZ, user_mode->refresh_hz);
+			}
+		}
+		tlv_end(w, mode);
+	}
+
+	tlv_put_strs(w, TAG_VRR_OFF, cfg->adaptive_sync_off_name_desc);
+
+	tlv_put_str(w, TAG_LAPTOP_DISPLAY_PREFIX, cfg->laptop_display_prefix);
+
+	tlv_put_strs(w, TAG_MAX_PREFERRED_REFRESH, cfg->max_preferred_refresh_name_desc);
+
+	tlv_put_strs(w, TAG_DISABLED, cfg->disabled_name_desc);
+
+	if (cfg->log_threshold) {
+		tlv_put_int(w, TAG_LOG_THRESHOLD, cfg->log_threshold);
+	}
+
+	tlv_put_strs(w, TAG_INCLUDE, cfg->includes);
+
+	tlv_end(w, begin);
+}
+
+void tlv_put_head_state(struct TlvWriter *w, uint8_t tag, struct HeadState *head_state) {
+	size_t begin = tlv_begin(w, tag);
+
+	tlv_put_double(w, TAG_SCALE_VAL, wl_fixed_to_double(head_state->scale));
+	tlv_put_bool(w, TAG_ENABLED, head_state->enabled);
+	tlv_put_int(w, TAG_X, head_state->x);
+	tlv_put_int(w, TAG_Y, head_state->y);
+
+	tlv_end(w, begin);
+}
+
+void tlv_put_head(struct TlvWriter *w, struct Head *head) {
+	size_t begin = tlv_begin(w, TAG_HEAD);
+
+	tlv_put_str(w, TAG_NAME, head->name);
+	tlv_put_str(w, TAG_DESCRIPTION, head->description);
+	tlv_put_str(w, TAG_MAKE, head->make);
+	tlv_put_str(w, TAG_MODEL, head->model);
+	tlv_put_str(w, TAG_SERIAL_NUMBER, head->serial_number);
+	tlv_put_int(w, TAG_WIDTH_MM, head->width_mm);
+	tlv_put_int(w, TAG_HEIGHT_MM, head->height_mm);
+	tlv_put_int(w, TAG_TRANSFORM, head->transform);
+
+	tlv_put_head_state(w, TAG_CURRENT, &head->current);
+	tlv_put_head_state(w, TAG_DESIRED, &head->desired);
+
+	for (struct SList *i = head->modes; i; i = i->nex) {
+		struct Mode *mode = (struct Mode*)i->val;
+		size_t m = tlv_begin(w, TAG_MODE);
+		tlv_put_int(w, TAG_WIDTH, mode->width);
+		tlv_put_int(w, TAG_HEIGHT, mode->height);
+		tlv_put_int(w, TAG_REFRESH_MHZ, mode->refresh_mhz);
+		tlv_put_bool(w, TAG_PREFERRED, mode->preferred);
+		tlv_put_bool(w, TAG_CURRENT, head->current.mode == mode);
+		tlv_end(w, m);
+	}
+
+	tlv_end(w, begin);
+}
+
+void tlv_put_evaluation(struct TlvWriter *w, struct IpcEvaluation *evaluation) {
+	size_t begin = tlv_begin(w, TAG_EVALUATION);
+
+	tlv_put_str(w, TAG_NAME, evaluation->name);
+	tlv_put_bool(w, TAG_ENABLED, evaluation->enabled);
+	if (evaluation->width) {
+		size_t m = tlv_begin(w, TAG_MODE);
+		tlv_put_int(w, TAG_WIDTH, evaluation->width);
+		tlv_put_int(w, TAG_HEIGHT, evaluation->height);
+		tlv_put_int(w, TAG_REFRESH_MHZ, evaluation->refresh_mhz);
+		tlv_end(w, m);
+	}
+	tlv_put_double(w, TAG_SCALE_VAL, evaluation->scale);
+	tlv_put_int(w, TAG_X, evaluation->x);
+	tlv_put_int(w, TAG_Y, evaluation->y);
+	tlv_put_bool(w, TAG_VRR, evaluation->adaptive_sync);
+
+	tlv_end(w, begin);
+}
+
+// append at tail, the last item appended, rather than walking the list
+void tlv_append(struct SList **head, struct SList **tail, void *val) {
+	*tail = slist_append(*tail ? tail : head, val);
+}
+
+// append a validated, not already present, name_desc
+// trusted when tail is set: appended at tail without validation
+void tlv_get_name_desc(struct TlvReader *r, struct TlvVal *v, struct SList **name_descs, struct SList **tail, enum CfgElement element) {
+	char *name_desc = tlv_str(r, v);
+	if (!name_desc) {
+		return;
+	}
+
+	if (tail) {
+		tlv_append(name_descs, tail, name_desc);
+		return;
+	}
+
+	if (slist_find_equal(*name_descs, slist_equal_strcmp, name_desc) || !validate_regex(name_desc, element)) {
+		free(name_desc);
+		return;
+	}
+
+	slist_append(name_descs, name_desc);
+}
+
+struct UserScale *tlv_get_user_scale(struct TlvReader *r, bool trusted) {
+	struct UserScale *user_scale = (struct UserScale*)calloc(1, sizeof(struct UserScale));
+	bool scale = false;
+
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_NAME_DESC:
+				free(user_scale->name_desc);
+				user_scale->name_desc = tlv_str(r, &v);
+				break;
+			case TAG_SCALE_VAL:
+				user_scale->scale = tlv_float(r, &v);
+				scale = true;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!user_scale->name_desc) {
+		log_warn("Ignoring missing %s %s %s", "SCALE", "", "NAME_DESC");
+	} else if (!scale) {
+		log_warn("Ignoring missing %s %s %s", "SCALE", user_scale->name_desc, "SCALE");
+	} else if (trusted || validate_regex(user_scale->name_desc, SCALE)) {
+		return user_scale;
+	}
+
+	cfg_user_scale_free(user_scale);
+	return NULL;
+}
+
+struct UserMode *tlv_get_user_mode(struct TlvReader *r, bool trusted) {
+	struct UserMode *user_mode = cfg_user_mode_default();
+
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_NAME_DESC:
+				free(user_mode->name_desc);
+				user_mode->name_desc = tlv_str(r, &v);
+				break;
+			case TAG_MAX:
+				user_mode->max = tlv_bool(r, &v);
+				break;
+			case TAG_WIDTH:
+				user_mode->width = (int32_t)tlv_int(r, &v);
+				break;
+			case TAG_HEIGHT:
+				user_mode->height = (int32_t)tlv_int(r, &v);
+				break;
+			case TAG_HZ:
+				user_mode->refresh_hz = (int32_t)tlv_int(r, &v);
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!user_mode->name_desc) {
+		log_warn("Ignoring missing %s %s %s", "MODE", "", "NAME_DESC");
+	} else if (trusted || validate_regex(user_mode->name_desc, MODE)) {
+		return user_mode;
+	}
+
+	cfg_user_mode_free(user_mode);
+	return NULL;
+}
+
+// same validation as for YAML, as the sender is not trusted
+// trusted content was validated before it was written: regexes and duplicates are not checked
+void tlv_get_cfg(struct TlvReader *r, struct Cfg *cfg, bool trusted) {
+	// by CfgElement, trusted only
+	struct SList *tails[ARRANGE_ALIGN] = { 0 };
+
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_ARRANGE:
+				cfg->arrange = (enum Arrange)tlv_int(r, &v);
+				if (!arrange_name(cfg->arrange)) {
+					cfg->arrange = ARRANGE_DEFAULT;
+					log_warn("Ignoring invalid ARRANGE, using default %s", arrange_name(cfg->arrange));
+				}
+				break;
+			case TAG_ALIGN:
+				cfg->align = (enum Align)tlv_int(r, &v);
+				if (!align_name(cfg->align)) {
+					cfg->align = ALIGN_DEFAULT;
+					log_warn("Ignoring invalid ALIGN, using default %s", align_name(cfg->align));
+				}
+				break;
+			case TAG_ORDER:
+				tlv_get_name_desc(r, &v, &cfg->order_name_desc, trusted ? &tails[ORDER] : NULL, ORDER);
+				break;
+			case TAG_AUTO_SCALE:
+				cfg->auto_scale = tlv_bool(r, &v) ? ON : OFF;
+				break;
+			case TAG_SCALE:
+				{
+					struct TlvReader nested = tlv_nested(r, &v);
+					struct UserScale *user_scale = tlv_get_user_scale(&nested, trusted);
+					if (user_scale && trusted) {
+						tlv_append(&cfg->user_scales, &tails[SCALE], user_scale);
+					} else if (user_scale) {
+						slist_remove_all_free(&cfg->user_scales, cfg_equal_user_scale_name, user_scale, cfg_user_scale_free);
+						slist_append(&cfg->user_scales, user_scale);
+					}
+					break;
+				}
+			case TAG_MODE:
+				{
+					struct TlvReader nested = tlv_nested(r, &v);
+					struct UserMode *user_mode = tlv_get_user_mode(&nested, trusted);
+					if (user_mode && trusted) {
+						tlv_append(&cfg->user_modes, &tails[MODE], user_mode);
+					} else if (user_mode) {
+						slist_remove_all_free(&cfg->user_modes, cfg_equal_user_mode_name, user_mode, cfg_user_mode_free);
+						slist_append(&cfg->user_modes, user_mode);
+					}
+					break;
+				}
+			case TAG_VRR_OFF:
+				tlv_get_name_desc(r, &v, &cfg->adaptive_sync_off_name_desc, trusted ? &tails[VRR_OFF] : NULL, VRR_OFF);
+				break;
+			case TAG_LAPTOP_DISPLAY_PREFIX:
+				free(cfg->laptop_display_prefix);
+				cfg->laptop_display_prefix = tlv_str(r, &v);
+				break;
+			case TAG_MAX_PREFERRED_REFRESH:
+				tlv_get_name_desc(r, &v, &cfg->max_preferred_refresh_name_desc, trusted ? &tails[MAX_PREFERRED_REFRESH] : NULL, MAX_PREFERRED_REFRESH);
+				break;
+			case TAG_DISABLED:
+				tlv_get_name_desc(r, &v, &cfg->disabled_name_desc, trusted ? &tails[DISABLED] : NULL, DISABLED);
+				break;
+			case TAG_LOG_THRESHOLD:
+				cfg->log_threshold = (enum LogThreshold)tlv_int(r, &v);
+				if (!log_threshold_name(cfg->log_threshold)) {
+					cfg->log_threshold = 0;
+					log_warn("Ignoring invalid LOG_THRESHOLD, using default %s", log_threshold_name(LOG_THRESHOLD_DEFAULT));
+				}
+				break;
+			case TAG_INCLUDE:
+				{
+					char *include = tlv_str(r, &v);
+					if (include) {
+						slist_append(&cfg->includes, include);
+					}
+					break;
+				}
+			default:
+				break;
+		}
+	}
+}
+
+void tlv_get_operation(struct TlvReader *r, struct IpcOperation *operation) {
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_OP:
+				operation->op = (enum IpcRequestOperation)tlv_int(r, &v);
+				break;
+			case TAG_CFG:
+				{
+					struct TlvReader nested = tlv_nested(r, &v);
+					cfg_free(operation->cfg);
+					operation->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+					tlv_get_cfg(&nested, operation->cfg, false);
+					break;
+				}
+			default:
+				break;
+		}
+	}
+}
+
+char *marshal_ipc_request_tlv(struct IpcRequest *request, size_t *len) {
+	if (!request) {
+		return NULL;
+	}
+
+	if (!ipc_request_op_name(request->op)) {
+		log_error("marshalling ipc request: missing OP");
+		return NULL;
+	}
+
+	struct TlvWriter w = { 0 };
+
+	tlv_message_begin(&w, TAG_REQUEST);
+
+	tlv_put_int(&w, TAG_OP, request->op);
+
+	if (request->encoding && request->encoding != IPC_ENCODING_TLV) {
+		tlv_put_int(&w, TAG_ENCODING, request->encoding);
+	}
+
+	if (request->memfd_threshold) {
+		tlv_put_int(&w, TAG_MEMFD_THRESHOLD, request->memfd_threshold);
+	}
+
+	if (request->timeout_ms) {
+		tlv_put_int(&w, TAG_TIMEOUT_MS, request->timeout_ms);
+	}
+
+	if (request->cfg) {
+		tlv_put_cfg(&w, request->cfg);
+	}
+
+	for (struct SList *i = request->ops; i; i = i->nex) {
+		struct IpcOperation *operation = (struct IpcOperation*)i->val;
+
+		size_t begin = tlv_begin(&w, TAG_OPERATION);
+		tlv_put_int(&w, TAG_OP, operation->op);
+		if (operation->cfg) {
+			tlv_put_cfg(&w, operation->cfg);
+		}
+		tlv_end(&w, begin);
+	}
+
+	tlv_message_end(&w);
+
+	*len = w.len;
+	return w.buf;
+}
+
+struct IpcRequest *unmarshal_ipc_request_tlv(const char *buf, size_t len) {
+	struct IpcRequest *request = (struct IpcRequest*)calloc(1, sizeof(struct IpcRequest));
+	request->encoding = IPC_ENCODING_TLV;
+
+	bool bad = false;
+	struct TlvReader r;
+	if (tlv_message_read(buf, len, &bad, &r) != TAG_REQUEST) {
+		log_error("\nunmarshalling ipc request: invalid message");
+		goto err;
+	}
+
+	struct TlvVal v;
+	while (tlv_next(&r, &v)) {
+		switch (v.tag) {
+			case TAG_OP:
+				request->op = (enum IpcRequestOperation)tlv_int(&r, &v);
+				break;
+			case TAG_ENCODING:
+				request->encoding = (enum IpcEncoding)tlv_int(&r, &v);
+				break;
+			case TAG_MEMFD_THRESHOLD:
+				{
+					int64_t threshold = tlv_int(&r, &v);
+					request->memfd_threshold = threshold > 0 ? threshold : 0;
+					break;
+				}
+			case TAG_TIMEOUT_MS:
+				{
+					int64_t timeout_ms = tlv_int(&r, &v);
+					request->timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+					break;
+				}
+			case TAG_CFG:
+				{
+					struct TlvReader nested = tlv_nested(&r, &v);
+					cfg_free(request->cfg);
+					request->cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+					tlv_get_cfg(&nested, request->cfg, false);
+					break;
+				}
+			case TAG_OPERATION:
+				{
+					struct TlvReader nested = tlv_nested(&r, &v);
+					struct IpcOperation *operation = ipc_operation_init(0, NULL);
+					slist_append(&request->ops, operation);
+					tlv_get_operation(&nested, operation);
+					break;
+				}
+			default:
+				break;
+		}
+	}
+
+	if (bad) {
+		log_error("\nunmarshalling ipc request: malformed message");
+		goto err;
+	}
+
+	for (struct SList *i = request->ops; i; i = i->nex) {
+		struct IpcOperation *operation = (struct IpcOperation*)i->val;
+		if (operation->op != CFG_SET && operation->op != CFG_DEL && operation->op != CFG_WRITE) {
+			log_error("\nunmarshalling ipc request: invalid OPS OP %d", operation->op);
+			goto err;
+		}
+	}
+
+	if (request->op == BATCH && !request->ops) {
+		log_error("\nunmarshalling ipc request: missing OPS");
+		goto err;
+	}
+
+	if (!ipc_request_op_name(request->op)) {
+		log_error("\nunmarshalling ipc request: invalid OP %d", request->op);
+		goto err;
+	}
+
+	if (!ipc_encoding_name(request->encoding)) {
+		log_error("\nunmarshalling ipc request: invalid ENCODING %d", request->encoding);
+		goto err;
+	}
+
+	return request;
+
+err:
+	ipc_request_free(request);
+	return NULL;
+}
+
+void tlv_put_trace_event(struct TlvWriter *w, const struct TraceEvent *event) {
+	size_t begin = tlv_begin(w, TAG_TRACE);
+
+	tlv_put_int(w, TAG_NS, event->ns);
+	tlv_put_int(w, TAG_EVENT, event->type);
+	tlv_put_int(w, TAG_SERIAL, event->serial);
+	if (event->head[0]) {
+		tlv_put_str(w, TAG_NAME, event->head);
+	}
+
+	switch (event->type) {
+		case TRACE_DELTA:
+			{
+				// differing only
+				size_t desired = tlv_begin(w, TAG_DESIRED);
+				if (event->delta & TRACE_DELTA_ENABLED) {
+					tlv_put_bool(w, TAG_ENABLED, event->desired.enabled);
+				}
+				if (event->delta & TRACE_DELTA_MODE) {
+					size_t mode = tlv_begin(w, TAG_MODE);
+					tlv_put_int(w, TAG_WIDTH, event->desired.width);
+					tlv_put_int(w, TAG_HEIGHT, event->desired.height);
+					tlv_put_int(w, TAG_REFRESH_MHZ, event->desired.refresh_mhz);
+					tlv_end(w, mode);
+				}
+				if (event->delta & TRACE_DELTA_SCALE) {
+					tlv_put_double(w, TAG_SCALE_VAL, wl_fixed_to_double(event->desired.scale));
+				}
+				if (event->delta & TRACE_DELTA_POSITION) {
+					tlv_put_int(w, TAG_X, event->desired.x);
+					tlv_put_int(w, TAG_Y, event->desired.y);
+				}
+				if (event->delta & TRACE_DELTA_VRR) {
+					tlv_put_bool(w, TAG_VRR, event->desired.adaptive_sync);
+				}
+				tlv_end(w, desired);
+				break;
+			}
+		case TRACE_APPLY:
+		case TRACE_ROLLBACK:
+			tlv_put_int(w, TAG_HEADS, event->heads);
+			break;
+		default:
+			break;
+	}
+
+	tlv_end(w, begin);
+}
+
+void tlv_get_trace_desired(struct TlvReader *r, struct TraceEvent *event) {
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_ENABLED:
+				event->delta |= TRACE_DELTA_ENABLED;
+				event->desired.enabled = tlv_bool(r, &v);
+				break;
+			case TAG_MODE:
+				{
+					event->delta |= TRACE_DELTA_MODE;
+					struct TlvReader nested = tlv_nested(r, &v);
+					struct TlvVal m;
+					while (tlv_next(&nested, &m)) {
+						if (m.tag == TAG_WIDTH) {
+							event->desired.width = (int32_t)tlv_int(&nested, &m);
+						} else if (m.tag == TAG_HEIGHT) {
+							event->desired.height = (int32_t)tlv_int(&nested, &m);
+						} else if (m.tag == TAG_REFRESH_MHZ) {
+							event->desired.refresh_mhz = (int32_t)tlv_int(&nested, &m);
+						}
+					}
+					break;
+				}
+			case TAG_SCALE_VAL:
+				event->delta |= TRACE_DELTA_SCALE;
+				event->desired.scale = wl_fixed_from_double(tlv_double(r, &v));
+				break;
+			case TAG_X:
+				event->delta |= TRACE_DELTA_POSITION;
+				event->desired.x = (int32_t)tlv_int(r, &v);
+				break;
+			case TAG_Y:
+				event->delta |= TRACE_DELTA_POSITION;
+				event->desired.y = (int32_t)tlv_int(r, &v);
+				break;
+			case TAG_VRR:
+				event->delta |= TRACE_DELTA_VRR;
+				event->desired.adaptive_sync = tlv_bool(r, &v);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void tlv_get_trace_event(struct TlvReader *r, struct TraceEvent *event) {
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_NS:
+				event->ns = tlv_int(r, &v);
+				break;
+			case TAG_EVENT:
+				event->type = (uint16_t)tlv_int(r, &v);
+				break;
+			case TAG_SERIAL:
+				event->serial = (uint32_t)tlv_int(r, &v);
+				break;
+			case TAG_NAME:
+				{
+					char *head = tlv_str(r, &v);
+					if (head) {
+						strncpy(event->head, head, TRACE_HEAD_LEN - 1);
+					}
+					free(head);
+					break;
+				}
+			case TAG_DESIRED:
+				{
+					struct TlvReader nested = tlv_nested(r, &v);
+					tlv_get_trace_desired(&nested, event);
+					break;
+				}
+			case TAG_HEADS:
+				event->heads = (uint32_t)tlv_int(r, &v);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void tlv_put_histogram(struct TlvWriter *w, uint8_t tag, const struct StatsHistogram *histogram) {
+	size_t begin = tlv_begin(w, tag);
+
+	tlv_put_int(w, TAG_COUNT, histogram->count);
+	tlv_put_int(w, TAG_SUM, histogram->sum);
+	tlv_put_int(w, TAG_MAX, histogram->max);
+	for (size_t i = 0; i < STATS_BUCKETS; i++) {
+		tlv_put_int(w, TAG_BUCKET, histogram->buckets[i]);
+	}
+
+	tlv_end(w, begin);
+}
+
+void tlv_put_stats(struct TlvWriter *w, const struct Stats *s) {
+	size_t begin = tlv_begin(w, TAG_STATS);
+
+	size_t begin_value;
+
+	for (enum StatsCounter c = 1; c < STATS_COUNTERS_END; c++) {
+		begin_value = tlv_begin(w, TAG_COUNTER);
+		tlv_put_str(w, TAG_NAME, stats_counter_name(c));
+		tlv_put_int(w, TAG_VALUE, s->counters[c]);
+		tlv_end(w, begin_value);
+	}
+
+	for (enum StatsGauge g = 1; g < STATS_GAUGES_END; g++) {
+		begin_value = tlv_begin(w, TAG_GAUGE);
+		tlv_put_str(w, TAG_NAME, stats_gauge_name(g));
+		tlv_put_int(w, TAG_VALUE, s->gauges[g]);
+		tlv_end(w, begin_value);
+	}
+
+	for (unsigned int op = 1; op < STATS_IPC_OPS; op++) {
+		if (ipc_request_op_name(op)) {
+			begin_value = tlv_begin(w, TAG_IPC_REQUESTS);
+			tlv_put_int(w, TAG_OP, op);
+			tlv_put_int(w, TAG_VALUE, s->ipc_requests[op]);
+			tlv_end(w, begin_value);
+		}
+	}
+
+	tlv_put_histogram(w, TAG_DESIRE_US, &s->desire_us);
+	tlv_put_histogram(w, TAG_APPLY_US, &s->apply_us);
+	tlv_put_histogram(w, TAG_SETTLE_US, &s->settle_us);
+	tlv_put_histogram(w, TAG_APPLIES, &s->applies);
+
+	tlv_end(w, begin);
+}
+
+void tlv_get_histogram(struct TlvReader *r, struct StatsHistogram *histogram) {
+	size_t bucket = 0;
+
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_COUNT:
+				histogram->count = (unsigned long)tlv_int(r, &v);
+				break;
+			case TAG_SUM:
+				histogram->sum = (uint64_t)tlv_int(r, &v);
+				break;
+			case TAG_MAX:
+				histogram->max = (uint64_t)tlv_int(r, &v);
+				break;
+			case TAG_BUCKET:
+				if (bucket < STATS_BUCKETS) {
+					histogram->buckets[bucket++] = (unsigned long)tlv_int(r, &v);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+// COUNTER, GAUGE or IPC_REQUESTS
+void tlv_get_stats_value(struct TlvReader *r, char **name, unsigned int *op, int64_t *value) {
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_NAME:
+				free(*name);
+				*name = tlv_str(r, &v);
+				break;
+			case TAG_OP:
+				*op = (unsigned int)tlv_int(r, &v);
+				break;
+			case TAG_VALUE:
+				*value = tlv_int(r, &v);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void tlv_get_stats(struct TlvReader *r, struct Stats *s) {
+	struct TlvVal v;
+	while (tlv_next(r, &v)) {
+		switch (v.tag) {
+			case TAG_COUNTER:
+			case TAG_GAUGE:
+			case TAG_IPC_REQUESTS:
+				{
+					char *name = NULL;
+					unsigned int op = 0;
+					int64_t value = 0;
+
+					// unknown names and ops are from a newer server
+					struct TlvReader nested = tlv_nested(r, &v);
+					tlv_get_stats_value(&nested, &name, &op, &value);
+					if (v.tag == TAG_COUNTER) {
+						enum StatsCounter c = stats_counter_val(name);
+						if (c) {
+							s->counters[c] = (unsigned long)value;
+						}
+					} else if (v.tag == TAG_GAUGE) {
+						enum StatsGauge g = stats_gauge_val(name);
+						if (g) {
+							s->gauges[g] = (long)value;
+						}
+					} else if (op < STATS_IPC_OPS) {
+						s->ipc_requests[op] = (unsigned long)value;
+					}
+
+					free(name);
+					break;
+				}
+			case TAG_DESIRE_US:
+			case TAG_APPLY_US:
+			case TAG_SETTLE_US:
+			case TAG_APPLIES:
+				{
+					struct StatsHistogram *histogram =
+						v.tag == TAG_DESIRE_US ? &s->desire_us :
+						v.tag == TAG_APPLY_US ? &s->apply_us :
+						v.tag == TAG_SETTLE_US ? &s->settle_us : &s->applies;
+					struct TlvReader nested = tlv_nested(r, &v);
+					tlv_get_histogram(&nested, histogram);
+					break;
+				}
+			default:
+				break;
+		}
+	}
+}
+
+// written top level record at a time when buf is set
+void tlv_flush(struct TlvWriter *w, struct SocketBuf *buf) {
+	if (buf) {
+		socket_buf_write(buf, w->buf, w->len);
+		w->len = 0;
+	}
+}
+
+void tlv_put_response(struct TlvWriter *w, struct IpcResponse *response, struct SocketBuf *buf) {
+	tlv_message_begin(w, TAG_RESPONSE);
+
+	tlv_put_bool(w, TAG_DONE, response->done);
+
+	if (response->state) {
+		if (cfg) {
+			tlv_put_cfg(w, cfg);
+			tlv_flush(w, buf);
+		}
+
+		if (lid) {
+			size_t l = tlv_begin(w, TAG_LID);
+			tlv_put_bool(w, TAG_CLOSED, lid->closed);
+			tlv_put_str(w, TAG_DEVICE_PATH, lid->device_path);
+			tlv_end(w, l);
+		}
+
+		for (struct SList *i = heads; i; i = i->nex) {
+			tlv_put_head(w, (struct Head*)i->val);
+			tlv_flush(w, buf);
+		}
+	}
+
+	if (response->trace) {
+		// oldest first
+		for (size_t i = 0; i < trace.len; i++) {
+			tlv_put_trace_event(w, trace_event_n(i));
+			tlv_flush(w, buf);
+		}
+	}
+
+	if (response->stats) {
+		tlv_put_stats(w, &stats);
+		tlv_flush(w, buf);
+	}
+
+	for (struct SList *i = response->evaluation; i; i = i->nex) {
+		tlv_put_evaluation(w, (struct IpcEvaluation*)i->val);
+		tlv_flush(w, buf);
+	}
+
+	if (response->messages) {
+		// oldest first
+		if (log_cap.dropped) {
+			tlv_put_int(w, TAG_MESSAGES_DROPPED, log_cap.dropped);
+			ipc_response_rc_message(response, log_cap.dropped_threshold);
+		}
+		for (size_t i = 0; i < log_cap.len; i++) {
+			const struct LogCapLine *cap_line = log_cap_line(i);
+			size_t message = tlv_begin(w, TAG_MESSAGE);
+			tlv_put_int(w, TAG_THRESHOLD, cap_line->threshold);
+			tlv_put_str(w, TAG_LINE, cap_line->line);
+			tlv_end(w, message);
+			tlv_flush(w, buf);
+			ipc_response_rc_message(response, cap_line->threshold);
+		}
+		log_capture_clear();
+	}
+
+	tlv_put_int(w, TAG_RC, response->rc);
+
+	tlv_message_end(w);
+	tlv_flush(w, buf);
+}
+
+char *marshal_ipc_response_tlv(struct IpcResponse *response, size_t *len) {
+	struct TlvWriter w = { 0 };
+
+	tlv_put_response(&w, response, NULL);
+
+	*len = w.len;
+	return w.buf;
+}
+
+bool marshal_ipc_response_tlv_stream(struct IpcResponse *response, struct SocketBuf *buf) {
+	struct TlvWriter w = { 0 };
+
+	tlv_put_response(&w, response, buf);
+
+	tlv_writer_free(&w);
+
+	return !buf->failed;
+}
+
+struct IpcResponse *unmarshal_ipc_response_tlv(const char *buf, size_t len) {
+	struct IpcResponse *response = (struct IpcResponse*)calloc(1, sizeof(struct IpcResponse));
+	response->encoding = IPC_ENCODING_TLV;
+
+	bool bad = false;
+	bool done = false;
+	bool rc = false;
+	size_t trace_size = 0;
+
+	struct TlvReader r;
+	if (tlv_message_read(buf, len, &bad, &r) != TAG_RESPONSE) {
+		log_error("\nunmarshalling ipc response: invalid message");
+		goto err;
+	}
+
+	// CFG and STATE are skipped, as they are for YAML
+	struct TlvVal v;
+	while (tlv_next(&r, &v)) {
+		switch (v.tag) {
+			case TAG_DONE:
+				response->done = tlv_bool(&r, &v);
+				done = true;
+				break;
+			case TAG_RC:
+				response->rc = (int)tlv_int(&r, &v);
+				rc = true;
+				break;
+			case TAG_MESSAGES_DROPPED:
+				response->messages_dropped = (unsigned long)tlv_int(&r, &v);
+				log_warn("%lu earlier messages dropped", response->messages_dropped);
+				break;
+			case TAG_MESSAGE:
+				{
+					struct TlvReader nested = tlv_nested(&r, &v);
+					enum LogThreshold threshold = 0;
+					char *line = NULL;
+					struct TlvVal m;
+					while (tlv_next(&nested, &m)) {
+						if (m.tag == TAG_THRESHOLD) {
+							threshold = (enum LogThreshold)tlv_int(&nested, &m);
+						} else if (m.tag == TAG_LINE) {
+							free(line);
+							line = tlv_str(&nested, &m);
+						}
+					}
+					if (line && log_threshold_name(threshold)) {
+						log_(threshold, "%s", line);
+					}
+					free(line);
+					break;
+				}
+			case TAG_TRACE:
+				{
+					if (response->trace_len == trace_size) {
+						trace_size = trace_size ? trace_size * 2 : 64;
+						response->trace_events = (struct TraceEvent*)realloc(response->trace_events, trace_size * sizeof(struct TraceEvent));
+					}
+					struct TraceEvent *event = &response->trace_events[response->trace_len++];
+					memset(event, 0, sizeof(struct TraceEvent));
+					struct TlvReader nested = tlv_nested(&r, &v);
+					tlv_get_trace_event(&nested, event);
+					break;
+				}
+			case TAG_STATS:
+				{
+					free(response->stats_values);
+					response->stats_values = (struct Stats*)calloc(1, sizeof(struct Stats));
+					struct TlvReader nested = tlv_nested(&r, &v);
+					tlv_get_stats(&nested, response->stats_values);
+					break;
+				}
+			default:
+				break;
+		}
+	}
+
+	if (bad) {
+		log_error("\nunmarshalling ipc response: malformed message");
+		goto err;
+	}
+
+	if (!done) {
+		log_error("\nunmarshalling ipc response: DONE missing");
+		goto err;
+	}
+
+	if (!rc) {
+		log_error("\nunmarshalling ipc response: RC missing");
+		goto err;
+	}
+
+	return response;
+
+err:
+	ipc_response_free(response);
+	return NULL;
+}
+
+
+char *marshal_cfg_cache_tlv(struct SList *cfg_layers, size_t *len) {
+	struct TlvWriter w = { 0 };
+
+	tlv_message_begin(&w, TAG_CFG_CACHE);
+
+	tlv_put_str(&w, TAG_VERSION, VERSION);
+
+	for (struct SList *i = cfg_layers; i; i = i->nex) {
+		struct CfgLayer *layer = (struct CfgLayer*)i->val;
+		if (!layer->cfg) {
+			continue;
+		}
+
+		size_t begin = tlv_begin(&w, TAG_LAYER);
+		tlv_put_str(&w, TAG_PATH, layer->file_path);
+		tlv_put_int(&w, TAG_HASH, (int64_t)layer->hash);
+		tlv_put_cfg(&w, layer->cfg);
+		tlv_end(&w, begin);
+	}
+
+	tlv_message_end(&w);
+
+	*len = w.len;
+	return w.buf;
+}
+
+struct Cfg *unmarshal_cfg_cache_tlv(const char *buf, size_t len, const char *path, uint64_t hash) {
+	bool bad = false;
+	struct TlvReader r;
+	if (tlv_message_read(buf, len, &bad, &r) != TAG_CFG_CACHE) {
+		return NULL;
+	}
+
+	struct TlvVal v;
+
+	// any other version may have parsed or validated differently
+	if (!tlv_next(&r, &v) || v.tag != TAG_VERSION ||
+			v.len != strlen(VERSION) || memcmp(v.val, VERSION, v.len) != 0) {
+		return NULL;
+	}
+
+	while (tlv_next(&r, &v)) {
+		if (v.tag != TAG_LAYER) {
+			continue;
+		}
+
+		// PATH and HASH precede CFG
+		struct TlvReader nested = tlv_nested(&r, &v);
+		bool matched_path = false, matched_hash = false;
+		struct TlvVal l;
+		while (tlv_next(&nested, &l)) {
+			switch (l.tag) {
+				case TAG_PATH:
+					matched_path = l.len == strlen(path) && memcmp(l.val, path, l.len) == 0;
+					break;
+				case TAG_HASH:
+					matched_hash = (uint64_t)tlv_int(&nested, &l) == hash;
+					break;
+				case TAG_CFG:
+					if (matched_path && matched_hash) {
+						struct TlvReader c = tlv_nested(&nested, &l);
+						struct Cfg *cfg = (struct Cfg*)calloc(1, sizeof(struct Cfg));
+						tlv_get_cfg(&c, cfg, true);
+						if (bad) {
+							cfg_free(cfg);
+							return NULL;
+						}
+						return cfg;
+					}
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	return NULL;
+}
@@ -104,12 +104,14 @@ void pid_file_create(void) {
 }
 
 void wd_exit(int __status) {
+	log_sink_flush();
 	exit(__status);
 }
 
 void wd_exit_message(int __status) {
 	log_error("\nPlease raise an issue: https://github.com/alex-courtis/way-displays/issues");
 	log_error("Attach this log and describe the events that occurred before this failure.");
+	log_sink_flush();
 	exit(__status);
 }
 
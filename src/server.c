@@ -19,11 +19,20 @@
 #include "ipc.h"
 #include "layout.h"
 #include "lid.h"
+#include "list.h"
 #include "log.h"
 #include "process.h"
+#include "snapshot.h"
+#include "stats.h"
 
 struct IpcResponse *ipc_response = NULL;
 
+// as of the last CFG_WRITE of a request, written once when the request has been handled
+struct Cfg *cfg_to_write = NULL;
+
+// cfg_layers modified, waiting for the cfg timer
+bool cfg_reload_pending = false;
+
 void handle_ipc_in_progress(int server_socket) {
 	struct IpcRequest *request = ipc_receive_request_server(server_socket);
 	if (!request) {
@@ -33,9 +42,33 @@ void handle_ipc_in_progress(int server_socket) {
 
 	struct IpcResponse *response = (struct IpcResponse*)calloc(1, sizeof(struct IpcResponse));
 	response->socket_client = request->socket_client;
+	response->encoding = request->encoding;
+	response->memfd_threshold = request->memfd_threshold;
 	response->done = true;
 	response->rc = IPC_RC_REQUEST_IN_PROGRESS;
 
+	// a SETTLE may wait for seconds; these do not need the messages, which are the SETTLE's
+	if (ipc_response->settle && !request->bad) {
+		switch (request->op) {
+			case TRACE:
+				response->rc = IPC_RC_SUCCESS;
+				response->trace = true;
+				break;
+			case STATS:
+				response->rc = IPC_RC_SUCCESS;
+				response->stats = true;
+				stats_sample();
+				break;
+			default:
+				break;
+		}
+		if (response->rc == IPC_RC_SUCCESS && request->op < STATS_IPC_OPS) {
+			stats.ipc_requests[request->op]++;
+		}
+	}
+
+	ipc_request_free(request);
+
 	ipc_send_response(response);
 
 	close(response->socket_client);
@@ -48,12 +81,19 @@ void handle_ipc_response(void) {
 		return;
 	}
 
+	// nothing until settled or timed out
+	if (ipc_response->settle && !ipc_response->done) {
+		return;
+	}
+
 	ipc_send_response(ipc_response);
 
 	if (ipc_response->done) {
 		log_capture_stop();
 		log_capture_clear();
 
+		fd_ipc_timer_arm(0);
+
 		close(ipc_response->socket_client);
 
 		ipc_response_free(ipc_response);
@@ -61,6 +101,59 @@ void handle_ipc_response(void) {
 	}
 }
 
+// SETTLE is done when settled or when timed_out
+// failed changes are not retried, so settle with an error
+void handle_ipc_settle(bool timed_out) {
+	if (layout_settled() && !cfg_reload_pending) {
+		bool failed = false;
+		for (struct SList *i = heads; i; i = i->nex) {
+			struct Head *head = i->val;
+			if (head_desired_failed(head)) {
+				log_error("\nSettled without %s: its desired state failed and was rolled back", head->name);
+				failed = true;
+			}
+		}
+		if (!failed) {
+			log_info("\nSettled");
+		}
+	} else if (timed_out) {
+		log_error("\nTimed out after %ldms waiting to settle", ipc_response->timeout_ms);
+	} else {
+		ipc_response->done = false;
+		return;
+	}
+
+	ipc_response->done = true;
+
+	print_heads(INFO, NONE, heads);
+}
+
+// true when cfg has been changed
+bool handle_ipc_operation(enum IpcRequestOperation op, struct Cfg *cfg_request) {
+	switch (op) {
+		case CFG_DEL:
+		case CFG_SET:
+			{
+				struct Cfg *cfg_merged = cfg_merge(cfg, cfg_request, op == CFG_DEL);
+				if (cfg_merged) {
+					cfg_free(cfg);
+					cfg = cfg_merged;
+					return true;
+				}
+				return false;
+			}
+		case CFG_WRITE:
+			{
+				// lists are shared, a later SET or DEL does not change it
+				cfg_free(cfg_to_write);
+				cfg_to_write = clone_cfg(cfg);
+				return false;
+			}
+		default:
+			return false;
+	}
+}
+
 void handle_ipc_request(int server_socket) {
 	if (ipc_response) {
 		handle_ipc_in_progress(server_socket);
@@ -80,6 +173,8 @@ void handle_ipc_request(int server_socket) {
 
 	ipc_response = (struct IpcResponse*)calloc(1, sizeof(struct IpcResponse));
 	ipc_response->socket_client = ipc_request->socket_client;
+	ipc_response->encoding = ipc_request->encoding;
+	ipc_response->memfd_threshold = ipc_request->memfd_threshold;
 	ipc_response->done = true;
 	ipc_response->messages = true;
 	ipc_response->state = true;
@@ -90,34 +185,92 @@ void handle_ipc_request(int server_socket) {
 		goto send;
 	}
 
+	if (ipc_request->op < STATS_IPC_OPS) {
+		stats.ipc_requests[ipc_request->op]++;
+	}
+
 	log_info("\nServer received request: %s", ipc_request_op_friendly(ipc_request->op));
 	if (ipc_request->cfg) {
 		print_cfg(INFO, ipc_request->cfg, ipc_request->op == CFG_DEL);
 	}
+	print_ipc_operations(INFO, ipc_request->ops);
 
 	switch (ipc_request->op) {
 		case CFG_DEL:
 		case CFG_SET:
+		case CFG_WRITE:
+		case BATCH:
 			{
-				struct Cfg *cfg_merged = cfg_merge(cfg, ipc_request->cfg, ipc_request->op == CFG_DEL);
-				if (cfg_merged) {
+				bool changed = false;
+
+				if (ipc_request->op == BATCH) {
+					// all merged before the next layout
+					for (struct SList *i = ipc_request->ops; i; i = i->nex) {
+						struct IpcOperation *operation = (struct IpcOperation*)i->val;
+						changed = handle_ipc_operation(operation->op, operation->cfg) || changed;
+					}
+				} else {
+					changed = handle_ipc_operation(ipc_request->op, ipc_request->cfg);
+				}
+
+				if (cfg_to_write) {
+					cfg_file_write(cfg_to_write);
+					cfg_free(cfg_to_write);
+					cfg_to_write = NULL;
+				}
+
+				if (changed) {
 					// ongoing
 					ipc_response->done = false;
-					cfg_free(cfg);
-					cfg = cfg_merged;
 					log_info("\nNew configuration:");
 					print_cfg(INFO, cfg, false);
-				} else {
+				} else if (ipc_request->op != CFG_WRITE) {
 					// complete
 					log_info("\nNo changes to make.");
 				}
 				break;
 			}
-		case CFG_WRITE:
+		case TRACE:
 			{
 				// complete
-				cfg_file_write();
-				log_info("\nWrote configuration file: %s", cfg->file_path);
+				ipc_response->state = false;
+				ipc_response->trace = true;
+				break;
+			}
+		case STATS:
+			{
+				// complete
+				ipc_response->state = false;
+				ipc_response->stats = true;
+				stats_sample();
+				break;
+			}
+		case EVALUATE:
+			{
+				// complete, as if the candidate were cfg.yaml, without applying
+				ipc_response->state = false;
+				struct Cfg *cfg_candidate = ipc_request->cfg ? cfg_layers_merge_candidate(ipc_request->cfg) : NULL;
+				if (ipc_request->cfg && !cfg_candidate) {
+					log_error("\nUnable to evaluate, an INCLUDE is unreadable or invalid");
+					break;
+				}
+				struct Cfg *cfg_evaluated = cfg_candidate ? cfg_candidate : cfg;
+
+				log_info("\nEvaluated configuration:");
+				print_cfg(INFO, cfg_evaluated, false);
+
+				ipc_response->evaluation = layout_evaluate(cfg_evaluated);
+
+				cfg_free(cfg_candidate);
+				break;
+			}
+		case SETTLE:
+			{
+				// ongoing, until settled or timed out
+				ipc_response->done = false;
+				ipc_response->settle = true;
+				ipc_response->timeout_ms = ipc_request->timeout_ms ? ipc_request->timeout_ms : IPC_SETTLE_TIMEOUT_MS_DEFAULT;
+				fd_ipc_timer_arm(ipc_response->timeout_ms);
 				break;
 			}
 		case GET:
@@ -157,6 +310,7 @@ int loop(void) {
 			wd_exit_message(EXIT_FAILURE);
 			return EXIT_FAILURE;
 		}
+		stats_inc(STATS_LOOPS);
 
 
 		// always read and dispatch wayland events; stop the file descriptor from getting stale
@@ -180,18 +334,38 @@ int loop(void) {
 		}
 
 
-		// cfg directory change
+		// cfg directory change, reloaded once quiet
 		if (pfd_cfg_dir && pfd_cfg_dir->revents & pfd_cfg_dir->events) {
-			if (cfg_file_modified(cfg->file_name)) {
-				if (cfg->written) {
-					cfg->written = false;
-				} else {
+			if (cfg_file_modified()) {
+				cfg_reload_pending = true;
+				fd_cfg_timer_arm(CFG_DEBOUNCE_MS);
+			}
+		}
+
+
+		// quiet, or retrying a directory deleted or moved away
+		if (pfd_cfg_timer && pfd_cfg_timer->revents & pfd_cfg_timer->events) {
+			if (fd_cfg_timer_expired()) {
+				// replaced directories may have new content
+				if (fd_cfg_dir_watch() || cfg_reload_pending) {
+					// including our own writes, which are already current
 					cfg_file_reload();
+					fd_cfg_dir_watch();
+					cfg_reload_pending = false;
+				}
+				if (fd_cfg_dir_unwatched()) {
+					fd_cfg_timer_arm(CFG_REWATCH_MS);
 				}
 			}
 		}
 
 
+		// log output writable
+		if ((pfd_log_out && pfd_log_out->revents & pfd_log_out->events) || (pfd_log_err && pfd_log_err->revents & pfd_log_err->events)) {
+			log_sink_drain();
+		}
+
+
 		// libinput lid event
 		if (pfd_lid && pfd_lid->revents & pfd_lid->events) {
 			lid_update();
@@ -208,13 +382,30 @@ int loop(void) {
 		layout();
 
 
+		// readers see the latest state
+		snapshot_publish();
+
+
+		// always drained, a SETTLE may have finished before its timeout
+		bool ipc_timed_out = pfd_ipc_timer && pfd_ipc_timer->revents & pfd_ipc_timer->events && fd_ipc_timer_expired();
+
+
 		// inform the client
 		if (ipc_response) {
-			ipc_response->done = displ->config_state == IDLE;
+			if (ipc_response->settle) {
+				handle_ipc_settle(ipc_timed_out);
+			} else if (ipc_response->state) {
+				// the state is reported once applied
+				ipc_response->done = displ->config_state == IDLE;
+			}
 			handle_ipc_response();
 		};
 
 
+		// write what we can, the remainder when writable
+		log_sink_drain();
+
+
 		destroy_pfds();
 	}
 }
@@ -223,6 +414,9 @@ int
 server(char *cfg_path) {
 	log_set_times(true);
 
+	// never block the loop on a slow stdout
+	log_sink_start();
+
 	// only one instance
 	pid_file_create();
 
@@ -250,15 +444,21 @@ server(char *cfg_path) {
 	// discover the output manager; it will call back
 	displ_init();
 
+	// shared state for readers
+	snapshot_init();
+
 	// only stops when signalled or display goes away
 	int sig = loop();
 
 	// release what remote resources we can
+	snapshot_destroy();
 	heads_destroy();
 	lid_destroy();
 	cfg_destroy();
 	displ_destroy();
 
+	log_sink_stop();
+
 	return sig;
 }
 
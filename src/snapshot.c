@@ -0,0 +1,147 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wayland-util.h>
+
+#include "snapshot.h"
+
+#include "global.h"
+#include "head.h"
+#include "lid.h"
+#include "list.h"
+#include "log.h"
+#include "mode.h"
+
+// server side, written in place under the seqlock
+struct Snapshot *snapshot_shared = NULL;
+
+// fields following seq, compared to skip unchanged writes
+#define SNAPSHOT_BODY offsetof(struct Snapshot, pid)
+
+void snapshot_build(struct Snapshot *snapshot) {
+	memset(snapshot, 0, sizeof(struct Snapshot));
+
+	snapshot->pid = getpid();
+
+	if (lid) {
+		snapshot->lid_present = true;
+		snapshot->lid_closed = lid->closed;
+	}
+
+	snapshot->heads_total = slist_length(heads);
+
+	for (struct SList *i = heads; i && snapshot->heads_len < SNAPSHOT_HEADS_MAX; i = i->nex) {
+		struct Head *head = i->val;
+		struct SnapshotHead *snapshot_head = &snapshot->heads[snapshot->heads_len++];
+
+		snprintf(snapshot_head->name, sizeof(snapshot_head->name), "%s", head->name ? head->name : "");
+		snprintf(snapshot_head->description, sizeof(snapshot_head->description), "%s", head->description ? head->description : "");
+
+		if (head->current.mode) {
+			snapshot_head->width = head->current.mode->width;
+			snapshot_head->height = head->current.mode->height;
+			snapshot_head->refresh_mhz = head->current.mode->refresh_mhz;
+		}
+
+		snapshot_head->x = head->current.x;
+		snapshot_head->y = head->current.y;
+		snapshot_head->scaled_width = head->scaled.width;
+		snapshot_head->scaled_height = head->scaled.height;
+		snapshot_head->transform = head->transform;
+		snapshot_head->scale = wl_fixed_to_double(head->current.scale);
+		snapshot_head->enabled = head->current.enabled;
+		snapshot_head->adaptive_sync = head->current.adaptive_sync == ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED;
+	}
+}
+
+void snapshot_write(const struct Snapshot *snapshot) {
+	uint32_t seq = __atomic_load_n(&snapshot_shared->seq, __ATOMIC_RELAXED);
+
+	// a previous server may have exited mid write
+	seq += seq & 1;
+
+	__atomic_store_n(&snapshot_shared->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy((char*)snapshot_shared + SNAPSHOT_BODY, (const char*)snapshot + SNAPSHOT_BODY, sizeof(struct Snapshot) - SNAPSHOT_BODY);
+
+	__atomic_store_n(&snapshot_shared->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void snapshot_init(void) {
+	char path[4096];
+	snapshot_path(path, sizeof(path));
+
+	// readers of a previous server's file continue to see updates
+	// the /tmp fallback is shared: no symlinks, and only a file private to us
+	int fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		log_warn_errno("\nunable to open snapshot %s", path);
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || st.st_nlink != 1 || st.st_mode & (S_IRWXG | S_IRWXO)) {
+		log_warn("\nIgnoring snapshot %s, not a private file", path);
+		close(fd);
+		return;
+	}
+
+	if (ftruncate(fd, sizeof(struct Snapshot)) == -1) {
+		log_warn_errno("\nunable to size snapshot %s", path);
+		close(fd);
+		return;
+	}
+
+	void *mapped = mmap(NULL, sizeof(struct Snapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		log_warn_errno("\nunable to map snapshot %s", path);
+		return;
+	}
+
+	snapshot_shared = mapped;
+	snapshot_shared->magic = SNAPSHOT_MAGIC;
+	snapshot_shared->version = SNAPSHOT_VERSION;
+	snapshot_shared->size = sizeof(struct Snapshot);
+
+	struct Snapshot snapshot;
+	snapshot_build(&snapshot);
+	snapshot_write(&snapshot);
+
+	log_debug("\nPublishing snapshot %s", path);
+}
+
+void snapshot_publish(void) {
+	if (!snapshot_shared) {
+		return;
+	}
+
+	struct Snapshot snapshot;
+	snapshot_build(&snapshot);
+
+	// only the server writes
+	if (memcmp((char*)snapshot_shared + SNAPSHOT_BODY, (char*)&snapshot + SNAPSHOT_BODY, sizeof(struct Snapshot) - SNAPSHOT_BODY) != 0) {
+		snapshot_write(&snapshot);
+	}
+}
+
+void snapshot_destroy(void) {
+	if (!snapshot_shared) {
+		return;
+	}
+
+	struct Snapshot snapshot;
+	memcpy(&snapshot, snapshot_shared, sizeof(struct Snapshot));
+	snapshot.pid = 0;
+	snapshot_write(&snapshot);
+
+	munmap(snapshot_shared, sizeof(struct Snapshot));
+	snapshot_shared = NULL;
+}
+
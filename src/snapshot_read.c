@@ -0,0 +1,94 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+// reader side, libc only
+
+#define SNAPSHOT_READ_TRIES 65536
+
+void snapshot_path(char *path, size_t len) {
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	const char *xdg_vtnr = getenv("XDG_VTNR");
+
+	if (!dir) {
+		dir = "/tmp";
+	}
+
+	if (xdg_vtnr) {
+		snprintf(path, len, "%s/way-displays.%s.snapshot", dir, xdg_vtnr);
+	} else {
+		snprintf(path, len, "%s/way-displays.snapshot", dir);
+	}
+}
+
+const struct Snapshot *snapshot_open(void) {
+	char path[4096];
+	snapshot_path(path, sizeof(path));
+
+	int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	// the /tmp fallback is shared
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || st.st_size < (off_t)sizeof(struct Snapshot)) {
+		close(fd);
+		return NULL;
+	}
+
+	void *mapped = mmap(NULL, sizeof(struct Snapshot), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return NULL;
+	}
+
+	const struct Snapshot *shared = mapped;
+	if (shared->magic != SNAPSHOT_MAGIC || shared->version != SNAPSHOT_VERSION || shared->size != sizeof(struct Snapshot)) {
+		munmap(mapped, sizeof(struct Snapshot));
+		return NULL;
+	}
+
+	return shared;
+}
+
+bool snapshot_read(const struct Snapshot *shared, struct Snapshot *snapshot) {
+	if (!shared || !snapshot) {
+		return false;
+	}
+
+	for (int i = 0; i < SNAPSHOT_READ_TRIES; i++) {
+		uint32_t seq = __atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+
+		memcpy(snapshot, shared, sizeof(struct Snapshot));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&shared->seq, __ATOMIC_RELAXED) == seq) {
+			snapshot->seq = seq;
+			if (snapshot->heads_len > SNAPSHOT_HEADS_MAX) {
+				snapshot->heads_len = SNAPSHOT_HEADS_MAX;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void snapshot_close(const struct Snapshot *shared) {
+	if (shared) {
+		munmap((void*)shared, sizeof(struct Snapshot));
+	}
+}
+
@@ -1,14 +1,18 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include "sockets.h"
+
 #include "log.h"
 
 #define SERVER_TIMEOUT_SEC 2
@@ -41,7 +45,47 @@ int socket_accept(int socket_server) {
 	return socket_client;
 }
 
-char *socket_read(int socket_client) {
+// fd passed with a received msg, -1 when none
+int msg_fd(struct msghdr *msg) {
+	int fd = -1;
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+
+	return fd;
+}
+
+// recvmsg with room for one passed fd, -1 when none
+ssize_t recv_fd(int socket_client, char *buf, size_t n, int *fd) {
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	struct iovec iov = { .iov_base = buf, .iov_len = n, };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+
+	ssize_t r = recvmsg(socket_client, &msg, MSG_CMSG_CLOEXEC);
+
+	*fd = r > 0 ? msg_fd(&msg) : -1;
+
+	return r;
+}
+
+char *socket_read_fd(int socket_client, size_t *len, int *fd) {
+	int passed = -1;
+
+	if (fd) {
+		*fd = -1;
+	}
 
 	// peek, as the sender may experience delay between connecting and sending
 	if (recv(socket_client, NULL, 0, MSG_PEEK) == -1) {
@@ -63,18 +107,106 @@ char *socket_read(int socket_client) {
 		return NULL;
 	}
 
-	// read it
+	// read it, stopping short after any passed fd
 	char *buf = calloc(n + 1, sizeof(char));
-	if (recv(socket_client, buf, n, 0) == -1) {
+	ssize_t r = recv_fd(socket_client, buf, n, &passed);
+	if (r == -1) {
 		log_error_errno("\nSocket recv failed");
+		free(buf);
 		return NULL;
 	}
 
-	log_debug_nocap("\nRead %d bytes from socket", n);
+	log_debug_nocap("\nRead %zd bytes from socket", r);
+
+	if (fd) {
+		*fd = passed;
+	} else if (passed != -1) {
+		close(passed);
+	}
+
+	if (len) {
+		*len = r;
+	}
 
 	return buf;
 }
 
+char *socket_read(int socket_client, size_t *len) {
+	return socket_read_fd(socket_client, len, NULL);
+}
+
+int socket_read_n_fd(int socket_client, char *buf, size_t n) {
+	size_t got = 0;
+	int fd = -1;
+
+	while (got < n) {
+		int passed = -1;
+		ssize_t r = recv_fd(socket_client, buf + got, n - got, &passed);
+		if (r == -1 && errno == EINTR) {
+			continue;
+		}
+		if (r == -1) {
+			if (errno == EAGAIN) {
+				log_error("\nSocket read timeout");
+			} else {
+				log_error_errno("\nSocket recv failed");
+			}
+			break;
+		}
+		if (r == 0) {
+			log_error("\nSocket closed after %zu of %zu bytes", got, n);
+			break;
+		}
+		if (passed != -1) {
+			if (fd == -1) {
+				fd = passed;
+			} else {
+				close(passed);
+			}
+		}
+		got += r;
+	}
+
+	if (got < n) {
+		if (fd != -1) {
+			close(fd);
+		}
+		return -1;
+	}
+
+	if (fd == -1) {
+		log_error("\nSocket fd not passed");
+	}
+
+	return fd;
+}
+
+bool socket_read_n(int socket_client, char *buf, size_t n) {
+	size_t got = 0;
+
+	while (got < n) {
+		ssize_t r = recv(socket_client, buf + got, n - got, 0);
+		if (r == -1 && errno == EINTR) {
+			continue;
+		}
+		if (r == -1) {
+			if (errno == EAGAIN) {
+				log_error("\nSocket read timeout");
+			} else {
+				log_error_errno("\nSocket recv failed");
+			}
+			return false;
+		}
+		if (r == 0) {
+			log_error("\nSocket closed after %zu of %zu bytes", got, n);
+			return false;
+		}
+		got += r;
+	}
+
+	return true;
+}
+
 ssize_t socket_write(int socket_client, char *data, size_t len) {
 	ssize_t n;
 	if ((n = write(socket_client, data, len)) == -1) {
@@ -87,6 +219,184 @@ ssize_t socket_write(int socket_client, char *data, size_t len) {
 	return n;
 }
 
+// all of data, a peer that has gone away is an error rather than a SIGPIPE
+bool send_all(int socket_client, const char *data, size_t len) {
+	size_t sent = 0;
+
+	while (sent < len) {
+		ssize_t n = send(socket_client, data + sent, len - sent, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n == -1) {
+			log_error_errno("\nSocket write failed");
+			return false;
+		}
+		sent += n;
+	}
+
+	return true;
+}
+
+bool socket_write_fd(int socket_client, const char *data, size_t len, int fd) {
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	memset(&control, 0, sizeof(control));
+
+	struct iovec iov = { .iov_base = (void*)data, .iov_len = len, };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	ssize_t n;
+	while ((n = sendmsg(socket_client, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+	if (n == -1) {
+		log_error_errno("\nSocket sendmsg failed");
+		return false;
+	}
+
+	// fd has been passed with the first byte
+	return send_all(socket_client, data + n, len - n);
+}
+
+// create the memfd on first use
+bool socket_buf_spill(struct SocketBuf *buf) {
+	if (!buf->spilled) {
+		buf->memfd = memfd_create("way-displays-ipc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (buf->memfd == -1) {
+			log_error_errno("\nmemfd create failed");
+			buf->failed = true;
+			return false;
+		}
+	}
+
+	size_t spilled = 0;
+	while (spilled < buf->len) {
+		ssize_t n = write(buf->memfd, buf->data + spilled, buf->len - spilled);
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n == -1) {
+			log_error_errno("\nmemfd write failed");
+			buf->failed = true;
+			return false;
+		}
+		spilled += n;
+	}
+
+	buf->spilled += buf->len;
+	buf->len = 0;
+
+	return true;
+}
+
+// seal the NUL terminated memfd and pass it in place of the response
+bool socket_buf_pass(struct SocketBuf *buf) {
+	if (write(buf->memfd, "", 1) != 1) {
+		log_error_errno("\nmemfd write failed");
+		return false;
+	}
+
+	if (fcntl(buf->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+		log_error_errno("\nmemfd seal failed");
+		return false;
+	}
+
+	if (!socket_write_fd(buf->socket, SOCKET_MEMFD_MARKER, SOCKET_MEMFD_MARKER_LEN, buf->memfd)) {
+		return false;
+	}
+
+	log_debug_nocap("\nPassed %zu bytes as memfd", buf->spilled);
+
+	return true;
+}
+
+// under threshold after all; read back through data
+bool socket_buf_copy(struct SocketBuf *buf) {
+	off_t offset = 0;
+
+	while (offset < (off_t)buf->spilled) {
+		ssize_t n = pread(buf->memfd, buf->data, SOCKET_BUF_SIZE, offset);
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			log_error_errno("\nmemfd read failed");
+			return false;
+		}
+		if (!send_all(buf->socket, buf->data, n)) {
+			return false;
+		}
+		offset += n;
+	}
+
+	return true;
+}
+
+bool socket_buf_flush(struct SocketBuf *buf) {
+	if (buf->failed) {
+		buf->len = 0;
+		return false;
+	}
+
+	if (buf->memfd_threshold && buf->spilled + buf->len >= buf->memfd_threshold) {
+		if (socket_buf_spill(buf) && !socket_buf_pass(buf)) {
+			buf->failed = true;
+		}
+	} else if (buf->spilled) {
+		if (socket_buf_spill(buf) && !socket_buf_copy(buf)) {
+			buf->failed = true;
+		}
+	} else if (!send_all(buf->socket, buf->data, buf->len)) {
+		buf->failed = true;
+	}
+
+	if (!buf->failed) {
+		buf->written += buf->spilled + buf->len;
+	}
+
+	if (buf->spilled) {
+		close(buf->memfd);
+		buf->spilled = 0;
+	}
+	buf->len = 0;
+
+	return !buf->failed;
+}
+
+void socket_buf_write(struct SocketBuf *buf, const char *data, size_t len) {
+	while (!buf->failed && len) {
+		size_t n = SOCKET_BUF_SIZE - buf->len;
+		if (n > len) {
+			n = len;
+		}
+
+		memcpy(buf->data + buf->len, data, n);
+		buf->len += n;
+		data += n;
+		len -= n;
+
+		if (buf->len == SOCKET_BUF_SIZE) {
+			if (buf->memfd_threshold) {
+				socket_buf_spill(buf);
+			} else {
+				socket_buf_flush(buf);
+			}
+		}
+	}
+}
+
 void socket_path(struct sockaddr_un *addr) {
 	size_t sun_path_size = sizeof(addr->sun_path);
 
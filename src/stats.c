@@ -0,0 +1,213 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stats.h"
+
+#include "convert.h"
+#include "displ.h"
+#include "global.h"
+#include "head.h"
+#include "list.h"
+#include "log.h"
+#include "trace.h"
+
+struct Stats stats = { 0 };
+
+// server side progress of the current transition
+struct StatsPending {
+	// monotonic, 0 when none in progress
+	int64_t hotplug_ns;
+	int64_t apply_ns;
+	unsigned long applies;
+	bool desired;
+};
+struct StatsPending stats_pending = { 0 };
+
+void stats_inc(enum StatsCounter counter) {
+	stats.counters[counter]++;
+}
+
+void stats_add(enum StatsCounter counter, unsigned long n) {
+	stats.counters[counter] += n;
+}
+
+void stats_sample(void) {
+	long enabled = 0;
+	for (struct SList *i = heads; i; i = i->nex) {
+		if (((struct Head*)i->val)->current.enabled) {
+			enabled++;
+		}
+	}
+
+	stats.gauges[STATS_HEADS] = slist_length(heads);
+	stats.gauges[STATS_HEADS_ENABLED] = enabled;
+	stats.gauges[STATS_TRACE_EVENTS] = trace.len;
+	stats.gauges[STATS_LOG_PENDING] = log_sink_out.len + log_sink_err.len;
+}
+
+void stats_histogram_add(struct StatsHistogram *histogram, uint64_t value) {
+	size_t i = value <= 1 ? 0 : 64 - __builtin_clzll(value - 1);
+	if (i >= STATS_BUCKETS) {
+		i = STATS_BUCKETS - 1;
+	}
+
+	histogram->buckets[i]++;
+	histogram->count++;
+	histogram->sum += value;
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+uint64_t since_us(int64_t ns) {
+	int64_t now = monotonic_ns();
+	return now > ns ? (now - ns) / 1000 : 0;
+}
+
+void stats_hotplug(void) {
+	stats.counters[STATS_HOTPLUGS]++;
+
+	if (!stats_pending.hotplug_ns) {
+		stats_pending.hotplug_ns = monotonic_ns();
+		stats_pending.applies = 0;
+		stats_pending.desired = false;
+	}
+}
+
+void stats_desire(void) {
+	if (stats_pending.hotplug_ns && !stats_pending.desired) {
+		stats_histogram_add(&stats.desire_us, since_us(stats_pending.hotplug_ns));
+		stats_pending.desired = true;
+	}
+}
+
+void stats_apply(bool modeset) {
+	stats.counters[STATS_APPLIED]++;
+	if (modeset) {
+		stats.counters[STATS_MODESETS]++;
+	}
+
+	stats_pending.apply_ns = monotonic_ns();
+	stats_pending.applies++;
+}
+
+void stats_result(enum ConfigState config_state) {
+	switch (config_state) {
+		case SUCCEEDED:
+			stats.counters[STATS_SUCCEEDED]++;
+			break;
+		case FAILED:
+			stats.counters[STATS_FAILED]++;
+			break;
+		case CANCELLED:
+			stats.counters[STATS_CANCELLED]++;
+			break;
+		default:
+			return;
+	}
+
+	if (stats_pending.apply_ns) {
+		stats_histogram_add(&stats.apply_us, since_us(stats_pending.apply_ns));
+		stats_pending.apply_ns = 0;
+	}
+}
+
+void stats_settled(void) {
+	if (!stats_pending.hotplug_ns) {
+		return;
+	}
+
+	stats_histogram_add(&stats.settle_us, since_us(stats_pending.hotplug_ns));
+	stats_histogram_add(&stats.applies, stats_pending.applies);
+
+	stats_pending.hotplug_ns = 0;
+}
+
+void print_histogram(FILE *stream, const char *name, const struct StatsHistogram *histogram) {
+	if (!histogram->count) {
+		fprintf(stream, "%-10s count 0\n", name);
+		return;
+	}
+
+	fprintf(stream, "%-10s count %lu mean %llu max %llu\n", name,
+			histogram->count,
+			(unsigned long long)(histogram->sum / histogram->count),
+			(unsigned long long)histogram->max);
+
+	for (size_t i = 0; i < STATS_BUCKETS; i++) {
+		if (!histogram->buckets[i]) {
+			continue;
+		}
+		if (i < STATS_BUCKETS - 1) {
+			fprintf(stream, "  <= %-10lu %lu\n", 1UL << i, histogram->buckets[i]);
+		} else {
+			fprintf(stream, "  >  %-10lu %lu\n", 1UL << (i - 1), histogram->buckets[i]);
+		}
+	}
+}
+
+void stats_print(FILE *stream, const struct Stats *s) {
+	for (enum StatsCounter c = 1; c < STATS_COUNTERS_END; c++) {
+		fprintf(stream, "%-16s %lu\n", stats_counter_friendly(c), s->counters[c]);
+	}
+
+	for (enum StatsGauge g = 1; g < STATS_GAUGES_END; g++) {
+		fprintf(stream, "%-16s %ld\n", stats_gauge_friendly(g), s->gauges[g]);
+	}
+
+	for (unsigned int op = 1; op < STATS_IPC_OPS; op++) {
+		const char *name = ipc_request_op_friendly(op);
+		if (name && s->ipc_requests[op]) {
+			fprintf(stream, "ipc %-12s %lu\n", name, s->ipc_requests[op]);
+		}
+	}
+
+	print_histogram(stream, "desire_us", &s->desire_us);
+	print_histogram(stream, "apply_us", &s->apply_us);
+	print_histogram(stream, "settle_us", &s->settle_us);
+	print_histogram(stream, "applies", &s->applies);
+}
+
+void print_histogram_prometheus(FILE *stream, const char *name, const struct StatsHistogram *histogram) {
+	fprintf(stream, "# TYPE way_displays_%s histogram\n", name);
+
+	// cumulative
+	unsigned long count = 0;
+	for (size_t i = 0; i < STATS_BUCKETS - 1; i++) {
+		count += histogram->buckets[i];
+		fprintf(stream, "way_displays_%s_bucket{le=\"%lu\"} %lu\n", name, 1UL << i, count);
+	}
+	fprintf(stream, "way_displays_%s_bucket{le=\"+Inf\"} %lu\n", name, histogram->count);
+
+	fprintf(stream, "way_displays_%s_sum %llu\n", name, (unsigned long long)histogram->sum);
+	fprintf(stream, "way_displays_%s_count %lu\n", name, histogram->count);
+}
+
+void stats_print_prometheus(FILE *stream, const struct Stats *s) {
+	for (enum StatsCounter c = 1; c < STATS_COUNTERS_END; c++) {
+		const char *name = stats_counter_friendly(c);
+		fprintf(stream, "# TYPE way_displays_%s_total counter\n", name);
+		fprintf(stream, "way_displays_%s_total %lu\n", name, s->counters[c]);
+	}
+
+	for (enum StatsGauge g = 1; g < STATS_GAUGES_END; g++) {
+		const char *name = stats_gauge_friendly(g);
+		fprintf(stream, "# TYPE way_displays_%s gauge\n", name);
+		fprintf(stream, "way_displays_%s %ld\n", name, s->gauges[g]);
+	}
+
+	fprintf(stream, "# TYPE way_displays_ipc_requests_total counter\n");
+	for (unsigned int op = 1; op < STATS_IPC_OPS; op++) {
+		const char *name = ipc_request_op_friendly(op);
+		if (name) {
+			fprintf(stream, "way_displays_ipc_requests_total{op=\"%s\"} %lu\n", name, s->ipc_requests[op]);
+		}
+	}
+
+	print_histogram_prometheus(stream, "desire_microseconds", &s->desire_us);
+	print_histogram_prometheus(stream, "apply_microseconds", &s->apply_us);
+	print_histogram_prometheus(stream, "settle_microseconds", &s->settle_us);
+	print_histogram_prometheus(stream, "transition_applies", &s->applies);
+}
+
@@ -0,0 +1,317 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlv.h"
+
+#define VARINT_MAX 10
+
+void tlv_reserve(struct TlvWriter *w, size_t n) {
+	if (w->len + n <= w->size) {
+		return;
+	}
+
+	size_t size = w->size ? w->size : 256;
+	while (size < w->len + n) {
+		size *= 2;
+	}
+
+	w->buf = realloc(w->buf, size);
+	w->size = size;
+}
+
+size_t varint_len(uint64_t val) {
+	size_t n = 1;
+	while (val >= 0x80) {
+		val >>= 7;
+		n++;
+	}
+	return n;
+}
+
+void put_varint(struct TlvWriter *w, uint64_t val) {
+	tlv_reserve(w, VARINT_MAX);
+	while (val >= 0x80) {
+		w->buf[w->len++] = (char)(val | 0x80);
+		val >>= 7;
+	}
+	w->buf[w->len++] = (char)val;
+}
+
+void put_header(struct TlvWriter *w, uint8_t tag, size_t len) {
+	tlv_reserve(w, 1 + VARINT_MAX + len);
+	w->buf[w->len++] = (char)tag;
+	put_varint(w, len);
+}
+
+void put_le(struct TlvWriter *w, uint8_t tag, uint64_t bits, size_t n) {
+	put_header(w, tag, n);
+	for (size_t i = 0; i < n; i++) {
+		w->buf[w->len++] = (char)(bits >> (8 * i));
+	}
+}
+
+bool get_varint(const char **pos, const char *end, uint64_t *val) {
+	*val = 0;
+	for (unsigned int shift = 0; *pos < end && shift < 7 * VARINT_MAX; shift += 7) {
+		uint8_t b = (uint8_t)*(*pos)++;
+		*val |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t get_le(struct TlvReader *r, const struct TlvVal *v, size_t n) {
+	if (v->len != n) {
+		*r->bad = true;
+		return 0;
+	}
+
+	uint64_t bits = 0;
+	for (size_t i = 0; i < n; i++) {
+		bits |= (uint64_t)(uint8_t)v->val[i] << (8 * i);
+	}
+	return bits;
+}
+
+bool tlv_is_message(const char *buf, size_t len) {
+	return buf && len > TLV_MAGIC_LEN && memcmp(buf, TLV_MAGIC, TLV_MAGIC_LEN) == 0;
+}
+
+void tlv_message_begin(struct TlvWriter *w, uint8_t kind) {
+	tlv_reserve(w, TLV_HEADER_LEN);
+	memcpy(w->buf + w->len, TLV_MAGIC, TLV_MAGIC_LEN);
+	w->len += TLV_MAGIC_LEN;
+	w->buf[w->len++] = TLV_VERSION;
+	w->buf[w->len++] = (char)kind;
+}
+
+void tlv_message_end(struct TlvWriter *w) {
+	put_header(w, 0, 0);
+}
+
+size_t tlv_message_len(const char *buf, size_t len) {
+	if (!tlv_is_message(buf, len) || len < TLV_HEADER_LEN || buf[TLV_MAGIC_LEN] != TLV_VERSION) {
+		return 0;
+	}
+
+	const char *pos = buf + TLV_HEADER_LEN;
+	const char *end = buf + len;
+
+	while (pos < end) {
+		uint8_t tag = (uint8_t)*pos++;
+
+		uint64_t val_len;
+		if (!get_varint(&pos, end, &val_len) || val_len > (uint64_t)(end - pos)) {
+			return 0;
+		}
+		pos += val_len;
+
+		if (!tag) {
+			return val_len ? 0 : (size_t)(pos - buf);
+		}
+	}
+
+	return 0;
+}
+
+bool tlv_message_need(const char *buf, size_t len, size_t *need) {
+	if (len < TLV_HEADER_LEN) {
+		*need = TLV_HEADER_LEN - len;
+		return len <= TLV_MAGIC_LEN ? memcmp(buf, TLV_MAGIC, len) == 0 : tlv_is_message(buf, len);
+	}
+
+	if (!tlv_is_message(buf, len) || buf[TLV_MAGIC_LEN] != TLV_VERSION) {
+		return false;
+	}
+
+	const char *pos = buf + TLV_HEADER_LEN;
+	const char *end = buf + len;
+
+	while (pos < end) {
+		uint8_t tag = (uint8_t)*pos++;
+
+		const char *val = pos;
+		uint64_t val_len;
+		if (!get_varint(&pos, end, &val_len)) {
+			if (end - val >= VARINT_MAX) {
+				return false;
+			}
+			*need = 1;
+			return true;
+		}
+
+		if (val_len > (uint64_t)(end - pos)) {
+			*need = val_len - (end - pos);
+			return true;
+		}
+		pos += val_len;
+
+		if (!tag) {
+			*need = 0;
+			return !val_len && pos == end;
+		}
+	}
+
+	*need = 1;
+	return true;
+}
+
+uint8_t tlv_message_read(const char *buf, size_t len, bool *bad, struct TlvReader *r) {
+	if (tlv_message_len(buf, len) != len) {
+		return 0;
+	}
+
+	r->pos = buf + TLV_HEADER_LEN;
+	r->end = buf + len - 2;
+	r->bad = bad;
+
+	return (uint8_t)buf[TLV_MAGIC_LEN + 1];
+}
+
+void tlv_put_int(struct TlvWriter *w, uint8_t tag, int64_t val) {
+	uint64_t zigzag = ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+
+	put_header(w, tag, varint_len(zigzag));
+	put_varint(w, zigzag);
+}
+
+void tlv_put_bool(struct TlvWriter *w, uint8_t tag, bool val) {
+	tlv_put_int(w, tag, val);
+}
+
+void tlv_put_str(struct TlvWriter *w, uint8_t tag, const char *str) {
+	if (!str) {
+		return;
+	}
+
+	size_t len = strlen(str);
+
+	put_header(w, tag, len);
+	memcpy(w->buf + w->len, str, len);
+	w->len += len;
+}
+
+void tlv_put_float(struct TlvWriter *w, uint8_t tag, float val) {
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+
+	put_le(w, tag, bits, sizeof(bits));
+}
+
+void tlv_put_double(struct TlvWriter *w, uint8_t tag, double val) {
+	uint64_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+
+	put_le(w, tag, bits, sizeof(bits));
+}
+
+size_t tlv_begin(struct TlvWriter *w, uint8_t tag) {
+	size_t begin = w->len;
+
+	// length is usually a single byte; tlv_end makes room when it isn't
+	put_header(w, tag, 0);
+
+	return begin;
+}
+
+void tlv_end(struct TlvWriter *w, size_t begin) {
+	size_t start = begin + 2;
+	size_t len = w->len - start;
+	size_t n = varint_len(len);
+
+	if (n > 1) {
+		tlv_reserve(w, n - 1);
+		memmove(w->buf + start + n - 1, w->buf + start, len);
+	}
+
+	w->len = begin + 1;
+	put_varint(w, len);
+	w->len += len;
+}
+
+void tlv_writer_free(struct TlvWriter *w) {
+	free(w->buf);
+
+	w->buf = NULL;
+	w->len = 0;
+	w->size = 0;
+}
+
+bool tlv_next(struct TlvReader *r, struct TlvVal *v) {
+	if (*r->bad || r->pos >= r->end) {
+		return false;
+	}
+
+	v->tag = (uint8_t)*r->pos++;
+
+	uint64_t len;
+	if (!get_varint(&r->pos, r->end, &len) || len > (uint64_t)(r->end - r->pos)) {
+		*r->bad = true;
+		return false;
+	}
+
+	v->val = r->pos;
+	v->len = len;
+
+	r->pos += len;
+
+	return true;
+}
+
+int64_t tlv_int(struct TlvReader *r, const struct TlvVal *v) {
+	const char *pos = v->val;
+	uint64_t zigzag;
+
+	if (!get_varint(&pos, v->val + v->len, &zigzag) || pos != v->val + v->len) {
+		*r->bad = true;
+		return 0;
+	}
+
+	return (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+}
+
+bool tlv_bool(struct TlvReader *r, const struct TlvVal *v) {
+	return tlv_int(r, v) != 0;
+}
+
+char *tlv_str(struct TlvReader *r, const struct TlvVal *v) {
+	if (memchr(v->val, '\0', v->len)) {
+		*r->bad = true;
+		return NULL;
+	}
+
+	return strndup(v->val, v->len);
+}
+
+float tlv_float(struct TlvReader *r, const struct TlvVal *v) {
+	uint32_t bits = (uint32_t)get_le(r, v, sizeof(bits));
+
+	float val;
+	memcpy(&val, &bits, sizeof(val));
+
+	return val;
+}
+
+double tlv_double(struct TlvReader *r, const struct TlvVal *v) {
+	uint64_t bits = get_le(r, v, sizeof(bits));
+
+	double val;
+	memcpy(&val, &bits, sizeof(val));
+
+	return val;
+}
+
+struct TlvReader tlv_nested(struct TlvReader *r, const struct TlvVal *v) {
+	struct TlvReader nested = {
+		.pos = v->val,
+		.end = v->val + v->len,
+		.bad = r->bad,
+	};
+
+	return nested;
+}
+
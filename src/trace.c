@@ -0,0 +1,191 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+
+#include "trace.h"
+
+#include "convert.h"
+#include "json.h"
+#include "log.h"
+
+struct Trace trace = { 0 };
+
+struct TraceEvent *trace_event(enum TraceEventType type, uint32_t serial, const char *head) {
+	struct TraceEvent *event;
+
+	if (trace.len < TRACE_EVENTS_MAX) {
+		event = &trace.events[(trace.start + trace.len++) % TRACE_EVENTS_MAX];
+	} else {
+		// overwrite the oldest
+		event = &trace.events[trace.start];
+		trace.start = (trace.start + 1) % TRACE_EVENTS_MAX;
+		trace.dropped++;
+	}
+
+	memset(event, 0, sizeof(struct TraceEvent));
+
+	event->ns = monotonic_ns();
+	event->type = type;
+	event->serial = serial;
+	if (head) {
+		strncpy(event->head, head, TRACE_HEAD_LEN - 1);
+	}
+
+	return event;
+}
+
+const struct TraceEvent *trace_event_n(size_t n) {
+	if (n >= trace.len) {
+		return NULL;
+	}
+
+	return &trace.events[(trace.start + n) % TRACE_EVENTS_MAX];
+}
+
+void trace_clear(void) {
+	trace.start = 0;
+	trace.len = 0;
+	trace.dropped = 0;
+}
+
+void trace_print_text(FILE *stream, const struct TraceEvent *events, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		const struct TraceEvent *event = &events[i];
+		const char *type = trace_event_type_name(event->type);
+
+		fprintf(stream, "%lld.%06lld %-13s serial %u",
+				(long long)(event->ns / 1000000000), (long long)(event->ns % 1000000000 / 1000),
+				type ? type : "?",
+				event->serial);
+
+		if (event->head[0]) {
+			fprintf(stream, " %s", event->head);
+		}
+
+		switch (event->type) {
+			case TRACE_DELTA:
+				if (event->delta & TRACE_DELTA_ENABLED) {
+					fprintf(stream, " %s", event->desired.enabled ? "enabled" : "disabled");
+				}
+				if (event->delta & TRACE_DELTA_MODE) {
+					fprintf(stream, " mode %dx%d@%d.%03dHz",
+							event->desired.width, event->desired.height,
+							event->desired.refresh_mhz / 1000, event->desired.refresh_mhz % 1000);
+				}
+				if (event->delta & TRACE_DELTA_SCALE) {
+					fprintf(stream, " scale %.3f", wl_fixed_to_double(event->desired.scale));
+				}
+				if (event->delta & TRACE_DELTA_POSITION) {
+					fprintf(stream, " position %d,%d", event->desired.x, event->desired.y);
+				}
+				if (event->delta & TRACE_DELTA_VRR) {
+					fprintf(stream, " VRR %s", event->desired.adaptive_sync ? "on" : "off");
+				}
+				break;
+			case TRACE_APPLY:
+			case TRACE_ROLLBACK:
+				fprintf(stream, " heads %u", event->heads);
+				break;
+			default:
+				break;
+		}
+
+		fprintf(stream, "\n");
+	}
+}
+
+// the outcome of the APPLY or ROLLBACK at i, NULL when still outstanding
+const struct TraceEvent *apply_outcome(const struct TraceEvent *events, size_t len, size_t i) {
+	for (size_t j = i + 1; j < len; j++) {
+		switch (events[j].type) {
+			case TRACE_SUCCEEDED:
+			case TRACE_FAILED:
+			case TRACE_CANCELLED:
+				return &events[j];
+			case TRACE_APPLY:
+			case TRACE_ROLLBACK:
+				return NULL;
+			default:
+				break;
+		}
+	}
+	return NULL;
+}
+
+void trace_print_chrome(FILE *stream, const struct TraceEvent *events, size_t len) {
+	struct JsonWriter w = { 0 };
+
+	json_object_begin(&w, NULL);
+	json_array_begin(&w, "traceEvents");
+
+	for (size_t i = 0; i < len; i++) {
+		const struct TraceEvent *event = &events[i];
+		const struct TraceEvent *outcome = (event->type == TRACE_APPLY || event->type == TRACE_ROLLBACK) ? apply_outcome(events, len, i) : NULL;
+
+		json_object_begin(&w, NULL);
+		json_put_str(&w, "name", trace_event_type_name(event->type));
+		json_put_str(&w, "cat", "way-displays");
+		if (outcome) {
+			json_put_str(&w, "ph", "X");
+			json_put_int(&w, "dur", (outcome->ns - event->ns) / 1000);
+		} else {
+			json_put_str(&w, "ph", "i");
+			json_put_str(&w, "s", "g");
+		}
+		json_put_int(&w, "ts", event->ns / 1000);
+		json_put_int(&w, "pid", 1);
+		json_put_int(&w, "tid", 1);
+
+		json_object_begin(&w, "args");
+		json_put_int(&w, "serial", event->serial);
+		if (event->head[0]) {
+			json_put_str(&w, "head", event->head);
+		}
+		switch (event->type) {
+			case TRACE_DELTA:
+				if (event->delta & TRACE_DELTA_ENABLED) {
+					json_put_bool(&w, "enabled", event->desired.enabled);
+				}
+				if (event->delta & TRACE_DELTA_MODE) {
+					json_put_int(&w, "width", event->desired.width);
+					json_put_int(&w, "height", event->desired.height);
+					json_put_int(&w, "refresh_mhz", event->desired.refresh_mhz);
+				}
+				if (event->delta & TRACE_DELTA_SCALE) {
+					json_put_double(&w, "scale", wl_fixed_to_double(event->desired.scale));
+				}
+				if (event->delta & TRACE_DELTA_POSITION) {
+					json_put_int(&w, "x", event->desired.x);
+					json_put_int(&w, "y", event->desired.y);
+				}
+				if (event->delta & TRACE_DELTA_VRR) {
+					json_put_bool(&w, "vrr", event->desired.adaptive_sync);
+				}
+				break;
+			case TRACE_APPLY:
+			case TRACE_ROLLBACK:
+				json_put_int(&w, "heads", event->heads);
+				if (outcome) {
+					json_put_str(&w, "outcome", trace_event_type_name(outcome->type));
+				}
+				break;
+			default:
+				break;
+		}
+		json_object_end(&w);
+
+		json_object_end(&w);
+	}
+
+	json_array_end(&w);
+	json_put_str(&w, "displayTimeUnit", "ms");
+	json_object_end(&w);
+
+	char *json = json_end(&w);
+	fprintf(stream, "%s", json);
+	free(json);
+}
+
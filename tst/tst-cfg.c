@@ -3,11 +3,17 @@
 #include "expects.h"
 
 #include <cmocka.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "global.h"
 #include "list.h"
+#include "log.h"
 
 #include "cfg.h"
 
@@ -15,6 +21,8 @@ struct Cfg *merge_set(struct Cfg *to, struct Cfg *from);
 struct Cfg *merge_del(struct Cfg *to, struct Cfg *from);
 void validate_warn(struct Cfg *cfg);
 void validate_fix(struct Cfg *cfg);
+void cfg_reuse(struct Cfg *to, struct Cfg *from, unsigned int changed);
+void cfg_share(struct Cfg *to, struct Cfg *from, enum CfgElement element);
 
 
 struct State {
@@ -131,15 +139,15 @@ void merge_set__user_scale(void **state) {
 void merge_set__mode(void **state) {
 	struct State *s = *state;
 
-	slist_append(&s->to->user_modes, cfg_user_mode_init("to", false, 1, 2, 3, false));
-	slist_append(&s->to->user_modes, cfg_user_mode_init("both", false, 4, 5, 6, false));
+	slist_append(&s->to->user_modes, cfg_user_mode_init("to", false, 1, 2, 3));
+	slist_append(&s->to->user_modes, cfg_user_mode_init("both", false, 4, 5, 6));
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("from", false, 7, 8, 9, true));
-	slist_append(&s->from->user_modes, cfg_user_mode_init("both", false, 10, 11, 12, true));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("from", false, 7, 8, 9));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("both", false, 10, 11, 12));
 
-	slist_append(&s->expected->user_modes, cfg_user_mode_init("to", false, 1, 2, 3, false));
-	slist_append(&s->expected->user_modes, cfg_user_mode_init("both", false, 10, 11, 12, true));
-	slist_append(&s->expected->user_modes, cfg_user_mode_init("from", false, 7, 8, 9, true));
+	slist_append(&s->expected->user_modes, cfg_user_mode_init("to", false, 1, 2, 3));
+	slist_append(&s->expected->user_modes, cfg_user_mode_init("both", false, 10, 11, 12));
+	slist_append(&s->expected->user_modes, cfg_user_mode_init("from", false, 7, 8, 9));
 
 	struct Cfg *merged = merge_set(s->to, s->from);
 
@@ -188,6 +196,35 @@ void merge_set__disabled(void **state) {
 	cfg_free(merged);
 }
 
+void merge_set__shared(void **state) {
+	struct State *s = *state;
+
+	slist_append(&s->to->user_scales, cfg_user_scale_init("to", 1));
+	slist_append(&s->to->disabled_name_desc, strdup("to"));
+
+	slist_append(&s->from->user_scales, cfg_user_scale_init("to", 2));
+
+	slist_append(&s->expected->user_scales, cfg_user_scale_init("to", 2));
+	slist_append(&s->expected->disabled_name_desc, strdup("to"));
+
+	struct Cfg *merged = merge_set(s->to, s->from);
+
+	// changed copied, unchanged shared
+	assert_ptr_not_equal(merged->user_scales, s->to->user_scales);
+	assert_ptr_equal(merged->disabled_name_desc, s->to->disabled_name_desc);
+	assert_int_equal(cfg_changed(merged, s->to), 1 << SCALE);
+
+	// to's untouched
+	assert_float_equal(((struct UserScale*)s->to->user_scales->val)->scale, 1, 0.001);
+
+	// outlives to
+	cfg_free(s->to);
+	s->to = NULL;
+	assert_cfg_equal(merged, s->expected);
+
+	cfg_free(merged);
+}
+
 void merge_del__scale(void **state) {
 	struct State *s = *state;
 
@@ -209,13 +246,13 @@ void merge_del__scale(void **state) {
 void merge_del__mode(void **state) {
 	struct State *s = *state;
 
-	slist_append(&s->to->user_modes, cfg_user_mode_init("1", false, 1, 1, 1, false));
-	slist_append(&s->to->user_modes, cfg_user_mode_init("2", false, 2, 2, 2, false));
+	slist_append(&s->to->user_modes, cfg_user_mode_init("1", false, 1, 1, 1));
+	slist_append(&s->to->user_modes, cfg_user_mode_init("2", false, 2, 2, 2));
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("2", false, 2, 2, 2, false));
-	slist_append(&s->from->user_modes, cfg_user_mode_init("3", false, 3, 3, 3, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("2", false, 2, 2, 2));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("3", false, 3, 3, 3));
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("1", false, 1, 1, 1, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("1", false, 1, 1, 1));
 
 	struct Cfg *merged = merge_del(s->to, s->from);
 
@@ -313,28 +350,28 @@ void validate_fix__scale(void **state) {
 void validate_fix__mode(void **state) {
 	struct State *s = *state;
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("ok", false, 1, 2, 3, false));
-	slist_append(&s->from->user_modes, cfg_user_mode_init("max", true, -1, -1, -1, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("ok", false, 1, 2, 3));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("max", true, -1, -1, -1));
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("negative width", false, -99, 2, 3, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("negative width", false, -99, 2, 3));
 	expect_log_warn("\nIgnoring non-positive MODE %s WIDTH %d", "negative width", NULL, NULL, NULL);
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("negative height", false, 1, -99, 3, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("negative height", false, 1, -99, 3));
 	expect_log_warn("\nIgnoring non-positive MODE %s HEIGHT %d", "negative height", NULL, NULL, NULL);
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("negative hz", false, 1, 2, -99, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("negative hz", false, 1, 2, -99));
 	expect_log_warn("\nIgnoring non-positive MODE %s HZ %d", "negative hz", NULL, NULL, NULL);
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("missing width", false, -1, 2, 3, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("missing width", false, -1, 2, 3));
 	expect_log_warn("\nIgnoring invalid MODE %s missing WIDTH", "missing width", NULL, NULL, NULL);
 
-	slist_append(&s->from->user_modes, cfg_user_mode_init("missing height", false, 1, -1, 3, false));
+	slist_append(&s->from->user_modes, cfg_user_mode_init("missing height", false, 1, -1, 3));
 	expect_log_warn("\nIgnoring invalid MODE %s missing HEIGHT", "missing height", NULL, NULL, NULL);
 
 	validate_fix(s->from);
 
-	slist_append(&s->expected->user_modes, cfg_user_mode_init("ok", false, 1, 2, 3, false));
-	slist_append(&s->expected->user_modes, cfg_user_mode_init("max", true, -1, -1, -1, false));
+	slist_append(&s->expected->user_modes, cfg_user_mode_init("ok", false, 1, 2, 3));
+	slist_append(&s->expected->user_modes, cfg_user_mode_init("max", true, -1, -1, -1));
 
 	assert_cfg_equal(s->from, s->expected);
 }
@@ -348,8 +385,8 @@ void validate_warn__(void **state) {
 	slist_append(&s->expected->user_scales, cfg_user_scale_init("ssssssss", 2));
 	expect_log_warn(fmt, "SCALE", "sss", NULL, NULL);
 
-	slist_append(&s->expected->user_modes, cfg_user_mode_init("mmm", false, 1, 1, 1, false));
-	slist_append(&s->expected->user_modes, cfg_user_mode_init("mmmmmmmm", false, 1, 1, 1, false));
+	slist_append(&s->expected->user_modes, cfg_user_mode_init("mmm", false, 1, 1, 1));
+	slist_append(&s->expected->user_modes, cfg_user_mode_init("mmmmmmmm", false, 1, 1, 1));
 	expect_log_warn(fmt, "MODE", "mmm", NULL, NULL);
 
 	slist_append(&s->expected->order_name_desc, strdup("ooo"));
@@ -371,6 +408,396 @@ void validate_warn__(void **state) {
 	validate_warn(s->expected);
 }
 
+void cfg_changed__sections(void **state) {
+	struct State *s = *state;
+
+	assert_int_equal(cfg_changed(s->from, s->to), 0);
+	assert_true(cfg_equal(s->from, s->to));
+
+	s->from->arrange = COL;
+	slist_append(&s->from->user_scales, cfg_user_scale_init("DP-1", 2));
+	s->to->log_threshold = DEBUG;
+
+	assert_int_equal(cfg_changed(s->from, s->to), (1 << ARRANGE) | (1 << SCALE) | (1 << LOG_THRESHOLD));
+	assert_false(cfg_equal(s->from, s->to));
+}
+
+void write_file(const char *path, const char *content) {
+	FILE *f = fopen(path, "w");
+	assert_non_null(f);
+	fputs(content, f);
+	fclose(f);
+}
+
+void cfg_reuse__changed(void **state) {
+	struct Cfg *from = cfg_default();
+	slist_append(&from->order_name_desc, strdup("x"));
+	slist_append(&from->disabled_name_desc, strdup("!a.*"));
+	const struct CfgCompiled *compiled = cfg_compiled(from);
+	struct Matcher *disabled = compiled->disabled.matchers;
+	from->marshalled = strdup("ORDER:\n  - x\n");
+
+	struct Cfg *to = cfg_default();
+	slist_append(&to->order_name_desc, strdup("y"));
+	slist_append(&to->disabled_name_desc, strdup("!a.*"));
+
+	cfg_reuse(to, from, cfg_changed(from, to));
+
+	// unchanged shared with its matchers
+	assert_ptr_equal(to->disabled_name_desc, from->disabled_name_desc);
+	assert_ptr_equal(to->compiled->disabled.matchers, disabled);
+	assert_null(from->compiled->disabled.matchers);
+
+	// changed compiled
+	assert_ptr_not_equal(to->order_name_desc, from->order_name_desc);
+	assert_int_equal(to->compiled->order.len, 1);
+	assert_string_equal(to->compiled->order.matchers[0].name_desc, "y");
+
+	// fragment stale
+	assert_null(to->marshalled);
+
+	cfg_free(from);
+
+	assert_int_equal(to->compiled->disabled.matchers[0].kind, MATCH_REGEX);
+	assert_string_equal(slist_at(to->disabled_name_desc, 0), "!a.*");
+
+	cfg_free(to);
+}
+
+void cfg_unshare__marshalled(void **state) {
+	struct Cfg *from = cfg_default();
+	slist_append(&from->order_name_desc, strdup("x"));
+
+	struct Cfg *to = cfg_default();
+	cfg_share(to, from, ORDER);
+	to->marshalled = strdup("ORDER:\n  - x\n");
+
+	// copied to be changed, fragment stale
+	cfg_unshare(to, ORDER);
+	assert_ptr_not_equal(to->order_name_desc, from->order_name_desc);
+	assert_null(to->marshalled);
+
+	cfg_free(from);
+	cfg_free(to);
+}
+
+void cfg_file_reload__unchanged(void **state) {
+	char path[] = "/tmp/tst-cfg-XXXXXX";
+	int fd = mkstemp(path);
+	assert_int_not_equal(fd, -1);
+	close(fd);
+
+	log_suppress_start();
+
+	cfg = cfg_default();
+	cfg->file_path = strdup(path);
+
+	// parsed and replaced
+	write_file(path, "ARRANGE: COLUMN\nALIGN: LEFT\n");
+	expect_value(__wrap_log_set_threshold, threshold, 0);
+	expect_value(__wrap_log_set_threshold, cli, false);
+	assert_int_equal(cfg_file_reload(), (1 << ARRANGE) | (1 << ALIGN));
+	assert_int_equal(cfg->arrange, COL);
+	assert_int_equal(cfg->align, LEFT);
+	struct Cfg *active = cfg;
+
+	// same content
+	write_file(path, "ARRANGE: COLUMN\nALIGN: LEFT\n");
+	assert_int_equal(cfg_file_reload(), 0);
+	assert_ptr_equal(cfg, active);
+
+	// same result, replaced rather than mutated, fragment and matchers reused
+	char *marshalled = strdup("ARRANGE: COLUMN\n");
+	active->marshalled = marshalled;
+	cfg_compiled(active);
+	write_file(path, "# columns\nARRANGE: COLUMN\nALIGN: LEFT\n");
+	assert_int_equal(cfg_file_reload(), 0);
+	assert_ptr_not_equal(cfg, active);
+	assert_ptr_equal(cfg->marshalled, marshalled);
+	assert_non_null(cfg->compiled);
+	assert_int_equal(cfg->arrange, COL);
+	assert_int_equal(cfg->file_hash, cfg_hash("# columns\nARRANGE: COLUMN\nALIGN: LEFT\n", 38));
+
+	// same result from an INCLUDE, fragment rebuilt
+	char inc_path[] = "/tmp/tst-cfg-inc-XXXXXX";
+	fd = mkstemp(inc_path);
+	assert_int_not_equal(fd, -1);
+	close(fd);
+	write_file(inc_path, "ALIGN: LEFT\n");
+	char content[PATH_MAX + 64];
+	snprintf(content, sizeof(content), "INCLUDE:\n  - '%s'\nARRANGE: COLUMN\n", inc_path);
+	write_file(path, content);
+	assert_int_equal(cfg_file_reload(), 0);
+	assert_null(cfg->marshalled);
+	assert_string_equal(slist_at(cfg->includes, 0), inc_path);
+
+	cfg_destroy();
+
+	log_suppress_stop();
+
+	char *cache_path = cfg_cache_path(path);
+	unlink(cache_path);
+	free(cache_path);
+	unlink(inc_path);
+	unlink(path);
+}
+
+void cfg_file_reload__layers(void **state) {
+	char dir[] = "/tmp/tst-cfg-XXXXXX";
+	assert_non_null(mkdtemp(dir));
+
+	char main_path[PATH_MAX], base_path[PATH_MAX];
+	snprintf(main_path, sizeof(main_path), "%s/cfg.yaml", dir);
+	snprintf(base_path, sizeof(base_path), "%s/base.yaml", dir);
+
+	log_suppress_start();
+
+	cfg = cfg_default();
+	cfg->file_path = strdup(main_path);
+
+	// base beneath main
+	write_file(base_path, "ARRANGE: COLUMN\nALIGN: LEFT\nDISABLED:\n  - base\n");
+	write_file(main_path, "INCLUDE:\n  - base.yaml\nALIGN: RIGHT\nDISABLED:\n  - main\n");
+	expect_value(__wrap_log_set_threshold, threshold, 0);
+	expect_value(__wrap_log_set_threshold, cli, false);
+	assert_int_equal(cfg_file_reload(), (1 << ARRANGE) | (1 << ALIGN) | (1 << DISABLED));
+	assert_int_equal(cfg->arrange, COL);
+	assert_int_equal(cfg->align, RIGHT);
+	assert_string_equal(slist_at(cfg->disabled_name_desc, 0), "base");
+	assert_string_equal(slist_at(cfg->disabled_name_desc, 1), "main");
+	assert_string_equal(slist_at(cfg->includes, 0), "base.yaml");
+
+	assert_int_equal(slist_length(cfg_layers), 2);
+	struct CfgLayer *base = slist_at(cfg_layers, 0);
+	struct CfgLayer *main = slist_at(cfg_layers, 1);
+	assert_string_equal(base->file_path, base_path);
+	assert_string_equal(main->file_path, main_path);
+	struct Cfg *main_parsed = main->cfg;
+
+	// nothing written
+	assert_int_equal(cfg_file_reload(), 0);
+
+	// base only reparsed
+	write_file(base_path, "ARRANGE: COLUMN\nALIGN: LEFT\nDISABLED:\n  - base2\n");
+	expect_value(__wrap_log_set_threshold, threshold, 0);
+	expect_value(__wrap_log_set_threshold, cli, false);
+	assert_int_equal(cfg_file_reload(), 1 << DISABLED);
+	assert_ptr_equal(main->cfg, main_parsed);
+	assert_string_equal(slist_at(cfg->disabled_name_desc, 0), "base2");
+
+	// invalid base
+	write_file(base_path, "ARRANGE: [\n");
+	expect_log_error("\nparsing file %s %s", NULL, NULL, NULL, NULL);
+	assert_int_equal(cfg_file_reload(), 0);
+	assert_int_equal(cfg->arrange, COL);
+
+	cfg_destroy();
+	assert_null(cfg_layers);
+
+	log_suppress_stop();
+
+	char *cache_path = cfg_cache_path(main_path);
+	unlink(cache_path);
+	free(cache_path);
+	unlink(base_path);
+	unlink(main_path);
+	rmdir(dir);
+}
+
+ino_t ino_of(const char *path) {
+	struct stat st;
+	assert_int_equal(stat(path, &st), 0);
+	return st.st_ino;
+}
+
+void cfg_cache__hit(void **state) {
+	char dir[] = "/tmp/tst-cfg-XXXXXX";
+	assert_non_null(mkdtemp(dir));
+
+	char main_path[PATH_MAX], base_path[PATH_MAX];
+	snprintf(main_path, sizeof(main_path), "%s/cfg.yaml", dir);
+	snprintf(base_path, sizeof(base_path), "%s/base.yaml", dir);
+	char *cache_path = cfg_cache_path(main_path);
+
+	log_suppress_start();
+
+	write_file(base_path, "ARRANGE: COLUMN\nSCALE:\n  - NAME_DESC: '!^DP-[0-9]'\n    SCALE: 1.5\n");
+	write_file(main_path, "INCLUDE:\n  - base.yaml\nDISABLED:\n  - main\n");
+
+	// parsed and written
+	assert_true(cfg_layers_refresh(main_path));
+	ino_t written = ino_of(cache_path);
+	slist_free_vals(&cfg_layers, cfg_layer_free);
+
+	// both layers from the cache, which is not rewritten
+	cfg_cache_map(main_path);
+	assert_non_null(cfg_cache.buf);
+	assert_true(cfg_layers_refresh(main_path));
+	cfg_cache_unmap();
+	assert_int_equal(ino_of(cache_path), written);
+
+	struct CfgLayer *base = slist_at(cfg_layers, 0);
+	struct CfgLayer *main = slist_at(cfg_layers, 1);
+	assert_string_equal(base->cfg->file_path, base_path);
+	assert_int_equal(base->cfg->arrange, COL);
+	struct UserScale *user_scale = slist_at(base->cfg->user_scales, 0);
+	assert_string_equal(user_scale->name_desc, "!^DP-[0-9]");
+	assert_float_equal(user_scale->scale, 1.5, 0.001);
+	assert_string_equal(slist_at(main->cfg->includes, 0), "base.yaml");
+	assert_string_equal(slist_at(main->cfg->disabled_name_desc, 0), "main");
+	slist_free_vals(&cfg_layers, cfg_layer_free);
+
+	// changed content misses and is rewritten
+	write_file(base_path, "ARRANGE: ROW\n");
+	cfg_cache_map(main_path);
+	assert_true(cfg_layers_refresh(main_path));
+	cfg_cache_unmap();
+	assert_int_not_equal(ino_of(cache_path), written);
+	base = slist_at(cfg_layers, 0);
+	assert_int_equal(base->cfg->arrange, ROW);
+	slist_free_vals(&cfg_layers, cfg_layer_free);
+
+	log_suppress_stop();
+
+	unlink(cache_path);
+	free(cache_path);
+	unlink(base_path);
+	unlink(main_path);
+	rmdir(dir);
+}
+
+void cfg_file_write__atomic(void **state) {
+	char dir[] = "/tmp/tst-cfg-XXXXXX";
+	assert_non_null(mkdtemp(dir));
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/cfg.yaml", dir);
+	char *cache_path = cfg_cache_path(path);
+
+	log_suppress_start();
+
+	write_file(path, "ALIGN: MIDDLE\n");
+	chmod(path, 0640);
+	ino_t read = ino_of(path);
+
+	cfg = cfg_default();
+	cfg->file_path = strdup(path);
+	expect_value(__wrap_log_set_threshold, threshold, 0);
+	expect_value(__wrap_log_set_threshold, cli, false);
+	assert_int_equal(cfg_file_reload(), 1 << ALIGN);
+
+	// replaced, keeping its mode
+	cfg->arrange = COL;
+	assert_true(cfg_file_write(cfg));
+	ino_t written = ino_of(path);
+	assert_int_not_equal(written, read);
+	struct stat st;
+	assert_int_equal(stat(path, &st), 0);
+	assert_int_equal(st.st_mode & 07777, 0640);
+
+	// what was written is current
+	struct CfgLayer *main = slist_at(cfg_layers, 0);
+	assert_int_equal(main->cfg->arrange, COL);
+	assert_int_equal(cfg_file_reload(), 0);
+
+	// same content not rewritten
+	assert_true(cfg_file_write(cfg));
+	assert_int_equal(ino_of(path), written);
+
+	// external change then the same content is rewritten
+	write_file(path, "ARRANGE: ROW\n");
+	assert_true(cfg_file_write(cfg));
+	assert_int_not_equal(ino_of(path), written);
+	size_t len = 0;
+	char *yaml = cfg_file_read(path, &len);
+	assert_non_null(strstr(yaml, "ARRANGE: COLUMN"));
+	free(yaml);
+
+	cfg_destroy();
+
+	log_suppress_stop();
+
+	unlink(cache_path);
+	free(cache_path);
+	unlink(path);
+
+	// no temporary files remain
+	assert_int_equal(rmdir(dir), 0);
+}
+
+void cfg_file_write__layers(void **state) {
+	char dir[] = "/tmp/tst-cfg-XXXXXX";
+	assert_non_null(mkdtemp(dir));
+
+	char main_path[PATH_MAX], base_path[PATH_MAX];
+	snprintf(main_path, sizeof(main_path), "%s/cfg.yaml", dir);
+	snprintf(base_path, sizeof(base_path), "%s/base.yaml", dir);
+
+	log_suppress_start();
+
+	cfg = cfg_default();
+	cfg->file_path = strdup(main_path);
+	cfg->file_name = strdup("cfg.yaml");
+
+	write_file(base_path, "ARRANGE: COLUMN\nSCALE:\n  - NAME_DESC: base\n    SCALE: 2\nDISABLED:\n  - base\n");
+	write_file(main_path, "INCLUDE:\n  - base.yaml\nALIGN: MIDDLE\n");
+	expect_value(__wrap_log_set_threshold, threshold, 0);
+	expect_value(__wrap_log_set_threshold, cli, false);
+	assert_int_not_equal(cfg_file_reload(), 0);
+
+	// a SET then a DEL of an included value, which cannot be removed
+	struct Cfg *set = calloc(1, sizeof(struct Cfg));
+	set->auto_scale = OFF;
+	slist_append(&set->user_scales, cfg_user_scale_init("main", 3));
+	struct Cfg *merged = cfg_merge(cfg, set, false);
+	cfg_free(set);
+	cfg_free(cfg);
+	cfg = merged;
+
+	struct Cfg *del = calloc(1, sizeof(struct Cfg));
+	slist_append(&del->disabled_name_desc, strdup("base"));
+	merged = cfg_merge(cfg, del, true);
+	cfg_free(del);
+	cfg_free(cfg);
+	cfg = merged;
+
+	expect_log_warn("\n%s %s is included from another file, it cannot be removed from %s", "DISABLED", "base", "cfg.yaml", NULL);
+	assert_true(cfg_file_write(cfg));
+
+	// own settings and the changes only
+	char *yaml = cfg_file_read(main_path, NULL);
+	assert_string_equal(yaml,
+			"INCLUDE:\n"
+			"  - base.yaml\n"
+			"ALIGN: MIDDLE\n"
+			"AUTO_SCALE: FALSE\n"
+			"SCALE:\n"
+			"  - NAME_DESC: main\n"
+			"    SCALE: 3\n"
+			"\n");
+	free(yaml);
+
+	// the base is not shadowed
+	write_file(base_path, "ARRANGE: ROW\n");
+	expect_value(__wrap_log_set_threshold, threshold, 0);
+	expect_value(__wrap_log_set_threshold, cli, false);
+	assert_int_not_equal(cfg_file_reload(), 0);
+	assert_int_equal(cfg->arrange, ROW);
+	assert_int_equal(cfg->align, MIDDLE);
+	assert_int_equal(cfg->auto_scale, OFF);
+
+	cfg_destroy();
+
+	log_suppress_stop();
+
+	char *cache_path = cfg_cache_path(main_path);
+	unlink(cache_path);
+	free(cache_path);
+	unlink(base_path);
+	unlink(main_path);
+	rmdir(dir);
+}
+
 int main(void) {
 	const struct CMUnitTest tests[] = {
 		TEST(merge_set__arrange),
@@ -381,6 +808,7 @@ int main(void) {
 		TEST(merge_set__mode),
 		TEST(merge_set__adaptive_sync_off),
 		TEST(merge_set__disabled),
+		TEST(merge_set__shared),
 
 		TEST(merge_del__scale),
 		TEST(merge_del__mode),
@@ -393,6 +821,17 @@ int main(void) {
 		TEST(validate_fix__mode),
 
 		TEST(validate_warn__),
+
+		TEST(cfg_changed__sections),
+		TEST(cfg_reuse__changed),
+		TEST(cfg_unshare__marshalled),
+		TEST(cfg_file_reload__unchanged),
+		TEST(cfg_file_reload__layers),
+
+		TEST(cfg_cache__hit),
+
+		TEST(cfg_file_write__atomic),
+		TEST(cfg_file_write__layers),
 	};
 
 	return RUN(tests);
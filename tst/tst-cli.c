@@ -17,6 +17,13 @@ struct Cfg *parse_element(enum IpcRequestOperation op, enum CfgElement element,
 struct IpcRequest *parse_write(int argc, char **argv);
 struct IpcRequest *parse_set(int argc, char **argv);
 struct IpcRequest *parse_del(int argc, char **argv);
+struct IpcRequest *parse_batch(const char *path);
+struct IpcRequest *parse_evaluate(const char *path);
+struct IpcRequest *parse_trace(int argc, char **argv);
+struct IpcRequest *parse_metrics(int argc, char **argv);
+struct IpcRequest *parse_await(int argc, char **argv);
+void append_request(struct IpcRequest **ipc_request, struct IpcRequest *request);
+int command_end(int argc, char **argv);
 bool parse_log_threshold(char *optarg);
 
 
@@ -494,6 +501,305 @@ void parse_del__ok(void **state) {
 	ipc_request_free(request);
 }
 
+void command_end__ok(void **state) {
+	char *argv[] = { "way-displays", "-s", "SCALE", "eDP-1", "-1.5", "--write", "-d", };
+
+	optind = 3;
+	assert_int_equal(command_end(7, argv), 5);
+
+	optind = 6;
+	assert_int_equal(command_end(7, argv), 6);
+
+	optind = 7;
+	assert_int_equal(command_end(7, argv), 7);
+}
+
+void append_request__batch(void **state) {
+	struct IpcRequest *ipc_request = NULL;
+
+	struct IpcRequest *set = calloc(1, sizeof(struct IpcRequest));
+	set->op = CFG_SET;
+	set->cfg = cfg_default();
+	struct Cfg *set_cfg = set->cfg;
+	append_request(&ipc_request, set);
+
+	assert_ptr_equal(ipc_request, set);
+
+	struct IpcRequest *write = calloc(1, sizeof(struct IpcRequest));
+	write->op = CFG_WRITE;
+	append_request(&ipc_request, write);
+
+	assert_non_null(ipc_request);
+	assert_int_equal(ipc_request->op, BATCH);
+	assert_null(ipc_request->cfg);
+	assert_int_equal(slist_length(ipc_request->ops), 2);
+
+	struct IpcOperation *operation = slist_at(ipc_request->ops, 0);
+	assert_int_equal(operation->op, CFG_SET);
+	assert_ptr_equal(operation->cfg, set_cfg);
+
+	operation = slist_at(ipc_request->ops, 1);
+	assert_int_equal(operation->op, CFG_WRITE);
+	assert_null(operation->cfg);
+
+	ipc_request_free(ipc_request);
+}
+
+void append_request__get(void **state) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	ipc_request->op = CFG_WRITE;
+
+	struct IpcRequest *get = calloc(1, sizeof(struct IpcRequest));
+	get->op = GET;
+
+	expect_log_error("--get cannot be combined with other commands", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	append_request(&ipc_request, get);
+
+	assert_int_equal(ipc_request->op, CFG_WRITE);
+
+	ipc_request_free(ipc_request);
+}
+
+void parse_trace__ok(void **state) {
+	optind = 1;
+	char *argv[] = { "-t", "chrome" };
+
+	struct IpcRequest *request = parse_trace(1, argv);
+	assert_non_null(request);
+	assert_int_equal(request->op, TRACE);
+	assert_int_equal(request->trace_format, TRACE_FORMAT_TEXT);
+	ipc_request_free(request);
+
+	request = parse_trace(2, argv);
+	assert_non_null(request);
+	assert_int_equal(request->op, TRACE);
+	assert_int_equal(request->trace_format, TRACE_FORMAT_CHROME);
+	ipc_request_free(request);
+}
+
+void parse_trace__invalid(void **state) {
+	optind = 1;
+	char *argv[] = { "-t", "perfetto", "text" };
+
+	expect_log_error("invalid --trace %s", "perfetto", NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_trace(2, argv));
+
+	expect_log_error("--trace takes at most one argument", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_trace(3, argv));
+}
+
+void append_request__trace(void **state) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	ipc_request->op = TRACE;
+
+	struct IpcRequest *write = calloc(1, sizeof(struct IpcRequest));
+	write->op = CFG_WRITE;
+
+	expect_log_error("--trace cannot be combined with other commands", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	append_request(&ipc_request, write);
+
+	assert_int_equal(ipc_request->op, TRACE);
+
+	ipc_request_free(ipc_request);
+}
+
+void parse_metrics__ok(void **state) {
+	optind = 1;
+	char *argv[] = { "-m", "prometheus" };
+
+	struct IpcRequest *request = parse_metrics(1, argv);
+	assert_non_null(request);
+	assert_int_equal(request->op, STATS);
+	assert_int_equal(request->stats_format, STATS_FORMAT_TEXT);
+	ipc_request_free(request);
+
+	request = parse_metrics(2, argv);
+	assert_non_null(request);
+	assert_int_equal(request->op, STATS);
+	assert_int_equal(request->stats_format, STATS_FORMAT_PROMETHEUS);
+	ipc_request_free(request);
+}
+
+void parse_metrics__invalid(void **state) {
+	optind = 1;
+	char *argv[] = { "-m", "openmetrics", "text" };
+
+	expect_log_error("invalid --metrics %s", "openmetrics", NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_metrics(2, argv));
+
+	expect_log_error("--metrics takes at most one argument", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_metrics(3, argv));
+}
+
+void parse_batch__ok(void **state) {
+	optind = 5;
+	optarg = "tst/cli/batch-ok.txt";
+
+	struct IpcRequest *request = parse_batch(optarg);
+
+	// restored
+	assert_int_equal(optind, 5);
+	assert_string_equal(optarg, "tst/cli/batch-ok.txt");
+
+	assert_non_null(request);
+	assert_int_equal(request->op, BATCH);
+	assert_int_equal(slist_length(request->ops), 4);
+
+	struct IpcOperation *operation = slist_at(request->ops, 0);
+	assert_int_equal(operation->op, CFG_SET);
+	assert_int_equal(operation->cfg->arrange, ROW);
+	assert_int_equal(operation->cfg->align, TOP);
+
+	operation = slist_at(request->ops, 1);
+	assert_int_equal(operation->op, CFG_SET);
+	struct UserScale *user_scale = slist_at(operation->cfg->user_scales, 0);
+	assert_string_equal(user_scale->name_desc, "Monitor Maker ABC");
+	assert_float_equal(user_scale->scale, 1.5, 0.001);
+
+	operation = slist_at(request->ops, 2);
+	assert_int_equal(operation->op, CFG_DEL);
+	struct UserMode *user_mode = slist_at(operation->cfg->user_modes, 0);
+	assert_string_equal(user_mode->name_desc, "HDMI-A-1");
+
+	operation = slist_at(request->ops, 3);
+	assert_int_equal(operation->op, CFG_WRITE);
+
+	ipc_request_free(request);
+}
+
+void parse_batch__quoted(void **state) {
+	struct IpcRequest *request = parse_batch("tst/cli/batch-quoted.txt");
+
+	assert_non_null(request);
+	assert_int_equal(slist_length(request->ops), 3);
+
+	// nothing globbed or expanded
+	struct IpcOperation *operation = slist_at(request->ops, 0);
+	struct UserScale *user_scale = slist_at(operation->cfg->user_scales, 0);
+	assert_string_equal(user_scale->name_desc, "DP-*");
+
+	operation = slist_at(request->ops, 1);
+	user_scale = slist_at(operation->cfg->user_scales, 0);
+	assert_string_equal(user_scale->name_desc, "$HOME \"2\"");
+
+	operation = slist_at(request->ops, 2);
+	user_scale = slist_at(operation->cfg->user_scales, 0);
+	assert_string_equal(user_scale->name_desc, "it's three");
+	assert_float_equal(user_scale->scale, 3, 0.001);
+
+	ipc_request_free(request);
+}
+
+void parse_batch__unterminated(void **state) {
+	expect_log_error("%s:%d invalid command: %s", "tst/cli/batch-unterminated.txt", NULL, "set SCALE \"DP-1 2", NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_batch("tst/cli/batch-unterminated.txt"));
+}
+
+void parse_batch__bad(void **state) {
+	expect_log_error("%s:%d invalid command: %s", "tst/cli/batch-bad.txt", NULL, "get", NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_batch("tst/cli/batch-bad.txt"));
+}
+
+void parse_evaluate__ok(void **state) {
+	struct IpcRequest *request = parse_evaluate("tst/marshalling/cfg-all.yaml");
+
+	assert_non_null(request);
+	assert_int_equal(request->op, EVALUATE);
+	assert_non_null(request->cfg);
+	assert_int_equal(request->cfg->arrange, COL);
+	assert_int_equal(request->cfg->align, BOTTOM);
+
+	ipc_request_free(request);
+}
+
+void parse_evaluate__missing(void **state) {
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_evaluate("tst/cli/missing.yaml"));
+}
+
+void append_request__evaluate(void **state) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	ipc_request->op = CFG_SET;
+
+	struct IpcRequest *evaluate = calloc(1, sizeof(struct IpcRequest));
+	evaluate->op = EVALUATE;
+
+	expect_log_error("--evaluate cannot be combined with other commands", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	append_request(&ipc_request, evaluate);
+
+	assert_int_equal(ipc_request->op, CFG_SET);
+
+	ipc_request_free(ipc_request);
+}
+
+void parse_await__ok(void **state) {
+	optind = 1;
+	char *argv[] = { "-a", "2.5" };
+
+	struct IpcRequest *request = parse_await(1, argv);
+	assert_non_null(request);
+	assert_int_equal(request->op, SETTLE);
+	assert_int_equal(request->timeout_ms, 0);
+	ipc_request_free(request);
+
+	request = parse_await(2, argv);
+	assert_non_null(request);
+	assert_int_equal(request->op, SETTLE);
+	assert_int_equal(request->timeout_ms, 2500);
+	ipc_request_free(request);
+}
+
+void parse_await__invalid(void **state) {
+	optind = 1;
+	char *argv[] = { "-a", "0", "1" };
+
+	expect_log_error("invalid --await %s", "0", NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_await(2, argv));
+
+	expect_log_error("--await takes at most one argument", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	assert_null(parse_await(3, argv));
+}
+
+void append_request__await(void **state) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	ipc_request->op = SETTLE;
+
+	struct IpcRequest *set = calloc(1, sizeof(struct IpcRequest));
+	set->op = CFG_SET;
+
+	expect_log_error("--await cannot be combined with other commands", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit, __status, EXIT_FAILURE);
+
+	append_request(&ipc_request, set);
+
+	assert_int_equal(ipc_request->op, SETTLE);
+
+	ipc_request_free(ipc_request);
+}
+
 void parse_log_threshold__invalid(void **state) {
 	expect_log_error("invalid --log-threshold %s", "INVALID", NULL, NULL, NULL);
 
@@ -553,6 +859,27 @@ int main(void) {
 		TEST(parse_del__invalid),
 		TEST(parse_del__ok),
 
+		TEST(command_end__ok),
+		TEST(append_request__batch),
+		TEST(append_request__get),
+		TEST(parse_trace__ok),
+		TEST(parse_trace__invalid),
+		TEST(append_request__trace),
+		TEST(parse_metrics__ok),
+		TEST(parse_metrics__invalid),
+		TEST(parse_batch__ok),
+		TEST(parse_batch__quoted),
+		TEST(parse_batch__unterminated),
+		TEST(parse_batch__bad),
+
+		TEST(parse_evaluate__ok),
+		TEST(parse_evaluate__missing),
+		TEST(append_request__evaluate),
+
+		TEST(parse_await__ok),
+		TEST(parse_await__invalid),
+		TEST(append_request__await),
+
 		TEST(parse_log_threshold__invalid),
 		TEST(parse_log_threshold__ok),
 	};
@@ -0,0 +1,221 @@
+#include "tst.h"
+#include "asserts.h"
+#include "expects.h"
+
+#include <cmocka.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cfg.h"
+#include "fds.h"
+#include "global.h"
+#include "list.h"
+#include "log.h"
+
+int create_fd_cfg_dir(void);
+int create_fd_cfg_timer(void);
+struct CfgLayer *cfg_layer_init(const char *file_path);
+
+struct State {
+	char dir[64];
+	char moved[128];
+	char path[PATH_MAX];
+	char other[PATH_MAX];
+};
+
+int before_all(void **state) {
+	return 0;
+}
+
+int after_all(void **state) {
+	return 0;
+}
+
+int before_each(void **state) {
+	struct State *s = calloc(1, sizeof(struct State));
+
+	snprintf(s->dir, sizeof(s->dir), "/tmp/tst-fds-XXXXXX");
+	assert_non_null(mkdtemp(s->dir));
+	snprintf(s->moved, sizeof(s->moved), "%s.moved", s->dir);
+	snprintf(s->path, sizeof(s->path), "%s/cfg.yaml", s->dir);
+	snprintf(s->other, sizeof(s->other), "%s/other.yaml", s->dir);
+
+	cfg = cfg_default();
+	cfg->dir_path = strdup(s->dir);
+	cfg->file_path = strdup(s->path);
+	cfg->file_name = strdup("cfg.yaml");
+
+	slist_append(&cfg_layers, cfg_layer_init(s->path));
+
+	fd_cfg_dir = create_fd_cfg_dir();
+	assert_int_not_equal(fd_cfg_dir, -1);
+	fd_cfg_timer = create_fd_cfg_timer();
+	assert_int_not_equal(fd_cfg_timer, -1);
+
+	*state = s;
+	return 0;
+}
+
+int after_each(void **state) {
+	struct State *s = *state;
+
+	close(fd_cfg_dir);
+	fd_cfg_dir = -1;
+	close(fd_cfg_timer);
+	fd_cfg_timer = -1;
+
+	cfg_destroy();
+
+	unlink(s->path);
+	unlink(s->other);
+	rmdir(s->dir);
+	rmdir(s->moved);
+
+	free(s);
+	return 0;
+}
+
+void write_file(const char *path, const char *content) {
+	FILE *f = fopen(path, "w");
+	assert_non_null(f);
+	fputs(content, f);
+	fclose(f);
+}
+
+struct CfgLayer *main_layer(void) {
+	return slist_at(cfg_layers, 0);
+}
+
+void cfg_file_modified__close_write(void **state) {
+	struct State *s = *state;
+
+	write_file(s->path, "ARRANGE: ROW\n");
+	assert_true(cfg_file_modified());
+
+	// drained
+	assert_false(cfg_file_modified());
+
+	// not a layer
+	write_file(s->other, "ARRANGE: ROW\n");
+	assert_false(cfg_file_modified());
+}
+
+void cfg_file_modified__moved_to(void **state) {
+	struct State *s = *state;
+
+	// an editor's temporary then rename
+	write_file(s->other, "ARRANGE: ROW\n");
+	assert_false(cfg_file_modified());
+
+	assert_int_equal(rename(s->other, s->path), 0);
+	assert_true(cfg_file_modified());
+}
+
+void cfg_file_modified__create(void **state) {
+	struct State *s = *state;
+
+	int fd = open(s->path, O_CREAT | O_WRONLY, 0644);
+	assert_int_not_equal(fd, -1);
+	assert_true(cfg_file_modified());
+
+	close(fd);
+	assert_true(cfg_file_modified());
+}
+
+void cfg_file_modified__burst(void **state) {
+	struct State *s = *state;
+
+	for (int i = 0; i < 50; i++) {
+		write_file(s->path, "ARRANGE: ROW\n");
+	}
+
+	// one modification
+	assert_true(cfg_file_modified());
+	assert_false(cfg_file_modified());
+}
+
+void cfg_file_modified__dir_moved(void **state) {
+	struct State *s = *state;
+
+	// replaced by another directory
+	assert_int_equal(rename(s->dir, s->moved), 0);
+	assert_int_equal(mkdir(s->dir, 0755), 0);
+	assert_true(cfg_file_modified());
+	assert_int_equal(main_layer()->wd, -1);
+	assert_true(fd_cfg_dir_unwatched());
+
+	// rewatched by path
+	assert_true(fd_cfg_dir_watch());
+	assert_int_not_equal(main_layer()->wd, -1);
+	assert_false(fd_cfg_dir_unwatched());
+	assert_false(cfg_file_modified());
+
+	// the moved directory is not watched
+	char moved_path[PATH_MAX];
+	snprintf(moved_path, sizeof(moved_path), "%s/cfg.yaml", s->moved);
+	write_file(moved_path, "ARRANGE: ROW\n");
+	unlink(moved_path);
+	assert_false(cfg_file_modified());
+
+	write_file(s->path, "ARRANGE: ROW\n");
+	assert_true(cfg_file_modified());
+}
+
+void cfg_file_modified__dir_deleted(void **state) {
+	struct State *s = *state;
+
+	assert_int_equal(rmdir(s->dir), 0);
+	assert_true(cfg_file_modified());
+	assert_int_equal(main_layer()->wd, -1);
+
+	// retried until it returns
+	assert_false(fd_cfg_dir_watch());
+	assert_true(fd_cfg_dir_unwatched());
+
+	assert_int_equal(mkdir(s->dir, 0755), 0);
+	assert_true(fd_cfg_dir_watch());
+
+	write_file(s->path, "ARRANGE: ROW\n");
+	assert_true(cfg_file_modified());
+}
+
+void fd_cfg_timer__debounce(void **state) {
+	struct pollfd pfd = { .fd = fd_cfg_timer, .events = POLLIN, };
+
+	fd_cfg_timer_arm(50);
+	assert_false(fd_cfg_timer_expired());
+
+	// restarted by a later modification
+	int64_t armed = monotonic_ns();
+	fd_cfg_timer_arm(100);
+	assert_int_equal(poll(&pfd, 1, 1000), 1);
+	assert_true(monotonic_ns() - armed >= 100 * 1000000L);
+
+	// once
+	assert_true(fd_cfg_timer_expired());
+	assert_false(fd_cfg_timer_expired());
+	assert_int_equal(poll(&pfd, 1, 200), 0);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		TEST(cfg_file_modified__close_write),
+		TEST(cfg_file_modified__moved_to),
+		TEST(cfg_file_modified__create),
+		TEST(cfg_file_modified__burst),
+		TEST(cfg_file_modified__dir_moved),
+		TEST(cfg_file_modified__dir_deleted),
+
+		TEST(fd_cfg_timer__debounce),
+	};
+
+	return RUN(tests);
+}
+
@@ -135,12 +135,12 @@ void head_find_mode__none(void **state) {
 	struct Mode mode = { 0 };
 
 	// no head
-	assert_null(head_find_mode(NULL));
+	assert_null(head_find_mode(cfg, NULL, true));
 
 	// all modes failed
 	slist_append(&head.modes, &mode);
 	slist_append(&head.modes_failed, &mode);
-	assert_null(head_find_mode(&head));
+	assert_null(head_find_mode(cfg, &head, true));
 
 	slist_free(&head.modes);
 	slist_free(&head.modes_failed);
@@ -164,7 +164,7 @@ void head_find_mode__user_available(void **state) {
 	expect_value(__wrap_mode_user_mode, user_mode, user_mode);
 	will_return(__wrap_mode_user_mode, &expected);
 
-	assert_ptr_equal(head_find_mode(&head), &expected);
+	assert_ptr_equal(head_find_mode(cfg, &head, true), &expected);
 
 	slist_free(&head.modes);
 	free(head.name);
@@ -192,7 +192,7 @@ void head_find_mode__user_failed(void **state) {
 	expect_log_info("\n%s: No preferred mode, falling back to maximum available", "HEAD", NULL, NULL, NULL);
 
 	// user failed, fall back to max
-	assert_ptr_equal(head_find_mode(&head), &mode);
+	assert_ptr_equal(head_find_mode(cfg, &head, true), &mode);
 
 	// try a second time
 	expect_value(__wrap_mode_user_mode, modes, head.modes);
@@ -201,7 +201,33 @@ void head_find_mode__user_failed(void **state) {
 	will_return(__wrap_mode_user_mode, NULL);
 
 	// no notices this time
-	assert_ptr_equal(head_find_mode(&head), &mode);
+	assert_ptr_equal(head_find_mode(cfg, &head, true), &mode);
+
+	slist_free(&head.modes);
+	free(head.name);
+}
+
+void head_find_mode__user_failed_quiet(void **state) {
+	struct Head head = { 0 };
+	struct Mode mode = { 0 };
+	slist_append(&head.modes, &mode);
+
+	// user preferred head
+	struct UserMode *user_mode = cfg_user_mode_default();
+	user_mode->name_desc = strdup("HEAD");
+	slist_append(&cfg->user_modes, user_mode);
+	head.name = strdup("HEAD");
+
+	// mode not matched to user
+	expect_value(__wrap_mode_user_mode, modes, head.modes);
+	expect_value(__wrap_mode_user_mode, modes_failed, head.modes_failed);
+	expect_value(__wrap_mode_user_mode, user_mode, user_mode);
+	will_return(__wrap_mode_user_mode, NULL);
+
+	// no notices, nothing marked warned
+	assert_ptr_equal(head_find_mode(cfg, &head, false), &mode);
+	assert_false(head.warned_no_user_mode);
+	assert_false(head.warned_no_preferred);
 
 	slist_free(&head.modes);
 	free(head.name);
@@ -213,7 +239,7 @@ void head_find_mode__preferred(void **state) {
 
 	slist_append(&head.modes, &mode);
 
-	assert_ptr_equal(head_find_mode(&head), &mode);
+	assert_ptr_equal(head_find_mode(cfg, &head, true), &mode);
 
 	slist_free(&head.modes);
 }
@@ -230,7 +256,7 @@ void head_find_mode__max_preferred_refresh(void **state) {
 	expect_value(__wrap_mode_max_preferred, modes_failed, head.modes_failed);
 	will_return(__wrap_mode_max_preferred, &mode);
 
-	assert_ptr_equal(head_find_mode(&head), &mode);
+	assert_ptr_equal(head_find_mode(cfg, &head, true), &mode);
 
 	slist_free(&head.modes);
 }
@@ -244,14 +270,36 @@ void head_find_mode__max(void **state) {
 	// one and only notice
 	expect_log_info("\n%s: No preferred mode, falling back to maximum available", "name", NULL, NULL, NULL);
 
-	assert_ptr_equal(head_find_mode(&head), &mode);
+	assert_ptr_equal(head_find_mode(cfg, &head, true), &mode);
 
 	// no notice
-	assert_ptr_equal(head_find_mode(&head), &mode);
+	assert_ptr_equal(head_find_mode(cfg, &head, true), &mode);
 
 	slist_free(&head.modes);
 }
 
+void head_desired_failed__changed(void **state) {
+	struct Mode mode = { 0 };
+	struct Head head = {
+		.desired = { .mode = &mode, .scale = 256, .enabled = true, },
+	};
+
+	// nothing rolled back
+	assert_false(head_desired_failed(&head));
+
+	head.failed = head.desired;
+	head.has_failed = true;
+	assert_true(head_desired_failed(&head));
+
+	head.desired.x = 1920;
+	assert_false(head_desired_failed(&head));
+
+	// released
+	head.desired.x = 0;
+	head_release_mode(&head, &mode);
+	assert_null(head.failed.mode);
+}
+
 int main(void) {
 	const struct CMUnitTest tests[] = {
 		TEST(head_auto_scale__default),
@@ -263,9 +311,12 @@ int main(void) {
 		TEST(head_find_mode__none),
 		TEST(head_find_mode__user_available),
 		TEST(head_find_mode__user_failed),
+		TEST(head_find_mode__user_failed_quiet),
 		TEST(head_find_mode__preferred),
 		TEST(head_find_mode__max_preferred_refresh),
 		TEST(head_find_mode__max),
+
+		TEST(head_desired_failed__changed),
 	};
 
 	return RUN(tests);
@@ -9,29 +9,39 @@
 #include <wayland-util.h>
 
 #include "cfg.h"
+#include "displ.h"
 #include "global.h"
 #include "head.h"
 #include "info.h"
+#include "ipc.h"
+#include "layout.h"
 #include "list.h"
 #include "log.h"
 #include "mode.h"
+#include "stats.h"
 #include "wlr-output-management-unstable-v1.h"
 
-struct SList *order_heads(struct SList *order_name_desc, struct SList *heads);
-void position_heads(struct SList *heads);
-void desire_enabled(struct Head *head);
-void desire_mode(struct Head *head);
-void desire_scale(struct Head *head);
-void desire_adaptive_sync(struct Head *head);
+struct SList *order_heads(const struct Matchers *order, struct SList *heads);
+
+void matchers_init(struct Matchers *matchers, struct SList *vals, const char *(*name_desc_of)(const void *val));
+
+void matchers_free(struct Matchers *matchers);
+void position_heads(struct Cfg *cfg, struct SList *heads);
+void desire_enabled(const struct LayoutState *state, struct Head *head);
+void desire_mode(const struct LayoutState *state, struct Head *head);
+void desire_scale(const struct LayoutState *state, struct Head *head);
+void desire_adaptive_sync(const struct LayoutState *state, struct Head *head);
 void handle_success(void);
 void handle_failure(void);
+void settle_last_good(void);
+void apply(void);
 
-bool __wrap_lid_is_closed(char *name) {
+bool __wrap_lid_is_closed(struct Cfg *cfg, char *name) {
 	check_expected(name);
 	return mock();
 }
 
-struct Mode *__wrap_head_find_mode(struct Head *head) {
+struct Mode *__wrap_head_find_mode(struct Cfg *cfg, struct Head *head, bool warn) {
 	check_expected(head);
 	return (struct Mode *)mock();
 }
@@ -59,6 +69,8 @@ int after_all(void **state) {
 int before_each(void **state) {
 	cfg = cfg_default();
 
+	displ = calloc(1, sizeof(struct Displ));
+
 	struct State *s = calloc(1, sizeof(struct State));
 
 	s->mode = calloc(1, sizeof(struct Mode));
@@ -81,6 +93,9 @@ int after_each(void **state) {
 
 	cfg_destroy();
 
+	free(displ);
+	displ = NULL;
+
 	struct State *s = *state;
 
 	slist_free_vals(&s->heads, NULL);
@@ -101,17 +116,17 @@ void order_heads__exact_partial_regex(void **state) {
 	slist_append(&order_name_desc, strdup("exact1"));
 	slist_append(&order_name_desc, strdup("!.*regex.*"));
 	slist_append(&order_name_desc, strdup("exact1")); // should not repeat
-	slist_append(&order_name_desc, strdup("partial"));
+	slist_append(&order_name_desc, strdup("PARTIAL"));
 
 	// heads
-	struct Head not_specified_1 = { .description = "not specified 1", };
-	struct Head exact0_partial =  { .description = "not an exact0 exact match" };
-	struct Head partial =         { .description = "a partial match" };
-	struct Head regex_match_1 =   { .description = "a regex match" };
-	struct Head exact1 =          { .description = "exact1" };
-	struct Head exact0 =          { .description = "exact0" };
-	struct Head regex_match_2 =   { .description = "another regex match" };
-	struct Head not_specified_2 = { .description = "not specified 2" };
+	struct Head not_specified_1 = { .description = "not specified 1", .description_lower = "not specified 1", };
+	struct Head exact0_partial =  { .description = "not an exact0 exact match", .description_lower = "not an exact0 exact match", };
+	struct Head partial =         { .description = "a Partial match", .description_lower = "a partial match", };
+	struct Head regex_match_1 =   { .description = "a regex match", .description_lower = "a regex match", };
+	struct Head exact1 =          { .description = "exact1", .description_lower = "exact1", };
+	struct Head exact0 =          { .description = "exact0", .description_lower = "exact0", };
+	struct Head regex_match_2 =   { .description = "another regex match", .description_lower = "another regex match", };
+	struct Head not_specified_2 = { .description = "not specified 2", .description_lower = "not specified 2", };
 	slist_append(&heads, &not_specified_1);
 	slist_append(&heads, &exact0_partial);
 	slist_append(&heads, &partial);
@@ -131,10 +146,14 @@ void order_heads__exact_partial_regex(void **state) {
 	slist_append(&expected, &not_specified_1);
 	slist_append(&expected, &not_specified_2);
 
-	struct SList *heads_ordered = order_heads(order_name_desc, heads);
+	struct Matchers order;
+	matchers_init(&order, order_name_desc, NULL);
+
+	struct SList *heads_ordered = order_heads(&order, heads);
 
 	assert_heads_equal(heads_ordered, expected);
 
+	matchers_free(&order);
 	slist_free_vals(&order_name_desc, NULL);
 	slist_free(&heads);
 	slist_free(&expected);
@@ -174,10 +193,14 @@ void order_heads__exact_regex_catchall(void **state) {
 	slist_append(&expected, &not_specified_2);
 	slist_append(&expected, &exact9);
 
-	struct SList *heads_ordered = order_heads(order_name_desc, heads);
+	struct Matchers order;
+	matchers_init(&order, order_name_desc, NULL);
+
+	struct SList *heads_ordered = order_heads(&order, heads);
 
 	assert_heads_equal(heads_ordered, expected);
 
+	matchers_free(&order);
 	slist_free_vals(&order_name_desc, NULL);
 	slist_free(&heads);
 	slist_free(&expected);
@@ -209,7 +232,7 @@ void position_heads__col_left(void **state) {
 	head = slist_at(s->heads, 1); head->scaled.width = 7; head->scaled.height = 3;
 	head = slist_at(s->heads, 2); head->scaled.width = 2; head->scaled.height = 1;
 
-	position_heads(s->heads);
+	position_heads(cfg, s->heads);
 
 	head = slist_at(s->heads, 0); assert_head_position(head, 0, 0);
 	head = slist_at(s->heads, 1); assert_head_position(head, 0, 2);
@@ -227,7 +250,7 @@ void position_heads__col_mid(void **state) {
 	head = slist_at(s->heads, 1); head->scaled.width = 7; head->scaled.height = 3;
 	head = slist_at(s->heads, 2); head->scaled.width = 2; head->scaled.height = 1;
 
-	position_heads(s->heads);
+	position_heads(cfg, s->heads);
 
 	head = slist_at(s->heads, 0); assert_head_position(head, 2, 0);
 	head = slist_at(s->heads, 1); assert_head_position(head, 0, 2);
@@ -245,7 +268,7 @@ void position_heads__col_right(void **state) {
 	head = slist_at(s->heads, 1); head->scaled.width = 7; head->scaled.height = 3;
 	head = slist_at(s->heads, 2); head->scaled.width = 2; head->scaled.height = 1;
 
-	position_heads(s->heads);
+	position_heads(cfg, s->heads);
 
 	head = slist_at(s->heads, 0); assert_head_position(head, 3, 0);
 	head = slist_at(s->heads, 1); assert_head_position(head, 0, 2);
@@ -263,7 +286,7 @@ void position_heads__row_top(void **state) {
 	head = slist_at(s->heads, 1); head->scaled.width = 7; head->scaled.height = 5;
 	head = slist_at(s->heads, 2); head->scaled.width = 2; head->scaled.height = 1;
 
-	position_heads(s->heads);
+	position_heads(cfg, s->heads);
 
 	head = slist_at(s->heads, 0); assert_head_position(head, 0, 0);
 	head = slist_at(s->heads, 1); assert_head_position(head, 4, 0);
@@ -281,7 +304,7 @@ void position_heads__row_mid(void **state) {
 	head = slist_at(s->heads, 1); head->scaled.width = 7; head->scaled.height = 5;
 	head = slist_at(s->heads, 2); head->scaled.width = 2; head->scaled.height = 1;
 
-	position_heads(s->heads);
+	position_heads(cfg, s->heads);
 
 	head = slist_at(s->heads, 0); assert_head_position(head, 0, 2);
 	head = slist_at(s->heads, 1); assert_head_position(head, 4, 0);
@@ -299,7 +322,7 @@ void position_heads__row_bottom(void **state) {
 	head = slist_at(s->heads, 1); head->scaled.width = 7; head->scaled.height = 5;
 	head = slist_at(s->heads, 2); head->scaled.width = 2; head->scaled.height = 1;
 
-	position_heads(s->heads);
+	position_heads(cfg, s->heads);
 
 	head = slist_at(s->heads, 0); assert_head_position(head, 0, 3);
 	head = slist_at(s->heads, 1); assert_head_position(head, 4, 0);
@@ -321,7 +344,8 @@ void desire_enabled__lid_closed_many(void **state) {
 	expect_string(__wrap_lid_is_closed, name, "head0");
 	will_return(__wrap_lid_is_closed, true);
 
-	desire_enabled(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_enabled(&layout_state, &head0);
 
 	assert_false(head0.desired.enabled);
 }
@@ -336,7 +360,8 @@ void desire_enabled__lid_closed_one(void **state) {
 	expect_string(__wrap_lid_is_closed, name, "head0");
 	will_return(__wrap_lid_is_closed, true);
 
-	desire_enabled(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_enabled(&layout_state, &head0);
 
 	assert_true(head0.desired.enabled);
 }
@@ -353,7 +378,8 @@ void desire_enabled__lid_closed_one_disabled(void **state) {
 	expect_string(__wrap_lid_is_closed, name, "head0");
 	will_return(__wrap_lid_is_closed, true);
 
-	desire_enabled(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_enabled(&layout_state, &head0);
 
 	assert_false(head0.desired.enabled);
 }
@@ -365,7 +391,8 @@ void desire_mode__disabled(void **state) {
 		.desired.mode = &mode0,
 	};
 
-	desire_mode(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_mode(&layout_state, &head0);
 
 	assert_null(head0.desired.mode);
 	assert_false(head0.desired.enabled);
@@ -389,7 +416,8 @@ void desire_mode__no_mode(void **state) {
 	expect_value(__wrap_print_head, event, NONE);
 	expect_value(__wrap_print_head, head, &head0);
 
-	desire_mode(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_mode(&layout_state, &head0);
 
 	assert_null(head0.desired.mode);
 	assert_false(head0.desired.enabled);
@@ -408,13 +436,34 @@ void desire_mode__no_mode_warned(void **state) {
 	expect_value(__wrap_head_find_mode, head, &head0);
 	will_return(__wrap_head_find_mode, NULL);
 
-	desire_mode(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_mode(&layout_state, &head0);
 
 	assert_null(head0.desired.mode);
 	assert_false(head0.desired.enabled);
 	assert_true(head0.warned_no_mode);
 }
 
+void desire_mode__no_mode_evaluate(void **state) {
+	struct Mode mode0 = { 0 };
+	struct Head head0 = {
+		.name = "head0",
+		.desired.enabled = true,
+		.desired.mode = &mode0,
+	};
+
+	expect_value(__wrap_head_find_mode, head, &head0);
+	will_return(__wrap_head_find_mode, NULL);
+
+	// no notices
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, .evaluate = true, };
+	desire_mode(&layout_state, &head0);
+
+	assert_null(head0.desired.mode);
+	assert_false(head0.desired.enabled);
+	assert_false(head0.warned_no_mode);
+}
+
 void desire_mode__ok(void **state) {
 	struct Mode mode0 = { 0 };
 	struct Head head0 = {
@@ -427,7 +476,8 @@ void desire_mode__ok(void **state) {
 	expect_value(__wrap_head_find_mode, head, &head0);
 	will_return(__wrap_head_find_mode, &mode1);
 
-	desire_mode(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_mode(&layout_state, &head0);
 
 	assert_ptr_equal(head0.desired.mode, &mode1);
 	assert_true(head0.desired.enabled);
@@ -439,7 +489,8 @@ void desire_scale__disabled(void **state) {
 		.desired.enabled = false,
 	};
 
-	desire_scale(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_scale(&layout_state, &head0);
 }
 
 void desire_scale__no_auto(void **state) {
@@ -448,7 +499,8 @@ void desire_scale__no_auto(void **state) {
 	};
 	cfg->auto_scale = OFF;
 
-	desire_scale(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_scale(&layout_state, &head0);
 
 	assert_wl_fixed_t_equal_double(head0.desired.scale, 1);
 }
@@ -462,7 +514,8 @@ void desire_scale__auto(void **state) {
 	expect_value(__wrap_head_auto_scale, head, &head0);
 	will_return(__wrap_head_auto_scale, wl_fixed_from_double(2.5));
 
-	desire_scale(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_scale(&layout_state, &head0);
 
 	assert_wl_fixed_t_equal_double(head0.desired.scale, 2.5);
 }
@@ -476,7 +529,8 @@ void desire_scale__user(void **state) {
 	slist_append(&cfg->user_scales, cfg_user_scale_init("![Hh]ea.*", 3.5));
 	slist_append(&cfg->user_scales, cfg_user_scale_init("head1", 7.5));
 
-	desire_scale(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_scale(&layout_state, &head0);
 
 	assert_wl_fixed_t_equal_double(head0.desired.scale, 3.5);
 }
@@ -487,7 +541,8 @@ void desire_adaptive_sync__head_disabled(void **state) {
 		.desired.adaptive_sync = true,
 	};
 
-	desire_adaptive_sync(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_adaptive_sync(&layout_state, &head0);
 
 	assert_int_equal(head0.desired.adaptive_sync, ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_DISABLED);
 }
@@ -499,7 +554,8 @@ void desire_adaptive_sync__failed(void **state) {
 		.adaptive_sync_failed = true,
 	};
 
-	desire_adaptive_sync(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_adaptive_sync(&layout_state, &head0);
 
 	assert_int_equal(head0.desired.adaptive_sync, ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_DISABLED);
 }
@@ -513,7 +569,8 @@ void desire_adaptive_sync__adaptive_sync_off(void **state) {
 
 	slist_append(&cfg->adaptive_sync_off_name_desc, strdup("!.*hea"));
 
-	desire_adaptive_sync(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_adaptive_sync(&layout_state, &head0);
 
 	assert_int_equal(head0.desired.adaptive_sync, ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_DISABLED);
 }
@@ -524,11 +581,77 @@ void desire_adaptive_sync__ok(void **state) {
 		.desired.adaptive_sync = true,
 	};
 
-	desire_adaptive_sync(&head0);
+	struct LayoutState layout_state = { .cfg = cfg, .heads = heads, };
+	desire_adaptive_sync(&layout_state, &head0);
 
 	assert_int_equal(head0.desired.adaptive_sync, ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED);
 }
 
+void layout_evaluate__owned(void **state) {
+	struct Mode mode0 = { .width = 200, .height = 100, };
+	struct Head head0 = {
+		.name = "head0",
+		.current = {
+			.enabled = true,
+			.mode = &mode0,
+			.scale = wl_fixed_from_int(1),
+			.adaptive_sync = ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED,
+		},
+	};
+	slist_append(&heads, &head0);
+	struct Head head1 = {
+		.name = "head1",
+	};
+	slist_append(&heads, &head1);
+
+	struct Cfg *candidate = cfg_default();
+	candidate->auto_scale = OFF;
+	slist_append(&candidate->disabled_name_desc, strdup("head1"));
+
+	expect_string(__wrap_lid_is_closed, name, "head0");
+	will_return(__wrap_lid_is_closed, false);
+	expect_any(__wrap_head_find_mode, head);
+	will_return(__wrap_head_find_mode, &mode0);
+
+	expect_string(__wrap_lid_is_closed, name, "head1");
+	will_return(__wrap_lid_is_closed, false);
+
+	unsigned long desires = stats.counters[STATS_DESIRES];
+
+	expect_log_info("\nNo changes to make.", NULL, NULL, NULL, NULL);
+
+	struct SList *evaluation = layout_evaluate(candidate);
+
+	// not counted
+	assert_int_equal(stats.counters[STATS_DESIRES], desires);
+
+	assert_int_equal(slist_length(evaluation), 2);
+
+	// owned
+	struct IpcEvaluation *evaluated0 = slist_at(evaluation, 0);
+	assert_string_equal(evaluated0->name, "head0");
+	assert_ptr_not_equal(evaluated0->name, head0.name);
+	assert_true(evaluated0->enabled);
+	assert_int_equal(evaluated0->width, mode0.width);
+	assert_int_equal(evaluated0->refresh_mhz, mode0.refresh_mhz);
+	assert_true(evaluated0->scale == 1);
+	assert_int_equal(evaluated0->x, 0);
+	assert_int_equal(evaluated0->y, 0);
+	assert_true(evaluated0->adaptive_sync);
+
+	struct IpcEvaluation *evaluated1 = slist_at(evaluation, 1);
+	assert_string_equal(evaluated1->name, "head1");
+	assert_false(evaluated1->enabled);
+
+	// active unchanged
+	assert_false(head0.desired.enabled);
+	assert_null(head0.desired.mode);
+	assert_false(head1.desired.enabled);
+
+	slist_free_vals(&evaluation, ipc_evaluation_free);
+	cfg_free(candidate);
+}
+
 void handle_success__head_changing_adaptive_sync(void **state) {
 	struct Head head = {
 		.desired.adaptive_sync = ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED,
@@ -582,6 +705,18 @@ void handle_success__ok(void **state) {
 	handle_success();
 }
 
+void handle_success__rolled_back(void **state) {
+	displ->rolling_back = true;
+	displ->rollbacks = 2;
+
+	expect_log_warn("\nRolled back to the last good configuration", NULL, NULL, NULL, NULL);
+
+	handle_success();
+
+	assert_false(displ->rolling_back);
+	assert_int_equal(displ->rollbacks, 0);
+}
+
 void handle_failure__mode(void **state) {
 	struct Mode mode_cur = { 0 };
 	struct Mode mode_des = { 0 };
@@ -626,9 +761,87 @@ void handle_failure__adaptive_sync(void **state) {
 
 void handle_failure__unspecified(void **state) {
 	expect_log_error("\nChanges failed", NULL, NULL, NULL, NULL);
+	expect_log_error("\nNo good configuration to roll back to", NULL, NULL, NULL, NULL);
+	expect_value(__wrap_wd_exit_message, __status, EXIT_FAILURE);
+
+	handle_failure();
+
+	assert_false(displ->rolling_back);
+}
+
+void handle_failure__rollback_exhausted(void **state) {
+	struct Head head = {
+		.name = "nam",
+		.has_last_good = true,
+	};
+	slist_append(&heads, &head);
+
+	displ->rolling_back = true;
+	displ->rollbacks = ROLLBACK_ATTEMPTS_MAX;
+
+	expect_log_error("\nRollback failed", NULL, NULL, NULL, NULL);
+	expect_log_error("\nRollback failed %u times, giving up", NULL, NULL, NULL, NULL);
 	expect_value(__wrap_wd_exit_message, __status, EXIT_FAILURE);
 
 	handle_failure();
+
+	assert_int_equal(displ->rollbacks, ROLLBACK_ATTEMPTS_MAX);
+}
+
+void apply__failed_not_retried(void **state) {
+	struct Mode mode = { 0 };
+	struct Head head = {
+		.current = { .mode = &mode, .enabled = true, },
+		.desired = { .mode = &mode, .enabled = true, .x = 1920, },
+	};
+	head.failed = head.desired;
+	head.has_failed = true;
+	slist_append(&heads, &head);
+
+	apply();
+
+	assert_int_equal(displ->config_state, IDLE);
+	assert_true(head.has_failed);
+}
+
+void settle_last_good__current(void **state) {
+	struct Mode mode = { 0 };
+	struct Head head = {
+		.current = { .mode = &mode, .scale = 512, .enabled = true, .x = 10, .y = 20, },
+		.desired = { .enabled = false, },
+	};
+	slist_append(&heads, &head);
+
+	displ->rollbacks = 1;
+
+	settle_last_good();
+
+	assert_true(head.has_last_good);
+	assert_true(head_state_equal(&head.last_good, &head.current));
+	assert_int_equal(displ->rollbacks, 0);
+}
+
+void layout_settled__current_desired(void **state) {
+	struct Mode mode = { 0 };
+	struct Head head = {
+		.current = { .mode = &mode, .enabled = true, },
+		.desired = { .mode = &mode, .enabled = true, },
+	};
+	slist_append(&heads, &head);
+
+	assert_true(layout_settled());
+
+	displ->config_state = OUTSTANDING;
+	assert_false(layout_settled());
+
+	displ->config_state = IDLE;
+	head.desired.x = 1920;
+	assert_false(layout_settled());
+
+	// rolled back, not retried
+	head.failed = head.desired;
+	head.has_failed = true;
+	assert_true(layout_settled());
 }
 
 int main(void) {
@@ -651,6 +864,7 @@ int main(void) {
 		TEST(desire_mode__disabled),
 		TEST(desire_mode__no_mode),
 		TEST(desire_mode__no_mode_warned),
+		TEST(desire_mode__no_mode_evaluate),
 		TEST(desire_mode__ok),
 
 		TEST(desire_scale__disabled),
@@ -663,14 +877,24 @@ int main(void) {
 		TEST(desire_adaptive_sync__adaptive_sync_off),
 		TEST(desire_adaptive_sync__ok),
 
+		TEST(layout_evaluate__owned),
+
 		TEST(handle_success__head_changing_adaptive_sync),
 		TEST(handle_success__head_changing_adaptive_sync_fail),
 		TEST(handle_success__head_changing_mode),
 		TEST(handle_success__ok),
+		TEST(handle_success__rolled_back),
 
 		TEST(handle_failure__mode),
 		TEST(handle_failure__adaptive_sync),
 		TEST(handle_failure__unspecified),
+		TEST(handle_failure__rollback_exhausted),
+
+		TEST(apply__failed_not_retried),
+
+		TEST(settle_last_good__current),
+
+		TEST(layout_settled__current_desired),
 	};
 
 	return RUN(tests);
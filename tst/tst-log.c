@@ -0,0 +1,305 @@
+#include "tst.h"
+#include "asserts.h"
+#include "expects.h"
+
+#include <cmocka.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+
+
+int before_all(void **state) {
+	// captured regardless
+	log_set_threshold(ERROR, true);
+	return 0;
+}
+
+int after_all(void **state) {
+	return 0;
+}
+
+int before_each(void **state) {
+	log_capture_start();
+	return 0;
+}
+
+int after_each(void **state) {
+	log_capture_stop();
+	log_capture_clear();
+	return 0;
+}
+
+void print_time(enum LogThreshold threshold, FILE *__restrict __stream);
+
+// print_time to a string
+char *printed_time(enum LogThreshold threshold) {
+	static char buf[128];
+
+	FILE *stream = fmemopen(buf, sizeof(buf), "w");
+	print_time(threshold, stream);
+	fclose(stream);
+
+	return buf;
+}
+
+void assert_matches(const char *actual, const char *pattern) {
+	regex_t regex;
+	assert_int_equal(regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB), 0);
+	if (regexec(&regex, actual, 0, NULL, 0) != 0) {
+		fail_msg("'%s' does not match '%s'", actual, pattern);
+	}
+	regfree(&regex);
+}
+
+int evaluated = 0;
+
+int evaluate(void) {
+	return ++evaluated;
+}
+
+
+void log_capture__ok(void **state) {
+	log_info("inf");
+	log_warn("\nwar");
+
+	assert_int_equal(log_cap.len, 3);
+	assert_int_equal(log_cap.dropped, 0);
+
+	assert_string_equal(log_cap_line(0)->line, "inf");
+	assert_int_equal(log_cap_line(0)->threshold, INFO);
+
+	assert_string_equal(log_cap_line(1)->line, "");
+	assert_int_equal(log_cap_line(1)->threshold, WARNING);
+
+	assert_string_equal(log_cap_line(2)->line, "war");
+	assert_int_equal(log_cap_line(2)->threshold, WARNING);
+
+	assert_null(log_cap_line(3));
+}
+
+void log_capture__full(void **state) {
+	log_warn("first");
+	for (int i = 1; i < LOG_CAP_LINES_MAX + 2; i++) {
+		log_info("line %d", i);
+	}
+
+	// oldest dropped
+	assert_int_equal(log_cap.len, LOG_CAP_LINES_MAX);
+	assert_int_equal(log_cap.dropped, 2);
+	assert_int_equal(log_cap.dropped_threshold, WARNING);
+
+	assert_string_equal(log_cap_line(0)->line, "line 2");
+
+	char last[32];
+	snprintf(last, sizeof(last), "line %d", LOG_CAP_LINES_MAX + 1);
+	assert_string_equal(log_cap_line(LOG_CAP_LINES_MAX - 1)->line, last);
+
+	assert_null(log_cap_line(LOG_CAP_LINES_MAX));
+}
+
+void log_capture_clear__reuse(void **state) {
+	log_info("a longer line");
+
+	const char *line = log_cap_line(0)->line;
+
+	log_capture_clear();
+
+	assert_int_equal(log_cap.len, 0);
+	assert_int_equal(log_cap.dropped, 0);
+	assert_null(log_cap_line(0));
+
+	// slot retained
+	log_info("short");
+	assert_ptr_equal(log_cap_line(0)->line, line);
+	assert_string_equal(log_cap_line(0)->line, "short");
+}
+
+void log_debug__below_threshold(void **state) {
+	evaluated = 0;
+
+	// captured
+	log_debug("%d", evaluate());
+	log_debug_nocap("%d", evaluate());
+	assert_int_equal(evaluated, 1);
+	assert_int_equal(log_cap.len, 1);
+	assert_string_equal(log_cap_line(0)->line, "1");
+
+	// neither printed nor captured, only log_warn's arguments evaluated
+	log_capture_stop();
+	log_debug("%d", evaluate());
+	log_info("%d", evaluate());
+	log_warn("%d", evaluate());
+	assert_int_equal(evaluated, 2);
+	assert_int_equal(log_cap.len, 1);
+
+	assert_false(log_enabled(WARNING, true));
+	assert_true(log_enabled(ERROR, false));
+
+	// nocap only when printed, although capturing
+	log_capture_start();
+	log_suppress_start();
+	log_error_nocap("%d", evaluate());
+	assert_int_equal(evaluated, 2);
+	assert_int_equal(log_cap.len, 1);
+	log_suppress_stop();
+}
+
+void print_time__ms(void **state) {
+	assert_matches(printed_time(INFO), "^I \\[[0-9]{2}:[0-9]{2}:[0-9]{2}\\.[0-9]{3}\\] $");
+
+	// cached second, same format
+	assert_matches(printed_time(WARNING), "^W \\[[0-9]{2}:[0-9]{2}:[0-9]{2}\\.[0-9]{3}\\] $");
+}
+
+void print_time__event(void **state) {
+	log_event_start();
+
+	assert_matches(printed_time(INFO), "^I \\[[0-9]{2}:[0-9]{2}:[0-9]{2}\\.[0-9]{3} \\+0\\.[0-9]{3}ms\\] $");
+
+	// not restarted
+	usleep(2000);
+	log_event_start();
+	assert_matches(printed_time(INFO), "\\+[1-9][0-9]*\\.[0-9]{3}ms\\] $");
+
+	log_event_stop();
+	assert_matches(printed_time(INFO), "[0-9]{3}\\] $");
+}
+
+void log_sink__drain(void **state) {
+	int pipefd[2];
+	assert_int_equal(pipe(pipefd), 0);
+
+	log_sink_out.fd = pipefd[1];
+	log_set_threshold(INFO, true);
+	log_sink_start();
+
+	// buffered
+	log_info("inf");
+	assert_int_equal(log_sink_out.len, 4);
+	assert_int_equal(log_sink_out.lines, 1);
+
+	log_sink_drain();
+	assert_int_equal(log_sink_out.len, 0);
+	assert_int_equal(log_sink_out.bytes_written, 4);
+
+	char buf[16] = { 0 };
+	assert_int_equal(read(pipefd[0], buf, sizeof(buf)), 4);
+	assert_string_equal(buf, "inf\n");
+
+	log_sink_stop();
+	log_set_threshold(ERROR, true);
+	log_sink_out = (struct LogSink){ .fd = STDOUT_FILENO, };
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+
+void log_sink__pipe_full(void **state) {
+	int pipefd[2];
+	assert_int_equal(pipe(pipefd), 0);
+
+	log_sink_out.fd = pipefd[1];
+	log_set_threshold(INFO, true);
+	log_sink_start();
+
+	char line[1024];
+	memset(line, 'x', sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+
+	// more than the pipe holds
+	for (int i = 0; i < 128; i++) {
+		log_info("%s", line);
+	}
+
+	// returns with the remainder buffered
+	log_sink_drain();
+	assert_true(log_sink_out.bytes_written > 0);
+	assert_true(log_sink_out.len > 0);
+	assert_int_equal(log_sink_out.bytes_written + log_sink_out.len, 128 * sizeof(line));
+	assert_int_equal(log_sink_out.blocked, 0);
+
+	// the shared fd is left blocking
+	assert_false(fcntl(pipefd[1], F_GETFL) & O_NONBLOCK);
+
+	// all written as it is read
+	char buf[4096];
+	size_t read_total = 0;
+	while (read_total < 128 * sizeof(line)) {
+		ssize_t n = read(pipefd[0], buf, sizeof(buf));
+		assert_true(n > 0);
+		read_total += n;
+		log_sink_drain();
+	}
+	assert_int_equal(log_sink_out.len, 0);
+
+	log_sink_stop();
+	log_set_threshold(ERROR, true);
+	log_sink_out = (struct LogSink){ .fd = STDOUT_FILENO, };
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+
+void log_sink__full(void **state) {
+	int fd = open("/dev/null", O_WRONLY);
+	assert_int_not_equal(fd, -1);
+
+	log_sink_out.fd = fd;
+	log_set_threshold(INFO, true);
+	log_sink_start();
+
+	char line[1024];
+	memset(line, 'x', sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+
+	// info dropped when full
+	for (int i = 0; i < LOG_SINK_SIZE / 1024 + 8; i++) {
+		log_info("%s", line);
+	}
+	assert_int_equal(log_sink_out.dropped, 8);
+	assert_int_equal(log_sink_out.dropped_unreported, 8);
+	assert_int_equal(log_sink_out.blocked, 0);
+	assert_int_equal(log_sink_out.high_water, LOG_SINK_SIZE);
+
+	// warning written through
+	log_warn("war");
+	assert_int_equal(log_sink_out.dropped, 8);
+	assert_int_equal(log_sink_out.blocked, 1);
+	assert_int_equal(log_sink_out.bytes_written, LOG_SINK_SIZE);
+	assert_int_equal(log_sink_out.len, strlen("WARNING: war\n"));
+
+	// drops reported
+	log_sink_drain();
+	assert_int_equal(log_sink_out.len, 0);
+	assert_int_equal(log_sink_out.dropped_unreported, 0);
+	assert_int_equal(log_sink_out.bytes_written, LOG_SINK_SIZE + strlen("WARNING: war\n") + strlen("WARNING: 8 log messages dropped\n"));
+
+	log_sink_stop();
+	log_set_threshold(ERROR, true);
+	log_sink_out = (struct LogSink){ .fd = STDOUT_FILENO, };
+
+	close(fd);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		TEST(log_capture__ok),
+		TEST(log_capture__full),
+		TEST(log_capture_clear__reuse),
+		TEST(log_debug__below_threshold),
+		TEST(print_time__ms),
+		TEST(print_time__event),
+		TEST(log_sink__drain),
+		TEST(log_sink__pipe_full),
+		TEST(log_sink__full),
+	};
+
+	return RUN(tests);
+}
+
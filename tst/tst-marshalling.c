@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <wayland-client-protocol.h>
 #include <wayland-util.h>
@@ -20,16 +21,19 @@
 #include "list.h"
 #include "log.h"
 #include "mode.h"
+#include "sockets.h"
+#include "tlv.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "marshalling.h"
 
-void lcl(enum LogThreshold threshold, char *line) {
-	struct LogCapLine *lcl = calloc(1, sizeof(struct LogCapLine));
+void capture_line(enum LogThreshold threshold, char *l);
 
-	lcl->threshold = threshold;
-	lcl->line = strdup(line);
+size_t yaml_response_end(const char *buf, size_t len, size_t *scanned);
 
-	slist_append(&log_cap_lines, lcl);
+void lcl(enum LogThreshold threshold, char *line) {
+	capture_line(threshold, line);
 }
 
 char *read_file(const char *path) {
@@ -84,9 +88,9 @@ struct Cfg *cfg_all(void) {
 	slist_append(&cfg->user_scales, cfg_user_scale_init("three", 3));
 	slist_append(&cfg->user_scales, cfg_user_scale_init("four", 4));
 
-	slist_append(&cfg->user_modes, cfg_user_mode_init("five", false, 1920, 1080, 60, false));
-	slist_append(&cfg->user_modes, cfg_user_mode_init("six", false, 2560, 1440, -1, false));
-	slist_append(&cfg->user_modes, cfg_user_mode_init("seven", true, -1, -1, -1, false));
+	slist_append(&cfg->user_modes, cfg_user_mode_init("five", false, 1920, 1080, 60));
+	slist_append(&cfg->user_modes, cfg_user_mode_init("six", false, 2560, 1440, -1));
+	slist_append(&cfg->user_modes, cfg_user_mode_init("seven", true, -1, -1, -1));
 
 	slist_append(&cfg->adaptive_sync_off_name_desc, strdup("ten"));
 	slist_append(&cfg->adaptive_sync_off_name_desc, strdup("ELEVEN"));
@@ -106,6 +110,49 @@ struct IpcRequest *ipc_request_get(void) {
 	return ipc_request;
 }
 
+// ipc-request-batch.yaml
+struct IpcRequest *ipc_request_batch(void) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	ipc_request->op = BATCH;
+
+	struct Cfg *set = calloc(1, sizeof(struct Cfg));
+	set->arrange = ROW;
+	slist_append(&set->user_scales, cfg_user_scale_init("three", 3));
+	slist_append(&ipc_request->ops, ipc_operation_init(CFG_SET, set));
+
+	struct Cfg *del = calloc(1, sizeof(struct Cfg));
+	slist_append(&del->user_modes, cfg_user_mode_init("five", true, -1, -1, -1));
+	slist_append(&ipc_request->ops, ipc_operation_init(CFG_DEL, del));
+
+	slist_append(&ipc_request->ops, ipc_operation_init(CFG_WRITE, NULL));
+
+	return ipc_request;
+}
+
+// ops of ipc-request-batch.yaml
+void assert_ipc_request_batch(struct IpcRequest *actual) {
+	struct IpcRequest *expected = ipc_request_batch();
+
+	assert_non_null(actual);
+	assert_int_equal(actual->op, BATCH);
+	assert_null(actual->cfg);
+	assert_int_equal(slist_length(actual->ops), slist_length(expected->ops));
+
+	for (struct SList *a = actual->ops, *e = expected->ops; a && e; a = a->nex, e = e->nex) {
+		struct IpcOperation *actual_operation = (struct IpcOperation*)a->val;
+		struct IpcOperation *expected_operation = (struct IpcOperation*)e->val;
+
+		assert_int_equal(actual_operation->op, expected_operation->op);
+		if (expected_operation->cfg) {
+			assert_cfg_equal(actual_operation->cfg, expected_operation->cfg);
+		} else {
+			assert_null(actual_operation->cfg);
+		}
+	}
+
+	ipc_request_free(expected);
+}
+
 void unmarshal_cfg_from_file__ok(void **state) {
 
 	struct Cfg *read = cfg_default();
@@ -239,6 +286,20 @@ void marshal_ipc_request__cfg_set(void **state) {
 	free(expected);
 }
 
+void marshal_ipc_request__batch(void **state) {
+	struct IpcRequest *ipc_request = ipc_request_batch();
+
+	char *actual = marshal_ipc_request(ipc_request);
+
+	char *expected = read_file("tst/marshalling/ipc-request-batch.yaml");
+
+	assert_string_equal(actual, expected);
+
+	ipc_request_free(ipc_request);
+	free(actual);
+	free(expected);
+}
+
 void marshal_ipc_response__ok(void **state) {
 	struct IpcResponse *ipc_response = calloc(1, sizeof(struct IpcResponse));
 	ipc_response->done = true;
@@ -309,10 +370,157 @@ void marshal_ipc_response__ok(void **state) {
 	ipc_response_free(ipc_response);
 	free(actual);
 	free(expected);
+	free(head.marshalled.yaml);
 	slist_free(&head.modes);
 	slist_free(&heads);
 }
 
+void marshal_ipc_response_json__ok(void **state) {
+	struct IpcResponse *ipc_response = calloc(1, sizeof(struct IpcResponse));
+	ipc_response->done = true;
+	ipc_response->rc = 1;
+	ipc_response->messages = true;
+	ipc_response->state = true;
+
+	cfg = cfg_all();
+
+	lid = calloc(1, sizeof(struct Lid));
+	lid->closed = true;
+	lid->device_path = "/path/to/lid";
+
+	lcl(DEBUG, "dbg");
+	lcl(INFO, "inf");
+	lcl(WARNING, "war");
+	lcl(ERROR, "err");
+
+	struct Mode mode1 = {
+		.width = 10,
+		.height = 11,
+		.refresh_mhz = 12,
+		.preferred = true,
+	};
+	struct Mode mode2 = {
+		.width = 13,
+		.height = 14,
+		.refresh_mhz = 15,
+		.preferred = false,
+	};
+	struct Head head = {
+		.name = "name",
+		.description = "desc",
+		.width_mm = 1,
+		.height_mm = 2,
+		.transform = WL_OUTPUT_TRANSFORM_270, // 3
+		.make = "make",
+		.model = "model",
+		.serial_number = "serial",
+		.current = {
+			.scale = wl_fixed_from_double(4.0),
+			.enabled = true,
+			.x = 5,
+			.y = 6,
+			.mode = &mode1,
+		},
+		.desired = {
+			.scale = wl_fixed_from_double(7.0),
+			.enabled = true,
+			.x = 8,
+			.y = 9,
+		},
+	};
+
+	slist_append(&head.modes, &mode1);
+	slist_append(&head.modes, &mode2);
+
+	slist_append(&heads, &head);
+
+	char *actual = marshal_ipc_response_json(ipc_response);
+
+	assert_non_null(actual);
+
+	char *expected = read_file("tst/marshalling/ipc-response-ok.json");
+
+	assert_string_equal(actual, expected);
+
+	ipc_response_free(ipc_response);
+	free(actual);
+	free(expected);
+	slist_free(&head.modes);
+	slist_free(&heads);
+}
+
+void marshal_ipc_response_json__escape(void **state) {
+	struct IpcResponse *ipc_response = calloc(1, sizeof(struct IpcResponse));
+	ipc_response->done = true;
+	ipc_response->messages = true;
+
+	lcl(INFO, "\"quoted\" \\ back\nnew\ttab\x01");
+
+	char *actual = marshal_ipc_response_json(ipc_response);
+
+	assert_string_equal(actual, "{\"DONE\":true,\"MESSAGES\":[{\"INFO\":\"\\\"quoted\\\" \\\\ back\\nnew\\ttab\\u0001\"}],\"RC\":0}\n");
+
+	ipc_response_free(ipc_response);
+	free(actual);
+}
+
+void marshal_ipc_response__cached(void **state) {
+	struct IpcResponse *ipc_response = calloc(1, sizeof(struct IpcResponse));
+	ipc_response->done = true;
+	ipc_response->state = true;
+
+	cfg = cfg_default();
+
+	struct Head head = {
+		.name = "name",
+		.current = {
+			.x = 1,
+		},
+	};
+
+	slist_append(&heads, &head);
+
+	char *first = marshal_ipc_response(ipc_response);
+	assert_non_null(first);
+	assert_non_null(cfg->marshalled);
+	assert_non_null(head.marshalled.yaml);
+
+	char *cfg_cached = cfg->marshalled;
+	char *head_cached = head.marshalled.yaml;
+
+	// unchanged
+	char *second = marshal_ipc_response(ipc_response);
+	assert_string_equal(second, first);
+	assert_ptr_equal(cfg->marshalled, cfg_cached);
+	assert_ptr_equal(head.marshalled.yaml, head_cached);
+
+	// not touched by a listener
+	head.name = "renamed";
+	char *third = marshal_ipc_response(ipc_response);
+	assert_string_equal(third, first);
+
+	// touched by a listener
+	head.marshalled.stale = true;
+	char *fourth = marshal_ipc_response(ipc_response);
+	assert_non_null(strstr(fourth, "NAME: renamed"));
+	assert_false(head.marshalled.stale);
+
+	// desired state change
+	head.desired.x = 5;
+	char *fifth = marshal_ipc_response(ipc_response);
+	assert_non_null(strstr(fifth, "X: 5"));
+	assert_ptr_equal(cfg->marshalled, cfg_cached);
+
+	ipc_response_free(ipc_response);
+	free(first);
+	free(second);
+	free(third);
+	free(fourth);
+	free(fifth);
+	free(head.marshalled.yaml);
+	slist_free(&heads);
+}
+
 void unmarshal_ipc_request__empty(void **state) {
 	char *yaml = "";
 
@@ -346,6 +554,85 @@ void unmarshal_ipc_request__no_op(void **state) {
 	assert_null(actual);
 }
 
+void marshal_ipc_request__encoding(void **state) {
+	struct IpcRequest *ipc_request = ipc_request_get();
+	ipc_request->encoding = IPC_ENCODING_JSON;
+
+	char *actual = marshal_ipc_request(ipc_request);
+
+	assert_string_equal(actual, "OP: GET\nENCODING: JSON\n");
+
+	struct IpcRequest *unmarshalled = unmarshal_ipc_request(actual);
+
+	assert_non_null(unmarshalled);
+	assert_int_equal(unmarshalled->encoding, IPC_ENCODING_JSON);
+
+	ipc_request_free(ipc_request);
+	ipc_request_free(unmarshalled);
+	free(actual);
+}
+
+void marshal_ipc_request__memfd_threshold(void **state) {
+	struct IpcRequest *ipc_request = ipc_request_get();
+	ipc_request->memfd_threshold = 65536;
+
+	char *actual = marshal_ipc_request(ipc_request);
+
+	assert_string_equal(actual, "OP: GET\nMEMFD_THRESHOLD: 65536\n");
+
+	struct IpcRequest *unmarshalled = unmarshal_ipc_request(actual);
+
+	assert_non_null(unmarshalled);
+	assert_int_equal(unmarshalled->memfd_threshold, 65536);
+
+	ipc_request_free(ipc_request);
+	ipc_request_free(unmarshalled);
+	free(actual);
+}
+
+void marshal_ipc_request__settle(void **state) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	ipc_request->op = SETTLE;
+	ipc_request->timeout_ms = 2500;
+
+	char *actual = marshal_ipc_request(ipc_request);
+
+	assert_string_equal(actual, "OP: SETTLE\nTIMEOUT_MS: 2500\n");
+
+	struct IpcRequest *unmarshalled = unmarshal_ipc_request(actual);
+
+	assert_non_null(unmarshalled);
+	assert_int_equal(unmarshalled->op, SETTLE);
+	assert_int_equal(unmarshalled->timeout_ms, 2500);
+
+	size_t len = 0;
+	char *buf = marshal_ipc_request_tlv(ipc_request, &len);
+	assert_non_null(buf);
+
+	struct IpcRequest *unmarshalled_tlv = unmarshal_ipc_request_tlv(buf, len);
+
+	assert_non_null(unmarshalled_tlv);
+	assert_int_equal(unmarshalled_tlv->op, SETTLE);
+	assert_int_equal(unmarshalled_tlv->timeout_ms, 2500);
+
+	ipc_request_free(ipc_request);
+	ipc_request_free(unmarshalled);
+	ipc_request_free(unmarshalled_tlv);
+	free(actual);
+	free(buf);
+}
+
+void unmarshal_ipc_request__bad_encoding(void **state) {
+	char *yaml = "OP: GET\nENCODING: TLV";
+
+	expect_log_error(NULL, "invalid ENCODING 'TLV'", NULL, NULL, NULL);
+	expect_log_error_nocap(NULL, yaml, NULL, NULL, NULL);
+
+	struct IpcRequest *actual = unmarshal_ipc_request(yaml);
+
+	assert_null(actual);
+}
+
 void unmarshal_ipc_request__get(void **state) {
 	char *yaml = read_file("tst/marshalling/ipc-request-get.yaml");
 
@@ -376,6 +663,39 @@ void unmarshal_ipc_request__cfg_set(void **state) {
 	free(yaml);
 }
 
+void unmarshal_ipc_request__batch(void **state) {
+	char *yaml = read_file("tst/marshalling/ipc-request-batch.yaml");
+
+	struct IpcRequest *actual = unmarshal_ipc_request(yaml);
+
+	assert_ipc_request_batch(actual);
+
+	ipc_request_free(actual);
+	free(yaml);
+}
+
+void unmarshal_ipc_request__batch_no_ops(void **state) {
+	char *yaml = "OP: BATCH";
+
+	expect_log_error(NULL, "missing OPS", NULL, NULL, NULL);
+	expect_log_error_nocap(NULL, yaml, NULL, NULL, NULL);
+
+	struct IpcRequest *actual = unmarshal_ipc_request(yaml);
+
+	assert_null(actual);
+}
+
+void unmarshal_ipc_request__batch_bad_op(void **state) {
+	char *yaml = "OP: BATCH\nOPS:\n  - OP: CFG_WRITE\n  - OP: GET";
+
+	expect_log_error(NULL, "invalid OPS OP 'GET'", NULL, NULL, NULL);
+	expect_log_error_nocap(NULL, yaml, NULL, NULL, NULL);
+
+	struct IpcRequest *actual = unmarshal_ipc_request(yaml);
+
+	assert_null(actual);
+}
+
 void unmarshal_ipc_response__empty(void **state) {
 	char *yaml = "";
 
@@ -427,6 +747,791 @@ void unmarshal_ipc_response__ok(void **state) {
 	free(yaml);
 }
 
+void marshal_ipc_response__dropped(void **state) {
+	struct IpcResponse ipc_response = {
+		.done = true,
+		.messages = true,
+	};
+
+	// YAML
+	lcl(INFO, "inf");
+	log_cap.dropped = 3;
+	log_cap.dropped_threshold = WARNING;
+
+	char *yaml = marshal_ipc_response(&ipc_response);
+	assert_string_equal(yaml, "DONE: TRUE\nMESSAGES_DROPPED: 3\nMESSAGES:\n  INFO: inf\nRC: 1\n");
+	assert_int_equal(log_cap.dropped, 0);
+
+	expect_log_warn("%lu earlier messages dropped", NULL, NULL, NULL, NULL);
+	expect_log_(INFO, NULL, "inf", NULL, NULL, NULL);
+
+	struct IpcResponse *actual = unmarshal_ipc_response(yaml);
+	assert_non_null(actual);
+	assert_int_equal(actual->messages_dropped, 3);
+	assert_int_equal(actual->rc, IPC_RC_WARN);
+	ipc_response_free(actual);
+
+	// TLV
+	ipc_response.rc = 0;
+	lcl(INFO, "inf");
+	log_cap.dropped = 3;
+	log_cap.dropped_threshold = WARNING;
+
+	size_t len = 0;
+	char *tlv = marshal_ipc_response_tlv(&ipc_response, &len);
+
+	expect_log_warn("%lu earlier messages dropped", NULL, NULL, NULL, NULL);
+	expect_log_(INFO, NULL, "inf", NULL, NULL, NULL);
+
+	actual = unmarshal_ipc_response_tlv(tlv, len);
+	assert_non_null(actual);
+	assert_int_equal(actual->messages_dropped, 3);
+	assert_int_equal(actual->rc, IPC_RC_WARN);
+	ipc_response_free(actual);
+
+	free(yaml);
+	free(tlv);
+}
+
+void marshal_ipc_response__trace(void **state) {
+	struct IpcResponse ipc_response = {
+		.done = true,
+		.trace = true,
+	};
+
+	trace_clear();
+
+	struct TraceEvent *delta = trace_event(TRACE_DELTA, 7, "DP-1");
+	delta->ns = 1000;
+	delta->delta = TRACE_DELTA_MODE | TRACE_DELTA_SCALE;
+	delta->desired.width = 1920;
+	delta->desired.height = 1080;
+	delta->desired.refresh_mhz = 60000;
+	delta->desired.scale = wl_fixed_from_double(1.5);
+
+	struct TraceEvent *apply = trace_event(TRACE_APPLY, 7, NULL);
+	apply->ns = 2000;
+	apply->heads = 1;
+
+	trace_event(TRACE_SUCCEEDED, 7, NULL)->ns = 3000;
+
+	// YAML
+	char *yaml = marshal_ipc_response(&ipc_response);
+	assert_string_equal(yaml,
+			"DONE: TRUE\n"
+			"TRACE:\n"
+			"  - NS: 1000\n"
+			"    EVENT: DELTA\n"
+			"    SERIAL: 7\n"
+			"    HEAD: DP-1\n"
+			"    DESIRED:\n"
+			"      MODE:\n"
+			"        WIDTH: 1920\n"
+			"        HEIGHT: 1080\n"
+			"        REFRESH_MHZ: 60000\n"
+			"      SCALE: 1.5\n"
+			"  - NS: 2000\n"
+			"    EVENT: APPLY\n"
+			"    SERIAL: 7\n"
+			"    HEADS: 1\n"
+			"  - NS: 3000\n"
+			"    EVENT: SUCCEEDED\n"
+			"    SERIAL: 7\n"
+			"RC: 0\n");
+
+	// JSON
+	char *json = marshal_ipc_response_json(&ipc_response);
+	assert_string_equal(json,
+			"{\"DONE\":true,\"TRACE\":["
+			"{\"NS\":1000,\"EVENT\":\"DELTA\",\"SERIAL\":7,\"HEAD\":\"DP-1\",\"DESIRED\":{\"MODE\":{\"WIDTH\":1920,\"HEIGHT\":1080,\"REFRESH_MHZ\":60000},\"SCALE\":1.5}},"
+			"{\"NS\":2000,\"EVENT\":\"APPLY\",\"SERIAL\":7,\"HEADS\":1},"
+			"{\"NS\":3000,\"EVENT\":\"SUCCEEDED\",\"SERIAL\":7}"
+			"],\"RC\":0}\n");
+
+	// TLV is read back
+	size_t len = 0;
+	char *tlv = marshal_ipc_response_tlv(&ipc_response, &len);
+
+	struct IpcResponse *actual = unmarshal_ipc_response_tlv(tlv, len);
+	assert_non_null(actual);
+	assert_int_equal(actual->trace_len, 3);
+	for (size_t i = 0; i < 3; i++) {
+		assert_memory_equal(&actual->trace_events[i], trace_event_n(i), sizeof(struct TraceEvent));
+	}
+	ipc_response_free(actual);
+
+	trace_clear();
+
+	free(yaml);
+	free(json);
+	free(tlv);
+}
+
+void marshal_ipc_response__stats(void **state) {
+	struct IpcResponse ipc_response = {
+		.done = true,
+		.stats = true,
+	};
+
+	memset(&stats, 0, sizeof(struct Stats));
+	stats.counters[STATS_HOTPLUGS] = 2;
+	stats.counters[STATS_APPLIED] = 3;
+	stats.counters[STATS_MODESETS] = 1;
+	stats.counters[STATS_SUCCEEDED] = 2;
+	stats.counters[STATS_FAILED] = 1;
+	stats.gauges[STATS_HEADS] = 2;
+	stats.gauges[STATS_HEADS_ENABLED] = 1;
+	stats.ipc_requests[GET] = 4;
+	stats.ipc_requests[STATS] = 1;
+	stats_histogram_add(&stats.desire_us, 3);
+	stats_histogram_add(&stats.apply_us, 1000);
+	stats_histogram_add(&stats.settle_us, 5000);
+	stats_histogram_add(&stats.applies, 3);
+
+	// YAML
+	char *yaml = marshal_ipc_response(&ipc_response);
+	assert_string_equal(yaml,
+			"DONE: TRUE\n"
+			"STATS:\n"
+			"  COUNTERS:\n"
+			"    LOOPS: 0\n"
+			"    LAYOUTS: 0\n"
+			"    LAYOUTS_SKIPPED: 0\n"
+			"    DESIRES: 0\n"
+			"    HOTPLUGS: 2\n"
+			"    APPLIED: 3\n"
+			"    MODESETS: 1\n"
+			"    SUCCEEDED: 2\n"
+			"    FAILED: 1\n"
+			"    CANCELLED: 0\n"
+			"    MODES_FAILED: 0\n"
+			"    REGEX_EVALS: 0\n"
+			"    BYTES_MARSHALLED: 0\n"
+			"    LOG_CAPTURED: 0\n"
+			"    ROLLBACKS: 0\n"
+			"  GAUGES:\n"
+			"    HEADS: 2\n"
+			"    HEADS_ENABLED: 1\n"
+			"    TRACE_EVENTS: 0\n"
+			"    LOG_PENDING: 0\n"
+			"  IPC_REQUESTS:\n"
+			"    GET: 4\n"
+			"    CFG_SET: 0\n"
+			"    CFG_DEL: 0\n"
+			"    CFG_WRITE: 0\n"
+			"    BATCH: 0\n"
+			"    TRACE: 0\n"
+			"    STATS: 1\n"
+			"    EVALUATE: 0\n"
+			"    SETTLE: 0\n"
+			"  DESIRE_US:\n"
+			"    COUNT: 1\n"
+			"    SUM: 3\n"
+			"    MAX: 3\n"
+			"    BUCKETS: [0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]\n"
+			"  APPLY_US:\n"
+			"    COUNT: 1\n"
+			"    SUM: 1000\n"
+			"    MAX: 1000\n"
+			"    BUCKETS: [0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]\n"
+			"  SETTLE_US:\n"
+			"    COUNT: 1\n"
+			"    SUM: 5000\n"
+			"    MAX: 5000\n"
+			"    BUCKETS: [0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]\n"
+			"  APPLIES:\n"
+			"    COUNT: 1\n"
+			"    SUM: 3\n"
+			"    MAX: 3\n"
+			"    BUCKETS: [0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]\n"
+			"RC: 0\n");
+
+	// JSON
+	char *json = marshal_ipc_response_json(&ipc_response);
+	assert_string_equal(json,
+			"{\"DONE\":true,\"STATS\":{"
+			"\"COUNTERS\":{\"LOOPS\":0,\"LAYOUTS\":0,\"LAYOUTS_SKIPPED\":0,\"DESIRES\":0,\"HOTPLUGS\":2,\"APPLIED\":3,\"MODESETS\":1,\"SUCCEEDED\":2,\"FAILED\":1,\"CANCELLED\":0,\"MODES_FAILED\":0,\"REGEX_EVALS\":0,\"BYTES_MARSHALLED\":0,\"LOG_CAPTURED\":0,\"ROLLBACKS\":0},"
+			"\"GAUGES\":{\"HEADS\":2,\"HEADS_ENABLED\":1,\"TRACE_EVENTS\":0,\"LOG_PENDING\":0},"
+			"\"IPC_REQUESTS\":{\"GET\":4,\"CFG_SET\":0,\"CFG_DEL\":0,\"CFG_WRITE\":0,\"BATCH\":0,\"TRACE\":0,\"STATS\":1,\"EVALUATE\":0,\"SETTLE\":0},"
+			"\"DESIRE_US\":{\"COUNT\":1,\"SUM\":3,\"MAX\":3,\"BUCKETS\":[0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]},"
+			"\"APPLY_US\":{\"COUNT\":1,\"SUM\":1000,\"MAX\":1000,\"BUCKETS\":[0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0]},"
+			"\"SETTLE_US\":{\"COUNT\":1,\"SUM\":5000,\"MAX\":5000,\"BUCKETS\":[0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0]},"
+			"\"APPLIES\":{\"COUNT\":1,\"SUM\":3,\"MAX\":3,\"BUCKETS\":[0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]}"
+			"},\"RC\":0}\n");
+
+	// TLV is read back
+	size_t len = 0;
+	char *tlv = marshal_ipc_response_tlv(&ipc_response, &len);
+
+	struct IpcResponse *actual = unmarshal_ipc_response_tlv(tlv, len);
+	assert_non_null(actual);
+	assert_non_null(actual->stats_values);
+	assert_memory_equal(actual->stats_values, &stats, sizeof(struct Stats));
+	ipc_response_free(actual);
+
+	memset(&stats, 0, sizeof(struct Stats));
+
+	free(yaml);
+	free(json);
+	free(tlv);
+}
+
+void marshal_ipc_response__evaluation(void **state) {
+	struct IpcEvaluation *head0 = calloc(1, sizeof(struct IpcEvaluation));
+	head0->name = strdup("DP-1");
+	head0->enabled = true;
+	head0->width = 1920;
+	head0->height = 1080;
+	head0->refresh_mhz = 60000;
+	head0->scale = 1.5;
+	head0->x = 1280;
+	head0->adaptive_sync = true;
+	struct IpcEvaluation *head1 = calloc(1, sizeof(struct IpcEvaluation));
+	head1->name = strdup("eDP-1");
+
+	struct IpcResponse ipc_response = {
+		.done = true,
+	};
+	slist_append(&ipc_response.evaluation, head0);
+	slist_append(&ipc_response.evaluation, head1);
+
+	// YAML
+	char *yaml = marshal_ipc_response(&ipc_response);
+	assert_string_equal(yaml,
+			"DONE: TRUE\n"
+			"EVALUATION:\n"
+			"  - NAME: DP-1\n"
+			"    ENABLED: TRUE\n"
+			"    MODE:\n"
+			"      WIDTH: 1920\n"
+			"      HEIGHT: 1080\n"
+			"      REFRESH_MHZ: 60000\n"
+			"    SCALE: 1.5\n"
+			"    X: 1280\n"
+			"    Y: 0\n"
+			"    VRR: TRUE\n"
+			"  - NAME: eDP-1\n"
+			"    ENABLED: FALSE\n"
+			"    SCALE: 0\n"
+			"    X: 0\n"
+			"    Y: 0\n"
+			"    VRR: FALSE\n"
+			"RC: 0\n");
+
+	// JSON
+	char *json = marshal_ipc_response_json(&ipc_response);
+	assert_string_equal(json,
+			"{\"DONE\":true,\"EVALUATION\":["
+			"{\"NAME\":\"DP-1\",\"ENABLED\":true,\"MODE\":{\"WIDTH\":1920,\"HEIGHT\":1080,\"REFRESH_MHZ\":60000},\"SCALE\":1.5,\"X\":1280,\"Y\":0,\"VRR\":true},"
+			"{\"NAME\":\"eDP-1\",\"ENABLED\":false,\"SCALE\":0,\"X\":0,\"Y\":0,\"VRR\":false}"
+			"],\"RC\":0}\n");
+
+	// TLV evaluation is not read back
+	size_t len = 0;
+	char *tlv = marshal_ipc_response_tlv(&ipc_response, &len);
+
+	struct IpcResponse *actual = unmarshal_ipc_response_tlv(tlv, len);
+	assert_non_null(actual);
+	assert_true(actual->done);
+	assert_null(actual->evaluation);
+	ipc_response_free(actual);
+
+	slist_free_vals(&ipc_response.evaluation, ipc_evaluation_free);
+
+	free(yaml);
+	free(json);
+	free(tlv);
+}
+
+void tlv__round_trip(void **state) {
+	char long_str[200];
+	memset(long_str, 'x', sizeof(long_str) - 1);
+	long_str[sizeof(long_str) - 1] = '\0';
+
+	struct TlvWriter w = { 0 };
+	size_t len = 0;
+
+	tlv_message_begin(&w, TAG_REQUEST);
+	tlv_put_int(&w, TAG_X, 0);
+	tlv_put_int(&w, TAG_X, -1);
+	tlv_put_int(&w, TAG_X, 64);
+	tlv_put_int(&w, TAG_X, INT32_MIN);
+	tlv_put_int(&w, TAG_X, INT64_MAX);
+	tlv_put_bool(&w, TAG_ENABLED, true);
+	tlv_put_str(&w, TAG_NAME, NULL);
+	tlv_put_str(&w, TAG_NAME, "");
+	size_t begin = tlv_begin(&w, TAG_HEAD);
+	tlv_put_str(&w, TAG_NAME, long_str);
+	tlv_put_float(&w, TAG_SCALE_VAL, 1.25f);
+	tlv_end(&w, begin);
+	tlv_put_double(&w, TAG_SCALE_VAL, 2.0 / 3.0);
+	tlv_message_end(&w);
+	char *buf = w.buf;
+	len = w.len;
+
+	assert_true(tlv_is_message(buf, len));
+	assert_int_equal(tlv_message_len(buf, len), len);
+
+	// partial messages need at least one more byte until complete
+	size_t need = 0;
+	for (size_t partial = 0; partial < len; partial += need) {
+		assert_true(tlv_message_need(buf, partial, &need));
+		assert_true(need > 0);
+		assert_true(partial + need <= len);
+	}
+	assert_true(tlv_message_need(buf, len, &need));
+	assert_int_equal(need, 0);
+
+	bool bad = false;
+	struct TlvReader r;
+	struct TlvVal v;
+	assert_int_equal(tlv_message_read(buf, len, &bad, &r), TAG_REQUEST);
+
+	int64_t ints[] = { 0, -1, 64, INT32_MIN, INT64_MAX, };
+	for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+		assert_true(tlv_next(&r, &v));
+		assert_int_equal(v.tag, TAG_X);
+		assert_true(tlv_int(&r, &v) == ints[i]);
+	}
+
+	assert_true(tlv_next(&r, &v));
+	assert_true(tlv_bool(&r, &v));
+
+	assert_true(tlv_next(&r, &v));
+	char *empty = tlv_str(&r, &v);
+	assert_string_equal(empty, "");
+	free(empty);
+
+	assert_true(tlv_next(&r, &v));
+	assert_int_equal(v.tag, TAG_HEAD);
+	assert_true(v.len > 127);
+	struct TlvReader nested = tlv_nested(&r, &v);
+	assert_true(tlv_next(&nested, &v));
+	char *str = tlv_str(&nested, &v);
+	assert_string_equal(str, long_str);
+	free(str);
+	assert_true(tlv_next(&nested, &v));
+	assert_true(tlv_float(&nested, &v) == 1.25f);
+	assert_false(tlv_next(&nested, &v));
+
+	assert_true(tlv_next(&r, &v));
+	assert_true(tlv_double(&r, &v) == 2.0 / 3.0);
+	assert_false(tlv_next(&r, &v));
+	assert_false(bad);
+
+	// wrong size value
+	assert_int_equal(tlv_message_read(buf, len, &bad, &r), TAG_REQUEST);
+	assert_true(tlv_next(&r, &v));
+	tlv_double(&r, &v);
+	assert_true(bad);
+	assert_false(tlv_next(&r, &v));
+
+	// truncated
+	bad = false;
+	assert_int_equal(tlv_message_read(buf, len - 1, &bad, &r), 0);
+
+	free(buf);
+}
+
+void marshal_ipc_request_tlv__no_op(void **state) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	size_t len = 0;
+
+	expect_log_error("marshalling ipc request: missing OP", NULL, NULL, NULL, NULL);
+
+	assert_null(marshal_ipc_request_tlv(ipc_request, &len));
+
+	ipc_request_free(ipc_request);
+}
+
+void marshal_ipc_request_tlv__cfg_set(void **state) {
+	struct IpcRequest *ipc_request = calloc(1, sizeof(struct IpcRequest));
+	ipc_request->op = CFG_SET;
+	ipc_request->cfg = cfg_all();
+	ipc_request->memfd_threshold = 65536;
+
+	size_t len = 0;
+	char *buf = marshal_ipc_request_tlv(ipc_request, &len);
+	assert_non_null(buf);
+
+	// much smaller than ipc-request-cfg-set.yaml
+	char *yaml = marshal_ipc_request(ipc_request);
+	assert_true(len < strlen(yaml) / 2);
+
+	struct IpcRequest *actual = unmarshal_ipc_request_tlv(buf, len);
+
+	assert_non_null(actual);
+	assert_int_equal(actual->op, CFG_SET);
+	assert_int_equal(actual->encoding, IPC_ENCODING_TLV);
+	assert_int_equal(actual->memfd_threshold, 65536);
+	assert_cfg_equal(actual->cfg, ipc_request->cfg);
+
+	ipc_request_free(ipc_request);
+	ipc_request_free(actual);
+	free(buf);
+	free(yaml);
+}
+
+void marshal_ipc_request_tlv__batch(void **state) {
+	struct IpcRequest *ipc_request = ipc_request_batch();
+
+	size_t len = 0;
+	char *buf = marshal_ipc_request_tlv(ipc_request, &len);
+	assert_non_null(buf);
+
+	struct IpcRequest *actual = unmarshal_ipc_request_tlv(buf, len);
+
+	assert_ipc_request_batch(actual);
+
+	ipc_request_free(ipc_request);
+	ipc_request_free(actual);
+	free(buf);
+}
+
+void unmarshal_ipc_request_tlv__bad(void **state) {
+	struct IpcRequest *ipc_request = ipc_request_get();
+	size_t len = 0;
+	char *buf = marshal_ipc_request_tlv(ipc_request, &len);
+
+	expect_log_error("\nunmarshalling ipc request: invalid message", NULL, NULL, NULL, NULL);
+	assert_null(unmarshal_ipc_request_tlv("OP: GET", strlen("OP: GET")));
+
+	expect_log_error("\nunmarshalling ipc request: invalid message", NULL, NULL, NULL, NULL);
+	assert_null(unmarshal_ipc_request_tlv(buf, len - 1));
+
+	// response
+	struct IpcResponse *ipc_response = calloc(1, sizeof(struct IpcResponse));
+	char *response = marshal_ipc_response_tlv(ipc_response, &len);
+
+	expect_log_error("\nunmarshalling ipc request: invalid message", NULL, NULL, NULL, NULL);
+	assert_null(unmarshal_ipc_request_tlv(response, len));
+
+	ipc_request_free(ipc_request);
+	ipc_response_free(ipc_response);
+	free(buf);
+	free(response);
+}
+
+void marshal_ipc_response_tlv__ok(void **state) {
+	struct IpcResponse *ipc_response = calloc(1, sizeof(struct IpcResponse));
+	ipc_response->done = true;
+	ipc_response->messages = true;
+	ipc_response->state = true;
+
+	cfg = cfg_all();
+
+	lid = calloc(1, sizeof(struct Lid));
+	lid->closed = true;
+	lid->device_path = "/path/to/lid";
+
+	lcl(INFO, "inf");
+	lcl(WARNING, "war");
+
+	struct Mode mode = {
+		.width = 10,
+		.height = 11,
+		.refresh_mhz = 12,
+	};
+	struct Head head = {
+		.name = "name",
+		.current = {
+			.scale = wl_fixed_from_double(1.5),
+			.x = -5,
+			.mode = &mode,
+		},
+	};
+	slist_append(&head.modes, &mode);
+	slist_append(&heads, &head);
+
+	size_t len = 0;
+	char *buf = marshal_ipc_response_tlv(ipc_response, &len);
+	assert_non_null(buf);
+	assert_int_equal(log_cap.len, 0);
+
+	// STATE
+	bool bad = false;
+	struct TlvReader r;
+	struct TlvVal v;
+	assert_int_equal(tlv_message_read(buf, len, &bad, &r), TAG_RESPONSE);
+	while (tlv_next(&r, &v) && v.tag != TAG_LID);
+	assert_int_equal(v.tag, TAG_LID);
+	assert_true(tlv_next(&r, &v));
+	assert_int_equal(v.tag, TAG_HEAD);
+	struct TlvReader head_reader = tlv_nested(&r, &v);
+	assert_true(tlv_next(&head_reader, &v));
+	char *name = tlv_str(&head_reader, &v);
+	assert_string_equal(name, "name");
+	free(name);
+	while (tlv_next(&head_reader, &v) && v.tag != TAG_CURRENT);
+	struct TlvReader current_reader = tlv_nested(&head_reader, &v);
+	assert_true(tlv_next(&current_reader, &v));
+	assert_true(tlv_double(&current_reader, &v) == 1.5);
+	assert_true(tlv_next(&current_reader, &v));
+	assert_false(tlv_bool(&current_reader, &v));
+	assert_true(tlv_next(&current_reader, &v));
+	assert_int_equal(tlv_int(&current_reader, &v), -5);
+	assert_false(bad);
+
+	expect_log_(INFO, NULL, "inf", NULL, NULL, NULL);
+	expect_log_(WARNING, NULL, "war", NULL, NULL, NULL);
+
+	struct IpcResponse *actual = unmarshal_ipc_response_tlv(buf, len);
+
+	assert_non_null(actual);
+	assert_true(actual->done);
+	assert_int_equal(actual->rc, IPC_RC_WARN);
+	assert_int_equal(actual->encoding, IPC_ENCODING_TLV);
+
+	ipc_response_free(ipc_response);
+	ipc_response_free(actual);
+	free(buf);
+	slist_free(&head.modes);
+	slist_free(&heads);
+}
+
+// written bytes read back from the other end of a socket pair
+char *read_streamed(struct SocketBuf *buf, int socket_client) {
+	char *out = calloc(buf->written + 1, sizeof(char));
+
+	assert_true(socket_read_n(socket_client, out, buf->written));
+
+	return out;
+}
+
+void socket_buf_write__flush(void **state) {
+	int sv[2];
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	struct SocketBuf buf = { .socket = sv[0], };
+
+	// cross the buffer boundary mid write
+	char data[SOCKET_BUF_SIZE * 2 + 100];
+	for (size_t i = 0; i < sizeof(data); i++) {
+		data[i] = (char)('a' + i % 26);
+	}
+	socket_buf_write(&buf, data, 100);
+	socket_buf_write(&buf, data + 100, sizeof(data) - 100);
+
+	assert_int_equal(buf.written, SOCKET_BUF_SIZE * 2);
+
+	assert_true(socket_buf_flush(&buf));
+	assert_int_equal(buf.written, sizeof(data));
+
+	char *actual = read_streamed(&buf, sv[1]);
+	assert_memory_equal(actual, data, sizeof(data));
+
+	// nothing written once failed
+	close(sv[1]);
+	socket_buf_write(&buf, data, 1);
+	assert_false(socket_buf_flush(&buf));
+	assert_int_equal(buf.written, sizeof(data));
+
+	free(actual);
+	close(sv[0]);
+}
+
+void marshal_ipc_response_stream__ok(void **state) {
+	struct IpcResponse ipc_response = {
+		.done = true,
+		.state = true,
+	};
+
+	cfg = cfg_all();
+
+	lid = calloc(1, sizeof(struct Lid));
+	lid->closed = true;
+	lid->device_path = "/path/to/lid";
+
+	int sv[2];
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	// YAML
+	struct SocketBuf yaml = { .socket = sv[0], };
+	assert_true(marshal_ipc_response_stream(&ipc_response, &yaml));
+	assert_true(socket_buf_flush(&yaml));
+
+	char *yaml_actual = read_streamed(&yaml, sv[1]);
+	char *yaml_expected = marshal_ipc_response(&ipc_response);
+	assert_string_equal(yaml_actual, yaml_expected);
+
+	// JSON
+	struct SocketBuf json = { .socket = sv[0], };
+	assert_true(marshal_ipc_response_json_stream(&ipc_response, &json));
+	assert_true(socket_buf_flush(&json));
+
+	char *json_actual = read_streamed(&json, sv[1]);
+	char *json_expected = marshal_ipc_response_json(&ipc_response);
+	assert_string_equal(json_actual, json_expected);
+
+	// TLV
+	struct SocketBuf tlv = { .socket = sv[0], };
+	assert_true(marshal_ipc_response_tlv_stream(&ipc_response, &tlv));
+	assert_true(socket_buf_flush(&tlv));
+
+	char *tlv_actual = read_streamed(&tlv, sv[1]);
+	size_t tlv_len = 0;
+	char *tlv_expected = marshal_ipc_response_tlv(&ipc_response, &tlv_len);
+	assert_int_equal(tlv.written, tlv_len);
+	assert_memory_equal(tlv_actual, tlv_expected, tlv_len);
+
+	close(sv[0]);
+	close(sv[1]);
+	free(yaml_actual);
+	free(yaml_expected);
+	free(json_actual);
+	free(json_expected);
+	free(tlv_actual);
+	free(tlv_expected);
+}
+
+void socket_buf_flush__memfd(void **state) {
+	int sv[2];
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	char data[SOCKET_BUF_SIZE * 2 + 100];
+	for (size_t i = 0; i < sizeof(data); i++) {
+		data[i] = (char)('a' + i % 26);
+	}
+
+	// under threshold, without any spill
+	struct SocketBuf small = { .socket = sv[0], .memfd_threshold = sizeof(data), };
+	socket_buf_write(&small, "abc", 3);
+	assert_true(socket_buf_flush(&small));
+
+	// at threshold, passed
+	struct SocketBuf passed = { .socket = sv[0], .memfd_threshold = sizeof(data), };
+	socket_buf_write(&passed, data, sizeof(data));
+	assert_int_equal(passed.written, 0);
+	assert_true(socket_buf_flush(&passed));
+	assert_int_equal(passed.written, sizeof(data));
+
+	// written bytes and the marker carrying the fd arrive together
+	size_t len = 0;
+	int fd = -1;
+	char *actual = ipc_receive_raw_client(sv[1], &len, &fd);
+	assert_non_null(actual);
+	assert_int_equal(len, 3);
+	assert_string_equal(actual, "abc");
+	assert_int_not_equal(fd, -1);
+
+	char *mapped = ipc_map_memfd(fd, &len);
+	assert_non_null(mapped);
+	assert_int_equal(len, sizeof(data));
+	assert_memory_equal(mapped, data, sizeof(data));
+	ipc_unmap_memfd(mapped, len);
+
+	// spilled but under threshold, copied back
+	struct SocketBuf copied = { .socket = sv[0], .memfd_threshold = sizeof(data) + 1, };
+	socket_buf_write(&copied, data, sizeof(data));
+	assert_true(socket_buf_flush(&copied));
+	assert_int_equal(copied.written, sizeof(data));
+
+	char *copied_actual = read_streamed(&copied, sv[1]);
+	assert_memory_equal(copied_actual, data, sizeof(data));
+
+	free(actual);
+	free(copied_actual);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+void ipc_receive_response_client__memfd(void **state) {
+	struct IpcResponse ipc_response = {
+		.done = true,
+		.rc = IPC_RC_WARN,
+		.state = true,
+	};
+
+	cfg = cfg_all();
+
+	int sv[2];
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	struct SocketBuf buf = { .socket = sv[0], .memfd_threshold = 1, };
+	assert_true(marshal_ipc_response_tlv_stream(&ipc_response, &buf));
+	assert_true(socket_buf_flush(&buf));
+
+	struct IpcResponse *actual = ipc_receive_response_client(sv[1]);
+
+	assert_non_null(actual);
+	assert_true(actual->done);
+	assert_int_equal(actual->rc, IPC_RC_WARN);
+
+	ipc_response_free(actual);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+void yaml_response_end__rc(void **state) {
+	size_t scanned = 0;
+
+	// nested RC and incomplete lines do not end it
+	const char *yaml = "DONE: TRUE\nMESSAGES:\n  RC: 1\nRC: 0";
+	assert_int_equal(yaml_response_end(yaml, strlen(yaml), &scanned), 0);
+	assert_int_equal(scanned, strlen("DONE: TRUE\nMESSAGES:\n  RC: 1\n"));
+
+	// the next response is not part of it
+	yaml = "DONE: TRUE\nMESSAGES:\n  RC: 1\nRC: 0\nDONE: TRUE\n";
+	assert_int_equal(yaml_response_end(yaml, strlen(yaml), &scanned), strlen("DONE: TRUE\nMESSAGES:\n  RC: 1\nRC: 0\n"));
+}
+
+void ipc_receive_response_client__yaml_streamed(void **state) {
+	int sv[2];
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	// many buffers of messages, followed by the final response
+	char line[] = "a message that is long enough to fill a few socket buffers";
+	for (int i = 0; i < 200; i++) {
+		lcl(INFO, line);
+	}
+
+	struct IpcResponse ongoing = { .done = false, .messages = true, };
+	struct SocketBuf buf = { .socket = sv[0], };
+	assert_true(marshal_ipc_response_stream(&ongoing, &buf));
+	assert_true(socket_buf_flush(&buf));
+	assert_true(buf.written > SOCKET_BUF_SIZE * 2);
+
+	struct IpcResponse done = { .done = true, .rc = IPC_RC_WARN, };
+	struct SocketBuf buf_done = { .socket = sv[0], };
+	assert_true(marshal_ipc_response_stream(&done, &buf_done));
+	assert_true(socket_buf_flush(&buf_done));
+
+	// messages are logged as received
+	const char *expected = line;
+	for (int i = 0; i < 200; i++) {
+		expect_log_(INFO, "%s", expected, NULL, NULL, NULL);
+	}
+
+	struct IpcResponse *actual = ipc_receive_response_client(sv[1]);
+	assert_non_null(actual);
+	assert_false(actual->done);
+	assert_int_equal(actual->rc, IPC_RC_SUCCESS);
+	ipc_response_free(actual);
+
+	actual = ipc_receive_response_client(sv[1]);
+	assert_non_null(actual);
+	assert_true(actual->done);
+	assert_int_equal(actual->rc, IPC_RC_WARN);
+	ipc_response_free(actual);
+
+	close(sv[0]);
+	close(sv[1]);
+}
+
+void ipc_receive_response_client__yaml_truncated(void **state) {
+	int sv[2];
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	const char *yaml = "DONE: TRUE\nMESSAGES:\n";
+	assert_int_equal(write(sv[0], yaml, strlen(yaml)), strlen(yaml));
+	close(sv[0]);
+
+	expect_log_error("\nYAML response truncated after %zu bytes", NULL, NULL, NULL, NULL);
+
+	// socket closed
+	assert_null(ipc_receive_response_client(sv[1]));
+}
+
 int main(void) {
 	const struct CMUnitTest tests[] = {
 		TEST(unmarshal_cfg_from_file__ok),
@@ -440,19 +1545,50 @@ int main(void) {
 		TEST(marshal_ipc_request__no_op),
 		TEST(marshal_ipc_request__get),
 		TEST(marshal_ipc_request__cfg_set),
+		TEST(marshal_ipc_request__encoding),
+		TEST(marshal_ipc_request__memfd_threshold),
+		TEST(marshal_ipc_request__settle),
+		TEST(marshal_ipc_request__batch),
 
 		TEST(marshal_ipc_response__ok),
+		TEST(marshal_ipc_response__cached),
+		TEST(marshal_ipc_response_json__ok),
+		TEST(marshal_ipc_response_json__escape),
 
 		TEST(unmarshal_ipc_request__empty),
 		TEST(unmarshal_ipc_request__bad_op),
 		TEST(unmarshal_ipc_request__no_op),
+		TEST(unmarshal_ipc_request__bad_encoding),
 		TEST(unmarshal_ipc_request__get),
 		TEST(unmarshal_ipc_request__cfg_set),
+		TEST(unmarshal_ipc_request__batch),
+		TEST(unmarshal_ipc_request__batch_no_ops),
+		TEST(unmarshal_ipc_request__batch_bad_op),
 
 		TEST(unmarshal_ipc_response__empty),
 		TEST(unmarshal_ipc_response__no_done),
 		TEST(unmarshal_ipc_response__no_rc),
 		TEST(unmarshal_ipc_response__ok),
+		TEST(marshal_ipc_response__dropped),
+		TEST(marshal_ipc_response__trace),
+		TEST(marshal_ipc_response__stats),
+		TEST(marshal_ipc_response__evaluation),
+
+		TEST(tlv__round_trip),
+
+		TEST(marshal_ipc_request_tlv__no_op),
+		TEST(marshal_ipc_request_tlv__cfg_set),
+		TEST(marshal_ipc_request_tlv__batch),
+		TEST(unmarshal_ipc_request_tlv__bad),
+		TEST(marshal_ipc_response_tlv__ok),
+
+		TEST(socket_buf_write__flush),
+		TEST(marshal_ipc_response_stream__ok),
+		TEST(socket_buf_flush__memfd),
+		TEST(ipc_receive_response_client__memfd),
+		TEST(yaml_response_end__rc),
+		TEST(ipc_receive_response_client__yaml_streamed),
+		TEST(ipc_receive_response_client__yaml_truncated),
 	};
 
 	return RUN(tests);
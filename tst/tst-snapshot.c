@@ -0,0 +1,284 @@
+#include "tst.h"
+#include "asserts.h"
+#include "expects.h"
+
+#include <cmocka.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wayland-util.h>
+
+#include "global.h"
+#include "head.h"
+#include "lid.h"
+#include "list.h"
+#include "mode.h"
+
+#include "snapshot.h"
+
+extern struct Snapshot *snapshot_shared;
+
+char runtime_dir[] = "/tmp/tst-snapshot.XXXXXX";
+
+struct Mode mode = {
+	.width = 1920,
+	.height = 1080,
+	.refresh_mhz = 60000,
+};
+
+struct Head head = {
+	.name = "DP-1",
+	.description = "Monitor Maker ABC",
+	.transform = WL_OUTPUT_TRANSFORM_90,
+	.current = {
+		.mode = &mode,
+		.enabled = true,
+		.x = 10,
+		.y = 20,
+		.adaptive_sync = ZWLR_OUTPUT_HEAD_V1_ADAPTIVE_SYNC_STATE_ENABLED,
+	},
+	.scaled = {
+		.width = 720,
+		.height = 1280,
+	},
+};
+
+struct Lid lid_closed = {
+	.closed = true,
+};
+
+
+int before_all(void **state) {
+	assert_non_null(mkdtemp(runtime_dir));
+	setenv("XDG_RUNTIME_DIR", runtime_dir, true);
+	setenv("XDG_VTNR", "1", true);
+	return 0;
+}
+
+int after_all(void **state) {
+	char path[4096];
+	snapshot_path(path, sizeof(path));
+	unlink(path);
+	rmdir(runtime_dir);
+	return 0;
+}
+
+int before_each(void **state) {
+	head.current.scale = wl_fixed_from_double(1.5);
+	slist_append(&heads, &head);
+	lid = &lid_closed;
+
+	snapshot_init();
+	assert_non_null(snapshot_shared);
+	return 0;
+}
+
+int after_each(void **state) {
+	snapshot_destroy();
+	slist_free(&heads);
+	lid = NULL;
+	return 0;
+}
+
+
+void snapshot_path__ok(void **state) {
+	char path[4096];
+	snapshot_path(path, sizeof(path));
+
+	char expected[4096];
+	snprintf(expected, sizeof(expected), "%s/way-displays.1.snapshot", runtime_dir);
+
+	assert_string_equal(path, expected);
+}
+
+void snapshot_read__ok(void **state) {
+	const struct Snapshot *shared = snapshot_open();
+	assert_non_null(shared);
+
+	struct Snapshot snapshot;
+	assert_true(snapshot_read(shared, &snapshot));
+
+	assert_int_equal(snapshot.magic, SNAPSHOT_MAGIC);
+	assert_int_equal(snapshot.version, SNAPSHOT_VERSION);
+	assert_int_equal(snapshot.size, sizeof(struct Snapshot));
+	assert_int_equal(snapshot.seq % 2, 0);
+	assert_int_equal(snapshot.pid, getpid());
+
+	assert_true(snapshot.lid_present);
+	assert_true(snapshot.lid_closed);
+
+	assert_int_equal(snapshot.heads_len, 1);
+	assert_int_equal(snapshot.heads_total, 1);
+	struct SnapshotHead *actual = &snapshot.heads[0];
+	assert_string_equal(actual->name, "DP-1");
+	assert_string_equal(actual->description, "Monitor Maker ABC");
+	assert_int_equal(actual->width, 1920);
+	assert_int_equal(actual->height, 1080);
+	assert_int_equal(actual->refresh_mhz, 60000);
+	assert_int_equal(actual->x, 10);
+	assert_int_equal(actual->y, 20);
+	assert_int_equal(actual->scaled_width, 720);
+	assert_int_equal(actual->scaled_height, 1280);
+	assert_int_equal(actual->transform, WL_OUTPUT_TRANSFORM_90);
+	assert_true(actual->scale == 1.5);
+	assert_true(actual->enabled);
+	assert_true(actual->adaptive_sync);
+
+	snapshot_close(shared);
+}
+
+void snapshot_publish__changed(void **state) {
+	const struct Snapshot *shared = snapshot_open();
+	assert_non_null(shared);
+
+	struct Snapshot before;
+	assert_true(snapshot_read(shared, &before));
+
+	// unchanged is not written
+	snapshot_publish();
+
+	struct Snapshot after;
+	assert_true(snapshot_read(shared, &after));
+	assert_int_equal(after.seq, before.seq);
+
+	// changed is visible through the existing mapping
+	head.current.scale = wl_fixed_from_double(2);
+	snapshot_publish();
+
+	assert_true(snapshot_read(shared, &after));
+	assert_int_equal(after.seq, before.seq + 2);
+	assert_true(after.heads[0].scale == 2);
+
+	// departed
+	slist_free(&heads);
+	lid = NULL;
+	snapshot_publish();
+
+	assert_true(snapshot_read(shared, &after));
+	assert_int_equal(after.seq, before.seq + 4);
+	assert_int_equal(after.heads_len, 0);
+	assert_false(after.lid_present);
+
+	snapshot_close(shared);
+}
+
+void snapshot_read__writing(void **state) {
+	const struct Snapshot *shared = snapshot_open();
+	assert_non_null(shared);
+
+	struct Snapshot snapshot;
+
+	// server exited mid write
+	snapshot_shared->seq++;
+	assert_false(snapshot_read(shared, &snapshot));
+
+	// next write recovers
+	head.current.x = 30;
+	snapshot_publish();
+	assert_true(snapshot_read(shared, &snapshot));
+	assert_int_equal(snapshot.heads[0].x, 30);
+	head.current.x = 10;
+
+	snapshot_close(shared);
+}
+
+void snapshot_destroy__exited(void **state) {
+	const struct Snapshot *shared = snapshot_open();
+	assert_non_null(shared);
+
+	snapshot_destroy();
+	assert_null(snapshot_shared);
+
+	struct Snapshot snapshot;
+	assert_true(snapshot_read(shared, &snapshot));
+	assert_int_equal(snapshot.pid, 0);
+
+	// heads retained
+	assert_int_equal(snapshot.heads_len, 1);
+
+	snapshot_close(shared);
+
+	snapshot_init();
+}
+
+void snapshot_read__truncated(void **state) {
+	const struct Snapshot *shared = snapshot_open();
+	assert_non_null(shared);
+
+	for (int i = 0; i < SNAPSHOT_HEADS_MAX; i++) {
+		slist_append(&heads, &head);
+	}
+	snapshot_publish();
+
+	struct Snapshot snapshot;
+	assert_true(snapshot_read(shared, &snapshot));
+	assert_int_equal(snapshot.heads_len, SNAPSHOT_HEADS_MAX);
+	assert_int_equal(snapshot.heads_total, SNAPSHOT_HEADS_MAX + 1);
+
+	snapshot_close(shared);
+}
+
+void snapshot_init__symlink(void **state) {
+	char path[4096];
+	snapshot_path(path, sizeof(path));
+
+	char target[4096];
+	snprintf(target, sizeof(target), "%s/target", runtime_dir);
+	FILE *f = fopen(target, "w");
+	assert_non_null(f);
+	fputs("precious", f);
+	fclose(f);
+
+	snapshot_destroy();
+	unlink(path);
+	assert_int_equal(symlink(target, path), 0);
+
+	// not followed
+	snapshot_init();
+	assert_null(snapshot_shared);
+	assert_null(snapshot_open());
+
+	struct stat st;
+	assert_int_equal(stat(target, &st), 0);
+	assert_int_equal(st.st_size, strlen("precious"));
+
+	unlink(path);
+	unlink(target);
+	snapshot_init();
+}
+
+void snapshot_init__not_private(void **state) {
+	char path[4096];
+	snapshot_path(path, sizeof(path));
+
+	snapshot_destroy();
+	assert_int_equal(chmod(path, 0644), 0);
+
+	const char *expected = path;
+	expect_log_warn("\nIgnoring snapshot %s, not a private file", expected, NULL, NULL, NULL);
+
+	snapshot_init();
+	assert_null(snapshot_shared);
+
+	unlink(path);
+	snapshot_init();
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		TEST(snapshot_path__ok),
+		TEST(snapshot_read__ok),
+		TEST(snapshot_publish__changed),
+		TEST(snapshot_read__writing),
+		TEST(snapshot_destroy__exited),
+		TEST(snapshot_read__truncated),
+		TEST(snapshot_init__symlink),
+		TEST(snapshot_init__not_private),
+	};
+
+	return RUN(tests);
+}
+
@@ -0,0 +1,213 @@
+#include "tst.h"
+#include "asserts.h"
+#include "expects.h"
+
+#include <cmocka.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "displ.h"
+#include "ipc.h"
+#include "stats.h"
+
+
+int before_all(void **state) {
+	return 0;
+}
+
+int after_all(void **state) {
+	return 0;
+}
+
+int before_each(void **state) {
+	return 0;
+}
+
+int after_each(void **state) {
+	// end any transition
+	stats_settled();
+	memset(&stats, 0, sizeof(struct Stats));
+	return 0;
+}
+
+void stats_histogram_add__buckets(void **state) {
+	struct StatsHistogram histogram = { 0 };
+
+	stats_histogram_add(&histogram, 0);
+	stats_histogram_add(&histogram, 1);
+	stats_histogram_add(&histogram, 2);
+	stats_histogram_add(&histogram, 3);
+	stats_histogram_add(&histogram, 4);
+	stats_histogram_add(&histogram, 5);
+	stats_histogram_add(&histogram, 1024);
+	stats_histogram_add(&histogram, 1025);
+	stats_histogram_add(&histogram, 1UL << 40);
+
+	assert_int_equal(histogram.buckets[0], 2);
+	assert_int_equal(histogram.buckets[1], 1);
+	assert_int_equal(histogram.buckets[2], 2);
+	assert_int_equal(histogram.buckets[3], 1);
+	assert_int_equal(histogram.buckets[10], 1);
+	assert_int_equal(histogram.buckets[11], 1);
+	assert_int_equal(histogram.buckets[STATS_BUCKETS - 1], 1);
+
+	assert_int_equal(histogram.count, 9);
+	assert_int_equal(histogram.sum, 0 + 1 + 2 + 3 + 4 + 5 + 1024 + 1025 + (1UL << 40));
+	assert_int_equal(histogram.max, 1UL << 40);
+}
+
+void stats__transition(void **state) {
+	// departed and arrived together
+	stats_hotplug();
+	stats_hotplug();
+	stats_desire();
+
+	stats_apply(true);
+	stats_result(SUCCEEDED);
+
+	// desired again after the first apply
+	stats_desire();
+
+	stats_apply(false);
+	stats_result(FAILED);
+
+	stats_apply(false);
+	stats_result(CANCELLED);
+
+	stats_settled();
+
+	assert_int_equal(stats.counters[STATS_HOTPLUGS], 2);
+	assert_int_equal(stats.counters[STATS_APPLIED], 3);
+	assert_int_equal(stats.counters[STATS_MODESETS], 1);
+	assert_int_equal(stats.counters[STATS_SUCCEEDED], 1);
+	assert_int_equal(stats.counters[STATS_FAILED], 1);
+	assert_int_equal(stats.counters[STATS_CANCELLED], 1);
+
+	assert_int_equal(stats.desire_us.count, 1);
+	assert_int_equal(stats.apply_us.count, 3);
+	assert_int_equal(stats.settle_us.count, 1);
+
+	assert_int_equal(stats.applies.count, 1);
+	assert_int_equal(stats.applies.sum, 3);
+}
+
+void stats__no_transition(void **state) {
+	// user changes outside of a hotplug
+	stats_desire();
+	stats_apply(false);
+	stats_result(SUCCEEDED);
+	stats_settled();
+
+	assert_int_equal(stats.counters[STATS_HOTPLUGS], 0);
+	assert_int_equal(stats.counters[STATS_APPLIED], 1);
+	assert_int_equal(stats.counters[STATS_SUCCEEDED], 1);
+
+	assert_int_equal(stats.desire_us.count, 0);
+	assert_int_equal(stats.apply_us.count, 1);
+	assert_int_equal(stats.settle_us.count, 0);
+	assert_int_equal(stats.applies.count, 0);
+}
+
+void stats_print__ok(void **state) {
+	stats.counters[STATS_HOTPLUGS] = 1;
+	stats.counters[STATS_APPLIED] = 2;
+	stats.gauges[STATS_HEADS] = 3;
+	stats.ipc_requests[GET] = 4;
+	stats_histogram_add(&stats.settle_us, 3);
+	stats_histogram_add(&stats.settle_us, 5);
+	stats_histogram_add(&stats.settle_us, 1UL << 30);
+
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *stream = open_memstream(&buf, &len);
+	stats_print(stream, &stats);
+	fclose(stream);
+
+	assert_string_equal(buf,
+			"loops            0\n"
+			"layouts          0\n"
+			"layouts_skipped  0\n"
+			"desires          0\n"
+			"hotplugs         1\n"
+			"applied          2\n"
+			"modesets         0\n"
+			"succeeded        0\n"
+			"failed           0\n"
+			"cancelled        0\n"
+			"modes_failed     0\n"
+			"regex_evals      0\n"
+			"bytes_marshalled 0\n"
+			"log_captured     0\n"
+			"rollbacks        0\n"
+			"heads            3\n"
+			"heads_enabled    0\n"
+			"trace_events     0\n"
+			"log_pending      0\n"
+			"ipc get          4\n"
+			"desire_us  count 0\n"
+			"apply_us   count 0\n"
+			"settle_us  count 3 mean 357913944 max 1073741824\n"
+			"  <= 4          1\n"
+			"  <= 8          1\n"
+			"  >  4194304    1\n"
+			"applies    count 0\n");
+
+	free(buf);
+}
+
+void stats_print_prometheus__ok(void **state) {
+	stats.counters[STATS_LOOPS] = 7;
+	stats.gauges[STATS_HEADS_ENABLED] = 2;
+	stats.ipc_requests[CFG_SET] = 5;
+	stats_histogram_add(&stats.settle_us, 3);
+	stats_histogram_add(&stats.settle_us, 1UL << 30);
+
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *stream = open_memstream(&buf, &len);
+	stats_print_prometheus(stream, &stats);
+	fclose(stream);
+
+	assert_non_null(strstr(buf,
+				"# TYPE way_displays_loops_total counter\n"
+				"way_displays_loops_total 7\n"
+				"# TYPE way_displays_layouts_total counter\n"));
+
+	assert_non_null(strstr(buf,
+				"# TYPE way_displays_heads_enabled gauge\n"
+				"way_displays_heads_enabled 2\n"));
+
+	assert_non_null(strstr(buf,
+				"# TYPE way_displays_ipc_requests_total counter\n"
+				"way_displays_ipc_requests_total{op=\"get\"} 0\n"
+				"way_displays_ipc_requests_total{op=\"set\"} 5\n"));
+
+	// cumulative
+	assert_non_null(strstr(buf,
+				"# TYPE way_displays_settle_microseconds histogram\n"
+				"way_displays_settle_microseconds_bucket{le=\"1\"} 0\n"
+				"way_displays_settle_microseconds_bucket{le=\"2\"} 0\n"
+				"way_displays_settle_microseconds_bucket{le=\"4\"} 1\n"
+				"way_displays_settle_microseconds_bucket{le=\"8\"} 1\n"));
+	assert_non_null(strstr(buf,
+				"way_displays_settle_microseconds_bucket{le=\"4194304\"} 1\n"
+				"way_displays_settle_microseconds_bucket{le=\"+Inf\"} 2\n"
+				"way_displays_settle_microseconds_sum 1073741827\n"
+				"way_displays_settle_microseconds_count 2\n"));
+
+	free(buf);
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		TEST(stats_histogram_add__buckets),
+		TEST(stats__transition),
+		TEST(stats__no_transition),
+		TEST(stats_print__ok),
+		TEST(stats_print_prometheus__ok),
+	};
+
+	return RUN(tests);
+}
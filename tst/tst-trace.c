@@ -0,0 +1,133 @@
+#include "tst.h"
+#include "asserts.h"
+#include "expects.h"
+
+#include <cmocka.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-util.h>
+
+#include "trace.h"
+
+
+int before_all(void **state) {
+	return 0;
+}
+
+int after_all(void **state) {
+	return 0;
+}
+
+int before_each(void **state) {
+	return 0;
+}
+
+int after_each(void **state) {
+	trace_clear();
+	return 0;
+}
+
+// DELTA, APPLY, SUCCEEDED, a second APPLY still outstanding
+void trace_events(void) {
+	struct TraceEvent *delta = trace_event(TRACE_DELTA, 7, "DP-1");
+	delta->ns = 1000001000;
+	delta->delta = TRACE_DELTA_ENABLED | TRACE_DELTA_MODE | TRACE_DELTA_POSITION;
+	delta->desired.enabled = true;
+	delta->desired.width = 1920;
+	delta->desired.height = 1080;
+	delta->desired.refresh_mhz = 59951;
+	delta->desired.x = 10;
+	delta->desired.y = -20;
+
+	struct TraceEvent *apply = trace_event(TRACE_APPLY, 7, NULL);
+	apply->ns = 1000002000;
+	apply->heads = 1;
+
+	trace_event(TRACE_SUCCEEDED, 7, NULL)->ns = 1000502000;
+
+	apply = trace_event(TRACE_APPLY, 8, NULL);
+	apply->ns = 2000000000;
+	apply->heads = 2;
+}
+
+// printer output to a string
+char *printed(void (*print)(FILE*, const struct TraceEvent*, size_t)) {
+	static char buf[4096];
+
+	struct TraceEvent events[TRACE_EVENTS_MAX];
+	for (size_t i = 0; i < trace.len; i++) {
+		events[i] = *trace_event_n(i);
+	}
+
+	FILE *stream = fmemopen(buf, sizeof(buf), "w");
+	print(stream, events, trace.len);
+	fclose(stream);
+
+	return buf;
+}
+
+
+void trace_event__full(void **state) {
+	for (int i = 0; i < TRACE_EVENTS_MAX + 2; i++) {
+		trace_event(TRACE_DONE, i, NULL);
+	}
+
+	// oldest overwritten
+	assert_int_equal(trace.len, TRACE_EVENTS_MAX);
+	assert_int_equal(trace.dropped, 2);
+
+	assert_int_equal(trace_event_n(0)->serial, 2);
+	assert_int_equal(trace_event_n(TRACE_EVENTS_MAX - 1)->serial, TRACE_EVENTS_MAX + 1);
+	assert_null(trace_event_n(TRACE_EVENTS_MAX));
+}
+
+void trace_event__head(void **state) {
+	struct TraceEvent *event = trace_event(TRACE_HEAD_ARRIVED, 3, "a-name-much-longer-than-the-limit");
+
+	assert_true(event->ns > 0);
+	assert_int_equal(event->type, TRACE_HEAD_ARRIVED);
+	assert_int_equal(event->serial, 3);
+
+	// truncated
+	assert_string_equal(event->head, "a-name-much-lon");
+}
+
+void trace_print_text__ok(void **state) {
+	trace_events();
+
+	assert_string_equal(printed(trace_print_text),
+			"1.000001 DELTA         serial 7 DP-1 enabled mode 1920x1080@59.951Hz position 10,-20\n"
+			"1.000002 APPLY         serial 7 heads 1\n"
+			"1.000502 SUCCEEDED     serial 7\n"
+			"2.000000 APPLY         serial 8 heads 2\n");
+}
+
+void trace_print_chrome__ok(void **state) {
+	trace_events();
+
+	assert_string_equal(printed(trace_print_chrome),
+			"{\"traceEvents\":["
+			"{\"name\":\"DELTA\",\"cat\":\"way-displays\",\"ph\":\"i\",\"s\":\"g\",\"ts\":1000001,\"pid\":1,\"tid\":1,"
+			"\"args\":{\"serial\":7,\"head\":\"DP-1\",\"enabled\":true,\"width\":1920,\"height\":1080,\"refresh_mhz\":59951,\"x\":10,\"y\":-20}},"
+			"{\"name\":\"APPLY\",\"cat\":\"way-displays\",\"ph\":\"X\",\"dur\":500,\"ts\":1000002,\"pid\":1,\"tid\":1,"
+			"\"args\":{\"serial\":7,\"heads\":1,\"outcome\":\"SUCCEEDED\"}},"
+			"{\"name\":\"SUCCEEDED\",\"cat\":\"way-displays\",\"ph\":\"i\",\"s\":\"g\",\"ts\":1000502,\"pid\":1,\"tid\":1,"
+			"\"args\":{\"serial\":7}},"
+			"{\"name\":\"APPLY\",\"cat\":\"way-displays\",\"ph\":\"i\",\"s\":\"g\",\"ts\":2000000,\"pid\":1,\"tid\":1,"
+			"\"args\":{\"serial\":8,\"heads\":2}}"
+			"],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		TEST(trace_event__full),
+		TEST(trace_event__head),
+		TEST(trace_print_text__ok),
+		TEST(trace_print_chrome__ok),
+	};
+
+	return RUN(tests);
+}
+